@@ -0,0 +1,190 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "console.h"
+#include "bench.h"
+
+/*
+ * Latency and throughput of the multiplier, divider and FPU. Each loop
+ * iteration issues 8 operations; the _lat variants form one dependency
+ * chain, the _tput variants interleave 4 independent chains.
+ */
+#define ITERS		(256 * BENCH_SCALE)
+
+#define OP8(op)		op op op op op op op op
+#define OP2x4(a, b, c, d)	a b c d a b c d
+
+static void report(const char *name, const struct bench_counts *c)
+{
+	bench_report(name, NULL, 0, ITERS * 8, c);
+}
+
+static unsigned long mul_lat(void)
+{
+	struct bench_counts c;
+	unsigned long x = 0x123456789abcdefl;
+
+	bench_start(&c, &bench_ev_fp);
+	asm("mtctr	%1\n"
+	    "1:\n"
+	    OP8("	mulld	%0,%0,%0\n")
+	    "	bdnz	1b"
+	    : "+r" (x) : "r" (ITERS) : "ctr");
+	bench_stop(&c);
+	report("mul_lat", &c);
+	return x;
+}
+
+static unsigned long mul_tput(void)
+{
+	struct bench_counts c;
+	unsigned long a = 3, b = 5, d = 7, e = 11;
+
+	bench_start(&c, &bench_ev_fp);
+	asm("mtctr	%4\n"
+	    "1:\n"
+	    OP2x4("	mulld	%0,%0,%0\n", "	mulld	%1,%1,%1\n",
+		  "	mulld	%2,%2,%2\n", "	mulld	%3,%3,%3\n")
+	    "	bdnz	1b"
+	    : "+r" (a), "+r" (b), "+r" (d), "+r" (e) : "r" (ITERS) : "ctr");
+	bench_stop(&c);
+	report("mul_tput", &c);
+	return a + b + d + e;
+}
+
+/*
+ * Each step of the divide chain ORs the quotient back into the starting
+ * dividend to keep it from collapsing to zero, so div_lat is one ALU op
+ * longer than the divide. The 32-bit and small-dividend versions show
+ * any early-out behaviour.
+ */
+static unsigned long div_lat(const char *name, unsigned long x, unsigned long d,
+			     bool word)
+{
+	struct bench_counts c;
+	unsigned long t, base = x;
+
+	bench_start(&c, &bench_ev_fp);
+	if (word)
+		asm("mtctr	%3\n"
+		    "1:\n"
+		    OP8("	divwu	%1,%0,%2\n	or	%0,%1,%4\n")
+		    "	bdnz	1b"
+		    : "+r" (x), "=&r" (t) : "r" (d), "r" (ITERS), "r" (base)
+		    : "ctr");
+	else
+		asm("mtctr	%3\n"
+		    "1:\n"
+		    OP8("	divdu	%1,%0,%2\n	or	%0,%1,%4\n")
+		    "	bdnz	1b"
+		    : "+r" (x), "=&r" (t) : "r" (d), "r" (ITERS), "r" (base)
+		    : "ctr");
+	bench_stop(&c);
+	report(name, &c);
+	return x;
+}
+
+static unsigned long div_tput(void)
+{
+	struct bench_counts c;
+	unsigned long a, b, d, e;
+	unsigned long x = 0x7edcba9876543210ul, y = 12345;
+
+	bench_start(&c, &bench_ev_fp);
+	asm("mtctr	%6\n"
+	    "1:\n"
+	    OP2x4("	divdu	%0,%4,%5\n", "	divdu	%1,%4,%5\n",
+		  "	divdu	%2,%4,%5\n", "	divdu	%3,%4,%5\n")
+	    "	bdnz	1b"
+	    : "=&r" (a), "=&r" (b), "=&r" (d), "=&r" (e)
+	    : "r" (x), "r" (y), "r" (ITERS) : "ctr");
+	bench_stop(&c);
+	report("div_tput", &c);
+	return a + b + d + e;
+}
+
+/*
+ * The tests are built soft-float, so the compiler never allocates FP
+ * registers and the asm can use them freely.
+ */
+static const double fp_init[4] = { 1.0, 0.9999999, 1e-9, 1.5 };
+
+static void fmadd_lat(void)
+{
+	struct bench_counts c;
+
+	bench_start(&c, &bench_ev_fp);
+	asm("lfd	0,0(%0)\n"
+	    "	lfd	1,8(%0)\n"
+	    "	lfd	2,16(%0)\n"
+	    "	mtctr	%1\n"
+	    "1:\n"
+	    OP8("	fmadd	0,0,1,2\n")
+	    "	bdnz	1b"
+	    : : "b" (fp_init), "r" (ITERS) : "ctr", "memory");
+	bench_stop(&c);
+	report("fmadd_lat", &c);
+}
+
+static void fmadd_tput(void)
+{
+	struct bench_counts c;
+
+	bench_start(&c, &bench_ev_fp);
+	asm("lfd	0,0(%0)\n"
+	    "	lfd	1,8(%0)\n"
+	    "	lfd	2,16(%0)\n"
+	    "	fmr	3,0\n"
+	    "	fmr	4,0\n"
+	    "	fmr	5,0\n"
+	    "	mtctr	%1\n"
+	    "1:\n"
+	    OP2x4("	fmadd	0,0,1,2\n", "	fmadd	3,3,1,2\n",
+		  "	fmadd	4,4,1,2\n", "	fmadd	5,5,1,2\n")
+	    "	bdnz	1b"
+	    : : "b" (fp_init), "r" (ITERS) : "ctr", "memory");
+	bench_stop(&c);
+	report("fmadd_tput", &c);
+}
+
+static void fdiv_lat(void)
+{
+	struct bench_counts c;
+
+	bench_start(&c, &bench_ev_fp);
+	asm("lfd	0,24(%0)\n"
+	    "	lfd	1,8(%0)\n"
+	    "	mtctr	%1\n"
+	    "1:\n"
+	    OP8("	fdiv	0,0,1\n")
+	    "	bdnz	1b"
+	    : : "b" (fp_init), "r" (ITERS) : "ctr", "memory");
+	bench_stop(&c);
+	report("fdiv_lat", &c);
+}
+
+int main(void)
+{
+	unsigned long msr, sum = 0;
+
+	bench_init();
+
+	sum += mul_lat();
+	sum += mul_tput();
+	sum += div_lat("div_lat", 0x7edcba9876543210ul, 0x123456789ul, false);
+	sum += div_lat("div_lat_small", 1000, 7, false);
+	sum += div_lat("divw_lat", 0x76543210ul, 12345, true);
+	sum += div_tput();
+
+	asm("mfmsr %0" : "=r" (msr));
+	msr |= MSR_FP;
+	asm("mtmsrd %0" : : "r" (msr));
+	fmadd_lat();
+	fmadd_tput();
+	fdiv_lat();
+
+	if (sum == 0)
+		puts("?\n");
+	bench_done();
+	return 0;
+}
@@ -0,0 +1,73 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "console.h"
+#include "bench.h"
+
+/*
+ * Branch prediction: one conditional branch per element of a pattern
+ * array, driven from inline asm so that the compiler can't turn it
+ * into a select. The patterns go from trivially predictable to random.
+ */
+#define N		1024
+#define ROUNDS		(4 * BENCH_SCALE)
+
+static unsigned char pattern[N];
+
+static unsigned long rand_state = 1;
+
+static unsigned long rand(void)
+{
+	rand_state = rand_state * 6364136223846793005ul + 1442695040888963407ul;
+	return rand_state >> 33;
+}
+
+static unsigned long run(const unsigned char *p, unsigned long n)
+{
+	unsigned long taken = 0;
+	unsigned long i, v;
+
+	for (i = 0; i < n; ++i) {
+		asm("lbzx	%1,%2,%3\n"
+		    "	cmpdi	%1,0\n"
+		    "	beq	1f\n"
+		    "	addi	%0,%0,1\n"
+		    "1:"
+		    : "+r" (taken), "=&r" (v) : "b" (p), "r" (i) : "cr0");
+	}
+	return taken;
+}
+
+static void measure(const char *name, unsigned long period)
+{
+	struct bench_counts c;
+	unsigned long i, taken = 0;
+
+	for (i = 0; i < N; ++i) {
+		if (period == 0)
+			pattern[i] = rand() & 1;
+		else
+			pattern[i] = (i % period) < (period + 1) / 2;
+	}
+	run(pattern, N);
+	bench_start(&c, &bench_ev_branch);
+	for (i = 0; i < ROUNDS; ++i)
+		taken += run(pattern, N);
+	bench_stop(&c);
+	bench_report(name, "period", period, ROUNDS * N, &c);
+	if (taken == ~0ul)
+		puts("?\n");
+}
+
+int main(void)
+{
+	bench_init();
+	measure("branch_constant", 1);
+	measure("branch_alternate", 2);
+	measure("branch_pattern", 3);
+	measure("branch_pattern", 8);
+	measure("branch_pattern", 32);
+	measure("branch_random", 0);
+	bench_done();
+	return 0;
+}
@@ -0,0 +1,381 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "console.h"
+#include "bench.h"
+
+/*
+ * A CoreMark-style workload: the same three kernels (linked list
+ * find/sort, integer matrix ops and a state machine), each folded into
+ * a CRC-16 so results can be checked across runs. It is not CoreMark
+ * and its numbers are not comparable with published CoreMark scores.
+ */
+#define ITERS		(8 * BENCH_SCALE)
+
+#define LIST_LEN	32
+#define MAT_N		12
+#define STATE_LEN	256
+
+static uint16_t crc16(uint16_t crc, uint16_t val)
+{
+	int i;
+
+	for (i = 0; i < 16; ++i) {
+		if ((crc ^ val) & 1)
+			crc = (crc >> 1) ^ 0xa001;
+		else
+			crc >>= 1;
+		val >>= 1;
+	}
+	return crc;
+}
+
+static unsigned long rand_state = 1;
+
+static uint16_t rand16(void)
+{
+	rand_state = rand_state * 6364136223846793005ul + 1442695040888963407ul;
+	return rand_state >> 48;
+}
+
+/* Linked list */
+
+struct item {
+	struct item *next;
+	int16_t data;
+	int16_t idx;
+};
+
+static struct item items[LIST_LEN];
+
+static struct item *list_init(void)
+{
+	int i;
+
+	for (i = 0; i < LIST_LEN; ++i) {
+		items[i].next = i + 1 < LIST_LEN ? &items[i + 1] : NULL;
+		items[i].data = rand16() & 0x7fff;
+		items[i].idx = i;
+	}
+	return &items[0];
+}
+
+static struct item *list_find(struct item *l, int16_t idx)
+{
+	for (; l; l = l->next)
+		if (l->idx == idx)
+			return l;
+	return NULL;
+}
+
+static struct item *list_reverse(struct item *l)
+{
+	struct item *next, *prev = NULL;
+
+	for (; l; l = next) {
+		next = l->next;
+		l->next = prev;
+		prev = l;
+	}
+	return prev;
+}
+
+static int cmp_data(const struct item *a, const struct item *b)
+{
+	return a->data - b->data;
+}
+
+static int cmp_idx(const struct item *a, const struct item *b)
+{
+	return a->idx - b->idx;
+}
+
+/* Bottom-up merge sort, as in CoreMark's core_list_mergesort */
+static struct item *list_sort(struct item *l,
+			      int (*cmp)(const struct item *, const struct item *))
+{
+	struct item *p, *q, *e, *tail;
+	int insize = 1, nmerges, psize, qsize, i;
+
+	for (;;) {
+		p = l;
+		l = tail = NULL;
+		nmerges = 0;
+		while (p) {
+			++nmerges;
+			q = p;
+			for (psize = 0, i = 0; i < insize && q; ++i, ++psize)
+				q = q->next;
+			qsize = insize;
+			while (psize > 0 || (qsize > 0 && q)) {
+				if (psize == 0) {
+					e = q; q = q->next; --qsize;
+				} else if (qsize == 0 || !q || cmp(p, q) <= 0) {
+					e = p; p = p->next; --psize;
+				} else {
+					e = q; q = q->next; --qsize;
+				}
+				if (tail)
+					tail->next = e;
+				else
+					l = e;
+				tail = e;
+			}
+			p = q;
+		}
+		tail->next = NULL;
+		if (nmerges <= 1)
+			return l;
+		insize *= 2;
+	}
+}
+
+static uint16_t bench_list(struct item **lp, int iter)
+{
+	struct item *l = *lp, *f;
+	uint16_t crc = 0;
+	int i;
+
+	for (i = 0; i < 8; ++i) {
+		f = list_find(l, (iter + i * 5) % (LIST_LEN + 4));
+		crc = crc16(crc, f ? f->data : 0xffff);
+		l = list_reverse(l);
+	}
+	l = list_sort(l, cmp_data);
+	for (f = l; f; f = f->next)
+		crc = crc16(crc, f->data);
+	/* perturb the data so that each iteration sorts differently */
+	l->data ^= iter;
+	l = list_sort(l, cmp_idx);
+	*lp = l;
+	return crc;
+}
+
+/* Matrix */
+
+static int16_t mat_a[MAT_N][MAT_N], mat_b[MAT_N][MAT_N];
+static int32_t mat_c[MAT_N][MAT_N];
+
+static void matrix_init(void)
+{
+	int i, j;
+
+	for (i = 0; i < MAT_N; ++i)
+		for (j = 0; j < MAT_N; ++j) {
+			mat_a[i][j] = rand16() & 0xfff;
+			mat_b[i][j] = rand16() & 0xfff;
+		}
+}
+
+static uint16_t matrix_sum(int32_t clip)
+{
+	int32_t tmp, prev = 0, cur, ret = 0;
+	int i, j;
+
+	for (i = 0, tmp = 0; i < MAT_N; ++i)
+		for (j = 0; j < MAT_N; ++j) {
+			cur = mat_c[i][j];
+			tmp += cur;
+			if (tmp > clip) {
+				ret += 10;
+				tmp = 0;
+			} else {
+				ret += cur > prev ? 1 : 0;
+			}
+			prev = cur;
+		}
+	return ret;
+}
+
+static uint16_t bench_matrix(int iter)
+{
+	int16_t val = iter | 0xf00;
+	uint16_t crc = 0;
+	int i, j, k;
+	int32_t sum;
+
+	/* matrix times constant */
+	for (i = 0; i < MAT_N; ++i)
+		for (j = 0; j < MAT_N; ++j)
+			mat_c[i][j] = (int32_t)mat_a[i][j] * val;
+	crc = crc16(crc, matrix_sum(iter * 8 + 0x100000));
+
+	/* matrix times vector */
+	for (i = 0; i < MAT_N; ++i) {
+		for (sum = 0, j = 0; j < MAT_N; ++j)
+			sum += (int32_t)mat_a[i][j] * mat_b[j][0];
+		mat_c[i][0] = sum;
+	}
+	crc = crc16(crc, matrix_sum(iter * 8 + 0x100000));
+
+	/* matrix times matrix, then only some of the bits of the result */
+	for (i = 0; i < MAT_N; ++i)
+		for (j = 0; j < MAT_N; ++j) {
+			for (sum = 0, k = 0; k < MAT_N; ++k)
+				sum += (int32_t)mat_a[i][k] * mat_b[k][j];
+			mat_c[i][j] = (sum >> 2) & 0xff;
+		}
+	crc = crc16(crc, matrix_sum(iter * 8 + 0x1000));
+
+	/* matrix plus constant, undone afterwards */
+	for (i = 0; i < MAT_N; ++i)
+		for (j = 0; j < MAT_N; ++j)
+			mat_a[i][j] += val;
+	for (i = 0; i < MAT_N; ++i)
+		for (j = 0; j < MAT_N; ++j)
+			mat_a[i][j] -= val;
+	return crc;
+}
+
+/* State machine */
+
+enum state { S_START, S_INVALID, S_S1, S_S2, S_INT, S_FLOAT, S_EXP, S_SCI, NSTATES };
+
+static const char *const state_words[] = {
+	"5012", "1234", "-874", "+122", "35.54400", ".1234500", "-110.700", "+0.64400",
+	"5.500e+3", "-.123e-2", "-87e+832", "+0.6e-12", "T0.3e-1F", "-T.T++Tq", "1T3.4e4z", "34.0e-T^",
+};
+
+static char state_input[STATE_LEN];
+
+static void state_init(void)
+{
+	int n = 0;
+	const char *w;
+
+	while (n + 10 < STATE_LEN) {
+		for (w = state_words[rand16() & 15]; *w; ++w)
+			state_input[n++] = *w;
+		state_input[n++] = ',';
+	}
+	state_input[n] = 0;
+}
+
+static enum state next_state(const char **pp, unsigned int *count)
+{
+	const char *p = *pp;
+	enum state s = S_START;
+	char c;
+
+	for (; (c = *p) != 0 && c != ','; ++p) {
+		++count[s];
+		switch (s) {
+		case S_START:
+			if (c >= '0' && c <= '9')
+				s = S_INT;
+			else if (c == '+' || c == '-')
+				s = S_S1;
+			else if (c == '.')
+				s = S_FLOAT;
+			else
+				s = S_INVALID;
+			break;
+		case S_S1:
+			if (c >= '0' && c <= '9')
+				s = S_INT;
+			else if (c == '.')
+				s = S_FLOAT;
+			else
+				s = S_INVALID;
+			break;
+		case S_INT:
+			if (c == '.')
+				s = S_FLOAT;
+			else if (!(c >= '0' && c <= '9'))
+				s = S_INVALID;
+			break;
+		case S_FLOAT:
+			if (c == 'e' || c == 'E')
+				s = S_S2;
+			else if (!(c >= '0' && c <= '9'))
+				s = S_INVALID;
+			break;
+		case S_S2:
+			if (c == '+' || c == '-')
+				s = S_EXP;
+			else
+				s = S_INVALID;
+			break;
+		case S_EXP:
+			if (c >= '0' && c <= '9')
+				s = S_SCI;
+			else
+				s = S_INVALID;
+			break;
+		case S_SCI:
+			if (!(c >= '0' && c <= '9'))
+				s = S_INVALID;
+			break;
+		default:
+			break;
+		}
+	}
+	*pp = *p ? p + 1 : p;
+	return s;
+}
+
+static uint16_t bench_state(int iter)
+{
+	unsigned int final[NSTATES], count[NSTATES];
+	const char *p;
+	uint16_t crc = 0;
+	int i;
+
+	for (i = 0; i < NSTATES; ++i)
+		final[i] = count[i] = 0;
+	for (p = state_input; *p; )
+		++final[next_state(&p, count)];
+
+	/* corrupt the input at a stride, then put it back */
+	for (i = iter & 7; i < STATE_LEN - 1; i += 13)
+		if (state_input[i] != ',')
+			state_input[i] ^= 0x40;
+	for (p = state_input; *p; )
+		++final[next_state(&p, count)];
+	for (i = iter & 7; i < STATE_LEN - 1; i += 13)
+		if (state_input[i] != ',')
+			state_input[i] ^= 0x40;
+
+	for (i = 0; i < NSTATES; ++i) {
+		crc = crc16(crc, final[i]);
+		crc = crc16(crc, count[i]);
+	}
+	return crc;
+}
+
+int main(void)
+{
+	struct bench_counts c;
+	struct item *list;
+	uint16_t crc;
+	int i;
+
+	bench_init();
+	list = list_init();
+	matrix_init();
+	state_init();
+
+	crc = 0;
+	bench_start(&c, &bench_ev_branch);
+	for (i = 0; i < ITERS; ++i)
+		crc = crc16(crc, bench_list(&list, i));
+	bench_stop(&c);
+	bench_report("coremark_list", "crc", crc, ITERS, &c);
+
+	crc = 0;
+	bench_start(&c, &bench_ev_branch);
+	for (i = 0; i < ITERS; ++i)
+		crc = crc16(crc, bench_matrix(i));
+	bench_stop(&c);
+	bench_report("coremark_matrix", "crc", crc, ITERS, &c);
+
+	crc = 0;
+	bench_start(&c, &bench_ev_branch);
+	for (i = 0; i < ITERS; ++i)
+		crc = crc16(crc, bench_state(i));
+	bench_stop(&c);
+	bench_report("coremark_state", "crc", crc, ITERS, &c);
+
+	bench_done();
+	return 0;
+}
@@ -0,0 +1,88 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "console.h"
+#include "bench.h"
+
+/*
+ * Load-to-use latency ladder: chase a pointer through a random cyclic
+ * permutation of cache lines, for working sets doubling from 1kB until
+ * memory runs out. Cycles per load shows each level of the hierarchy.
+ */
+#define LINE		64
+#define LOADS		(8192 * BENCH_SCALE)
+#define MAX_SIZE	(1024 * 1024)
+
+static unsigned long rand_state = 1;
+
+static unsigned long rand(void)
+{
+	rand_state = rand_state * 6364136223846793005ul + 1442695040888963407ul;
+	return rand_state >> 33;
+}
+
+static void *make_chain(char *buf, unsigned long size, unsigned long *order)
+{
+	unsigned long n = size / LINE;
+	unsigned long i, j, t;
+
+	for (i = 0; i < n; ++i)
+		order[i] = i;
+	for (i = n - 1; i > 0; --i) {
+		j = rand() % (i + 1);
+		t = order[i];
+		order[i] = order[j];
+		order[j] = t;
+	}
+	for (i = 0; i < n; ++i)
+		*(void **)(buf + order[i] * LINE) = buf + order[(i + 1) % n] * LINE;
+	return buf + order[0] * LINE;
+}
+
+static void *chase(void *p, unsigned long n)
+{
+	for (n /= 8; n; --n) {
+		p = *(void **)p;
+		p = *(void **)p;
+		p = *(void **)p;
+		p = *(void **)p;
+		p = *(void **)p;
+		p = *(void **)p;
+		p = *(void **)p;
+		p = *(void **)p;
+	}
+	return p;
+}
+
+int main(void)
+{
+	struct bench_counts c;
+	unsigned long size, avail;
+	unsigned long *order;
+	char *buf;
+	void *p;
+
+	bench_init();
+	buf = bench_mem(&avail);
+
+	for (size = 1024; size <= MAX_SIZE; size *= 2) {
+		/* the shuffle order lives just above the chain */
+		if (size + size / LINE * sizeof(unsigned long) > avail)
+			break;
+		order = (unsigned long *)(buf + size);
+		p = make_chain(buf, size, order);
+
+		/* one pass to warm the caches and TLB */
+		p = chase(p, size / LINE);
+		bench_start(&c, &bench_ev_mem);
+		p = chase(p, LOADS);
+		bench_stop(&c);
+		bench_report("latency", "size", size, LOADS, &c);
+	}
+
+	/* keep the chase live */
+	if (p == NULL)
+		puts("?\n");
+	bench_done();
+	return 0;
+}
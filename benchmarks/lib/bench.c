@@ -0,0 +1,212 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "console.h"
+#include "microwatt_soc.h"
+#include "io.h"
+#include "bench.h"
+
+const struct bench_events bench_ev_mem = {
+	0xfcfcf0f0, { "loads", "icache_misses", "dcache_store_misses", "dcache_load_misses" }
+};
+
+const struct bench_events bench_ev_branch = {
+	0xfcfaf2f6, { "loads", "branches_taken", "dispatches", "mispredicts" }
+};
+
+const struct bench_events bench_ev_fp = {
+	0xf4f0f2f0, { "fp_ops", "stores", "dispatches", "dcache_load_misses" }
+};
+
+const struct bench_events bench_ev_tlb = {
+	0xf6f6fef0, { "itlb_misses", "dtlb_misses_resolved", "dtlb_misses", "dcache_load_misses" }
+};
+
+extern char __stack_top[];
+
+void print_dec(unsigned long val)
+{
+	char buf[24];
+	int i = sizeof(buf);
+
+	buf[--i] = 0;
+	do {
+		buf[--i] = '0' + val % 10;
+		val /= 10;
+	} while (val);
+	puts(&buf[i]);
+}
+
+void print_hex(unsigned long val)
+{
+	int i, x;
+
+	puts("0x");
+	for (i = 60; i >= 0; i -= 4) {
+		x = (val >> i) & 0xf;
+		putchar(x < 10 ? '0' + x : 'a' + x - 10);
+	}
+}
+
+/*
+ * Keep gcc from turning these loops back into calls to themselves.
+ */
+__attribute__((optimize("no-tree-loop-distribute-patterns")))
+void *memset(void *s, int c, size_t n)
+{
+	unsigned char *p = s;
+	unsigned long v, *q;
+
+	v = (unsigned char)c;
+	v |= v << 8;
+	v |= v << 16;
+	v |= v << 32;
+	for (; n && ((unsigned long)p & 7); --n)
+		*p++ = c;
+	for (q = (unsigned long *)p; n >= 32; n -= 32, q += 4) {
+		q[0] = v;
+		q[1] = v;
+		q[2] = v;
+		q[3] = v;
+	}
+	for (; n >= 8; n -= 8)
+		*q++ = v;
+	for (p = (unsigned char *)q; n; --n)
+		*p++ = c;
+	return s;
+}
+
+__attribute__((optimize("no-tree-loop-distribute-patterns")))
+void *memcpy(void *dest, const void *src, size_t n)
+{
+	unsigned char *d = dest;
+	const unsigned char *s = src;
+	unsigned long *dq;
+	const unsigned long *sq;
+
+	if (((unsigned long)d ^ (unsigned long)s) & 7) {
+		while (n--)
+			*d++ = *s++;
+		return dest;
+	}
+	for (; n && ((unsigned long)d & 7); --n)
+		*d++ = *s++;
+	dq = (unsigned long *)d;
+	sq = (const unsigned long *)s;
+	for (; n >= 32; n -= 32, dq += 4, sq += 4) {
+		dq[0] = sq[0];
+		dq[1] = sq[1];
+		dq[2] = sq[2];
+		dq[3] = sq[3];
+	}
+	for (; n >= 8; n -= 8)
+		*dq++ = *sq++;
+	d = (unsigned char *)dq;
+	s = (const unsigned char *)sq;
+	while (n--)
+		*d++ = *s++;
+	return dest;
+}
+
+static unsigned long memory_size(void)
+{
+	if (readq(SYSCON_BASE + SYS_REG_CTRL) & SYS_REG_CTRL_DRAM_AT_0)
+		return readq(SYSCON_BASE + SYS_REG_DRAMINFO) & SYS_REG_DRAMINFO_SIZE_MASK;
+	return readq(SYSCON_BASE + SYS_REG_BRAMINFO) & SYS_REG_BRAMINFO_SIZE_MASK;
+}
+
+/*
+ * Everything in main memory above the stack is free for the kernels
+ * to use as their working set.
+ */
+void *bench_mem(unsigned long *size)
+{
+	unsigned long start = ((unsigned long)__stack_top + 0xfff) & ~0xfffUL;
+	unsigned long end = memory_size();
+
+	*size = end > start ? end - start : 0;
+	return (void *)start;
+}
+
+void bench_init(void)
+{
+	unsigned long size;
+
+	console_init();
+	mtspr(MMCR0, MMCR0_FC);
+	mtspr(MMCR1, 0);
+	mtspr(MMCR2, 0);
+	mtspr(MMCRA, 0);
+
+	bench_mem(&size);
+	puts("BENCH-INFO clk_hz=");
+	print_dec(readq(SYSCON_BASE + SYS_REG_CLKINFO) & SYS_REG_CLKINFO_FREQ_MASK);
+	puts(" free_mem=");
+	print_dec(size);
+	puts("\n");
+}
+
+void bench_start(struct bench_counts *c, const struct bench_events *ev)
+{
+	c->ev = ev;
+	mtspr(MMCR0, MMCR0_FC);
+	mtspr(MMCR1, ev->mmcr1);
+	mtspr(PMC1, 0);
+	mtspr(PMC2, 0);
+	mtspr(PMC3, 0);
+	mtspr(PMC4, 0);
+	mtspr(PMC5, 0);
+	mtspr(PMC6, 0);
+	c->tb = mftb();
+	mtspr(MMCR0, MMCR0_CC56RUN);
+}
+
+void bench_stop(struct bench_counts *c)
+{
+	mtspr(MMCR0, MMCR0_FC | MMCR0_CC56RUN);
+	c->tb = mftb() - c->tb;
+	c->pmc[0] = mfspr(PMC1);
+	c->pmc[1] = mfspr(PMC2);
+	c->pmc[2] = mfspr(PMC3);
+	c->pmc[3] = mfspr(PMC4);
+	c->pmc[4] = mfspr(PMC5);
+	c->pmc[5] = mfspr(PMC6);
+}
+
+static void print_field(const char *key, unsigned long val)
+{
+	putchar(' ');
+	puts(key);
+	putchar('=');
+	print_dec(val);
+}
+
+/*
+ * One line per measurement, made of space-separated key=value fields:
+ *   BENCH name=<kernel> [<param>=<value>] ops=<n> tb=<n> cycles=<n>
+ *         insns=<n> <event>=<n> ...
+ * "ops" is the amount of work done in the kernel's own units (bytes
+ * copied, loads, iterations), so that rates can be derived offline.
+ */
+void bench_report(const char *name, const char *param, unsigned long value,
+		  unsigned long ops, const struct bench_counts *c)
+{
+	int i;
+
+	puts("BENCH name=");
+	puts(name);
+	if (param)
+		print_field(param, value);
+	print_field("ops", ops);
+	print_field("tb", c->tb);
+	print_field("cycles", c->pmc[5]);
+	print_field("insns", c->pmc[4]);
+	for (i = 0; i < 4; ++i)
+		print_field(c->ev->name[i], c->pmc[i]);
+	puts("\n");
+}
+
+void bench_done(void)
+{
+	puts("BENCH-DONE\n");
+}
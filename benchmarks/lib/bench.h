@@ -0,0 +1,91 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define asm     __asm__ volatile
+
+/*
+ * The default amount of work is sized for a simulator; build with
+ * e.g. CPPFLAGS=-DBENCH_SCALE=1000 for runs on hardware.
+ */
+#ifndef BENCH_SCALE
+#define BENCH_SCALE     1
+#endif
+
+#define SPR_TB  268
+#define MMCR0   795
+#define MMCR1   798
+#define MMCR2   785
+#define MMCRA   786
+#define PMC1    771
+#define PMC2    772
+#define PMC3    773
+#define PMC4    774
+#define PMC5    775
+#define PMC6    776
+
+#define MMCR0_FC        0x80000000 // Freeze Counters
+#define MMCR0_CC56RUN   0x00000100 // PMC5/6 count regardless of CTRL[RUN]
+
+#define MSR_FP          0x2000
+
+static inline unsigned long mfspr(int sprnum)
+{
+	unsigned long val;
+
+	asm("mfspr %0,%1" : "=r" (val) : "i" (sprnum));
+	return val;
+}
+
+static inline void mtspr(int sprnum, unsigned long val)
+{
+	asm("mtspr %0,%1" : : "i" (sprnum), "r" (val));
+}
+
+static inline unsigned long mftb(void)
+{
+	unsigned long tb;
+
+	asm("mftb %0" : "=r" (tb));
+	return tb;
+}
+
+/*
+ * What PMC1-4 count during a run: the MMCR1 value selecting the events
+ * and the names they are reported under. PMC5 and PMC6 always count
+ * instructions and cycles.
+ */
+struct bench_events {
+	unsigned long mmcr1;
+	const char *name[4];
+};
+
+/* Loads, icache misses, dcache store misses, dcache load misses */
+extern const struct bench_events bench_ev_mem;
+/* Loads, taken branches, dispatches, branch mispredicts */
+extern const struct bench_events bench_ev_branch;
+/* FP completions, stores, dispatches, dcache load misses */
+extern const struct bench_events bench_ev_fp;
+/* ITLB misses, resolved DTLB misses, DTLB misses, dcache load misses */
+extern const struct bench_events bench_ev_tlb;
+
+struct bench_counts {
+	const struct bench_events *ev;
+	unsigned long tb;
+	unsigned long pmc[6];
+};
+
+void bench_init(void);
+void bench_start(struct bench_counts *c, const struct bench_events *ev);
+void bench_stop(struct bench_counts *c);
+void bench_report(const char *name, const char *param, unsigned long value,
+		  unsigned long ops, const struct bench_counts *c);
+void bench_done(void);
+
+void *bench_mem(unsigned long *size);
+
+void print_dec(unsigned long val);
+void print_hex(unsigned long val);
+
+void *memset(void *s, int c, size_t n);
+void *memcpy(void *dest, const void *src, size_t n);
@@ -0,0 +1,43 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "console.h"
+#include "bench.h"
+
+/*
+ * memcpy and memset bandwidth for working sets from well inside the
+ * L1 dcache out to main memory. Each size moves at least MIN_BYTES.
+ */
+#define MIN_BYTES	(64 * 1024 * BENCH_SCALE)
+#define MAX_SIZE	(128 * 1024)
+
+int main(void)
+{
+	struct bench_counts c;
+	unsigned long size, avail, reps, i;
+	char *buf;
+
+	bench_init();
+	buf = bench_mem(&avail);
+
+	for (size = 512; size <= MAX_SIZE && 2 * size <= avail; size *= 4) {
+		reps = (MIN_BYTES + size - 1) / size;
+
+		memcpy(buf + size, buf, size);
+		bench_start(&c, &bench_ev_mem);
+		for (i = 0; i < reps; ++i)
+			memcpy(buf + size, buf, size);
+		bench_stop(&c);
+		bench_report("memcpy", "size", size, reps * size, &c);
+
+		memset(buf, 0, size);
+		bench_start(&c, &bench_ev_mem);
+		for (i = 0; i < reps; ++i)
+			memset(buf, i, size);
+		bench_stop(&c);
+		bench_report("memset", "size", size, reps * size, &c);
+	}
+
+	bench_done();
+	return 0;
+}
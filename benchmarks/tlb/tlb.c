@@ -0,0 +1,154 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "console.h"
+#include "bench.h"
+
+/*
+ * TLB reach: with data relocation on, touch one doubleword in each of
+ * an increasing number of 4kB pages. All the virtual pages map onto a
+ * single physical page, at a different cache line in each, so the
+ * dcache footprint stays at 4kB and only the DTLB is stressed.
+ */
+#define PID		48
+#define PTCR		464
+#define MSR_DR		0x10
+
+#define PERM_WR		0x002
+#define PERM_RD		0x004
+#define REF		0x100
+#define CHG		0x080
+
+#define VA_BASE		0x10000000ul
+#define MAX_PAGES	2048
+#define ACCESSES	(8192 * BENCH_SCALE)
+
+static unsigned long *pgdir, *proc_tbl, *part_tbl;
+static char *alloc_ptr, *alloc_end;
+
+static inline void store_pte(unsigned long *p, unsigned long pte)
+{
+	asm("stdbrx %1,0,%0" : : "r" (p), "r" (pte) : "memory");
+}
+
+static inline void do_tlbie(unsigned long rb, unsigned long rs)
+{
+	asm("tlbie %0,%1" : : "r" (rb), "r" (rs) : "memory");
+}
+
+/* page table memory has to be aligned to its size */
+static void *alloc(unsigned long size)
+{
+	char *p = (char *)(((unsigned long)alloc_ptr + size - 1) & ~(size - 1));
+
+	if (p + size > alloc_end)
+		return NULL;
+	alloc_ptr = p + size;
+	memset(p, 0, size);
+	return p;
+}
+
+static bool init_mmu(void)
+{
+	part_tbl = alloc(0x1000);
+	proc_tbl = alloc(0x1000);
+	pgdir = alloc(0x2000);
+	if (!pgdir)
+		return false;
+	store_pte(&part_tbl[1], (unsigned long)proc_tbl);
+	mtspr(PTCR, (unsigned long)part_tbl);
+	mtspr(PID, 1);
+	/* RTS = 0 (2GB address space), RPDS = 10 (1024-entry top level) */
+	store_pte(&proc_tbl[2 * 1], (unsigned long)pgdir | 10);
+	do_tlbie(0xc00, 0);	/* invalidate all TLB entries */
+	return true;
+}
+
+static bool map(unsigned long ea, void *pa)
+{
+	unsigned long epn = ea >> 12;
+	unsigned long i = (epn >> 9) & 0x3ff;
+	unsigned long j = epn & 0x1ff;
+	unsigned long *ptep;
+
+	if (pgdir[i] == 0) {
+		ptep = alloc(0x1000);
+		if (!ptep)
+			return false;
+		store_pte(&pgdir[i], 0x8000000000000000ul | (unsigned long)ptep | 9);
+	} else {
+		/* entries are big-endian */
+		ptep = (unsigned long *)(__builtin_bswap64(pgdir[i]) & 0x00ffffffffffff00ul);
+	}
+	store_pte(&ptep[j], 0xc000000000000000ul | ((unsigned long)pa & 0x00fffffffffff000ul) |
+		  PERM_WR | PERM_RD | REF | CHG);
+	return true;
+}
+
+/*
+ * Walk the first npages pages from VA_BASE round-robin, n loads in
+ * total. Runs entirely in registers, since the stack isn't mapped.
+ */
+static unsigned long walk(unsigned long npages, unsigned long n)
+{
+	unsigned long msr, msr_dr, sum = 0;
+	unsigned long i, ea, t, u;
+
+	asm("mfmsr	%0" : "=r" (msr));
+	asm("ori	%5,%6,%7\n"
+	    "	mtmsrd	%5,0\n"
+	    "	mtctr	%8\n"
+	    "	li	%1,0\n"
+	    "1:	rldicr	%2,%1,12,51\n"	/* page i ... */
+	    "	rldic	%3,%1,6,52\n"	/* ... line i % 64 */
+	    "	add	%2,%2,%3\n"
+	    "	ldx	%4,%2,%9\n"
+	    "	add	%0,%0,%4\n"
+	    "	addi	%1,%1,1\n"
+	    "	cmpld	%1,%10\n"
+	    "	bne	2f\n"
+	    "	li	%1,0\n"
+	    "2:	bdnz	1b\n"
+	    "	mtmsrd	%6,0"
+	    : "+r" (sum), "=&r" (i), "=&b" (ea), "=&r" (t), "=&r" (u), "=&r" (msr_dr)
+	    : "r" (msr), "i" (MSR_DR), "r" (n), "r" (VA_BASE), "r" (npages)
+	    : "ctr", "cr0", "memory");
+	return sum;
+}
+
+int main(void)
+{
+	struct bench_counts c;
+	unsigned long avail, npages, mapped, sum = 0;
+	char *page;
+
+	bench_init();
+	alloc_ptr = bench_mem(&avail);
+	alloc_end = alloc_ptr + avail;
+
+	page = alloc(0x1000);
+	if (!page || !init_mmu()) {
+		puts("BENCH-ERROR not enough memory\n");
+		return 1;
+	}
+
+	mapped = 0;
+	for (npages = 4; npages <= MAX_PAGES; npages *= 2) {
+		for (; mapped < npages; ++mapped)
+			if (!map(VA_BASE + (mapped << 12), page))
+				break;
+		if (mapped < npages)
+			break;
+
+		sum += walk(npages, npages);
+		bench_start(&c, &bench_ev_tlb);
+		sum += walk(npages, ACCESSES);
+		bench_stop(&c);
+		bench_report("tlb_reach", "pages", npages, ACCESSES, &c);
+	}
+
+	if (sum == 1)
+		puts("?\n");
+	bench_done();
+	return 0;
+}
@@ -377,6 +377,8 @@ package common is
     type IcacheEventType is record
         icache_miss : std_ulogic;
         itlb_miss_resolved : std_ulogic;
+        prefetch_useful : std_ulogic;
+        prefetch_discard : std_ulogic;
     end record;
 
     type Decode1ToDecode2Type is record
@@ -391,6 +393,7 @@ package common is
 	insn: std_ulogic_vector(31 downto 0);
 	decode: decode_rom_t;
         br_pred: std_ulogic; -- Branch was predicted to be taken
+        pred_target: std_ulogic_vector(63 downto 0); -- Predicted target of bclr/bcctr/bctar
         big_endian: std_ulogic;
         spr_info : spr_id;
         ram_spr : ram_spr_info;
@@ -402,8 +405,8 @@ package common is
         (valid => '0', stop_mark => '0', second => '0', nia => (others => '0'),
          prefixed => '0', prefix => (others => '0'), insn => (others => '0'),
          illegal_suffix => '0', misaligned_prefix => '0',
-         decode => decode_rom_init, br_pred => '0', big_endian => '0',
-         spr_info => spr_id_init, ram_spr => ram_spr_info_init,
+         decode => decode_rom_init, br_pred => '0', pred_target => (others => '0'),
+         big_endian => '0', spr_info => spr_id_init, ram_spr => ram_spr_info_init,
          reg_a => (others => '0'), reg_b => (others => '0'), reg_c => (others => '0'));
 
     type Decode1ToFetch1Type is record
@@ -474,6 +477,7 @@ package common is
 	update : std_ulogic;				-- is this an update instruction?
         reserve : std_ulogic;                           -- set for larx/stcx
         br_pred : std_ulogic;
+        pred_target : std_ulogic_vector(63 downto 0);
         result_sel : result_sel_t;                      -- select source of result
         sub_select : subresult_sel_t;                   -- sub-result selection
         repeat : std_ulogic;                            -- set if instruction is cracked into two ops
@@ -510,6 +514,7 @@ package common is
 	 invert_out => '0', input_carry => ZERO, output_carry => '0', input_cr => '0',
          output_cr => '0', output_xer => '0',
 	 is_32bit => '0', is_signed => '0', xerc => xerc_init, reserve => '0', br_pred => '0',
+         pred_target => (others => '0'),
          byte_reverse => '0', sign_extend => '0', update => '0', nia => (others => '0'),
          read_data1 => (others => '0'), read_data2 => (others => '0'), read_data3 => (others => '0'),
          reg_valid1 => '0', reg_valid2 => '0', reg_valid3 => '0',
@@ -572,6 +577,7 @@ package common is
         br_taken_complete   : std_ulogic;
         br_mispredict       : std_ulogic;
         ipref_discard       : std_ulogic;
+        ipref_useful        : std_ulogic;
         itlb_miss           : std_ulogic;
         itlb_miss_resolved  : std_ulogic;
         icache_miss         : std_ulogic;
@@ -583,6 +589,8 @@ package common is
         dtlb_miss_resolved  : std_ulogic;
         ld_miss_nocache     : std_ulogic;
         ld_fill_nocache     : std_ulogic;
+        dc_pref_useful      : std_ulogic;
+        dc_pref_useless     : std_ulogic;
     end record;
     constant PMUEventInit : PMUEventType := (others => '0');
 
@@ -684,6 +692,7 @@ package common is
 	load : std_ulogic;				-- is this a load
         dcbz : std_ulogic;
         flush : std_ulogic;
+        clean : std_ulogic;                             -- dcbst: flush without invalidating
         touch : std_ulogic;
         sync : std_ulogic;
 	nc : std_ulogic;
@@ -718,6 +727,8 @@ package common is
         dcache_refill      : std_ulogic;
         dtlb_miss          : std_ulogic;
         dtlb_miss_resolved : std_ulogic;
+        prefetch_useful    : std_ulogic;
+        prefetch_useless   : std_ulogic;
     end record;
 
     type Loadstore1ToMmuType is record
@@ -820,6 +831,9 @@ package common is
         br_last: std_ulogic;
         br_taken: std_ulogic;
         abs_br: std_ulogic;
+        ras_push: std_ulogic;
+        ras_pop: std_ulogic;
+        br_indirect: std_ulogic;
         srr1: std_ulogic_vector(15 downto 0);
     end record;
     constant Execute1ToWritebackInit : Execute1ToWritebackType :=
@@ -832,6 +846,7 @@ package common is
          redirect => '0', redir_mode => "0000",
          last_nia => (others => '0'),
          br_last => '0', br_taken => '0', abs_br => '0',
+         ras_push => '0', ras_pop => '0', br_indirect => '0',
          srr1 => (others => '0'));
 
     type Execute1ToFPUType is record
@@ -916,6 +931,9 @@ package common is
         br_nia : std_ulogic_vector(63 downto 0);
         br_last : std_ulogic;
         br_taken : std_ulogic;
+        ras_push : std_ulogic;
+        ras_pop : std_ulogic;
+        br_indirect : std_ulogic;
         interrupt : std_ulogic;
         alt_intr : std_ulogic;
         intr_vec : std_ulogic_vector(63 downto 0);
@@ -924,6 +942,7 @@ package common is
         (redirect => '0', virt_mode => '0', priv_mode => '0', big_endian => '0',
          mode_32bit => '0', redirect_nia => (others => '0'),
          br_last => '0', br_taken => '0', br_nia => (others => '0'),
+         ras_push => '0', ras_pop => '0', br_indirect => '0',
          interrupt => '0', alt_intr => '0', intr_vec => 64x"0");
 
     type WritebackToRegisterFileType is record
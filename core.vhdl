@@ -3,27 +3,44 @@ use ieee.std_logic_1164.all;
 use ieee.numeric_std.all;
 
 library work;
+use work.utils.all;
 use work.common.all;
 use work.wishbone_types.all;
 
 entity core is
     generic (
         SIM : boolean := false;
+        SIM_END_ON_TERMINATE : boolean := true;
         CPU_INDEX : natural := 0;
         NCPUS : positive := 1;
 	DISABLE_FLATTEN : boolean := false;
         EX1_BYPASS : boolean := true;
         HAS_FPU : boolean := true;
+        -- Faster integer divider, used when there is no FPU
+        FAST_DIVIDE : boolean := false;
         HAS_BTC : boolean := true;
+        BTC_SIZE : positive := 1024;
+        BTC_WAYS : positive := 1;
+        BTC_TAG_BITS : positive := 52;
+        HAS_RAS : boolean := false;
+        HAS_ITC : boolean := false;
+        ITC_SIZE : positive := 256;
+        HAS_BHT : boolean := false;
+        BHT_SIZE : positive := 1024;
 	ALT_RESET_ADDRESS : std_ulogic_vector(63 downto 0) := (others => '0');
         LOG_LENGTH : natural := 512;
         ICACHE_NUM_LINES : natural := 64;
         ICACHE_NUM_WAYS : natural := 2;
         ICACHE_TLB_SIZE : natural := 64;
+        ICACHE_PREFETCH_LINES : natural := 0;
         DCACHE_NUM_LINES : natural := 64;
         DCACHE_NUM_WAYS : natural := 2;
         DCACHE_TLB_SET_SIZE : natural := 64;
-        DCACHE_TLB_NUM_WAYS : natural := 2
+        DCACHE_TLB_NUM_WAYS : natural := 2;
+        DCACHE_WRITE_BACK : boolean := false;
+        DCACHE_STORE_QUEUE : boolean := false;
+        DCACHE_SECOND_REFILL : boolean := false;
+        DCACHE_PREFETCH : boolean := false
         );
     port (
         clk          : in std_ulogic;
@@ -233,7 +250,12 @@ begin
             RESET_ADDRESS => (others => '0'),
 	    ALT_RESET_ADDRESS => ALT_RESET_ADDRESS,
             TLB_SIZE => ICACHE_TLB_SIZE,
-            HAS_BTC => HAS_BTC
+            HAS_BTC => HAS_BTC,
+            BTC_SIZE => BTC_SIZE,
+            BTC_WAYS => BTC_WAYS,
+            BTC_TAG_BITS => BTC_TAG_BITS,
+            HAS_BHT => HAS_BHT,
+            BHT_SIZE => BHT_SIZE
             )
         port map (
             clk => clk,
@@ -260,6 +282,7 @@ begin
             LINE_SIZE => 64,
             NUM_LINES => ICACHE_NUM_LINES,
             NUM_WAYS => ICACHE_NUM_WAYS,
+            PREFETCH_LINES => ICACHE_PREFETCH_LINES,
             LOG_LENGTH => LOG_LENGTH
             )
         port map(
@@ -283,6 +306,12 @@ begin
     decode1_0: entity work.decode1
         generic map(
             HAS_FPU => HAS_FPU,
+            DCACHE_WRITE_BACK => DCACHE_WRITE_BACK,
+            BTC_CHECK => HAS_BTC and log2(BTC_SIZE / BTC_WAYS) + 2 + BTC_TAG_BITS < 64,
+            HAS_RAS => HAS_RAS,
+            HAS_BHT => HAS_BHT,
+            HAS_ITC => HAS_ITC,
+            ITC_SIZE => ITC_SIZE,
             LOG_LENGTH => LOG_LENGTH
             )
         port map (
@@ -293,6 +322,7 @@ begin
             flush_out => decode1_flush,
             busy_out => decode1_busy,
             f_in => icache_to_decode1,
+            w_in => writeback_to_fetch1,
             d_out => decode1_to_decode2,
             f_out => decode1_to_fetch1,
             r_out => decode1_to_register_file,
@@ -358,6 +388,7 @@ begin
     cr_file_0: entity work.cr_file
         generic map (
             SIM => SIM,
+            SIM_END_ON_TERMINATE => SIM_END_ON_TERMINATE,
             LOG_LENGTH => LOG_LENGTH
             )
         port map (
@@ -377,6 +408,7 @@ begin
             NCPUS => NCPUS,
             EX1_BYPASS => EX1_BYPASS,
             HAS_FPU => HAS_FPU,
+            FAST_DIVIDE => FAST_DIVIDE,
             LOG_LENGTH => LOG_LENGTH
             )
         port map (
@@ -481,6 +513,10 @@ begin
             NUM_WAYS => DCACHE_NUM_WAYS,
             TLB_SET_SIZE => DCACHE_TLB_SET_SIZE,
             TLB_NUM_WAYS => DCACHE_TLB_NUM_WAYS,
+            WRITE_BACK => DCACHE_WRITE_BACK,
+            STORE_QUEUE => DCACHE_STORE_QUEUE,
+            SECOND_REFILL => DCACHE_SECOND_REFILL,
+            PREFETCH => DCACHE_PREFETCH,
             LOG_LENGTH => LOG_LENGTH
             )
         port map (
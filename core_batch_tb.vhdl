@@ -0,0 +1,103 @@
+library ieee;
+use ieee.std_logic_1164.all;
+use ieee.numeric_std.all;
+
+library work;
+use work.common.all;
+use work.wishbone_types.all;
+use work.sim_bram_helpers.all;
+
+-- Runs a series of test images in one simulation, as core_tb does for a
+-- single one. Each line of CMD_FILE names an image, which is loaded into
+-- main RAM while the SoC is held in reset. The SoC is then run until the
+-- core terminates, or for MAX_CYCLES, after which the usual register dump
+-- is followed by "BATCH END <cycles>" or "BATCH TIMEOUT <cycles>".
+-- The simulation finishes at the end of CMD_FILE.
+-- The remaining generics turn on optional features of the core, as for
+-- core_tb.
+entity core_batch_tb is
+    generic (
+        CMD_FILE   : string := "batch.cmd";
+        MAX_CYCLES : natural := 10000000;
+        ICACHE_PREFETCH_LINES : natural := 0;
+        DCACHE_WRITE_BACK : boolean := false;
+        DCACHE_STORE_QUEUE : boolean := false;
+        DCACHE_SECOND_REFILL : boolean := false;
+        DCACHE_PREFETCH : boolean := false;
+        BTC_WAYS : positive := 1;
+        BTC_TAG_BITS : positive := 52;
+        HAS_RAS : boolean := false;
+        HAS_ITC : boolean := false;
+        HAS_BHT : boolean := false
+        );
+end core_batch_tb;
+
+architecture behave of core_batch_tb is
+        signal clk, rst: std_logic;
+        signal terminated : std_ulogic;
+
+        -- testbench signals
+        constant clk_period : time := 10 ns;
+        constant RAM_INIT_FILE : string := "main_ram.bin";
+begin
+
+    soc0: entity work.soc
+        generic map(
+            SIM => true,
+            SIM_END_ON_TERMINATE => false,
+            MEMORY_SIZE => (384*1024),
+            RAM_INIT_FILE => RAM_INIT_FILE,
+            CLK_FREQ => 100000000,
+            ICACHE_PREFETCH_LINES => ICACHE_PREFETCH_LINES,
+            DCACHE_WRITE_BACK => DCACHE_WRITE_BACK,
+            DCACHE_STORE_QUEUE => DCACHE_STORE_QUEUE,
+            DCACHE_SECOND_REFILL => DCACHE_SECOND_REFILL,
+            DCACHE_PREFETCH => DCACHE_PREFETCH,
+            BTC_WAYS => BTC_WAYS,
+            BTC_TAG_BITS => BTC_TAG_BITS,
+            HAS_RAS => HAS_RAS,
+            HAS_ITC => HAS_ITC,
+            HAS_BHT => HAS_BHT
+            )
+        port map(
+            rst => rst,
+            system_clk => clk,
+            terminated_out => terminated
+            );
+
+    clk_process: process
+    begin
+        clk <= '0';
+        wait for clk_period/2;
+        clk <= '1';
+        wait for clk_period/2;
+    end process;
+
+    batch_process: process
+        variable cycles : natural;
+    begin
+        loop
+            rst <= '1';
+            for i in 1 to 10 loop
+                wait until rising_edge(clk);
+            end loop;
+            exit when behavioural_next_image(CMD_FILE, RAM_INIT_FILE) = 0;
+
+            rst <= '0';
+            cycles := 0;
+            while terminated /= '1' and cycles < MAX_CYCLES loop
+                wait until rising_edge(clk);
+                cycles := cycles + 1;
+            end loop;
+            if terminated = '1' then
+                report "BATCH END " & integer'image(cycles);
+            else
+                report "BATCH TIMEOUT " & integer'image(cycles);
+            end if;
+        end loop;
+        std.env.finish;
+    end process;
+
+    jtag: entity work.sim_jtag;
+
+end;
@@ -74,12 +74,14 @@ architecture behave of core_debug is
     -- bit     2 : Icache reset
     -- bit     3 : Single step
     -- bit     4 : Core start
+    -- bit     5 : Snapshot STAT, NIA and MSR into the SNAP registers
     constant DBG_CORE_CTRL         : std_ulogic_vector(3 downto 0) := "0000";
     constant DBG_CORE_CTRL_STOP    : integer := 0;
     constant DBG_CORE_CTRL_RESET   : integer := 1;
     constant DBG_CORE_CTRL_ICRESET : integer := 2;
     constant DBG_CORE_CTRL_STEP    : integer := 3;
     constant DBG_CORE_CTRL_START   : integer := 4;
+    constant DBG_CORE_CTRL_SNAP    : integer := 5;
 
     -- STAT register (read only)
     -- bit    0 : Core stopping (wait til bit 1 set)
@@ -108,6 +110,12 @@ architecture behave of core_debug is
     constant DBG_CORE_LOG_TRIGGER    : std_ulogic_vector(3 downto 0) := "1000";
     constant DBG_CORE_LOG_MTRIGGER   : std_ulogic_vector(3 downto 0) := "1001";
 
+    -- Snapshot of STAT, NIA and MSR taken by a CTRL write (read only).
+    -- A CTRL write to all cores at once latches them in the same cycle.
+    constant DBG_CORE_SNAP_STAT      : std_ulogic_vector(3 downto 0) := "1010";
+    constant DBG_CORE_SNAP_NIA       : std_ulogic_vector(3 downto 0) := "1011";
+    constant DBG_CORE_SNAP_MSR       : std_ulogic_vector(3 downto 0) := "1100";
+
     constant LOG_INDEX_BITS : natural := log2(LOG_LENGTH);
 
     -- Some internal wires
@@ -125,6 +133,10 @@ architecture behave of core_debug is
 
     signal spr_index_valid : std_ulogic;
 
+    signal snap_stat    : std_ulogic_vector(63 downto 0) := (others => '0');
+    signal snap_nia     : std_ulogic_vector(63 downto 0) := (others => '0');
+    signal snap_msr     : std_ulogic_vector(63 downto 0) := (others => '0');
+
     signal log_dmi_addr        : std_ulogic_vector(31 downto 0) := (others => '0');
     signal log_dmi_data        : std_ulogic_vector(63 downto 0) := (others => '0');
     signal log_dmi_trigger     : std_ulogic_vector(63 downto 0) := (others => '0');
@@ -164,6 +176,9 @@ begin
         log_dmi_data    when DBG_CORE_LOG_DATA,
         log_dmi_trigger when DBG_CORE_LOG_TRIGGER,
         log_mem_trigger when DBG_CORE_LOG_MTRIGGER,
+        snap_stat       when DBG_CORE_SNAP_STAT,
+        snap_nia        when DBG_CORE_SNAP_NIA,
+        snap_msr        when DBG_CORE_SNAP_MSR,
         (others => '0') when others;
 
     -- DMI writes
@@ -229,6 +244,11 @@ begin
                                 stopping <= '0';
                                 terminated <= '0';
                             end if;
+                            if dmi_din(DBG_CORE_CTRL_SNAP) = '1' then
+                                snap_stat <= stat_reg;
+                                snap_nia <= nia;
+                                snap_msr <= msr;
+                            end if;
                         elsif dmi_addr = DBG_CORE_GSPR_INDEX then
                             gspr_index <= dmi_din(7 downto 0);
                         elsif dmi_addr = DBG_CORE_LOG_ADDR then
@@ -6,7 +6,21 @@ library work;
 use work.common.all;
 use work.wishbone_types.all;
 
+-- The generics turn on optional features of the core, so that the tests
+-- can be run with them (see check_options in the Makefile).
 entity core_tb is
+    generic (
+        ICACHE_PREFETCH_LINES : natural := 0;
+        DCACHE_WRITE_BACK : boolean := false;
+        DCACHE_STORE_QUEUE : boolean := false;
+        DCACHE_SECOND_REFILL : boolean := false;
+        DCACHE_PREFETCH : boolean := false;
+        BTC_WAYS : positive := 1;
+        BTC_TAG_BITS : positive := 52;
+        HAS_RAS : boolean := false;
+        HAS_ITC : boolean := false;
+        HAS_BHT : boolean := false
+        );
 end core_tb;
 
 architecture behave of core_tb is
@@ -21,7 +35,17 @@ begin
             SIM => true,
             MEMORY_SIZE => (384*1024),
             RAM_INIT_FILE => "main_ram.bin",
-            CLK_FREQ => 100000000
+            CLK_FREQ => 100000000,
+            ICACHE_PREFETCH_LINES => ICACHE_PREFETCH_LINES,
+            DCACHE_WRITE_BACK => DCACHE_WRITE_BACK,
+            DCACHE_STORE_QUEUE => DCACHE_STORE_QUEUE,
+            DCACHE_SECOND_REFILL => DCACHE_SECOND_REFILL,
+            DCACHE_PREFETCH => DCACHE_PREFETCH,
+            BTC_WAYS => BTC_WAYS,
+            BTC_TAG_BITS => BTC_TAG_BITS,
+            HAS_RAS => HAS_RAS,
+            HAS_ITC => HAS_ITC,
+            HAS_BHT => HAS_BHT
             )
         port map(
             rst => rst,
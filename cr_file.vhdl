@@ -8,6 +8,8 @@ use work.common.all;
 entity cr_file is
     generic (
         SIM : boolean := false;
+        -- End the simulation after the register dump on terminate
+        SIM_END_ON_TERMINATE : boolean := true;
         -- Non-zero to enable log data collection
         LOG_LENGTH : natural := 0
         );
@@ -101,7 +103,7 @@ begin
                 xer(18) := xerc.ca32;
                 xer(17 downto 0) := ctrl.xer_low;
                 report "XER 00000000" & to_hstring(xer);
-                assert false report "end of test" severity failure;
+                assert not SIM_END_ON_TERMINATE report "end of test" severity failure;
             end if;
         end process;
     end generate;
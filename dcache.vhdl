@@ -1,5 +1,5 @@
 --
--- Set associative dcache write-through
+-- Set associative dcache, write-through or write-back
 --
 --
 library ieee;
@@ -27,6 +27,18 @@ entity dcache is
         TLB_NUM_WAYS : positive := 2;
         -- L1 DTLB log_2(page_size)
         TLB_LG_PGSZ : positive := 12;
+        -- Keep store hits in the cache and write dirty lines back on
+        -- replacement, rather than storing through to memory
+        WRITE_BACK : boolean := false;
+        -- Complete stores as soon as they are queued, and write them
+        -- to memory later, rather than starting a wishbone cycle
+        STORE_QUEUE : boolean := false;
+        -- Number of stores that can wait to be written to memory
+        STORE_QUEUE_SIZE : positive := 4;
+        -- Let a load miss start its refill while another completes
+        SECOND_REFILL : boolean := false;
+        -- Prefetch lines ahead of strided sequences of load misses
+        PREFETCH : boolean := false;
         -- Non-zero to enable log data collection
         LOG_LENGTH : natural := 0
         );
@@ -118,7 +130,8 @@ architecture rtl of dcache is
     subtype cache_tags_set_t is std_logic_vector(TAG_RAM_WIDTH-1 downto 0);
     type cache_tags_array_t is array(0 to NUM_LINES-1) of cache_tags_set_t;
 
-    -- The cache valid bits
+    -- The cache valid bits, dirty bits for write-back mode, and bits for
+    -- prefetched lines that haven't been used yet
     subtype cache_way_valids_t is std_ulogic_vector(NUM_WAYS-1 downto 0);
     type cache_valids_t is array(0 to NUM_LINES-1) of cache_way_valids_t;
     type row_per_line_valid_t is array(0 to ROW_PER_LINE - 1) of std_ulogic;
@@ -127,10 +140,38 @@ architecture rtl of dcache is
     signal cache_tags    : cache_tags_array_t;
     signal cache_tag_set : cache_tags_set_t;
     signal cache_valids  : cache_valids_t;
+    signal cache_dirty   : cache_valids_t;
+    signal cache_pf      : cache_valids_t;
 
     attribute ram_style : string;
     attribute ram_style of cache_tags : signal is "distributed";
 
+    -- The second refill slot (r1.mshr_*) is used by SECOND_REFILL and
+    -- by the prefetcher
+    constant HAS_MSHR : boolean := SECOND_REFILL or PREFETCH;
+
+    -- Stride prefetcher.  Each stream records the last line in a page that
+    -- was missed on, or used for the first time after being prefetched,
+    -- and its distance in lines from the one before.
+    constant PF_STREAMS     : positive := 4;
+    constant PAGE_LINE_BITS : natural := TLB_LG_PGSZ - LINE_OFF_BITS;
+
+    subtype pf_line_t is std_ulogic_vector(REAL_ADDR_BITS - 1 downto LINE_OFF_BITS);
+    type pf_stream_t is record
+        valid  : std_ulogic;
+        page   : std_ulogic_vector(REAL_ADDR_BITS - 1 downto TLB_LG_PGSZ);
+        line   : unsigned(PAGE_LINE_BITS - 1 downto 0);
+        stride : signed(PAGE_LINE_BITS downto 0);
+    end record;
+    type pf_stream_array_t is array(0 to PF_STREAMS - 1) of pf_stream_t;
+
+    signal pf_streams : pf_stream_array_t;
+    signal pf_next    : natural range 0 to PF_STREAMS - 1;  -- stream to replace
+    signal pf_valid   : std_ulogic;
+    signal pf_addr    : pf_line_t;                          -- line to prefetch
+    signal pf_use     : std_ulogic;
+    signal pf_train   : std_ulogic;
+
     -- L1 TLB.
     constant TLB_SET_BITS : natural := log2(TLB_SET_SIZE);
     constant TLB_WAY_BITS : natural := maximum(log2(TLB_NUM_WAYS), 1);
@@ -197,7 +238,9 @@ architecture rtl of dcache is
 		     STORE_WAIT_ACK,   -- Store wait ack
 		     NC_LOAD_WAIT_ACK, -- Non-cachable load wait ack
                      DO_STCX,          -- Check for stcx. validity
-                     FLUSH_CYCLE);     -- Cycle for invalidating cache line
+                     FLUSH_CYCLE,      -- Cycle for invalidating cache line
+                     VICTIM_CHECK,     -- See if a miss has to write back its victim
+                     WRITE_LINE);      -- Write a dirty line back to memory
 
     --
     -- Dcache operations:
@@ -250,6 +293,19 @@ architecture rtl of dcache is
     -- requests can come in to r0 and be satisfied if they are
     -- cacheable load hits or stores with the same cache tag.
     --
+    -- With STORE_QUEUE, a store (other than stcx. and dcbz) is instead
+    -- put in the store queue and completes in cycle 2 in IDLE or
+    -- STORE_WAIT_ACK state, one per cycle.  A cacheable store to the
+    -- same doubleword as the last store in the queue is merged into
+    -- that entry.  The queue is drained in STORE_WAIT_ACK state, in
+    -- order and as one wishbone cycle for as long as it has entries,
+    -- whenever the state machine has nothing else to do, and it stops
+    -- early to let a cacheable load miss through.  A load miss to a
+    -- line with a store in the queue, a non-cacheable load, stcx.,
+    -- dcbz and sync wait for the queue to be empty (and every store
+    -- acked) first, so loads never need data forwarded from the queue:
+    -- cacheable loads that hit see stored data in the cache data RAM.
+    --
     -- Writing to the cache data RAM is done at the clock edge
     -- at the end of cycle 2 for a store hit (excluding dcbz).
     -- Stores that miss are not written to the cache data RAM
@@ -259,6 +315,22 @@ architecture rtl of dcache is
     -- the cache data RAM.  Thus dcbz will allocate the line in
     -- the cache as well as zeroing memory.
     --
+    -- With WRITE_BACK, a store that hits is only written to the cache
+    -- data RAM and marks the line dirty, and completes from IDLE state
+    -- without a wishbone cycle.  Store misses still go through to memory
+    -- without allocating a line.  Before a load miss or dcbz replaces a
+    -- line, VICTIM_CHECK looks at the victim way, and if it is dirty,
+    -- WRITE_LINE reads it out of the cache data RAM a row at a time and
+    -- writes it to memory.  r1.full is 1 throughout, so r0 is stalled and
+    -- the data RAM read port is free, and there is always at least one
+    -- more cycle with r1.full = 1 afterwards in which the row for the
+    -- request in r0 gets read again.  dcbst and dcbf write back a dirty
+    -- line the same way, then dcbf invalidates it.  Snooped writes from
+    -- other masters still just invalidate lines, dirty or not, so
+    -- software has to flush dirty lines before another master (e.g. DMA)
+    -- writes to them or reads them, and before executing code it has
+    -- stored.
+    --
     -- Since stores are written to the cache data RAM at the end of
     -- cycle 2, and loads can come in and hit on the data just stored,
     -- there is a two-stage bypass from store data to load data to
@@ -275,6 +347,17 @@ architecture rtl of dcache is
     -- soon as the necessary data comes in from memory, without
     -- waiting for the whole line to be read.
     --
+    -- With SECOND_REFILL, a second load miss (or dcbt) to a line in a
+    -- different set can start its refill once all the requests for the
+    -- line being reloaded have been sent, so that its memory latency
+    -- overlaps the rest of the first refill.  Its line is tagged and
+    -- made valid straight away, with loads to it treated as waiting for
+    -- a row of the line being reloaded, and it becomes the line being
+    -- reloaded when the first refill completes.  A dcbt completes the
+    -- cycle after its refill has started, so software prefetches don't
+    -- hold up later loads that hit.  (The prefetcher uses the same
+    -- second refill slot for its lines whether or not this is enabled.)
+    --
     -- Aligned loads and stores of a doubleword or less are atomic
     -- because they are done in a single wishbone operation.
     -- For quadword atomic loads and stores we rely on the wishbone
@@ -311,6 +394,7 @@ architecture rtl of dcache is
         valid      : std_ulogic;
         dcbz       : std_ulogic;
         flush      : std_ulogic;
+        clean      : std_ulogic;
         touch      : std_ulogic;
         sync       : std_ulogic;
         reserve    : std_ulogic;
@@ -340,6 +424,7 @@ architecture rtl of dcache is
         mmu_req          : std_ulogic;          -- request is from MMU
         req              : mem_access_request_t;
         atomic_more      : std_ulogic;          -- atomic request isn't finished
+        sq_more          : std_ulogic;          -- store sent is 1st half of a stq
 
 	-- Cache hit state
 	hit_way          : way_t;
@@ -378,18 +463,41 @@ architecture rtl of dcache is
         wb               : wishbone_master_out;
         reloading        : std_ulogic;
         reload_tag       : cache_tag_t;
+        reload_pf        : std_ulogic;          -- line is being prefetched
 	store_way        : way_t;
         store_ways       : way_expand_t;
 	store_row        : row_t;
         store_index      : index_t;
         end_row_ix       : row_in_line_t;
         rows_valid       : row_per_line_valid_t;
-        acks_pending     : unsigned(2 downto 0);
+        acks_pending     : unsigned(3 downto 0);
         stalled          : std_ulogic;
         dec_acks         : std_ulogic;
         choose_victim    : std_ulogic;
         victim_way       : way_t;
 
+        -- Second line refill, requested while the first is still
+        -- coming in, and started when it completes
+        mshr_valid       : std_ulogic;
+        mshr_index       : index_t;
+        mshr_tag         : cache_tag_t;
+        mshr_way         : way_t;
+        mshr_row         : row_t;               -- first row requested
+        mshr_end_row_ix  : row_in_line_t;
+        mshr_pf          : std_ulogic;
+
+        -- Prefetch state
+        tag_hazard       : std_ulogic;          -- r0 may have read a stale tag
+        pf_victim        : way_t;
+        pf_last          : pf_line_t;           -- last line taken from the prefetcher
+
+        -- Dirty line write-back state
+        wl_way           : way_t;
+        wl_row           : row_in_line_t;       -- next row to read
+        wl_rd_done       : std_ulogic;          -- all rows read
+        wl_data_ok       : std_ulogic;          -- RAM output is a row to send
+        wl_data_row      : row_in_line_t;       -- and this is its row
+
         -- Signals to complete (possibly with error)
         ls_valid         : std_ulogic;
         ls_error         : std_ulogic;
@@ -437,6 +545,20 @@ architecture rtl of dcache is
 
     signal early_req_row  : row_t;
     signal early_rd_valid : std_ulogic;
+    signal wl_rd_en       : std_ulogic;
+
+    -- Store queue, oldest first
+    type sq_entry_t is record
+        adr : wishbone_addr_type;
+        dat : wishbone_data_type;
+        sel : wishbone_sel_type;
+        nc  : std_ulogic;
+        more : std_ulogic;      -- first half of a stq, goes in the same cycle as the next
+    end record;
+    type sq_array_t is array(0 to STORE_QUEUE_SIZE - 1) of sq_entry_t;
+
+    signal store_queue : sq_array_t;
+    signal sq_count    : natural range 0 to STORE_QUEUE_SIZE;
 
     signal r0_valid   : std_ulogic;
     signal r0_stall   : std_ulogic;
@@ -593,6 +715,7 @@ begin
 	report "geometry bits don't add up" severity FAILURE;
     assert (64 = wishbone_data_bits)
 	report "Can't yet handle a wishbone width that isn't 64-bits" severity FAILURE;
+    assert STORE_QUEUE_SIZE >= 2 report "Store queue can't hold both halves of stq" severity FAILURE;
     assert SET_SIZE_BITS <= TLB_LG_PGSZ report "Set indexed by virtual address" severity FAILURE;
 
     -- Latch the request in r0.req as long as we're not stalling
@@ -622,7 +745,7 @@ begin
             end if;
             if rst = '1' then
                 r0_full <= '0';
-            elsif r1.full = '0' and d_in.hold = '0' then
+            elsif r0_stall = '0' then
                 r0 <= r;
                 r0_full <= r.req.valid;
             elsif r0.d_valid = '0' then
@@ -641,9 +764,20 @@ begin
     m_out.stall <= '0';
 
     -- Hold off the request in r0 when r1 has an uncompleted request
-    r0_stall <= r1.full or d_in.hold;
-    r0_valid <= r0_full and not r1.full and not d_in.hold;
-    stall_out <= r1.full;
+    r0_hold: if not PREFETCH generate
+        r0_stall <= r1.full or d_in.hold;
+        r0_valid <= r0_full and not r1.full and not d_in.hold;
+        stall_out <= r1.full;
+    end generate;
+
+    -- With the prefetcher, also hold it off for a cycle after a prefetch
+    -- has written a tag, since the request in r0 might have been looked
+    -- up with the old one.
+    r0_hold_pf: if PREFETCH generate
+        r0_stall <= r1.full or d_in.hold or (r1.tag_hazard and r0_full);
+        r0_valid <= r0_full and not r1.full and not d_in.hold and not r1.tag_hazard;
+        stall_out <= r1.full or (r1.tag_hazard and r0_full);
+    end generate;
 
     events <= ev;
 
@@ -991,6 +1125,15 @@ begin
                 idx_reload := r1.store_ways;
             end if;
         end if;
+        -- None of the line for the second refill has arrived yet
+        if HAS_MSHR and go = '1' and r1.mshr_valid = '1' and rindex = r1.mshr_index and
+            r0.req.load = '1' and r0.req.touch = '0' then
+            for i in 0 to NUM_WAYS-1 loop
+                if to_unsigned(i, WAY_BITS) = r1.mshr_way then
+                    idx_reload(i) := '1';
+                end if;
+            end loop;
+        end if;
 
         -- See if request matches the location being stored in this cycle
         maybe_fwd_st := (others => '0');
@@ -1156,8 +1299,11 @@ begin
         -- Version of the row number that is valid one cycle earlier
         -- in the cases where we need to read the cache data BRAM.
         -- If we're stalling then we need to keep reading the last
-        -- row requested.
-        if r0_stall = '0' then
+        -- row requested, unless we are writing back a dirty line.
+        if WRITE_BACK and r1.state = WRITE_LINE then
+            early_req_row <= r1.store_index & r1.wl_row;
+            early_rd_valid <= wl_rd_en;
+        elsif r0_stall = '0' then
             early_rd_valid <= '1';
             if m_in.valid = '1' then
                 early_req_row <= get_row(m_in.addr);
@@ -1173,6 +1319,11 @@ begin
     -- Wire up wishbone request latch out of stage 1
     wishbone_out <= r1.wb;
 
+    -- When writing back a dirty line, read the next row once the row
+    -- read previously (if any) is going out on the wishbone
+    wl_rd_en <= '1' when WRITE_BACK and r1.state = WRITE_LINE and r1.wl_rd_done = '0' and
+                (r1.wb.stb = '0' or wishbone_in.stall = '0') else '0';
+
     -- Return data for loads & completion control logic
     --
     writeback_control: process(all)
@@ -1397,6 +1548,68 @@ begin
 	end if;
     end process;
 
+    --
+    -- Stride prefetcher.  Cacheable load misses, and the first access to
+    -- a prefetched line, are looked up by page in a small table.  When the
+    -- distance in lines from the last one in that page is the same twice
+    -- running, the line that distance further on (if it is in the same
+    -- page) is the one to prefetch.  dcache_slow fetches it into the cache
+    -- when the state machine is idle, or as the second refill while
+    -- another line is being reloaded.
+    --
+    pf_use <= '1' when PREFETCH and req_go = '1' and (req_is_hit or req_hit_reload) = '1' and
+              (req_op_load_hit or req_op_load_miss or req_op_store) = '1' and
+              cache_pf(to_integer(req_index))(to_integer(req_hit_way)) = '1' else '0';
+    pf_train <= '1' when PREFETCH and req_go = '1' and r0.mmu_req = '0' and r0.req.load = '1' and
+                req_nc = '0' and ((req_op_load_miss = '1' and req_hit_reload = '0') or pf_use = '1')
+                else '0';
+
+    dcache_prefetch : process(clk)
+        variable page   : std_ulogic_vector(REAL_ADDR_BITS - 1 downto TLB_LG_PGSZ);
+        variable line   : unsigned(PAGE_LINE_BITS - 1 downto 0);
+        variable e      : natural range 0 to PF_STREAMS - 1;
+        variable found  : boolean;
+        variable stride : signed(PAGE_LINE_BITS downto 0);
+        variable target : signed(PAGE_LINE_BITS + 1 downto 0);
+    begin
+        if rising_edge(clk) then
+            if rst = '1' or not PREFETCH then
+                for i in 0 to PF_STREAMS - 1 loop
+                    pf_streams(i).valid <= '0';
+                end loop;
+                pf_next <= 0;
+                pf_valid <= '0';
+            elsif pf_train = '1' then
+                page := ra(REAL_ADDR_BITS - 1 downto TLB_LG_PGSZ);
+                line := unsigned(ra(TLB_LG_PGSZ - 1 downto LINE_OFF_BITS));
+                found := false;
+                e := pf_next;
+                for i in 0 to PF_STREAMS - 1 loop
+                    if pf_streams(i).valid = '1' and pf_streams(i).page = page then
+                        found := true;
+                        e := i;
+                    end if;
+                end loop;
+                if found then
+                    stride := signed('0' & line) - signed('0' & pf_streams(e).line);
+                    target := resize(signed('0' & line), PAGE_LINE_BITS + 2) +
+                              resize(stride, PAGE_LINE_BITS + 2);
+                    if stride /= 0 and stride = pf_streams(e).stride and
+                        target >= 0 and target < 2 ** PAGE_LINE_BITS then
+                        pf_valid <= '1';
+                        pf_addr <= page & std_ulogic_vector(target(PAGE_LINE_BITS - 1 downto 0));
+                    end if;
+                    pf_streams(e).line <= line;
+                    pf_streams(e).stride <= stride;
+                else
+                    pf_streams(e) <= (valid => '1', page => page, line => line,
+                                      stride => (others => '0'));
+                    pf_next <= (pf_next + 1) mod PF_STREAMS;
+                end if;
+            end if;
+        end if;
+    end process;
+
     --
     -- Memory accesses are handled by this state machine:
     --
@@ -1410,12 +1623,26 @@ begin
     dcache_slow : process(clk)
         variable stbs_done : boolean;
         variable req       : mem_access_request_t;
-        variable acks      : unsigned(2 downto 0);
+        variable acks      : unsigned(3 downto 0);
+        variable victim    : way_t;
+        variable sq        : sq_array_t;
+        variable sq_n      : natural range 0 to STORE_QUEUE_SIZE;
+        variable sq_hold   : boolean;
+        variable sq_match  : boolean;
+        variable sq_adr    : wishbone_addr_type;
+        variable pf_idx    : index_t;
+        variable pf_tag    : cache_tag_t;
+        variable pf_adr    : wishbone_addr_type;
+        variable pf_way    : way_t;
+        variable pf_ok     : boolean;
+        variable pf_start  : boolean;
     begin
         if rising_edge(clk) then
             ev.dcache_refill <= '0';
             ev.load_miss <= '0';
             ev.store_miss <= '0';
+            ev.prefetch_useful <= '0';
+            ev.prefetch_useless <= '0';
             ev.dtlb_miss <= tlb_miss;
             r1.choose_victim <= '0';
 
@@ -1423,7 +1650,10 @@ begin
             if rst = '1' then
 		for i in 0 to NUM_LINES-1 loop
 		    cache_valids(i) <= (others => '0');
+		    cache_dirty(i) <= (others => '0');
+                    cache_pf(i) <= (others => '0');
 		end loop;
+                sq_count <= 0;
                 r1.state <= IDLE;
                 r1.full <= '0';
 		r1.slow_valid <= '0';
@@ -1432,10 +1662,16 @@ begin
                 r1.ls_valid <= '0';
                 r1.mmu_done <= '0';
                 r1.reloading <= '0';
-                r1.acks_pending <= to_unsigned(0, 3);
+                r1.acks_pending <= to_unsigned(0, 4);
                 r1.stalled <= '0';
                 r1.dec_acks <= '0';
                 r1.prev_hit <= '0';
+                r1.sq_more <= '0';
+                r1.mshr_valid <= '0';
+                r1.reload_pf <= '0';
+                r1.tag_hazard <= '0';
+                r1.pf_victim <= to_unsigned(0, WAY_BITS);
+                r1.pf_last <= (others => '0');
                 r1.prev_hit_reload <= '0';
                 r1.prev_hit_ways <= (others => '0');
                 reservation.valid <= '0';
@@ -1448,6 +1684,7 @@ begin
 		r1.slow_valid <= '0';
                 r1.write_bram <= '0';
                 r1.stcx_fail <= '0';
+                r1.tag_hazard <= '0';
 
                 r1.ls_valid <= (req_op_load_hit or req_op_nop) and not r0.mmu_req;
                 r1.mmu_done <= req_op_load_hit and r0.mmu_req;
@@ -1490,12 +1727,24 @@ begin
                     -- Set the line valid now.  While the line is being
                     -- reloaded, the hit detection logic will use r1.rows_valid
                     -- to determine hits on this line.
+                    if cache_valids(to_integer(r1.store_index))(to_integer(replace_way)) = '1' and
+                        cache_pf(to_integer(r1.store_index))(to_integer(replace_way)) = '1' then
+                        ev.prefetch_useless <= '1';
+                    end if;
                     cache_valids(to_integer(r1.store_index))(to_integer(replace_way)) <= '1';
+                    cache_dirty(to_integer(r1.store_index))(to_integer(replace_way)) <= '0';
+                    cache_pf(to_integer(r1.store_index))(to_integer(replace_way)) <= '0';
                     -- record which way was used, for possible 2nd half of lqarx
                     r1.prev_hit_ways <= (others => '0');
                     r1.prev_hit_ways(to_integer(replace_way)) <= '1';
                 end if;
 
+                -- First access to a prefetched line
+                if pf_use = '1' then
+                    cache_pf(to_integer(req_index))(to_integer(req_hit_way)) <= '0';
+                    ev.prefetch_useful <= '1';
+                end if;
+
                 -- Take request from r1.req if there is one there,
                 -- else from req_op_*, ra, etc.
                 if r1.full = '1' then
@@ -1510,6 +1759,7 @@ begin
                     req.mmu_req := r0.mmu_req;
                     req.dcbz := r0.req.dcbz;
                     req.flush := r0.req.flush;
+                    req.clean := r0.req.clean;
                     req.touch := r0.req.touch;
                     req.sync := r0.req.sync;
                     req.reserve := r0.req.reserve;
@@ -1573,7 +1823,7 @@ begin
                 -- Update count of pending acks
                 acks := r1.acks_pending;
                 if r1.wb.cyc = '0' then
-                    acks := to_unsigned(0, 3);
+                    acks := to_unsigned(0, 4);
                 elsif r1.wb.stb = '1' and r1.stalled = '0' and r1.dec_acks = '0' then
                     acks := acks + 1;
                 elsif (r1.wb.stb = '0' or r1.stalled = '1') and r1.dec_acks = '1' then
@@ -1583,6 +1833,105 @@ begin
                 r1.stalled <= wishbone_in.stall and r1.wb.cyc;
                 r1.dec_acks <= wishbone_in.ack and r1.wb.cyc;
 
+                -- Put plain stores in the store queue, or merge them with
+                -- the last entry, in IDLE state or while the queue drains.
+                sq := store_queue;
+                sq_n := sq_count;
+                sq_hold := false;
+                sq_adr := addr_to_wb(req.real_addr);
+                if STORE_QUEUE and req.op_store = '1' and req.reserve = '0' and req.dcbz = '0' and
+                    (r1.state = IDLE or (r1.state = STORE_WAIT_ACK and r1.atomic_more = '0')) then
+                    if WRITE_BACK and req.is_hit = '1' then
+                        -- Store hit: just write the cache and mark the
+                        -- line dirty
+                        assert not is_X(req.real_addr) and not is_X(req.hit_way);
+                        cache_dirty(to_integer(get_index(req.real_addr)))(to_integer(req.hit_way)) <= '1';
+                    elsif sq_n /= 0 and req.nc = '0' and sq(sq_n - 1).nc = '0' and
+                        req.last_dw = '1' and sq(sq_n - 1).more = '0' and sq(sq_n - 1).adr = sq_adr then
+                        for i in 0 to wishbone_sel_bits - 1 loop
+                            if req.byte_sel(i) = '1' then
+                                sq(sq_n - 1).dat(i * 8 + 7 downto i * 8) := req.data(i * 8 + 7 downto i * 8);
+                            end if;
+                        end loop;
+                        sq(sq_n - 1).sel := sq(sq_n - 1).sel or req.byte_sel;
+                    elsif sq_n < STORE_QUEUE_SIZE then
+                        sq(sq_n) := (adr => sq_adr, dat => req.data, sel => req.byte_sel, nc => req.nc,
+                                     more => not req.last_dw);
+                        sq_n := sq_n + 1;
+                    else
+                        -- Queue full, the store waits in r1
+                        sq_hold := true;
+                    end if;
+                    if not sq_hold then
+                        r1.store_way <= req.hit_way;
+                        r1.store_ways <= req.hit_ways;
+                        r1.store_row <= get_row(req.real_addr);
+                        r1.write_bram <= req.is_hit;
+                        r1.full <= '0';
+                        r1.slow_valid <= '1';
+                        -- Store requests never come from the MMU
+                        r1.ls_valid <= '1';
+                        ev.store_miss <= not req.is_hit;
+                    end if;
+                end if;
+
+                -- Requests that have to wait for the queue to drain
+                sq_match := false;
+                for i in 0 to STORE_QUEUE_SIZE - 1 loop
+                    if i < sq_n and sq(i).adr(wishbone_addr_bits - 1 downto ROW_LINEBITS) =
+                        sq_adr(wishbone_addr_bits - 1 downto ROW_LINEBITS) then
+                        sq_match := true;
+                    end if;
+                end loop;
+                if STORE_QUEUE and sq_n /= 0 and (req.op_sync = '1' or
+                                                  (req.op_store = '1' and (req.reserve = '1' or req.dcbz = '1')) or
+                                                  (req.op_lmiss = '1' and (req.nc = '1' or sq_match))) then
+                    sq_hold := true;
+                end if;
+
+                -- See whether the line the prefetcher wants can be fetched.
+                -- Drop it if it is present or on its way, if there is a
+                -- store to it in the queue, or if the victim is dirty.
+                -- Wait while the request in r0 or r1 is for the same set,
+                -- since it may hit the victim.
+                pf_ok := false;
+                pf_start := false;
+                if PREFETCH and pf_valid = '1' and pf_addr /= r1.pf_last then
+                    pf_idx := get_index(pf_addr);
+                    pf_tag := get_tag(pf_addr);
+                    pf_adr := addr_to_wb(pf_addr & (LINE_OFF_BITS - 1 downto 0 => '0'));
+                    pf_way := r1.pf_victim;
+                    pf_ok := true;
+                    for i in NUM_WAYS - 1 downto 0 loop
+                        if cache_valids(to_integer(pf_idx))(i) = '0' then
+                            pf_way := to_unsigned(i, WAY_BITS);
+                        elsif read_tag(i, cache_tags(to_integer(pf_idx))) = pf_tag then
+                            pf_ok := false;
+                        end if;
+                    end loop;
+                    if (r1.reloading = '1' and r1.store_index = pf_idx and r1.reload_tag = pf_tag) or
+                        (r1.mshr_valid = '1' and r1.mshr_index = pf_idx and r1.mshr_tag = pf_tag) then
+                        pf_ok := false;
+                    end if;
+                    for i in 0 to STORE_QUEUE_SIZE - 1 loop
+                        if i < sq_n and sq(i).adr(wishbone_addr_bits - 1 downto ROW_LINEBITS) =
+                            pf_adr(wishbone_addr_bits - 1 downto ROW_LINEBITS) then
+                            pf_ok := false;
+                        end if;
+                    end loop;
+                    if WRITE_BACK and cache_valids(to_integer(pf_idx))(to_integer(pf_way)) = '1' and
+                        cache_dirty(to_integer(pf_idx))(to_integer(pf_way)) = '1' then
+                        pf_ok := false;
+                    end if;
+                    if not pf_ok then
+                        r1.pf_last <= pf_addr;
+                    end if;
+                    if (r0_full = '1' and req_index = pf_idx) or
+                        (req.valid = '1' and get_index(req.real_addr) = pf_idx) then
+                        pf_ok := false;
+                    end if;
+                end if;
+
 		-- Main state machine
 		case r1.state is
                 when IDLE =>
@@ -1597,6 +1946,7 @@ begin
                     r1.store_row <= get_row(req.real_addr);
                     r1.end_row_ix <= get_row_of_line(get_row(req.real_addr)) - 1;
                     r1.reload_tag <= get_tag(req.real_addr);
+                    r1.reload_pf <= '0';
                     r1.req.hit_reload <= '1';
                     r1.ls_tlb_hit <= req.tlb_hit and not req.mmu_req;
                     r1.tlb_acc_index <= req.tlb_index;
@@ -1612,7 +1962,7 @@ begin
                         r1.rows_valid(i) <= '0';
                     end loop;
 
-                    if req.op_lmiss = '1' then
+                    if req.op_lmiss = '1' and not sq_hold then
 			-- Normal load cache miss, start the reload machine
 			-- Or non-cacheable load
                         if req.nc = '0' then
@@ -1621,23 +1971,29 @@ begin
                                 " tag:" & to_hstring(get_tag(req.real_addr));
                         end if;
 
-			-- Start the wishbone cycle
-			r1.wb.we  <= '0';
-			r1.wb.cyc <= '1';
-			r1.wb.stb <= '1';
-
-                        if req.nc = '0' then
-                            -- Track that we had one request sent
-                            r1.state <= RELOAD_WAIT_ACK;
-                            r1.reloading <= '1';
-                            r1.write_tag <= '1';
+                        if req.nc = '0' and WRITE_BACK then
+                            -- The victim may have to be written back first
+                            r1.state <= VICTIM_CHECK;
                             ev.load_miss <= '1';
                         else
-                            r1.state <= NC_LOAD_WAIT_ACK;
+                            -- Start the wishbone cycle
+                            r1.wb.we  <= '0';
+                            r1.wb.cyc <= '1';
+                            r1.wb.stb <= '1';
+
+                            if req.nc = '0' then
+                                -- Track that we had one request sent
+                                r1.state <= RELOAD_WAIT_ACK;
+                                r1.reloading <= '1';
+                                r1.write_tag <= '1';
+                                ev.load_miss <= '1';
+                            else
+                                r1.state <= NC_LOAD_WAIT_ACK;
+                            end if;
                         end if;
                     end if;
 
-                    if req.op_store = '1' then
+                    if req.op_store = '1' and not sq_hold then
                         if req.reserve = '1' then
                             if reservation.valid = '0' or kill_rsrv = '1' then
                                 -- someone else has stored to the reservation granule
@@ -1652,18 +2008,40 @@ begin
                                 r1.state <= DO_STCX;
                             end if;
                         elsif req.dcbz = '0' then
-                            r1.state <= STORE_WAIT_ACK;
-                            r1.full <= '0';
-                            r1.slow_valid <= '1';
-                            if req.mmu_req = '0' then
-                                r1.ls_valid <= '1';
+                            if STORE_QUEUE then
+                                -- Done above, via the store queue
+                                null;
+                            elsif WRITE_BACK and req.is_hit = '1' then
+                                -- Store hit: just write the cache and mark
+                                -- the line dirty
+                                r1.full <= '0';
+                                r1.slow_valid <= '1';
+                                if req.mmu_req = '0' then
+                                    r1.ls_valid <= '1';
+                                else
+                                    r1.mmu_done <= '1';
+                                end if;
+                                r1.write_bram <= '1';
+                                assert not is_X(req.real_addr) and not is_X(req.hit_way);
+                                cache_dirty(to_integer(get_index(req.real_addr)))(to_integer(req.hit_way)) <= '1';
                             else
-                                r1.mmu_done <= '1';
+                                r1.state <= STORE_WAIT_ACK;
+                                r1.full <= '0';
+                                r1.slow_valid <= '1';
+                                if req.mmu_req = '0' then
+                                    r1.ls_valid <= '1';
+                                else
+                                    r1.mmu_done <= '1';
+                                end if;
+                                r1.write_bram <= req.is_hit;
+                                r1.wb.we <= '1';
+                                r1.wb.cyc <= '1';
+                                r1.wb.stb <= '1';
                             end if;
-                            r1.write_bram <= req.is_hit;
-                            r1.wb.we <= '1';
-                            r1.wb.cyc <= '1';
-                            r1.wb.stb <= '1';
+                        elsif WRITE_BACK and req.nc = '0' and req.is_hit = '0' then
+                            -- dcbz miss; the victim may have to be written
+                            -- back first
+                            r1.state <= VICTIM_CHECK;
                         else
                             -- dcbz is handled much like a load miss except
                             -- that we are writing to memory instead of reading
@@ -1679,23 +2057,84 @@ begin
 
                     if req.op_flush = '1' then
                         r1.state <= FLUSH_CYCLE;
+                        if WRITE_BACK then
+                            -- (flush requests only get here on a hit)
+                            assert not is_X(req.real_addr) and not is_X(req.hit_way);
+                            if cache_dirty(to_integer(get_index(req.real_addr)))(to_integer(req.hit_way)) = '1' then
+                                -- Write the line back, then go to FLUSH_CYCLE
+                                r1.wb.adr <= addr_to_wb(req.real_addr(REAL_ADDR_BITS - 1 downto LINE_OFF_BITS) &
+                                                        (LINE_OFF_BITS - 1 downto 0 => '0'));
+                                r1.wb.sel <= (others => '1');
+                                r1.wb.we <= '1';
+                                r1.wb.cyc <= '1';
+                                r1.wl_way <= req.hit_way;
+                                r1.wl_row <= to_unsigned(0, ROW_LINEBITS);
+                                r1.wl_rd_done <= '0';
+                                r1.wl_data_ok <= '0';
+                                r1.state <= WRITE_LINE;
+                            end if;
+                        end if;
                     end if;
 
-                    if req.op_sync = '1' then
+                    if req.op_sync = '1' and not sq_hold then
                         -- sync/lwsync can complete now that the state machine
-                        -- is idle.
+                        -- is idle and the store queue is empty.
                         r1.full <= '0';
                         r1.slow_valid <= '1';
                         r1.ls_valid <= '1';
                     end if;
 
+                    -- Start draining the store queue if nothing else
+                    -- needs the wishbone or a change of state.  The two
+                    -- halves of a stq go out in one cycle, so don't start
+                    -- on the first until the second is in the queue.
+                    if STORE_QUEUE and sq_n /= 0 and (sq_n > 1 or sq(0).more = '0') and
+                        (sq_hold or (req.op_lmiss = '0' and req.op_flush = '0' and
+                                     (req.op_store = '0' or (req.reserve = '0' and req.dcbz = '0')))) then
+                        r1.wb.adr <= sq(0).adr;
+                        r1.wb.dat <= sq(0).dat;
+                        r1.wb.sel <= sq(0).sel;
+                        r1.sq_more <= sq(0).more;
+                        r1.atomic_more <= '0';
+                        r1.wb.we <= '1';
+                        r1.wb.cyc <= '1';
+                        r1.wb.stb <= '1';
+                        sq(0 to STORE_QUEUE_SIZE - 2) := sq(1 to STORE_QUEUE_SIZE - 1);
+                        sq_n := sq_n - 1;
+                        r1.state <= STORE_WAIT_ACK;
+                    end if;
+
+                    -- Otherwise reload a line for the prefetcher
+                    if pf_ok and r1.full = '0' and sq_n = 0 and req.op_lmiss = '0' and
+                        req.op_store = '0' and req.op_flush = '0' and req.op_sync = '0' then
+                        r1.wb.adr <= pf_adr;
+                        r1.wb.sel <= (others => '1');
+                        r1.wb.we <= '0';
+                        r1.wb.cyc <= '1';
+                        r1.wb.stb <= '1';
+                        r1.store_index <= pf_idx;
+                        r1.store_row <= pf_idx & to_unsigned(0, ROW_LINEBITS);
+                        r1.end_row_ix <= to_unsigned(ROW_PER_LINE - 1, ROW_LINEBITS);
+                        r1.reload_tag <= pf_tag;
+                        r1.reload_pf <= '1';
+                        r1.store_way <= pf_way;
+                        r1.store_ways <= (others => '0');
+                        r1.store_ways(to_integer(pf_way)) <= '1';
+                        r1.reloading <= '1';
+                        r1.state <= RELOAD_WAIT_ACK;
+                        pf_start := true;
+                    end if;
+
                 when RELOAD_WAIT_ACK =>
 		    -- If we are still sending requests, was one accepted ?
                     if wishbone_in.stall = '0' and r1.wb.stb = '1' then
 			-- That was the last word ? We are done sending. Clear stb.
                         assert not is_X(r1.wb.adr);
                         assert not is_X(r1.end_row_ix);
-			if is_last_row_wb_addr(r1.wb.adr, r1.end_row_ix) then
+                        -- (requests for a second refill go out after all
+                        -- those for the first)
+			if (r1.mshr_valid = '0' and is_last_row_wb_addr(r1.wb.adr, r1.end_row_ix)) or
+                            (r1.mshr_valid = '1' and is_last_row_wb_addr(r1.wb.adr, r1.mshr_end_row_ix)) then
 			    r1.wb.stb <= '0';
 			end if;
 
@@ -1710,6 +2149,70 @@ begin
                         r1.ls_valid <= '1';
                     end if;
 
+                    -- Once all the requests for this line have gone out, a
+                    -- load miss waiting in r1 for a line in another set can
+                    -- request its line too, on the same wishbone cycle.
+                    -- It gets the cache tag now, and becomes the line being
+                    -- reloaded when this one is complete.  The victim was
+                    -- chosen while the miss was in r1.
+                    victim := to_unsigned(0, WAY_BITS);
+                    if NUM_WAYS > 1 then
+                        if r1.choose_victim = '1' then
+                            victim := plru_victim;
+                        else
+                            victim := r1.victim_way;
+                        end if;
+                    end if;
+                    if SECOND_REFILL and r1.full = '1' and r1.mshr_valid = '0' and r1.dcbz = '0' and r1.wb.stb = '0' and
+                        req.op_lmiss = '1' and req.nc = '0' and req.hit_reload = '0' and
+                        req.reserve = '0' and req.last_dw = '1' and not sq_hold and
+                        get_index(req.real_addr) /= r1.store_index and
+                        (not WRITE_BACK or
+                         cache_dirty(to_integer(get_index(req.real_addr)))(to_integer(victim)) = '0') then
+                        r1.wb.adr <= addr_to_wb(req.real_addr);
+                        r1.wb.sel <= req.byte_sel;
+                        r1.wb.stb <= '1';
+                        r1.mshr_valid <= '1';
+                        r1.mshr_index <= get_index(req.real_addr);
+                        r1.mshr_tag <= get_tag(req.real_addr);
+                        r1.mshr_way <= victim;
+                        r1.mshr_row <= get_row(req.real_addr);
+                        r1.mshr_end_row_ix <= get_row_of_line(get_row(req.real_addr)) - 1;
+                        r1.mshr_pf <= '0';
+                        for i in 0 to NUM_WAYS-1 loop
+                            if to_unsigned(i, WAY_BITS) = victim then
+                                cache_tags(to_integer(get_index(req.real_addr)))((i + 1) * TAG_WIDTH - 1 downto i * TAG_WIDTH) <=
+                                    (TAG_WIDTH - 1 downto TAG_BITS => '0') & get_tag(req.real_addr);
+                            end if;
+                        end loop;
+                        if cache_valids(to_integer(get_index(req.real_addr)))(to_integer(victim)) = '1' and
+                            cache_pf(to_integer(get_index(req.real_addr)))(to_integer(victim)) = '1' then
+                            ev.prefetch_useless <= '1';
+                        end if;
+                        cache_valids(to_integer(get_index(req.real_addr)))(to_integer(victim)) <= '1';
+                        cache_dirty(to_integer(get_index(req.real_addr)))(to_integer(victim)) <= '0';
+                        cache_pf(to_integer(get_index(req.real_addr)))(to_integer(victim)) <= '0';
+                        ev.load_miss <= '1';
+                        -- Complete when its data arrives, as for a miss on
+                        -- the line being reloaded (or next cycle for a dcbt,
+                        -- by which time r0 sees the new tag)
+                        r1.req.hit_reload <= '1';
+                    elsif pf_ok and req.op_lmiss = '0' and r1.mshr_valid = '0' and r1.dcbz = '0' and
+                        r1.wb.stb = '0' and pf_idx /= r1.store_index then
+                        -- Or a line for the prefetcher, if no miss wants it
+                        r1.wb.adr <= pf_adr;
+                        r1.wb.sel <= (others => '1');
+                        r1.wb.stb <= '1';
+                        r1.mshr_valid <= '1';
+                        r1.mshr_index <= pf_idx;
+                        r1.mshr_tag <= pf_tag;
+                        r1.mshr_way <= pf_way;
+                        r1.mshr_row <= pf_idx & to_unsigned(0, ROW_LINEBITS);
+                        r1.mshr_end_row_ix <= to_unsigned(ROW_PER_LINE - 1, ROW_LINEBITS);
+                        r1.mshr_pf <= '1';
+                        pf_start := true;
+                    end if;
+
 		    -- Incoming acks processing
 		    if wishbone_in.ack = '1' then
                         r1.rows_valid(to_integer(r1.store_row(ROW_LINEBITS-1 downto 0))) <= '1';
@@ -1725,9 +2228,13 @@ begin
                         end if;
                         -- r1.req.hit_reload is always 1 for the request that
                         -- started this reload, and otherwise always 0 for dcbz
-                        -- (since it is considered a store).
+                        -- (since it is considered a store).  With a second
+                        -- refill slot, it can also be waiting for the line
+                        -- after this one, so the set has to match as well.
 			if req.hit_reload = '1' and
-                            get_row_of_line(r1.store_row) = get_row_of_line(get_row(req.real_addr)) then
+                            ((not HAS_MSHR and
+                              get_row_of_line(r1.store_row) = get_row_of_line(get_row(req.real_addr))) or
+                             (HAS_MSHR and r1.store_row = get_row(req.real_addr))) then
                             r1.full <= '0';
                             r1.slow_valid <= '1';
                             if req.mmu_req = '0' then
@@ -1753,57 +2260,99 @@ begin
                             assert not is_X(r1.store_way);
                             r1.reloading <= '0';
 
-                            ev.dcache_refill <= not r1.dcbz;
+                            ev.dcache_refill <= not r1.dcbz and not r1.reload_pf;
                             -- Second half of a lq/lqarx can assume a hit on this line now
-                            -- if the first half hit this line.
-                            r1.prev_hit <= r1.prev_hit_reload;
-                            r1.prev_way <= r1.store_way;
-                            r1.prev_hit_ways <= r1.store_ways;
+                            -- if the first half hit this line.  (Requests carry on during
+                            -- a prefetch, so the last one may have been for another line.)
+                            if r1.reload_pf = '0' then
+                                r1.prev_hit <= r1.prev_hit_reload;
+                                r1.prev_way <= r1.store_way;
+                                r1.prev_hit_ways <= r1.store_ways;
+                            end if;
                             r1.state <= IDLE;
 			end if;
 
 			-- Increment store row counter
 			r1.store_row <= next_row(r1.store_row);
+
+                        -- Move on to the second refill, if there is one
+                        if is_last_row(r1.store_row, r1.end_row_ix) and r1.mshr_valid = '1' then
+                            r1.wb.cyc <= '1';
+                            r1.reloading <= '1';
+                            r1.state <= RELOAD_WAIT_ACK;
+                            r1.mshr_valid <= '0';
+                            r1.store_index <= r1.mshr_index;
+                            r1.store_row <= r1.mshr_row;
+                            r1.end_row_ix <= r1.mshr_end_row_ix;
+                            r1.reload_tag <= r1.mshr_tag;
+                            r1.reload_pf <= r1.mshr_pf;
+                            r1.store_way <= r1.mshr_way;
+                            r1.store_ways <= (others => '0');
+                            r1.store_ways(to_integer(r1.mshr_way)) <= '1';
+                            for i in 0 to ROW_PER_LINE - 1 loop
+                                r1.rows_valid(i) <= '0';
+                            end loop;
+                        end if;
 		    end if;
 
                 when STORE_WAIT_ACK =>
 		    stbs_done := r1.wb.stb = '0';
 		    -- Clear stb when slave accepted request
                     if wishbone_in.stall = '0' then
-                        -- See if there is another store waiting to be done
-                        -- which is in the same real page.
-                        -- This could be either in r1.req or in r0.
-                        -- Ignore store-conditionals, they have to go through
-                        -- DO_STCX state, unless they are the second half of a
-                        -- successful stqcx, which is handled here.
-                        if req.valid = '1' then
-                            r1.wb.adr(TLB_LG_PGSZ - ROW_OFF_BITS - 1 downto 0) <=
-                                req.real_addr(TLB_LG_PGSZ - 1 downto ROW_OFF_BITS);
-                            r1.wb.dat <= req.data;
-                            r1.wb.sel <= req.byte_sel;
-                        end if;
                         assert not is_X(acks);
                         r1.wb.stb <= '0';
-                        if req.op_store = '1' and req.same_page = '1' and req.dcbz = '0' and
-                            (req.reserve = '0' or r1.atomic_more = '1') then
+                        if r1.atomic_more = '1' or not STORE_QUEUE then
+                            -- Without the store queue, see if there is
+                            -- another store waiting to be done which is in
+                            -- the same real page.  The second half of a
+                            -- successful stqcx. is always added on to the
+                            -- cycle here, without going through DO_STCX
+                            -- state.  It could be either in r1.req or in r0.
+                            if req.valid = '1' then
+                                r1.wb.adr(TLB_LG_PGSZ - ROW_OFF_BITS - 1 downto 0) <=
+                                    req.real_addr(TLB_LG_PGSZ - 1 downto ROW_OFF_BITS);
+                                r1.wb.dat <= req.data;
+                                r1.wb.sel <= req.byte_sel;
+                            end if;
+                            if req.op_store = '1' and req.same_page = '1' and req.dcbz = '0' and
+                                (req.reserve = '0' or r1.atomic_more = '1') then
+                                if acks < 7 then
+                                    r1.wb.stb <= '1';
+                                    stbs_done := false;
+                                    r1.store_way <= req.hit_way;
+                                    r1.store_ways <= req.hit_ways;
+                                    r1.store_row <= get_row(req.real_addr);
+                                    r1.write_bram <= req.is_hit;
+                                    r1.atomic_more <= not req.last_dw;
+                                    r1.full <= '0';
+                                    r1.slow_valid <= '1';
+                                    -- Store requests never come from the MMU
+                                    r1.ls_valid <= '1';
+                                end if;
+                            else
+                                stbs_done := true;
+                                if req.valid = '1' then
+                                    r1.atomic_more <= '0';
+                                end if;
+                            end if;
+                        elsif sq_n /= 0 and (sq_n > 1 or sq(0).more = '0') and
+                            (r1.sq_more = '1' or not ((req.op_lmiss = '1' and not sq_hold) or
+                                                      req.op_flush = '1')) then
+                            -- Send the next store from the queue, unless
+                            -- a load miss or flush can go ahead of it
+                            -- (but not between the halves of a stq)
+                            stbs_done := false;
                             if acks < 7 then
+                                r1.wb.adr <= sq(0).adr;
+                                r1.wb.dat <= sq(0).dat;
+                                r1.wb.sel <= sq(0).sel;
+                                r1.sq_more <= sq(0).more;
                                 r1.wb.stb <= '1';
-                                stbs_done := false;
-                                r1.store_way <= req.hit_way;
-                                r1.store_ways <= req.hit_ways;
-                                r1.store_row <= get_row(req.real_addr);
-                                r1.write_bram <= req.is_hit;
-                                r1.atomic_more <= not req.last_dw;
-                                r1.full <= '0';
-                                r1.slow_valid <= '1';
-                                -- Store requests never come from the MMU
-                                r1.ls_valid <= '1';
+                                sq(0 to STORE_QUEUE_SIZE - 2) := sq(1 to STORE_QUEUE_SIZE - 1);
+                                sq_n := sq_n - 1;
                             end if;
                         else
                             stbs_done := true;
-                            if req.valid = '1' then
-                                r1.atomic_more <= '0';
-                            end if;
                         end if;
 		    end if;
 
@@ -1869,12 +2418,118 @@ begin
                     end if;
 
                 when FLUSH_CYCLE =>
-                    cache_valids(to_integer(r1.store_index))(to_integer(r1.store_way)) <= '0';
+                    -- dcbst leaves the line valid
+                    if r1.req.clean = '0' then
+                        cache_valids(to_integer(r1.store_index))(to_integer(r1.store_way)) <= '0';
+                    end if;
                     r1.full <= '0';
                     r1.slow_valid <= '1';
                     r1.ls_valid <= '1';
                     r1.state <= IDLE;
+
+                when VICTIM_CHECK =>
+                    -- The victim way was chosen in this cycle, or earlier
+                    -- if the miss had to wait in r1.
+                    victim := to_unsigned(0, WAY_BITS);
+                    if NUM_WAYS > 1 then
+                        if r1.choose_victim = '1' then
+                            victim := plru_victim;
+                        else
+                            victim := r1.victim_way;
+                        end if;
+                    end if;
+                    assert not is_X(r1.store_index) and not is_X(victim);
+                    if cache_valids(to_integer(r1.store_index))(to_integer(victim)) = '1' and
+                        cache_dirty(to_integer(r1.store_index))(to_integer(victim)) = '1' then
+                        r1.wb.adr <= addr_to_wb(read_tag(to_integer(victim),
+                                                         cache_tags(to_integer(r1.store_index))) &
+                                                std_ulogic_vector(r1.store_index) &
+                                                (LINE_OFF_BITS - 1 downto 0 => '0'));
+                        r1.wb.sel <= (others => '1');
+                        r1.wb.we <= '1';
+                        r1.wb.cyc <= '1';
+                        r1.wl_way <= victim;
+                        r1.wl_row <= to_unsigned(0, ROW_LINEBITS);
+                        r1.wl_rd_done <= '0';
+                        r1.wl_data_ok <= '0';
+                        r1.state <= WRITE_LINE;
+                    else
+                        -- Start the reload (or the dcbz write), as IDLE
+                        -- does in write-through mode
+                        r1.wb.adr <= addr_to_wb(r1.req.real_addr);
+                        r1.wb.sel <= r1.req.byte_sel;
+                        r1.wb.dat <= r1.req.data;
+                        r1.wb.we <= r1.req.dcbz;
+                        r1.wb.cyc <= '1';
+                        r1.wb.stb <= '1';
+                        r1.state <= RELOAD_WAIT_ACK;
+                        r1.reloading <= '1';
+                        r1.write_tag <= '1';
+                    end if;
+
+                when WRITE_LINE =>
+                    -- Send the row read from the cache RAM last cycle
+                    if r1.wb.stb = '0' or wishbone_in.stall = '0' then
+                        if r1.wl_data_ok = '1' then
+                            assert not is_X(r1.wl_way);
+                            r1.wb.dat <= cache_out(to_integer(r1.wl_way));
+                            r1.wb.adr(ROW_LINEBITS - 1 downto 0) <= std_ulogic_vector(r1.wl_data_row);
+                            r1.wb.stb <= '1';
+                        else
+                            r1.wb.stb <= '0';
+                        end if;
+                        r1.wl_data_ok <= wl_rd_en;
+                    end if;
+                    if wl_rd_en = '1' then
+                        r1.wl_data_row <= r1.wl_row;
+                        r1.wl_row <= r1.wl_row + 1;
+                        if r1.wl_row = ROW_PER_LINE - 1 then
+                            r1.wl_rd_done <= '1';
+                        end if;
+                    end if;
+
+                    -- Done when the last row has gone and been acked
+                    if r1.wl_rd_done = '1' and r1.wl_data_ok = '0' and
+                        (r1.wb.stb = '0' or wishbone_in.stall = '0') and
+                        (acks = 0 or (wishbone_in.ack = '1' and acks = 1)) then
+                        r1.wb.cyc <= '0';
+                        r1.wb.stb <= '0';
+                        cache_dirty(to_integer(r1.store_index))(to_integer(r1.wl_way)) <= '0';
+                        if r1.req.op_flush = '1' then
+                            r1.state <= FLUSH_CYCLE;
+                        else
+                            r1.state <= VICTIM_CHECK;
+                        end if;
+                    end if;
                 end case;
+
+                -- Allocate the line being prefetched.  The request in r0
+                -- waits a cycle in case it was looked up with the old tag.
+                if pf_start then
+                    for i in 0 to NUM_WAYS-1 loop
+                        if to_unsigned(i, WAY_BITS) = pf_way then
+                            cache_tags(to_integer(pf_idx))((i + 1) * TAG_WIDTH - 1 downto i * TAG_WIDTH) <=
+                                (TAG_WIDTH - 1 downto TAG_BITS => '0') & pf_tag;
+                        end if;
+                    end loop;
+                    if cache_valids(to_integer(pf_idx))(to_integer(pf_way)) = '1' and
+                        cache_pf(to_integer(pf_idx))(to_integer(pf_way)) = '1' then
+                        ev.prefetch_useless <= '1';
+                    end if;
+                    cache_valids(to_integer(pf_idx))(to_integer(pf_way)) <= '1';
+                    cache_dirty(to_integer(pf_idx))(to_integer(pf_way)) <= '0';
+                    cache_pf(to_integer(pf_idx))(to_integer(pf_way)) <= '1';
+                    r1.tag_hazard <= '1';
+                    r1.pf_last <= pf_addr;
+                    if r1.pf_victim = NUM_WAYS - 1 then
+                        r1.pf_victim <= to_unsigned(0, WAY_BITS);
+                    else
+                        r1.pf_victim <= r1.pf_victim + 1;
+                    end if;
+                end if;
+
+                store_queue <= sq;
+                sq_count <= sq_n;
 	    end if;
 	end if;
     end process;
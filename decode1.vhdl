@@ -3,6 +3,7 @@ use ieee.std_logic_1164.all;
 use ieee.numeric_std.all;
 
 library work;
+use work.utils.all;
 use work.common.all;
 use work.decode_types.all;
 use work.insn_helpers.all;
@@ -10,6 +11,17 @@ use work.insn_helpers.all;
 entity decode1 is
     generic (
         HAS_FPU : boolean := true;
+        -- dcbst has to write back dirty lines in a write-back dcache
+        DCACHE_WRITE_BACK : boolean := false;
+        -- Check the branches that fetch1 predicted taken from the BTC,
+        -- needed when the BTC only has partial tags
+        BTC_CHECK : boolean := false;
+        HAS_RAS : boolean := false;
+        -- fetch1 has a branch history table
+        HAS_BHT : boolean := false;
+        -- Indirect target cache for bcctr and bctar
+        HAS_ITC : boolean := false;
+        ITC_SIZE : positive := 256;
         -- Non-zero to enable log data collection
         LOG_LENGTH : natural := 0
         );
@@ -23,6 +35,7 @@ entity decode1 is
         flush_out : out std_ulogic;
 
         f_in      : in IcacheToDecode1Type;
+        w_in      : in WritebackToFetch1Type;
         f_out     : out Decode1ToFetch1Type;
         d_out     : out Decode1ToDecode2Type;
         r_out     : out Decode1ToRegisterFileType;
@@ -37,9 +50,64 @@ architecture behaviour of decode1 is
     type br_predictor_t is record
         br_target : signed(61 downto 0);
         predict   : std_ulogic;
+        check     : std_ulogic;
+        check_nia : std_ulogic_vector(61 downto 0);
     end record;
 
     signal br, br_in : br_predictor_t;
+    signal br_mismatch : std_ulogic;
+
+    -- Return address stack.  ras_top is the top of stack as seen by
+    -- decode; ras_commit is the top of stack after the calls and returns
+    -- that have completed, which ras_top is reset to on a flush.
+    constant RAS_BITS : natural := 3;
+    constant RAS_DEPTH : natural := 2 ** RAS_BITS;
+    type ras_t is array(0 to RAS_DEPTH - 1) of std_ulogic_vector(61 downto 0);
+
+    signal ras : ras_t := (others => (others => '0'));
+    signal ras_top : unsigned(RAS_BITS - 1 downto 0);
+    signal ras_commit : unsigned(RAS_BITS - 1 downto 0);
+    signal ras_push : std_ulogic;
+    signal ras_pop : std_ulogic;
+    signal ras_ret : std_ulogic_vector(61 downto 0);
+
+    -- Indirect target cache, indexed by the branch address XORed with a
+    -- path history of the addresses of recent taken branches.  Like the
+    -- return address stack, the history used by decode is set back to the
+    -- history of completed branches on a flush, so that the index used
+    -- to train an entry matches the one it was predicted from.
+    constant ITC_BITS : natural := log2(ITC_SIZE);
+    constant ITC_TAG_BITS : natural := 8;
+    constant ITC_TAG_LSB : natural := ITC_BITS + 2;
+    -- Tag and target
+    subtype itc_entry_t is std_ulogic_vector(ITC_TAG_BITS + 61 downto 0);
+    type itc_t is array(0 to 2 ** ITC_BITS - 1) of itc_entry_t;
+
+    signal itc : itc_t := (others => (others => '0'));
+    attribute ram_style : string;
+    attribute ram_style of itc : signal is "distributed";
+    -- Valid bits, kept separately so they can be cleared on reset
+    signal itc_valids : std_ulogic_vector(0 to 2 ** ITC_BITS - 1) := (others => '0');
+    signal path_hist : std_ulogic_vector(ITC_BITS - 1 downto 0);
+    signal path_commit : std_ulogic_vector(ITC_BITS - 1 downto 0);
+    signal path_push : std_ulogic;
+
+    function path_update(hist: std_ulogic_vector; nia: std_ulogic_vector(63 downto 0))
+        return std_ulogic_vector is
+    begin
+        return hist(hist'left - 2 downto 0) & (nia(3 downto 2) xor nia(5 downto 4));
+    end;
+
+    function itc_index(hist: std_ulogic_vector; nia: std_ulogic_vector(63 downto 0))
+        return integer is
+        variable idx : std_ulogic_vector(ITC_BITS - 1 downto 0);
+    begin
+        idx := nia(ITC_BITS + 1 downto 2) xor hist;
+        if is_X(idx) then
+            return 0;
+        end if;
+        return to_integer(unsigned(idx));
+    end;
 
     signal decode_rom_addr : insn_code;
     signal decode : decode_rom_t;
@@ -70,6 +138,17 @@ architecture behaviour of decode1 is
     end;
     constant DVU : unit_t := divider_unit(HAS_FPU);
 
+    -- dcbst is a no-op unless the dcache can hold dirty lines, in which
+    -- case it goes to loadstore1 as a flush that doesn't invalidate.
+    function dcbst_decode(wb : boolean) return decode_rom_t is
+    begin
+        if wb then
+            return (LDST, NONE, OP_DCBST,     RA_OR_ZERO, RB,  NONE,        NONE, NONE, ADD, "000", '0', '0', '0', '0', ZERO, '0', NONE, '0', '0', '0', '0', '0', '0', NONE, '0', '0', '0', NONE);
+        else
+            return (ALU,  NONE, OP_DCBST,     NONE,       IMM, NONE,        NONE, NONE, ADD, "000", '0', '0', '0', '0', ZERO, '0', NONE, '0', '0', '0', '0', '0', '0', NONE, '0', '0', '0', NONE);
+        end if;
+    end;
+
     type decoder_rom_t is array(insn_code) of decode_rom_t;
 
     constant decode_rom : decoder_rom_t := (
@@ -130,7 +209,7 @@ architecture behaviour of decode1 is
         INSN_crxor       =>  (ALU,  NONE, OP_COMPUTE,   NONE,       IMM, NONE,        NONE, NONE, ADD, "011", '1', '1', '0', '0', ZERO, '0', NONE, '0', '0', '0', '0', '0', '0', NONE, '0', '0', '0', NONE),
         INSN_darn        =>  (ALU,  NONE, OP_DARN,      NONE,       IMM, NONE,        NONE, RT,   MSC, "011", '0', '0', '0', '0', ZERO, '0', NONE, '0', '0', '0', '0', '0', '0', NONE, '0', '0', '0', NONE),
         INSN_dcbf        =>  (LDST, NONE, OP_DCBF,      RA_OR_ZERO, RB,  NONE,        NONE, NONE, ADD, "000", '0', '0', '0', '0', ZERO, '0', NONE, '0', '0', '0', '0', '0', '0', NONE, '0', '0', '0', NONE),
-        INSN_dcbst       =>  (ALU,  NONE, OP_DCBST,     NONE,       IMM, NONE,        NONE, NONE, ADD, "000", '0', '0', '0', '0', ZERO, '0', NONE, '0', '0', '0', '0', '0', '0', NONE, '0', '0', '0', NONE),
+        INSN_dcbst       =>  dcbst_decode(DCACHE_WRITE_BACK),
         INSN_dcbt        =>  (LDST, NONE, OP_LOAD,      RA_OR_ZERO, RB,  NONE,        NONE, NONE, ADD, "000", '0', '0', '0', '0', ZERO, '0', NONE, '0', '0', '0', '0', '0', '0', NONE, '0', '0', '0', NONE),
         INSN_dcbtst      =>  (LDST, NONE, OP_STORE,     RA_OR_ZERO, RB,  NONE,        NONE, NONE, ADD, "000", '0', '0', '0', '0', ZERO, '0', NONE, '0', '0', '0', '0', '0', '0', NONE, '0', '0', '0', NONE),
         INSN_dcbz        =>  (LDST, NONE, OP_DCBZ,      RA_OR_ZERO, RB,  NONE,        NONE, NONE, ADD, "000", '0', '0', '0', '0', ZERO, '0', NONE, '0', '0', '0', '0', '0', '0', NONE, '0', '0', '0', NONE),
@@ -546,7 +625,7 @@ begin
             elsif stall_in = '0' then
                 if double = '0' then
                     r <= rin;
-                    fetch_failed <= f_in.fetch_failed;
+                    fetch_failed <= f_in.fetch_failed and not br_mismatch;
                     if f_in.valid = '1' then
                         pr <= pr_in;
                     end if;
@@ -557,6 +636,7 @@ begin
             end if;
             if rst = '1' then
                 br.predict <= '0';
+                br.check <= '0';
             else
                 br <= br_in;
             end if;
@@ -565,6 +645,73 @@ begin
 
     busy_out <= stall_in or double;
 
+    ras_sync: process(clk)
+        variable commit : unsigned(RAS_BITS - 1 downto 0);
+        variable top : unsigned(RAS_BITS - 1 downto 0);
+    begin
+        if rising_edge(clk) then
+            commit := ras_commit;
+            if w_in.ras_pop = '1' then
+                commit := commit - 1;
+            end if;
+            if w_in.ras_push = '1' then
+                commit := commit + 1;
+            end if;
+            -- bclrl pops and then pushes, replacing the top entry
+            top := ras_top;
+            if ras_pop = '1' then
+                top := top - 1;
+            end if;
+            if ras_push = '1' then
+                top := top + 1;
+                ras(to_integer(top)) <= ras_ret;
+            end if;
+            if rst = '1' then
+                ras_commit <= (others => '0');
+                ras_top <= (others => '0');
+            elsif flush_in = '1' then
+                ras_commit <= commit;
+                ras_top <= commit;
+            else
+                ras_commit <= commit;
+                ras_top <= top;
+            end if;
+        end if;
+    end process;
+
+    itc_sync: process(clk)
+        variable commit : std_ulogic_vector(ITC_BITS - 1 downto 0);
+    begin
+        if rising_edge(clk) then
+            commit := path_commit;
+            if HAS_ITC and w_in.br_indirect = '1' then
+                itc(itc_index(path_commit, w_in.br_nia)) <=
+                    w_in.br_nia(ITC_TAG_LSB + ITC_TAG_BITS - 1 downto ITC_TAG_LSB) &
+                    w_in.redirect_nia(63 downto 2);
+            end if;
+            if rst = '1' then
+                itc_valids <= (others => '0');
+            elsif HAS_ITC and w_in.br_indirect = '1' then
+                itc_valids(itc_index(path_commit, w_in.br_nia)) <= '1';
+            end if;
+            if (w_in.br_last = '1' and w_in.br_taken = '1') or w_in.br_indirect = '1' then
+                commit := path_update(commit, w_in.br_nia);
+            end if;
+            if rst = '1' then
+                path_commit <= (others => '0');
+                path_hist <= (others => '0');
+            elsif flush_in = '1' then
+                path_commit <= commit;
+                path_hist <= commit;
+            else
+                path_commit <= commit;
+                if path_push = '1' then
+                    path_hist <= path_update(path_hist, f_in.nia);
+                end if;
+            end if;
+        end if;
+    end process;
+
     decode1_rom: process(clk)
     begin
         if rising_edge(clk) then
@@ -586,6 +733,11 @@ begin
         variable pv : prefix_state_t;
         variable icode_bits : std_ulogic_vector(9 downto 0);
         variable valid_suffix : std_ulogic;
+        variable ras_ok : std_ulogic;
+        variable accept : std_ulogic;
+        variable mismatch : std_ulogic;
+        variable itc_ent : itc_entry_t;
+        variable itc_valid : std_ulogic;
     begin
         v := Decode1ToDecode2Init;
         pv := pr;
@@ -669,9 +821,34 @@ begin
                 to_hstring(f_in.insn) & " at " & to_hstring(f_in.nia);
         end if;
 
+        -- With partial BTC tags, a BTC hit in fetch1 may not be for the
+        -- branch the entry was made for.  Check that the instruction
+        -- following one that fetch1 predicted taken is at the address
+        -- it should go to, and if not, drop it and redirect there.
+        accept := f_in.valid and not flush_in and not busy_out;
+        bv.check := br.check and not flush_in;
+        bv.check_nia := br.check_nia;
+        mismatch := '0';
+        if BTC_CHECK and br.check = '1' and accept = '1' then
+            bv.check := '0';
+            if f_in.nia(63 downto 2) /= br.check_nia then
+                mismatch := '1';
+            end if;
+        end if;
+        br_mismatch <= mismatch;
+
         -- Branch predictor
-        -- Note bclr, bcctr and bctar not predicted as we have no
-        -- count cache or link stack.
+        -- Unconditional bcctr and bctar are predicted taken to the target
+        -- in the indirect target cache, if there is one and it has an entry.
+        -- Branches with LK = 1 push the address of the next instruction
+        -- on the return address stack, and an unconditional bclr with
+        -- BH = 0 (a subroutine return) pops it and is predicted taken to it.
+        ras_ok := accept and not f_in.fetch_failed and not pr.prefixed and not mismatch;
+        ras_push <= '0';
+        ras_pop <= '0';
+        ras_ret <= std_ulogic_vector(unsigned(f_in.nia(63 downto 2)) + 1);
+        itc_ent := itc(itc_index(path_hist, f_in.nia));
+        itc_valid := itc_valids(itc_index(path_hist, f_in.nia));
         br_offset := f_in.insn(25 downto 2);
         case icode is
             when INSN_brel | INSN_babs =>
@@ -681,19 +858,82 @@ begin
                 -- Predict backward relative branches as taken, others as untaken
                 v.br_pred := f_in.insn(15);
                 br_offset(23 downto 14) := (others => '1');
+                if BTC_CHECK then
+                    -- The forward target is needed to check a BTC prediction
+                    br_offset(23 downto 14) := (others => f_in.insn(15));
+                end if;
+            when INSN_bcabs =>
+                if BTC_CHECK then
+                    br_offset(23 downto 14) := (others => f_in.insn(15));
+                end if;
+            when INSN_bclr =>
+                -- BO = 1z1zz, i.e. branch always
+                if HAS_RAS and pr.prefixed = '0' and f_in.insn(25) = '1' and f_in.insn(23) = '1' and
+                    insn_bh(f_in.insn) = "00" then
+                    v.br_pred := '1';
+                    v.pred_target := ras(to_integer(ras_top)) & "00";
+                    ras_pop <= ras_ok;
+                end if;
+            when INSN_bcctr | INSN_bctar =>
+                -- BO = 1z1zz, i.e. branch always
+                if HAS_ITC and pr.prefixed = '0' and f_in.insn(25) = '1' and f_in.insn(23) = '1' and
+                    itc_valid = '1' and
+                    itc_ent(ITC_TAG_BITS + 61 downto 62) =
+                        f_in.nia(ITC_TAG_LSB + ITC_TAG_BITS - 1 downto ITC_TAG_LSB) then
+                    v.br_pred := '1';
+                    v.pred_target := itc_ent(61 downto 0) & "00";
+                end if;
             when others =>
         end case;
+        if HAS_RAS and f_in.insn(0) = '1' and
+            (icode = INSN_brel or icode = INSN_babs or icode = INSN_bcrel or icode = INSN_bcabs or
+             icode = INSN_bclr or icode = INSN_bcctr or icode = INSN_bctar) then
+            ras_push <= ras_ok;
+        end if;
         br_nia := f_in.nia(63 downto 2);
         if f_in.insn(1) = '1' then
             br_nia := (others => '0');
         end if;
         bv.br_target := signed(br_nia) + signed(br_offset);
-        if f_in.next_predicted = '1' then
+        if (HAS_RAS or HAS_ITC) and (icode = INSN_bclr or icode = INSN_bcctr or icode = INSN_bctar) then
+            bv.br_target := signed(v.pred_target(63 downto 2));
+        end if;
+        if BTC_CHECK or HAS_BHT then
+            -- With partial BTC tags, a prediction from fetch1 may be for
+            -- another instruction, so it only applies to direct branches.
+            -- A not-taken prediction only applies to conditional ones;
+            -- b and ba are always taken whatever the BHT says.
+            if icode = INSN_brel or icode = INSN_babs or icode = INSN_bcrel or icode = INSN_bcabs then
+                if f_in.next_predicted = '1' then
+                    v.br_pred := '1';
+                elsif f_in.next_pred_ntaken = '1' and (icode = INSN_bcrel or icode = INSN_bcabs) then
+                    v.br_pred := '0';
+                end if;
+            end if;
+        elsif f_in.next_predicted = '1' then
             v.br_pred := '1';
         elsif f_in.next_pred_ntaken = '1' then
             v.br_pred := '0';
         end if;
-        bv.predict := v.br_pred and f_in.valid and not flush_in and not busy_out and not f_in.next_predicted;
+        bv.predict := v.br_pred and accept and not f_in.next_predicted;
+        -- Taken branches other than bclr go into the path history
+        path_push <= '0';
+        if HAS_ITC and v.br_pred = '1' and icode /= INSN_bclr then
+            path_push <= ras_ok;
+        end if;
+        if mismatch = '1' then
+            v.valid := '0';
+            pv := pr;
+            bv.predict := '1';
+            bv.br_target := signed(br.check_nia);
+        elsif BTC_CHECK and accept = '1' and f_in.next_predicted = '1' then
+            bv.check := '1';
+            if v.br_pred = '1' then
+                bv.check_nia := std_ulogic_vector(bv.br_target);
+            else
+                bv.check_nia := std_ulogic_vector(unsigned(f_in.nia(63 downto 2)) + 1);
+            end if;
+        end if;
 
         -- Work out GPR/FPR read addresses
         -- Note that for prefixed instructions we are working this out based
@@ -613,6 +613,7 @@ begin
             v.e.update := d_in.decode.update;
             v.e.reserve := d_in.decode.reserve;
             v.e.br_pred := d_in.br_pred;
+            v.e.pred_target := d_in.pred_target;
             v.e.result_sel := d_in.decode.result;
             v.e.sub_select := d_in.decode.subresult;
             v.e.privileged := d_in.decode.privileged;
@@ -0,0 +1,226 @@
+library ieee;
+use ieee.std_logic_1164.all;
+use ieee.numeric_std.all;
+
+library work;
+use work.common.all;
+use work.decode_types.all;
+
+-- Divider with the same interface as divider.vhdl, which skips the
+-- leading quotient bits that must be zero, and then produces RADIX
+-- (2 or 4) quotient bits per cycle.
+
+entity divider_radix4 is
+    generic (
+        RADIX : natural := 4
+        );
+    port (
+        clk   : in std_logic;
+        rst   : in std_logic;
+        d_in  : in Execute1ToDividerType;
+        d_out : out DividerToExecute1Type
+        );
+end entity divider_radix4;
+
+architecture behaviour of divider_radix4 is
+    signal dend       : std_ulogic_vector(128 downto 0);
+    signal div        : unsigned(63 downto 0);
+    signal quot       : std_ulogic_vector(63 downto 0);
+    signal result     : std_ulogic_vector(63 downto 0);
+    signal sresult    : std_ulogic_vector(64 downto 0);
+    signal oresult    : std_ulogic_vector(63 downto 0);
+    signal running    : std_ulogic;
+    signal done       : std_ulogic;
+    signal neg_result : std_ulogic;
+    signal is_modulus : std_ulogic;
+    signal is_32bit   : std_ulogic;
+    signal extended   : std_ulogic;
+    signal is_signed  : std_ulogic;
+    signal overflow   : std_ulogic;
+    signal ovf32      : std_ulogic;
+    signal did_ovf    : std_ulogic;
+    signal div3       : unsigned(65 downto 0);
+    signal setup      : std_ulogic;
+    signal left       : unsigned(6 downto 0);
+    signal dend_clz   : std_ulogic_vector(63 downto 0);
+    signal div_clz    : std_ulogic_vector(63 downto 0);
+begin
+    -- Leading zero counts of the operands, available in the setup cycle
+    dend_lz: entity work.bit_counter
+        port map (
+            clk => clk,
+            rs => d_in.dividend,
+            stall => '0',
+            count_right => '0',
+            do_popcnt => '0',
+            is_32bit => '0',
+            datalen => "1000",
+            result => dend_clz
+            );
+
+    div_lz: entity work.bit_counter
+        port map (
+            clk => clk,
+            rs => d_in.divisor,
+            stall => '0',
+            count_right => '0',
+            do_popcnt => '0',
+            is_32bit => '0',
+            datalen => "1000",
+            result => div_clz
+            );
+
+    divider_0: process(clk)
+        variable skip : integer range -64 to 128;
+        variable x    : unsigned(65 downto 0);
+        variable r    : unsigned(65 downto 0);
+        variable q    : std_ulogic_vector(1 downto 0);
+    begin
+        if rising_edge(clk) then
+            done <= '0';
+            if rst = '1' or d_in.flush = '1' then
+                dend <= (others => '0');
+                div <= (others => '0');
+                quot <= (others => '0');
+                setup <= '0';
+                running <= '0';
+                left <= "0000000";
+                is_32bit <= '0';
+                overflow <= '0';
+            elsif d_in.valid = '1' then
+                if d_in.is_extended = '1'  then
+                    dend <= '0' & d_in.dividend & x"0000000000000000";
+                else
+                    dend <= '0' & x"0000000000000000" & d_in.dividend;
+                end if;
+                div <= unsigned(d_in.divisor);
+                quot <= (others => '0');
+                neg_result <= d_in.neg_result;
+                is_modulus <= d_in.is_modulus;
+                extended <= d_in.is_extended;
+                is_32bit <= d_in.is_32bit;
+                is_signed <= d_in.is_signed;
+                setup <= '1';
+                running <= '0';
+                overflow <= '0';
+                ovf32 <= '0';
+            elsif setup = '1' then
+                -- There are 65 quotient bits, of weight 2^64 down to 2^0.
+                -- Those above the difference in length between the
+                -- dividend and divisor must be zero, so skip over them
+                -- by shifting the dividend up.  A zero divisor takes the
+                -- full number of steps so that the overflow is seen.
+                if div_clz(6) = '1' then
+                    skip := 0;
+                elsif extended = '1' then
+                    skip := to_integer(unsigned(dend_clz(6 downto 0))) -
+                            to_integer(unsigned(div_clz(6 downto 0)));
+                else
+                    skip := 64 + to_integer(unsigned(dend_clz(6 downto 0))) -
+                            to_integer(unsigned(div_clz(6 downto 0)));
+                end if;
+                if skip < 0 then
+                    skip := 0;
+                elsif skip > 65 then
+                    skip := 65;
+                end if;
+                dend <= std_ulogic_vector(shift_left(unsigned(dend), skip));
+                div3 <= ('0' & div & '0') + ("00" & div);
+                left <= to_unsigned(65 - skip, 7);
+                setup <= '0';
+                if skip = 65 then
+                    done <= '1';
+                else
+                    running <= '1';
+                end if;
+            elsif running = '1' then
+                if RADIX = 2 or left(0) = '1' then
+                    -- one quotient bit; for radix 4 this evens up the count
+                    overflow <= quot(63);
+                    ovf32 <= ovf32 or quot(31);
+                    if dend(128) = '1' or unsigned(dend(127 downto 64)) >= div then
+                        dend <= std_ulogic_vector(unsigned(dend(127 downto 64)) - div) &
+                                dend(63 downto 0) & '0';
+                        quot <= quot(62 downto 0) & '1';
+                    else
+                        dend <= dend(127 downto 0) & '0';
+                        quot <= quot(62 downto 0) & '0';
+                    end if;
+                    if left = 1 then
+                        running <= '0';
+                        done <= '1';
+                    end if;
+                    left <= left - 1;
+                else
+                    -- two quotient bits, comparing the partial remainder
+                    -- with 1, 2 and 3 times the divisor in parallel
+                    overflow <= quot(63) or quot(62);
+                    ovf32 <= ovf32 or quot(31) or quot(30);
+                    x := unsigned(dend(128 downto 63));
+                    if x >= div3 then
+                        q := "11";
+                        r := x - div3;
+                    elsif x >= ('0' & div & '0') then
+                        q := "10";
+                        r := x - ('0' & div & '0');
+                    elsif x >= ("00" & div) then
+                        q := "01";
+                        r := x - ("00" & div);
+                    else
+                        q := "00";
+                        r := x;
+                    end if;
+                    dend <= std_ulogic_vector(r(63 downto 0)) & dend(62 downto 0) & "00";
+                    quot <= quot(61 downto 0) & q;
+                    if left = 2 then
+                        running <= '0';
+                        done <= '1';
+                    end if;
+                    left <= left - 2;
+                end if;
+            end if;
+        end if;
+    end process;
+
+    divider_1: process(all)
+    begin
+        if is_modulus = '1' then
+            result <= dend(128 downto 65);
+        else
+            result <= quot;
+        end if;
+        if neg_result = '1' then
+            sresult <= std_ulogic_vector(- signed('0' & result));
+        else
+            sresult <= '0' & result;
+        end if;
+        did_ovf <= '0';
+        if is_32bit = '0' then
+            did_ovf <= overflow or (is_signed and (sresult(64) xor sresult(63)));
+        elsif is_signed = '1' then
+            if ovf32 = '1' or sresult(32) /= sresult(31) then
+                did_ovf <= '1';
+            end if;
+        else
+            did_ovf <= ovf32;
+        end if;
+        if did_ovf = '1' then
+            oresult <= (others => '0');
+        elsif (is_32bit = '1') and (is_modulus = '0') then
+            -- 32-bit divisions set the top 32 bits of the result to 0
+            oresult <= x"00000000" & sresult(31 downto 0);
+        else
+            oresult <= sresult(63 downto 0);
+        end if;
+    end process;
+
+    divider_out: process(clk)
+    begin
+        if rising_edge(clk) then
+            d_out.write_reg_data <= oresult;
+            d_out.overflow <= did_ovf;
+            d_out.valid <= done;
+        end if;
+    end process;
+
+end architecture behaviour;
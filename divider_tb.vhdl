@@ -14,7 +14,10 @@ library osvvm;
 use osvvm.RandomPkg.all;
 
 entity divider_tb is
-    generic (runner_cfg : string := runner_cfg_default);
+    generic (
+        runner_cfg : string := runner_cfg_default;
+        FAST : boolean := false
+        );
 end divider_tb;
 
 architecture behave of divider_tb is
@@ -24,9 +27,28 @@ architecture behave of divider_tb is
 
     signal d1               : Execute1ToDividerType;
     signal d2               : DividerToExecute1Type;
+
+    -- Cycles to wait for a result in the early out test; the one bit
+    -- per cycle divider only skips runs of 8 zeroes, so allow for all
+    -- its steps
+    function early_cycles(fast : boolean; qlength : natural) return natural is
+    begin
+        if fast then
+            return 2 + qlength / 2;
+        else
+            return 66;
+        end if;
+    end;
 begin
-    divider_0: entity work.divider
-        port map (clk => clk, rst => rst, d_in => d1, d_out => d2);
+    slow_div: if not FAST generate
+        divider_0: entity work.divider
+            port map (clk => clk, rst => rst, d_in => d1, d_out => d2);
+    end generate;
+
+    fast_div: if FAST generate
+        divider_0: entity work.divider_radix4
+            port map (clk => clk, rst => rst, d_in => d1, d_out => d2);
+    end generate;
 
     clk_process: process
     begin
@@ -515,6 +537,39 @@ begin
                         end loop;
                     end loop;
                 end loop;
+
+            elsif run("Test early out") then
+                -- the fast divider skips quotient bits that must be zero,
+                -- so divides with a short quotient take only a few cycles
+                early_loop : for qlength in 0 to 8 loop
+                    for i in 0 to 100 loop
+                        ra := '1' & rnd.RandSlv(62) & '0';
+                        ra := std_ulogic_vector(shift_right(unsigned(ra), rnd.RandInt(0, 56)));
+                        if qlength = 0 then
+                            rb := std_ulogic_vector(unsigned(ra) + 1);
+                        else
+                            rb := std_ulogic_vector(shift_right(unsigned(ra), qlength - 1));
+                        end if;
+
+                        d1.dividend <= ra;
+                        d1.divisor <= rb;
+                        d1.valid <= '1';
+
+                        wait for clk_period;
+
+                        d1.valid <= '0';
+                        for j in 0 to early_cycles(FAST, qlength) loop
+                            wait for clk_period;
+                            if d2.valid = '1' then
+                                exit;
+                            end if;
+                        end loop;
+                        check_true(?? d2.valid, result("for valid"));
+
+                        behave_rt := std_ulogic_vector(unsigned(ra) / unsigned(rb));
+                        check_equal(d2.write_reg_data, behave_rt, result("for early out"));
+                    end loop;
+                end loop;
             end if;
         end loop;
 
@@ -59,7 +59,7 @@ begin
 
     wishbone_debug_0: entity work.wishbone_debug_master
         port map(clk => clk, rst => rst,
-                 dmi_addr => dmi_addr(1 downto 0),
+                 dmi_addr => dmi_addr(2 downto 0),
                  dmi_dout => dmi_din,
                  dmi_din => dmi_dout,
                  dmi_wr => dmi_wr,
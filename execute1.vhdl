@@ -15,6 +15,7 @@ entity execute1 is
         SIM : boolean := false;
         EX1_BYPASS : boolean := true;
         HAS_FPU : boolean := true;
+        FAST_DIVIDE : boolean := false;
         CPU_INDEX : natural;
         NCPUS : positive := 1;
         -- Non-zero to enable log data collection
@@ -122,6 +123,7 @@ architecture behaviour of execute1 is
         new_msr : std_ulogic_vector(63 downto 0);
         take_branch : std_ulogic;
         direct_branch : std_ulogic;
+        pred_indirect : std_ulogic;
         start_mul : std_ulogic;
         start_div : std_ulogic;
         start_bsort : std_ulogic;
@@ -541,7 +543,7 @@ begin
             m_out => mult_32s_to_x
             );
 
-    divider_0: if not HAS_FPU generate
+    divider_0: if not HAS_FPU and not FAST_DIVIDE generate
         div_0: entity work.divider
             port map (
                 clk => clk,
@@ -551,6 +553,16 @@ begin
                 );
     end generate;
 
+    divider_1: if not HAS_FPU and FAST_DIVIDE generate
+        div_0: entity work.divider_radix4
+            port map (
+                clk => clk,
+                rst => rst,
+                d_in => x_to_divider,
+                d_out => divider_to_x
+                );
+    end generate;
+
     bsort_0: entity work.bit_sorter
         port map (
             clk => clk,
@@ -650,8 +662,12 @@ begin
                        dc_store_miss => dc_events.store_miss,
                        dtlb_miss => dc_events.dtlb_miss,
                        dtlb_miss_resolved => dc_events.dtlb_miss_resolved,
+                       dc_pref_useful => dc_events.prefetch_useful,
+                       dc_pref_useless => dc_events.prefetch_useless,
                        icache_miss => ic_events.icache_miss,
                        itlb_miss_resolved => ic_events.itlb_miss_resolved,
+                       ipref_discard => ic_events.prefetch_discard,
+                       ipref_useful => ic_events.prefetch_useful,
                        no_instr_avail => ex1.no_instr_avail,
                        dispatch => ex1.instr_dispatch,
                        ext_interrupt => ex2.ext_interrupt,
@@ -1349,6 +1365,7 @@ begin
                 v.direct_branch := '1';
                 v.e.br_last := '1';
                 v.e.br_taken := '1';
+                v.e.ras_push := insn_lk(e_in.insn);
                 if e_in.br_pred = '0' then
                     -- should never happen
                     v.e.redirect := '1';
@@ -1372,6 +1389,7 @@ begin
                 v.direct_branch := '1';
                 v.e.br_last := '1';
                 v.e.br_taken := v.take_branch;
+                v.e.ras_push := insn_lk(e_in.insn);
                 if ex1.msr(MSR_BE) = '1' then
                     v.do_trace := '1';
                 end if;
@@ -1382,9 +1400,30 @@ begin
 		bo := insn_bo(e_in.insn);
 		bi := insn_bi(e_in.insn);
                 v.take_branch := ppc_bc_taken(bo, bi, cr_in, ramspr_odd);
-                -- Indirect branches are never predicted taken
-                v.e.redirect := v.take_branch;
+                -- Indirect branches predicted taken by decode1, from the
+                -- return address stack or the indirect target cache,
+                -- only redirect if the predicted target turns out to be wrong.
+                if e_in.br_pred = '1' then
+                    if v.take_branch = '0' then
+                        v.e.redirect := '1';
+                        v.redir_to_next := '1';
+                    elsif ramspr_result(63 downto 2) /= e_in.pred_target(63 downto 2) then
+                        v.e.redirect := '1';
+                    end if;
+                else
+                    -- Indirect branches are otherwise never predicted taken
+                    v.e.redirect := v.take_branch;
+                end if;
+                v.pred_indirect := e_in.br_pred;
                 v.e.br_taken := v.take_branch;
+                v.e.ras_push := insn_lk(e_in.insn);
+                -- bclr with BO = 1z1zz and BH = 0 is a subroutine return
+                if e_in.insn(10 downto 1) = "0000010000" and bo(4) = '1' and bo(2) = '1' and
+                    insn_bh(e_in.insn) = "00" then
+                    v.e.ras_pop := '1';
+                end if;
+                -- bcctr and bctar train the indirect target cache
+                v.e.br_indirect := v.take_branch and e_in.insn(10);
                 if ex1.msr(MSR_BE) = '1' then
                     v.do_trace := '1';
                 end if;
@@ -1836,7 +1875,7 @@ begin
             v.div_in_progress := actions.start_div;
             v.bsort_in_progress := actions.start_bsort;
             v.bperm_in_progress := actions.start_bperm;
-            v.br_mispredict := v.e.redirect and actions.direct_branch;
+            v.br_mispredict := v.e.redirect and (actions.direct_branch or actions.pred_indirect);
             v.advance_nia := actions.advance_nia;
             v.redir_to_next := actions.redir_to_next;
             exception := actions.trap;
@@ -1927,12 +1966,18 @@ begin
         if v.e.valid = '0' then
             v.e.redirect := '0';
             v.e.br_last := '0';
+            v.e.ras_push := '0';
+            v.e.ras_pop := '0';
+            v.e.br_indirect := '0';
         end if;
         if flush_in = '1' then
             v.e.valid := '0';
             v.e.interrupt := '0';
             v.e.redirect := '0';
             v.e.br_last := '0';
+            v.e.ras_push := '0';
+            v.e.ras_pop := '0';
+            v.e.br_indirect := '0';
             v.busy := '0';
             v.div_in_progress := '0';
             v.mul_in_progress := '0';
@@ -2104,6 +2149,9 @@ begin
             v.e.write_xerc_enable := '0';
             v.e.redirect := '0';
             v.e.br_last := '0';
+            v.e.ras_push := '0';
+            v.e.ras_pop := '0';
+            v.e.br_indirect := '0';
             v.taken_branch_event := '0';
             v.br_mispredict := '0';
         end if;
@@ -2287,6 +2335,45 @@ begin
     end process;
 
     sim_dump_test: if SIM generate
+        -- Performance counts since reset, dumped along with the registers
+        type sim_perf_event is (cycles, instructions, loads, stores,
+                                branches_taken, mispredicts, icache_misses,
+                                dcache_load_misses, dcache_store_misses,
+                                itlb_misses, dtlb_misses);
+        type sim_perf_counts is array(sim_perf_event) of natural;
+        signal perf : sim_perf_counts := (others => 0);
+
+        function count(n : natural; event : std_ulogic) return natural is
+        begin
+            if event = '1' and n /= natural'high then
+                return n + 1;
+            end if;
+            return n;
+        end;
+    begin
+        sim_perf: process(clk)
+            variable ev : PMUEventType;
+        begin
+            if rising_edge(clk) then
+                ev := x_to_pmu.occur;
+                if rst = '1' then
+                    perf <= (others => 0);
+                else
+                    perf(cycles) <= count(perf(cycles), '1');
+                    perf(instructions) <= count(perf(instructions), ev.instr_complete);
+                    perf(loads) <= count(perf(loads), ev.ld_complete);
+                    perf(stores) <= count(perf(stores), ev.st_complete);
+                    perf(branches_taken) <= count(perf(branches_taken), ev.br_taken_complete);
+                    perf(mispredicts) <= count(perf(mispredicts), ev.br_mispredict);
+                    perf(icache_misses) <= count(perf(icache_misses), ev.icache_miss);
+                    perf(dcache_load_misses) <= count(perf(dcache_load_misses), ev.dc_load_miss);
+                    perf(dcache_store_misses) <= count(perf(dcache_store_misses), ev.dc_store_miss);
+                    perf(itlb_misses) <= count(perf(itlb_misses), ev.itlb_miss);
+                    perf(dtlb_misses) <= count(perf(dtlb_misses), ev.dtlb_miss);
+                end if;
+            end if;
+        end process;
+
         dump_exregs: process(all)
             variable xer : std_ulogic_vector(63 downto 0);
         begin
@@ -2298,6 +2385,17 @@ begin
                 sim_dump_done <= '0';
             end if;
         end process;
+
+        -- The counts change every cycle, so report them once, as the
+        -- dump starts, rather than from dump_exregs above
+        dump_perf: process(sim_dump)
+        begin
+            if rising_edge(sim_dump) then
+                for e in sim_perf_event loop
+                    report "PERF " & sim_perf_event'image(e) & " " & integer'image(perf(e));
+                end loop;
+            end if;
+        end process;
     end generate;
 
     -- Keep GHDL synthesis happy
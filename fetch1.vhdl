@@ -11,7 +11,16 @@ entity fetch1 is
 	RESET_ADDRESS     : std_logic_vector(63 downto 0) := (others => '0');
 	ALT_RESET_ADDRESS : std_logic_vector(63 downto 0) := (others => '0');
         TLB_SIZE          : positive := 64;        -- L1 ITLB number of entries (direct mapped)
-        HAS_BTC           : boolean := true
+        HAS_BTC           : boolean := true;
+        -- Branch target cache entries, ways and width of the tags; tags
+        -- narrower than the address bits above the index are partial
+        BTC_SIZE          : positive := 1024;
+        BTC_WAYS          : positive := 1;
+        BTC_TAG_BITS      : positive := 52;
+        -- Branch history table of 2-bit counters giving the direction of
+        -- branches that hit in the BTC, indexed by the branch address
+        HAS_BHT           : boolean := false;
+        BHT_SIZE          : positive := 1024
 	);
     port(
 	clk           : in std_ulogic;
@@ -69,16 +78,29 @@ architecture behaviour of fetch1 is
     signal erat_hit : std_ulogic;
     signal erat_sel : std_ulogic;
 
-    constant BTC_ADDR_BITS : integer := 10;
-    constant BTC_TAG_BITS : integer := 62 - BTC_ADDR_BITS;
-    constant BTC_TARGET_BITS : integer := 62;
-    constant BTC_SIZE : integer := 2 ** BTC_ADDR_BITS;
-    constant BTC_WIDTH : integer := BTC_TAG_BITS + BTC_TARGET_BITS + 2;
-    type btc_mem_type is array (0 to BTC_SIZE - 1) of std_ulogic_vector(BTC_WIDTH - 1 downto 0);
-
-    signal btc_rd_addr : unsigned(BTC_ADDR_BITS - 1 downto 0);
-    signal btc_rd_data : std_ulogic_vector(BTC_WIDTH - 1 downto 0) := (others => '0');
-    signal btc_rd_valid : std_ulogic := '0';
+    -- Branch target cache.  If the tags are only partial, a hit may be
+    -- for a different instruction; decode1 then checks the predicted
+    -- target and redirects if it was wrong.
+    constant BTC_SET_BITS : natural := log2(BTC_SIZE / BTC_WAYS);
+    constant BTC_SETS : natural := 2 ** BTC_SET_BITS;
+    constant BTC_WAY_BITS : natural := log2(BTC_WAYS);
+    constant BTC_TAG_LSB : natural := BTC_SET_BITS + 2;
+    constant BTC_TARGET_BITS : natural := 62;
+    -- MSR[IR] and the partial tag
+    subtype btc_tag_t is std_ulogic_vector(BTC_TAG_BITS downto 0);
+    -- Taken bit and the target
+    subtype btc_target_t is std_ulogic_vector(BTC_TARGET_BITS downto 0);
+    subtype btc_way_t is integer range 0 to BTC_WAYS - 1;
+
+    signal btc_rd_addr : unsigned(BTC_SET_BITS - 1 downto 0);
+    signal btc_hit : std_ulogic := '0';
+    signal btc_taken : std_ulogic := '0';
+    signal btc_target : std_ulogic_vector(BTC_TARGET_BITS - 1 downto 0) := (others => '0');
+
+    constant BHT_BITS : natural := log2(BHT_SIZE);
+
+    signal bht_rd_addr : unsigned(BHT_BITS - 1 downto 0);
+    signal bht_rd_data : std_ulogic_vector(1 downto 0) := "00";
 
     -- L1 ITLB.
     constant TLB_BITS : natural := log2(TLB_SIZE);
@@ -102,6 +124,23 @@ architecture behaviour of fetch1 is
     signal itlb_pte : tlb_pte_t;
     signal itlb_hit : std_ulogic;
 
+    function btc_tag(addr: std_ulogic_vector(63 downto 0); virt_mode: std_ulogic) return btc_tag_t is
+    begin
+        return virt_mode & addr(BTC_TAG_LSB + BTC_TAG_BITS - 1 downto BTC_TAG_LSB);
+    end;
+
+    -- With more than one way, the tags are also read at the write address
+    -- to find the way a branch is already in, so they have to be in
+    -- distributed RAM.  With one way they can go in block RAM.
+    function btc_tag_ram_style(ways: positive) return string is
+    begin
+        if ways = 1 then
+            return "block";
+        else
+            return "distributed";
+        end if;
+    end;
+
     -- Simple hash for direct-mapped TLB index
     function hash_ea(addr: std_ulogic_vector(63 downto 0)) return std_ulogic_vector is
         variable hash : std_ulogic_vector(TLB_BITS - 1 downto 0);
@@ -147,46 +186,222 @@ begin
     log_out <= log_nia;
 
     btc : if HAS_BTC generate
-        signal btc_memory : btc_mem_type;
-        attribute ram_style : string;
-        attribute ram_style of btc_memory : signal is "block";
+        type btc_tags_t is array(0 to BTC_SETS - 1) of btc_tag_t;
+        type btc_targets_t is array(0 to BTC_SETS - 1) of btc_target_t;
+        type btc_way_tags_t is array(btc_way_t) of btc_tag_t;
+        type btc_way_targets_t is array(btc_way_t) of btc_target_t;
+        type btc_valids_t is array(btc_way_t) of std_ulogic_vector(BTC_SETS - 1 downto 0);
+
+        signal btc_valids : btc_valids_t;
 
-        signal btc_valids : std_ulogic_vector(BTC_SIZE - 1 downto 0);
-        -- attribute ram_style of btc_valids : signal is "distributed";
+        -- Values read from the ways for the BTC lookup
+        signal btc_rd_tags : btc_way_tags_t;
+        signal btc_rd_targets : btc_way_targets_t;
+        signal btc_rd_valids : std_ulogic_vector(BTC_WAYS - 1 downto 0);
 
         signal btc_wr : std_ulogic;
-        signal btc_wr_data : std_ulogic_vector(BTC_WIDTH - 1 downto 0);
-        signal btc_wr_addr : std_ulogic_vector(BTC_ADDR_BITS - 1 downto 0);
+        signal btc_wr_set : std_ulogic_vector(BTC_SET_BITS - 1 downto 0);
+        signal btc_wr_tag : btc_tag_t;
+        signal btc_wr_target : btc_target_t;
+        signal btc_wr_hits : std_ulogic_vector(BTC_WAYS - 1 downto 0);
+        signal btc_wr_way : btc_way_t;
+        signal btc_victim : btc_way_t;
     begin
-        btc_wr_data <= w_in.br_taken &
-                       r.virt_mode &
-                       w_in.br_nia(63 downto BTC_ADDR_BITS + 2) &
-                       w_in.redirect_nia(63 downto 2);
-        btc_wr_addr <= w_in.br_nia(BTC_ADDR_BITS + 1 downto 2);
-        btc_wr <= w_in.br_last;
-
-        btc_ram : process(clk)
-            variable raddr : unsigned(BTC_ADDR_BITS - 1 downto 0);
+        assert BTC_TAG_LSB + BTC_TAG_BITS <= 64 report "BTC_TAG_BITS too large" severity failure;
+
+        btc_wr_set <= w_in.br_nia(BTC_SET_BITS + 1 downto 2);
+        btc_wr_tag <= btc_tag(w_in.br_nia, r.virt_mode);
+        btc_wr_target <= w_in.br_taken & w_in.redirect_nia(63 downto 2);
+        -- With a BHT, the BTC only needs to supply targets, so keep the
+        -- target of a taken branch when it later falls through.
+        btc_wr <= w_in.br_last and w_in.br_taken when HAS_BHT else w_in.br_last;
+
+        btc_ways : for i in btc_way_t generate
+            signal btc_tags : btc_tags_t;
+            signal btc_targets : btc_targets_t;
+            attribute ram_style : string;
+            attribute ram_style of btc_tags : signal is btc_tag_ram_style(BTC_WAYS);
+            attribute ram_style of btc_targets : signal is "block";
         begin
-            if rising_edge(clk) then
-                if advance_nia = '1' then
-		    if is_X(btc_rd_addr) then
-			btc_rd_data <= (others => 'X');
-			btc_rd_valid <= 'X';
-		    else
-			btc_rd_data <= btc_memory(to_integer(btc_rd_addr));
-			btc_rd_valid <= btc_valids(to_integer(btc_rd_addr));
-		    end if;
-                end if;
-                if btc_wr = '1' then
-		    assert not is_X(btc_wr_addr) report "Writing to unknown address" severity FAILURE;
-                    btc_memory(to_integer(unsigned(btc_wr_addr))) <= btc_wr_data;
+            btc_wr_lookup : if BTC_WAYS > 1 generate
+                process(all)
+                    variable idx : integer;
+                begin
+                    btc_wr_hits(i) <= '0';
+                    if is_X(btc_wr_set) then
+                        btc_wr_hits(i) <= 'X';
+                    else
+                        idx := to_integer(unsigned(btc_wr_set));
+                        if btc_valids(i)(idx) = '1' and btc_tags(idx) = btc_wr_tag then
+                            btc_wr_hits(i) <= '1';
+                        end if;
+                    end if;
+                end process;
+            end generate;
+
+            btc_no_wr_lookup : if BTC_WAYS = 1 generate
+                btc_wr_hits(i) <= '0';
+            end generate;
+
+            btc_ram : process(clk)
+            begin
+                if rising_edge(clk) then
+                    if advance_nia = '1' then
+                        if is_X(btc_rd_addr) then
+                            btc_rd_tags(i) <= (others => 'X');
+                            btc_rd_targets(i) <= (others => 'X');
+                            btc_rd_valids(i) <= 'X';
+                        else
+                            btc_rd_tags(i) <= btc_tags(to_integer(btc_rd_addr));
+                            btc_rd_targets(i) <= btc_targets(to_integer(btc_rd_addr));
+                            btc_rd_valids(i) <= btc_valids(i)(to_integer(btc_rd_addr));
+                        end if;
+                    end if;
+                    if btc_wr = '1' and btc_wr_way = i then
+                        assert not is_X(btc_wr_set) report "Writing to unknown address" severity FAILURE;
+                        btc_tags(to_integer(unsigned(btc_wr_set))) <= btc_wr_tag;
+                        btc_targets(to_integer(unsigned(btc_wr_set))) <= btc_wr_target;
+                    end if;
                 end if;
+            end process;
+        end generate;
+
+        btc_valid_update : process(clk)
+        begin
+            if rising_edge(clk) then
                 if inval_btc = '1' or rst = '1' then
-                    btc_valids <= (others => '0');
+                    btc_valids <= (others => (others => '0'));
                 elsif btc_wr = '1' then
-		    assert not is_X(btc_wr_addr) report "Writing to unknown address" severity FAILURE;
-                    btc_valids(to_integer(unsigned(btc_wr_addr))) <= '1';
+                    assert not is_X(btc_wr_set) report "Writing to unknown address" severity FAILURE;
+                    btc_valids(btc_wr_way)(to_integer(unsigned(btc_wr_set))) <= '1';
+                end if;
+            end if;
+        end process;
+
+        -- Write the way the branch is already in, otherwise the PLRU victim
+        btc_way_sel : process(all)
+        begin
+            btc_wr_way <= btc_victim;
+            for i in btc_way_t loop
+                if btc_wr_hits(i) = '1' then
+                    btc_wr_way <= i;
+                end if;
+            end loop;
+        end process;
+
+        btc_plrus : if BTC_WAYS > 1 generate
+            type plru_array is array(0 to BTC_SETS - 1) of std_ulogic_vector(BTC_WAYS - 2 downto 0);
+            signal plru_ram    : plru_array;
+            signal plru_cur    : std_ulogic_vector(BTC_WAYS - 2 downto 0);
+            signal plru_upd    : std_ulogic_vector(BTC_WAYS - 2 downto 0);
+            signal plru_acc    : std_ulogic_vector(BTC_WAY_BITS - 1 downto 0);
+            signal plru_out    : std_ulogic_vector(BTC_WAY_BITS - 1 downto 0);
+        begin
+            plru : entity work.plrufn
+                generic map (
+                    BITS => BTC_WAY_BITS
+                    )
+                port map (
+                    acc => plru_acc,
+                    tree_in => plru_cur,
+                    tree_out => plru_upd,
+                    lru => plru_out
+                    );
+
+            process(all)
+            begin
+                if is_X(btc_wr_set) then
+                    plru_cur <= (others => 'X');
+                else
+                    plru_cur <= plru_ram(to_integer(unsigned(btc_wr_set)));
+                end if;
+                plru_acc <= std_ulogic_vector(to_unsigned(btc_wr_way, BTC_WAY_BITS));
+                btc_victim <= to_integer(unsigned(plru_out));
+            end process;
+
+            -- The PLRU is updated when branches are written, i.e. as they complete
+            process(clk)
+            begin
+                if rising_edge(clk) then
+                    if btc_wr = '1' then
+                        assert not is_X(btc_wr_set) severity failure;
+                        plru_ram(to_integer(unsigned(btc_wr_set))) <= plru_upd;
+                    end if;
+                end if;
+            end process;
+        end generate;
+
+        btc_no_plru : if BTC_WAYS = 1 generate
+            btc_victim <= 0;
+        end generate;
+
+        -- Look for the address that was used to read the BTC in all ways
+        btc_lookup : process(all)
+            variable tag : btc_tag_t;
+        begin
+            tag := btc_tag(r_int.next_nia, r.virt_mode);
+            btc_hit <= '0';
+            btc_taken <= '0';
+            btc_target <= (others => '0');
+            for i in btc_way_t loop
+                if btc_rd_valids(i) = '1' and btc_rd_tags(i) = tag then
+                    btc_hit <= '1';
+                    btc_taken <= btc_rd_targets(i)(BTC_TARGET_BITS);
+                    btc_target <= btc_rd_targets(i)(BTC_TARGET_BITS - 1 downto 0);
+                end if;
+            end loop;
+        end process;
+    end generate;
+
+    bht : if HAS_BHT generate
+        type bht_mem_type is array(0 to BHT_SIZE - 1) of std_ulogic_vector(1 downto 0);
+        -- Start out weakly not taken
+        signal bht_memory : bht_mem_type := (others => "01");
+        attribute ram_style : string;
+        attribute ram_style of bht_memory : signal is "distributed";
+
+        signal bht_wr_addr : std_ulogic_vector(BHT_BITS - 1 downto 0);
+
+        -- After reset, the counters are set back to weakly not taken one
+        -- per cycle, and the BHT isn't used or trained until that is done.
+        signal bht_init : std_ulogic := '1';
+        signal bht_init_addr : unsigned(BHT_BITS - 1 downto 0) := (others => '0');
+    begin
+        bht_wr_addr <= w_in.br_nia(BHT_BITS + 1 downto 2);
+
+        bht_ram : process(clk)
+            variable raddr : std_ulogic_vector(BHT_BITS - 1 downto 0);
+            variable ctr : unsigned(1 downto 0);
+        begin
+            if rising_edge(clk) then
+                if advance_nia = '1' then
+                    raddr := std_ulogic_vector(bht_rd_addr);
+                    if bht_init = '1' then
+                        bht_rd_data <= "01";
+                    elsif is_X(raddr) then
+                        bht_rd_data <= "XX";
+                    else
+                        bht_rd_data <= bht_memory(to_integer(unsigned(raddr)));
+                    end if;
+                end if;
+                if rst = '1' then
+                    bht_init <= '1';
+                    bht_init_addr <= (others => '0');
+                elsif bht_init = '1' then
+                    bht_memory(to_integer(bht_init_addr)) <= "01";
+                    bht_init_addr <= bht_init_addr + 1;
+                    if bht_init_addr = BHT_SIZE - 1 then
+                        bht_init <= '0';
+                    end if;
+                elsif w_in.br_last = '1' then
+                    assert not is_X(bht_wr_addr) report "Writing to unknown address" severity FAILURE;
+                    ctr := unsigned(bht_memory(to_integer(unsigned(bht_wr_addr))));
+                    if w_in.br_taken = '1' and ctr /= "11" then
+                        ctr := ctr + 1;
+                    elsif w_in.br_taken = '0' and ctr /= "00" then
+                        ctr := ctr - 1;
+                    end if;
+                    bht_memory(to_integer(unsigned(bht_wr_addr))) <= std_ulogic_vector(ctr);
                 end if;
             end if;
         end process;
@@ -288,6 +503,7 @@ begin
         variable m32 : std_ulogic;
         variable ehit, esel : std_ulogic;
         variable eaa_priv : std_ulogic;
+        variable pred_taken : std_ulogic;
     begin
 	v := r;
 	v_int := r_int;
@@ -335,7 +551,8 @@ begin
         -- overridden with the reset or interrupt address or the predicted branch
         -- target address, in order to improve timing.  If it gets overridden then
         -- rd_is_niap4 gets cleared to indicate that the BTC data doesn't apply.
-        btc_rd_addr <= unsigned(v_int.next_nia(BTC_ADDR_BITS + 1 downto 2));
+        btc_rd_addr <= unsigned(v_int.next_nia(BTC_SET_BITS + 1 downto 2));
+        bht_rd_addr <= unsigned(v_int.next_nia(BHT_BITS + 1 downto 2));
         v_int.rd_is_niap4 := '1';
 
         -- If the last NIA value went down with a stop mark, it didn't get
@@ -413,18 +630,21 @@ begin
 
         -- If there is a valid entry in the BTC which corresponds to the next instruction,
         -- use that to predict the address of the instruction after that.
+        -- The direction comes from the BHT if we have one.
         -- (w_in.redirect = '0' and d_in.redirect = '0' and r_int.tlbstall = '0')
         -- implies v.nia = r_int.next_nia.
         -- r_int.rd_is_niap4 implies r_int.next_nia is the address used to read the BTC.
 	if v.req = '1' and w_in.redirect = '0' and d_in.redirect = '0' and r_int.tlbstall = '0' and 
-                btc_rd_valid = '1' and r_int.rd_is_niap4 = '1' and
-                btc_rd_data(BTC_WIDTH - 2) = r.virt_mode and
-                btc_rd_data(BTC_WIDTH - 3 downto BTC_TARGET_BITS)
-                    = r_int.next_nia(BTC_TAG_BITS + BTC_ADDR_BITS + 1 downto BTC_ADDR_BITS + 2) then
-            v.predicted := btc_rd_data(BTC_WIDTH - 1);
-            v.pred_ntaken := not btc_rd_data(BTC_WIDTH - 1);
-            if btc_rd_data(BTC_WIDTH - 1) = '1' then
-                v_int.next_nia := btc_rd_data(BTC_TARGET_BITS - 1 downto 0) & "00";
+                btc_hit = '1' and r_int.rd_is_niap4 = '1' then
+            if HAS_BHT then
+                pred_taken := bht_rd_data(1);
+            else
+                pred_taken := btc_taken;
+            end if;
+            v.predicted := pred_taken;
+            v.pred_ntaken := not pred_taken;
+            if pred_taken = '1' then
+                v_int.next_nia := btc_target & "00";
                 v_int.rd_is_niap4 := '0';
             end if;
         end if;
@@ -0,0 +1,243 @@
+/*
+ * Checkpoints that core_tb can resume from.
+ *
+ * A checkpoint is a main_ram.bin image of memory plus a small restore
+ * routine, and a text dump of the architected state (.state) for
+ * reference. The word at address 0 is replaced with a branch to the
+ * routine, which puts the original word back, reloads the SPRs, FPRs, CR,
+ * XER, LR, CTR and GPRs from a table stored alongside it, and then does
+ * an hrfid to the saved NIA and MSR. HSRR0, HSRR1 and CFAR are clobbered
+ * on the way, and any reservation is lost; the restore code is left in
+ * memory.
+ *
+ * The routine goes in the highest all-zero region of BRAM that is big
+ * enough, unless --stub-addr says otherwise. A zeroed region can still be
+ * .bss or stack that the program will use later, so if a resumed run goes
+ * wrong, try another address.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+#include "funcsim.h"
+
+/* SPRs to restore, in order; MMCR0 goes last so the PMCs stay frozen */
+static const int restore_sprs[] = {
+	SPR_SRR0, SPR_SRR1, SPR_SPRG0, SPR_SPRG1, SPR_SPRG2, SPR_SPRG3,
+	SPR_HSPRG0, SPR_HSPRG1, SPR_DAR, SPR_DSISR, SPR_DSCR, SPR_FSCR,
+	SPR_TAR, SPR_HEIR, SPR_CIABR, SPR_DAWR0, SPR_DAWR1, SPR_DAWRX0,
+	SPR_DAWRX1, SPR_VRSAVE, SPR_HASHKEYR, SPR_HASHPKEYR, SPR_DEXCR,
+	SPR_HDEXCR, SPR_LPCR, SPR_PID, SPR_PTCR,
+	784, 785, 786, 787, 788, 789, 790, 791, 792, 796, 797, 798,
+	SPR_MMCR0,
+};
+
+#define R_TMP		2
+#define R_BASE		1
+
+static inline uint32_t d_form(unsigned int op, unsigned int rt,
+			      unsigned int ra, uint16_t d)
+{
+	return (op << 26) | (rt << 21) | (ra << 16) | d;
+}
+
+static inline uint32_t x_form(unsigned int rt, unsigned int ra,
+			      unsigned int rb, unsigned int xo)
+{
+	return (31u << 26) | (rt << 21) | (ra << 16) | (rb << 11) | (xo << 1);
+}
+
+static inline uint32_t mtspr(int sprn, unsigned int rs)
+{
+	return x_form(rs, sprn & 0x1f, sprn >> 5, 467);
+}
+
+struct stub {
+	std::vector<uint32_t> code;
+	std::vector<uint64_t> data;
+};
+
+/* Load the next table entry into a GPR */
+static void load_value(struct stub *s, unsigned int rt, uint64_t val)
+{
+	s->code.push_back(d_form(58, rt, R_BASE, s->data.size() * 8));
+	s->data.push_back(val);
+}
+
+static void set_spr(struct stub *s, int sprn, uint64_t val)
+{
+	load_value(s, R_TMP, val);
+	s->code.push_back(mtspr(sprn, R_TMP));
+}
+
+static void build_stub(struct cpu *cpu, struct stub *s, uint32_t word0)
+{
+	uint64_t tb = read_spr(cpu, SPR_TB);
+	unsigned int i;
+
+	/* Put back the word at 0 and make sure we don't fetch it stale */
+	load_value(s, R_TMP, word0);
+	s->code.push_back(d_form(36, R_TMP, 0, 0));	/* stw r2,0(0) */
+	s->code.push_back(0x7c0004ac);			/* sync */
+	s->code.push_back(d_form(14, R_TMP, 0, 0));	/* li r2,0 */
+	s->code.push_back(x_form(0, 0, R_TMP, 982));	/* icbi 0,r2 */
+	s->code.push_back(0x4c00012c);			/* isync */
+
+	/* FPRs and FPSCR, with MSR[FP] set for now */
+	s->code.push_back(x_form(R_TMP, 0, 0, 83));	/* mfmsr r2 */
+	s->code.push_back(d_form(24, R_TMP, R_TMP, MSR_FP));
+	s->code.push_back(x_form(R_TMP, 0, 0, 178));	/* mtmsrd r2 */
+	s->code.push_back(d_form(50, 0, R_BASE, s->data.size() * 8));
+	s->data.push_back(cpu->fpscr);
+	/* mtfsf 0xff,f0,1,0 */
+	s->code.push_back((63u << 26) | (1u << 25) | (0xffu << 17) | (711u << 1));
+	for (i = 0; i < 32; i++) {
+		s->code.push_back(d_form(50, i, R_BASE, s->data.size() * 8));
+		s->data.push_back(cpu->fpr[i]);
+	}
+
+	for (int sprn : restore_sprs) {
+		set_spr(s, sprn, read_spr(cpu, sprn));
+		if (sprn == SPR_PTCR) {
+			/* tlbie r2,r0,2,1,1 then r2,r0,2,0,1 with IS = 3 */
+			load_value(s, R_TMP, 0xc00);
+			s->code.push_back(x_form(0, 0x3, R_TMP, 306) | (2u << 18));
+			s->code.push_back(x_form(0, 0x1, R_TMP, 306) | (2u << 18));
+			s->code.push_back(0x7c4004ac);	/* ptesync */
+		}
+	}
+
+	set_spr(s, SPR_TBLW, 0);
+	set_spr(s, SPR_TBUW, tb >> 32);
+	set_spr(s, SPR_TBLW, (uint32_t)tb);
+	set_spr(s, SPR_DEC, get_dec(cpu));
+
+	load_value(s, R_TMP, cpu->cr);
+	s->code.push_back(x_form(R_TMP, 0, 0, 144) | (0xffu << 12));	/* mtcr */
+	set_spr(s, SPR_XER, get_xer(cpu));
+	set_spr(s, SPR_LR, cpu->lr);
+	set_spr(s, SPR_CTR, cpu->ctr);
+	set_spr(s, SPR_HSRR0, cpu->nia);
+	set_spr(s, SPR_HSRR1, cpu->msr);
+
+	/* GPRs, with the base register last */
+	for (i = 0; i < 32; i++)
+		if (i != R_BASE)
+			load_value(s, i, cpu->gpr[i]);
+	load_value(s, R_BASE, cpu->gpr[R_BASE]);
+	s->code.push_back(0x4c000224);			/* hrfid */
+}
+
+static bool all_zero(const uint8_t *p, uint64_t len)
+{
+	for (uint64_t i = 0; i < len; i++)
+		if (p[i])
+			return false;
+	return true;
+}
+
+static void write_file(const char *name, const void *buf, size_t len)
+{
+	FILE *f = fopen(name, "wb");
+
+	if (!f || fwrite(buf, 1, len, f) != len || fclose(f)) {
+		fprintf(stderr, "funcsim: can't write %s: %s\n", name, strerror(errno));
+		exit(1);
+	}
+}
+
+static void write_state(struct cpu *cpu, const char *name, uint64_t stub_addr)
+{
+	FILE *f = fopen(name, "w");
+	int i;
+
+	if (!f) {
+		fprintf(stderr, "funcsim: can't write %s: %s\n", name, strerror(errno));
+		exit(1);
+	}
+	fprintf(f, "ICOUNT %lu\n", (unsigned long)cpu->icount);
+	fprintf(f, "STUB %016lX\n", (unsigned long)stub_addr);
+	fprintf(f, "NIA %016lX\n", (unsigned long)cpu->nia);
+	fprintf(f, "MSR %016lX\n", (unsigned long)cpu->msr);
+	for (i = 0; i < 32; i++)
+		fprintf(f, "GPR%d %016lX\n", i, (unsigned long)cpu->gpr[i]);
+	fprintf(f, "CR %016lX\n", (unsigned long)cpu->cr);
+	fprintf(f, "LR %016lX\n", (unsigned long)cpu->lr);
+	fprintf(f, "CTR %016lX\n", (unsigned long)cpu->ctr);
+	fprintf(f, "XER %016lX\n", (unsigned long)get_xer(cpu));
+	for (i = 0; i < 32; i++)
+		fprintf(f, "FPR%d %016lX\n", i, (unsigned long)cpu->fpr[i]);
+	fprintf(f, "FPSCR %016lX\n", (unsigned long)cpu->fpscr);
+	for (int sprn : restore_sprs)
+		fprintf(f, "SPR%d %016lX\n", sprn, (unsigned long)read_spr(cpu, sprn));
+	fprintf(f, "TB %016lX\n", (unsigned long)read_spr(cpu, SPR_TB));
+	fprintf(f, "DEC %016lX\n", (unsigned long)get_dec(cpu));
+	fclose(f);
+}
+
+void write_checkpoint(struct cpu *cpu, const char *prefix, uint64_t stub_addr)
+{
+	struct stub s;
+	std::vector<uint8_t> image(soc.bram, soc.bram + soc.bram_size);
+	uint64_t code_len, len, off;
+	uint32_t word0, br;
+	char name[4096];
+
+	if (soc.dram_at_0) {
+		fprintf(stderr, "funcsim: checkpoints need BRAM at address 0\n");
+		exit(1);
+	}
+	memcpy(&word0, soc.bram, 4);
+	build_stub(cpu, &s, word0);
+	/* allowing for the two instructions that set up r1 */
+	code_len = (s.code.size() * 4 + 8 + 7) & ~7ull;
+	len = code_len + s.data.size() * 8;
+
+	if (!stub_addr) {
+		for (off = (soc.bram_size - len) & ~0xfffull; off > 0; off -= 0x1000)
+			if (all_zero(soc.bram + off, len))
+				break;
+		if (!off) {
+			fprintf(stderr, "funcsim: no free space for the restore code, "
+				"use --stub-addr\n");
+			exit(1);
+		}
+		stub_addr = off;
+	}
+	if (stub_addr < 4 || stub_addr + len > soc.bram_size || (stub_addr & 3)) {
+		fprintf(stderr, "funcsim: bad restore code address %lx\n",
+			(unsigned long)stub_addr);
+		exit(1);
+	}
+	if (stub_addr >= (1u << 25)) {
+		fprintf(stderr, "funcsim: restore code out of branch range\n");
+		exit(1);
+	}
+
+	/* The first two instructions point r1 at the data table */
+	off = stub_addr + code_len;
+	s.code.insert(s.code.begin(), {
+		d_form(15, R_BASE, 0, off >> 16),		/* lis */
+		d_form(24, R_BASE, R_BASE, off & 0xffff),	/* ori */
+	});
+	memcpy(&image[stub_addr], s.code.data(), s.code.size() * 4);
+	memcpy(&image[off], s.data.data(), s.data.size() * 8);
+	br = (18u << 26) | (uint32_t)stub_addr;
+	memcpy(&image[0], &br, 4);
+
+	snprintf(name, sizeof(name), "%s-%lu.bin", prefix, (unsigned long)cpu->icount);
+	write_file(name, image.data(), image.size());
+	if (soc.dram_size) {
+		snprintf(name, sizeof(name), "%s-%lu.dram.bin", prefix,
+			 (unsigned long)cpu->icount);
+		write_file(name, soc.dram, soc.dram_size);
+	}
+	snprintf(name, sizeof(name), "%s-%lu.state", prefix, (unsigned long)cpu->icount);
+	write_state(cpu, name, stub_addr);
+	fprintf(stderr, "funcsim: checkpoint %s-%lu at %016lx, restore code at %lx\n",
+		prefix, (unsigned long)cpu->icount, (unsigned long)cpu->nia,
+		(unsigned long)stub_addr);
+}
@@ -0,0 +1,1998 @@
+/*
+ * Integer, branch, CR and system instructions, SPRs and interrupts.
+ *
+ * Where the architecture leaves results undefined we follow what the RTL
+ * does (execute1.vhdl and friends), so that register dumps match core_tb.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "funcsim.h"
+
+#define XER_SO		(1ull << 31)
+#define XER_OV		(1ull << 30)
+#define XER_CA		(1ull << 29)
+#define XER_OV32	(1ull << 19)
+#define XER_CA32	(1ull << 18)
+
+/* DEXCR aspects, in the low (problem state) word */
+#define DEXCR_NPHIE	(1u << 26)
+#define DEXCR_PHIE	(1u << 25)
+/* SBHE, IBRTPD, SRAPD, NPHIE and PHIE in both words; all set at reset */
+#define DEXCR_ASPECTS	0x9e0000009e000000ull
+
+void cpu_reset(struct cpu *cpu)
+{
+	memset(cpu, 0, sizeof(*cpu));
+	cpu->msr = MSR_SF | MSR_HV | MSR_LE;
+	cpu->spr[SPR_LPCR] = LPCR_LD;
+	cpu->spr[SPR_FSCR] = FSCR_PREFIX | FSCR_SCV | FSCR_TAR | FSCR_DSCR;
+	cpu->spr[SPR_DEXCR] = DEXCR_ASPECTS;
+	cpu->spr[SPR_HDEXCR] = DEXCR_ASPECTS;
+}
+
+[[noreturn]] static void raise(uint64_t vec, uint64_t srr1 = 0, bool hv = false)
+{
+	struct interrupt intr = { vec, srr1, hv };
+
+	throw intr;
+}
+
+/* Illegal instruction: hypervisor emulation assistance interrupt */
+[[noreturn]] void illegal(struct cpu *cpu, uint32_t insn)
+{
+	cpu->spr[SPR_HEIR] = insn;
+	raise(0xe40, 0, true);
+}
+
+[[noreturn]] static void privileged(void)
+{
+	raise(0x700, SRR1_PRIV);
+}
+
+void take_interrupt(struct cpu *cpu, const struct interrupt &intr)
+{
+	bool alt = (cpu->spr[SPR_LPCR] & LPCR_HAIL) &&
+		(cpu->msr & MSR_IR) && (cpu->msr & MSR_DR);
+	uint64_t srr1, vec = intr.vec;
+	bool scv = vec >= 0x17000;
+
+	srr1 = (cpu->msr & 0xffffffff87c0ffffull) | MSR_HV |
+		(intr.srr1 & 0x783f0000ull);
+	if (scv) {
+		cpu->lr = cpu->nia;
+		cpu->ctr = srr1;
+		if (alt)
+			vec = (vec & 0xfff) | 0x3000;
+	} else if (intr.hv) {
+		cpu->spr[SPR_HSRR0] = cpu->nia;
+		cpu->spr[SPR_HSRR1] = srr1;
+	} else {
+		cpu->spr[SPR_SRR0] = cpu->nia;
+		cpu->spr[SPR_SRR1] = srr1;
+	}
+	if (alt && !scv)
+		vec |= 0xc000000000004000ull;
+	else if (alt)
+		vec |= 0xc000000000000000ull;
+	cpu->msr &= ~(MSR_PR | MSR_SE | MSR_BE | MSR_FP | MSR_FE0 | MSR_FE1 |
+		      MSR_IR | MSR_DR);
+	cpu->msr |= MSR_SF | MSR_LE;
+	if (alt)
+		cpu->msr |= MSR_IR | MSR_DR;
+	if (!scv)
+		cpu->msr &= ~MSR_EE;
+	if (!scv && !intr.hv)
+		cpu->msr &= ~MSR_RI;
+	cpu->nia = vec;
+	cpu->resv_valid = false;
+	cpu->trace_pending = false;
+}
+
+uint64_t get_dec(struct cpu *cpu)
+{
+	uint64_t dec = cpu->dec_set - (cpu->icount - cpu->dec_at);
+
+	if (!(cpu->spr[SPR_LPCR] & LPCR_LD))
+		dec = (uint32_t)dec;
+	return dec;
+}
+
+static bool dec_pending(struct cpu *cpu)
+{
+	uint64_t dec = get_dec(cpu);
+
+	if (cpu->spr[SPR_LPCR] & LPCR_LD)
+		return dec >> 63;
+	return (dec >> 31) & 1;
+}
+
+/* Asynchronous interrupts, checked between instructions */
+void check_async(struct cpu *cpu)
+{
+	if (cpu->fp_intr_pending) {
+		cpu->fp_intr_pending = false;
+		take_interrupt(cpu, { 0x700, SRR1_FP_ENAB | SRR1_FP_NEXT, false });
+		return;
+	}
+	if (cpu->trace_pending) {
+		cpu->trace_pending = false;
+		take_interrupt(cpu, { 0xd00, cpu->trace_srr1, false });
+		return;
+	}
+	if ((cpu->msr & MSR_EE) && dec_pending(cpu))
+		take_interrupt(cpu, { 0x900, 0, false });
+}
+
+static bool is_branch(uint32_t insn)
+{
+	switch (insn >> 26) {
+	case 16: case 18:
+		return true;
+	case 19:
+		switch ((insn >> 1) & 0x3ff) {
+		case 16: case 528: case 560:
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+ * After an instruction completes: single-step and branch trace, and CIABR
+ * matches, which are reported as trace interrupts before the next one.
+ * msr is the MSR the instruction ran with.
+ */
+void check_trace(struct cpu *cpu, uint64_t cia, uint32_t insn, uint64_t msr)
+{
+	uint64_t ciabr = cpu->spr[SPR_CIABR];
+	bool trace = (msr & MSR_SE) || ((msr & MSR_BE) && is_branch(insn));
+	bool match = (ciabr & 1) && !!(ciabr & 2) == !(msr & MSR_PR) &&
+		(ciabr & ~3ull) == (cia & ~3ull);
+
+	if (cpu->no_trace)
+		trace = false;
+	if (!trace && !match)
+		return;
+	cpu->trace_srr1 = SRR1_ISI_NOPT;
+	if ((insn >> 26) == 1)
+		cpu->trace_srr1 |= SRR1_PREFIXED;
+	if (match)
+		cpu->trace_srr1 |= SRR1_CIABR;
+	else if (cpu->mem_access == ACCESS_LOAD)
+		cpu->trace_srr1 |= SRR1_ISI_PERM;
+	else if (cpu->mem_access == ACCESS_STORE)
+		cpu->trace_srr1 |= SRR1_TRACE_ST;
+	if (trace) {
+		cpu->spr[SPR_SIAR] = cia;
+		cpu->spr[SPR_SDAR] = cpu->mem_ea;
+	}
+	cpu->trace_pending = true;
+}
+
+/*
+ * PMC1-4 count the events MMCR1 selects. The cycle and run events count
+ * one per instruction, as PMC6 does; cache and TLB events never happen.
+ */
+void pmu_count(struct cpu *cpu, uint64_t cia, uint32_t insn)
+{
+	uint64_t mmcr1 = cpu->spr[SPR_MMCR1];
+	bool ld = cpu->mem_access == ACCESS_LOAD;
+	bool st = cpu->mem_access == ACCESS_STORE;
+	bool fp = (insn >> 26) == 59 || (insn >> 26) == 63;
+	bool taken = is_branch(insn) && cpu->nia != cia + 4;
+	bool inc[4] = {};
+
+	if (!mmcr1 || (cpu->spr[SPR_MMCR0] & MMCR0_FC))
+		return;
+	switch ((mmcr1 >> 24) & 0xff) {
+	case 0xf0: case 0xf2: case 0xfa: case 0xfe: inc[0] = true; break;
+	case 0xf4: inc[0] = fp; break;
+	case 0xfc: inc[0] = ld; break;
+	}
+	switch ((mmcr1 >> 16) & 0xff) {
+	case 0xf0: inc[1] = st; break;
+	case 0xf2: case 0xf4: inc[1] = true; break;
+	case 0xfa: inc[1] = taken; break;
+	}
+	switch ((mmcr1 >> 8) & 0xff) {
+	case 0xf2: case 0xf4: inc[2] = true; break;
+	}
+	switch (mmcr1 & 0xff) {
+	case 0xf2: case 0xf4: case 0xfa: inc[3] = true; break;
+	}
+	for (int i = 0; i < 4; i++)
+		if (inc[i])
+			cpu->spr[787 + i] = (uint32_t)(cpu->spr[787 + i] + 1);
+}
+
+uint64_t get_xer(struct cpu *cpu)
+{
+	return (cpu->so ? XER_SO : 0) | (cpu->ov ? XER_OV : 0) |
+		(cpu->ca ? XER_CA : 0) | (cpu->ov32 ? XER_OV32 : 0) |
+		(cpu->ca32 ? XER_CA32 : 0) | cpu->xer_low;
+}
+
+void set_xer(struct cpu *cpu, uint64_t val)
+{
+	cpu->so = !!(val & XER_SO);
+	cpu->ov = !!(val & XER_OV);
+	cpu->ca = !!(val & XER_CA);
+	cpu->ov32 = !!(val & XER_OV32);
+	cpu->ca32 = !!(val & XER_CA32);
+	cpu->xer_low = val & 0x3ffff;
+}
+
+/* PMC5 and PMC6 count instructions; fold the count in before changes */
+static void pmu_update(struct cpu *cpu)
+{
+	uint64_t n = cpu->icount - cpu->pmc_at;
+
+	if (!(cpu->spr[SPR_MMCR0] & MMCR0_FC)) {
+		cpu->spr[SPR_PMC5] = (uint32_t)(cpu->spr[SPR_PMC5] + n);
+		cpu->spr[SPR_PMC6] = (uint32_t)(cpu->spr[SPR_PMC6] + n);
+	}
+	cpu->pmc_at = cpu->icount;
+}
+
+static bool spr_implemented(int sprn)
+{
+	switch (sprn) {
+	case SPR_XER: case SPR_UDSCR: case SPR_LR: case SPR_CTR:
+	case SPR_DSCR: case SPR_DSISR: case SPR_DAR: case SPR_DEC:
+	case SPR_SRR0: case SPR_SRR1: case SPR_CFAR: case SPR_PID:
+	case SPR_CTRL: case SPR_CTRLW: case SPR_FSCR:
+	case SPR_DAWR0: case SPR_DAWR1: case SPR_CIABR:
+	case SPR_DAWRX0: case SPR_DAWRX1: case SPR_VRSAVE:
+	case SPR_SPRG3U: case SPR_TB: case SPR_TBU:
+	case SPR_SPRG0: case SPR_SPRG1: case SPR_SPRG2: case SPR_SPRG3:
+	case SPR_TBLW: case SPR_TBUW: case SPR_PVR:
+	case SPR_HSPRG0: case SPR_HSPRG1: case SPR_HRMOR:
+	case SPR_HSRR0: case SPR_HSRR1: case SPR_LPCR:
+	case SPR_HMER: case SPR_HMEER: case SPR_HEIR:
+	case SPR_HDEXCRU: case SPR_PTCR: case SPR_HASHKEYR:
+	case SPR_HASHPKEYR: case SPR_HDEXCR: case SPR_DEXCRU:
+	case SPR_TAR: case SPR_DEXCR: case SPR_PIR:
+	case 724: case 725:			/* LOG_ADDR, LOG_DATA */
+	case 736: case 737: case 738:		/* USIER2, USIER3, UMMCR3 */
+	case 752: case 753: case 754:		/* SIER2, SIER3, MMCR3 */
+	case 768 ... 776:			/* user PMU */
+	case 779 ... 782:
+	case 784 ... 792:			/* PMU */
+	case 795 ... 798:
+	case 808 ... 811:			/* no-op SPRs */
+		return true;
+	}
+	return false;
+}
+
+uint64_t read_spr(struct cpu *cpu, int sprn)
+{
+	switch (sprn) {
+	case SPR_XER:
+		return get_xer(cpu);
+	case SPR_LR:
+		return cpu->lr;
+	case SPR_CTR:
+		return cpu->ctr;
+	case SPR_UDSCR:
+		return cpu->spr[SPR_DSCR];
+	case SPR_DEC:
+		return get_dec(cpu);
+	case SPR_TB:
+		return cpu->icount + cpu->tb_offset;
+	case SPR_TBU:
+		return (cpu->icount + cpu->tb_offset) >> 32;
+	case SPR_PVR:
+		return PVR_MICROWATT;
+	case SPR_PIR:
+		return 0;
+	case SPR_CTRL:
+		return 1 | (cpu->msr & MSR_PR ? 0 : 0x8000);
+	case SPR_LPCR:
+		return cpu->spr[SPR_LPCR] | LPCR_FIXED;
+	case SPR_SPRG3U:
+		return cpu->spr[SPR_SPRG3];
+	case SPR_VRSAVE:
+		return (uint32_t)cpu->spr[SPR_VRSAVE];
+	case SPR_DEXCRU:
+	case SPR_HDEXCRU:
+		return cpu->spr[sprn + 16] & 0xffffffff00000000ull;
+	case SPR_TBLW: case SPR_TBUW: case SPR_CTRLW:
+	case SPR_HMER: case SPR_HMEER: case SPR_HRMOR:
+	case 736 ... 738: case 752 ... 754:
+		return 0;
+	case 768 ... 782:
+		/* user-mode aliases of the PMU registers */
+		sprn += 16;
+		/* fall through */
+	case SPR_PMC5:
+	case SPR_PMC6:
+		pmu_update(cpu);
+		return cpu->spr[sprn];
+	}
+	return cpu->spr[sprn];
+}
+
+void write_spr(struct cpu *cpu, int sprn, uint64_t val)
+{
+	switch (sprn) {
+	case SPR_XER:
+		set_xer(cpu, val);
+		return;
+	case SPR_LR:
+		cpu->lr = val;
+		return;
+	case SPR_CTR:
+		cpu->ctr = val;
+		return;
+	case SPR_UDSCR:
+		sprn = SPR_DSCR;
+		break;
+	case SPR_DEC:
+		cpu->dec_set = val;
+		cpu->dec_at = cpu->icount;
+		return;
+	case SPR_TBLW:
+		cpu->tb_offset = (((cpu->icount + cpu->tb_offset) &
+				   0xffffffff00000000ull) | (uint32_t)val) -
+			cpu->icount;
+		return;
+	case SPR_TBUW:
+		cpu->tb_offset = ((val << 32) |
+				  (uint32_t)(cpu->icount + cpu->tb_offset)) -
+			cpu->icount;
+		return;
+	case SPR_LPCR:
+		val &= LPCR_HAIL | LPCR_EVIRT | LPCR_LD | LPCR_HEIC |
+			LPCR_LPES | LPCR_HVICE;
+		/* DEC reads differently with LD changed; keep its value */
+		cpu->dec_set = get_dec(cpu);
+		cpu->dec_at = cpu->icount;
+		break;
+	case SPR_PID:
+	case SPR_PTCR:
+		tlb_flush(cpu);
+		break;
+	case SPR_DEXCR: case SPR_HDEXCR:
+		val &= DEXCR_ASPECTS;
+		break;
+	case SPR_SPRG3U: case SPR_TB: case SPR_TBU: case SPR_PVR:
+	case SPR_PIR: case SPR_CTRL: case SPR_CTRLW: case 725:
+	case SPR_DEXCRU: case SPR_HDEXCRU:
+	case SPR_HMER: case SPR_HMEER: case SPR_HRMOR:
+	case 736 ... 738: case 752 ... 754:
+	case 808 ... 811:
+		return;
+	case 768 ... 782:
+		sprn += 16;
+		/* fall through */
+	case 784 ... 798:
+		pmu_update(cpu);
+		if (sprn >= 787 && sprn <= 792)
+			val = (uint32_t)val;
+		break;
+	}
+	cpu->spr[sprn] = val;
+}
+
+/*
+ * Arithmetic helpers. In 32-bit mode CA and OV come from the low word
+ * and CR0 from the low word of the result.
+ */
+static inline void set_cr0(struct cpu *cpu, uint64_t val)
+{
+	uint32_t c;
+	int64_t s = (cpu->msr & MSR_SF) ? (int64_t)val : (int32_t)val;
+
+	c = s < 0 ? 8 : s > 0 ? 4 : 2;
+	set_cr_field(cpu, 0, c | cpu->so);
+}
+
+static inline uint64_t add_carry(struct cpu *cpu, uint64_t a, uint64_t b,
+				 uint64_t ci, bool set_ca, bool oe)
+{
+	uint64_t r = a + b + ci;
+	uint64_t r32 = (a & 0xffffffff) + (b & 0xffffffff) + ci;
+	bool c64 = (r < a) || (ci && r == a);
+	bool c32 = r32 >> 32;
+
+	if (set_ca) {
+		cpu->ca32 = c32;
+		cpu->ca = (cpu->msr & MSR_SF) ? c64 : c32;
+	}
+	if (oe) {
+		bool o64 = ((a ^ r) & (b ^ r)) >> 63;
+		bool o32 = (((a ^ r) & (b ^ r)) >> 31) & 1;
+
+		cpu->ov32 = o32;
+		cpu->ov = (cpu->msr & MSR_SF) ? o64 : o32;
+		if (cpu->ov)
+			cpu->so = 1;
+	}
+	return r;
+}
+
+static inline void set_ov(struct cpu *cpu, bool ov, bool ov32)
+{
+	cpu->ov = ov;
+	cpu->ov32 = ov32;
+	if (ov)
+		cpu->so = 1;
+}
+
+static inline uint64_t rotl64(uint64_t x, unsigned int n)
+{
+	n &= 63;
+	return n ? (x << n) | (x >> (64 - n)) : x;
+}
+
+static inline uint64_t rotl32(uint64_t x, unsigned int n)
+{
+	uint32_t w = x;
+
+	n &= 31;
+	if (n)
+		w = (w << n) | (w >> (32 - n));
+	return ((uint64_t)w << 32) | w;
+}
+
+/* Mask with IBM bits mb..me set, wrapping if mb > me */
+static inline uint64_t mask64(unsigned int mb, unsigned int me)
+{
+	uint64_t m1 = ~0ull >> mb;
+	uint64_t m2 = ~0ull << (63 - me);
+
+	return mb <= me ? (m1 & m2) : (m1 | m2);
+}
+
+static bool cond_true(struct cpu *cpu, unsigned int bo, unsigned int bi)
+{
+	bool ctr_ok = true, cond_ok = true;
+
+	if (!(bo & 4)) {
+		cpu->ctr--;
+		uint64_t ctr = (cpu->msr & MSR_SF) ? cpu->ctr : (uint32_t)cpu->ctr;
+		ctr_ok = (ctr != 0) != ((bo >> 1) & 1);
+	}
+	if (!(bo & 0x10))
+		cond_ok = ((cpu->cr >> (31 - bi)) & 1) == ((bo >> 3) & 1);
+	return ctr_ok && cond_ok;
+}
+
+static inline uint64_t ea_mask(struct cpu *cpu, uint64_t ea)
+{
+	return (cpu->msr & MSR_SF) ? ea : (uint32_t)ea;
+}
+
+static void branch(struct cpu *cpu, uint64_t target, uint64_t cia)
+{
+	cpu->spr[SPR_CFAR] = cia;
+	cpu->nia = ea_mask(cpu, target);
+}
+
+static bool trap_cond(uint64_t a, uint64_t b, unsigned int to, bool w)
+{
+	int64_t sa = w ? (int32_t)a : (int64_t)a;
+	int64_t sb = w ? (int32_t)b : (int64_t)b;
+	uint64_t ua = w ? (uint32_t)a : a;
+	uint64_t ub = w ? (uint32_t)b : b;
+
+	return ((to & 0x10) && sa < sb) || ((to & 0x08) && sa > sb) ||
+		((to & 0x04) && sa == sb) || ((to & 0x02) && ua < ub) ||
+		((to & 0x01) && ua > ub);
+}
+
+[[noreturn]] static void trap(void)
+{
+	raise(0x700, SRR1_TRAP);
+}
+
+static uint32_t compare(struct cpu *cpu, int64_t a, int64_t b)
+{
+	return (a < b ? 8 : a > b ? 4 : 2) | cpu->so;
+}
+
+static uint32_t compare_unsigned(struct cpu *cpu, uint64_t a, uint64_t b)
+{
+	return (a < b ? 8 : a > b ? 4 : 2) | cpu->so;
+}
+
+/*
+ * Divides, done the way divider.vhdl does them: a restoring division of
+ * the operand magnitudes, with its own rules for what counts as overflow.
+ * Overflow (including division by zero) gives 0, and the 32-bit forms
+ * give a zero-extended quotient.
+ */
+static uint64_t divide(struct cpu *cpu, uint64_t a, uint64_t b, bool sign,
+		       bool word, bool ext, bool mod, bool oe)
+{
+	bool sign1 = false, sign2 = false, neg, top = false;
+	bool ovf, overflow = false, ovf32 = false;
+	uint64_t abs1, abs2, dhi, dlo, quot = 0, result;
+	unsigned __int128 sres;
+
+	if (sign) {
+		sign1 = word ? (a >> 31) & 1 : a >> 63;
+		sign2 = word ? (b >> 31) & 1 : b >> 63;
+	}
+	abs1 = sign1 ? -a : a;
+	abs2 = sign2 ? -b : b;
+	neg = sign1 ^ (sign2 && !mod);
+	if (word) {
+		dhi = 0;
+		dlo = ext ? abs1 << 32 : (uint32_t)abs1;
+		abs2 = (uint32_t)abs2;
+	} else if (ext) {
+		dhi = abs1;
+		dlo = 0;
+	} else {
+		dhi = 0;
+		dlo = abs1;
+	}
+
+	/* dend is top:dhi:dlo, 129 bits; 65 steps */
+	for (int i = 0; i < 65; i++) {
+		overflow = quot >> 63;
+		ovf32 |= (quot >> 31) & 1;
+		if (top || dhi >= abs2) {
+			dhi -= abs2;
+			top = dhi >> 63;
+			dhi = (dhi << 1) | (dlo >> 63);
+			dlo <<= 1;
+			quot = (quot << 1) | 1;
+		} else {
+			top = dhi >> 63;
+			dhi = (dhi << 1) | (dlo >> 63);
+			dlo <<= 1;
+			quot <<= 1;
+		}
+	}
+
+	/* the remainder is dend(128 downto 65) */
+	result = mod ? ((uint64_t)top << 63) | (dhi >> 1) : quot;
+	sres = neg ? -(unsigned __int128)result : result;
+	sres &= ((unsigned __int128)1 << 65) - 1;
+	if (!word)
+		ovf = overflow || (sign && (((sres >> 64) ^ (sres >> 63)) & 1));
+	else if (sign)
+		ovf = ovf32 || (((sres >> 32) ^ (sres >> 31)) & 1);
+	else
+		ovf = ovf32;
+
+	if (oe)
+		set_ov(cpu, ovf, ovf);
+	if (ovf)
+		return 0;
+	if (word && !mod)
+		return (uint32_t)sres;
+	return (uint64_t)sres;
+}
+
+static uint64_t popcnt_bytes(uint64_t x)
+{
+	uint64_t r = 0;
+
+	for (int i = 0; i < 8; i++)
+		r |= (uint64_t)__builtin_popcount((x >> (8 * i)) & 0xff) << (8 * i);
+	return r;
+}
+
+static uint64_t pdep(uint64_t src, uint64_t mask)
+{
+	uint64_t r = 0;
+
+	for (; mask; mask &= mask - 1, src >>= 1)
+		if (src & 1)
+			r |= mask & -mask;
+	return r;
+}
+
+static uint64_t pext(uint64_t src, uint64_t mask)
+{
+	uint64_t r = 0;
+	int n = 0;
+
+	for (; mask; mask &= mask - 1, n++)
+		if (src & mask & -mask)
+			r |= 1ull << n;
+	return r;
+}
+
+static uint64_t cfuged(uint64_t src, uint64_t mask)
+{
+	int ones = __builtin_popcountll(mask);
+	uint64_t hi = pext(src, mask), lo = pext(src, ~mask);
+
+	if (ones == 64)
+		return hi;
+	return (lo << ones) | hi;
+}
+
+static uint64_t bpermd(uint64_t rs, uint64_t rb)
+{
+	uint64_t r = 0;
+
+	for (int i = 0; i < 8; i++) {
+		unsigned int idx = (rs >> (8 * i)) & 0xff;
+
+		if (idx < 64 && ((rb >> (63 - idx)) & 1))
+			r |= 1ull << i;
+	}
+	return r;
+}
+
+static uint64_t cdtbcd(uint64_t x)
+{
+	uint64_t r = 0;
+
+	for (int w = 0; w < 2; w++) {
+		uint32_t in = x >> (32 * w), out = 0;
+
+		for (int g = 0; g < 2; g++) {
+			unsigned int dpd = (in >> (10 * g)) & 0x3ff;
+			unsigned int b, c, d;
+			unsigned int p = (dpd >> 9) & 1, q = (dpd >> 8) & 1;
+			unsigned int r_ = (dpd >> 7) & 1, s = (dpd >> 6) & 1;
+			unsigned int t = (dpd >> 5) & 1, u = (dpd >> 4) & 1;
+			unsigned int v = (dpd >> 3) & 1, w_ = (dpd >> 2) & 1;
+			unsigned int x_ = (dpd >> 1) & 1, y = dpd & 1;
+
+			if (!v) {
+				b = (p << 2) | (q << 1) | r_;
+				c = (s << 2) | (t << 1) | u;
+				d = (w_ << 2) | (x_ << 1) | y;
+			} else if (!w_ && !x_) {
+				b = (p << 2) | (q << 1) | r_;
+				c = (s << 2) | (t << 1) | u;
+				d = 8 | y;
+			} else if (!w_ && x_) {
+				b = (p << 2) | (q << 1) | r_;
+				c = 8 | u;
+				d = (s << 2) | (t << 1) | y;
+			} else if (w_ && !x_) {
+				b = 8 | r_;
+				c = (s << 2) | (t << 1) | u;
+				d = (p << 2) | (q << 1) | y;
+			} else if (!s && !t) {
+				b = 8 | r_;
+				c = 8 | u;
+				d = (p << 2) | (q << 1) | y;
+			} else if (!s && t) {
+				b = 8 | r_;
+				c = (p << 2) | (q << 1) | u;
+				d = 8 | y;
+			} else if (s && !t) {
+				b = (p << 2) | (q << 1) | r_;
+				c = 8 | u;
+				d = 8 | y;
+			} else {
+				b = 8 | r_;
+				c = 8 | u;
+				d = 8 | y;
+			}
+			out |= ((b << 8) | (c << 4) | d) << (12 * g);
+		}
+		r |= (uint64_t)out << (32 * w);
+	}
+	return r;
+}
+
+static uint64_t cbcdtd(uint64_t x)
+{
+	uint64_t r = 0;
+
+	for (int w = 0; w < 2; w++) {
+		uint32_t in = x >> (32 * w), out = 0;
+
+		for (int g = 0; g < 2; g++) {
+			unsigned int bcd = (in >> (12 * g)) & 0xfff;
+			unsigned int d1 = (bcd >> 8) & 15, d2 = (bcd >> 4) & 15;
+			unsigned int d3 = bcd & 15;
+			unsigned int a = (d1 >> 3) & 1, b = (d1 >> 2) & 1;
+			unsigned int c = (d1 >> 1) & 1, d = d1 & 1;
+			unsigned int e = (d2 >> 3) & 1, f = (d2 >> 2) & 1;
+			unsigned int g_ = (d2 >> 1) & 1, h = d2 & 1;
+			unsigned int i = (d3 >> 3) & 1, j = (d3 >> 2) & 1;
+			unsigned int k = (d3 >> 1) & 1, m = d3 & 1;
+			unsigned int p, q, r_, s, t, u, v, w_, x_, y;
+
+			switch ((a << 2) | (e << 1) | i) {
+			case 0:
+				p = b; q = c; r_ = d; s = f; t = g_; u = h;
+				v = 0; w_ = j; x_ = k; y = m;
+				break;
+			case 1:
+				p = b; q = c; r_ = d; s = f; t = g_; u = h;
+				v = 1; w_ = 0; x_ = 0; y = m;
+				break;
+			case 2:
+				p = b; q = c; r_ = d; s = j; t = k; u = h;
+				v = 1; w_ = 0; x_ = 1; y = m;
+				break;
+			case 3:
+				p = b; q = c; r_ = d; s = 1; t = 0; u = h;
+				v = 1; w_ = 1; x_ = 1; y = m;
+				break;
+			case 4:
+				p = j; q = k; r_ = d; s = f; t = g_; u = h;
+				v = 1; w_ = 1; x_ = 0; y = m;
+				break;
+			case 5:
+				p = f; q = g_; r_ = d; s = 0; t = 1; u = h;
+				v = 1; w_ = 1; x_ = 1; y = m;
+				break;
+			case 6:
+				p = j; q = k; r_ = d; s = 0; t = 0; u = h;
+				v = 1; w_ = 1; x_ = 1; y = m;
+				break;
+			default:
+				p = 0; q = 0; r_ = d; s = 1; t = 1; u = h;
+				v = 1; w_ = 1; x_ = 1; y = m;
+				break;
+			}
+			out |= ((p << 9) | (q << 8) | (r_ << 7) | (s << 6) |
+				(t << 5) | (u << 4) | (v << 3) | (w_ << 2) |
+				(x_ << 1) | y) << (10 * g);
+		}
+		r |= (uint64_t)out << (32 * w);
+	}
+	return r;
+}
+
+static uint64_t addg6s(uint64_t a, uint64_t b)
+{
+	uint64_t sum = a + b;
+	uint64_t carries = (sum ^ a ^ b) >> 4;	/* carry into each digit */
+	uint64_t r = 0;
+
+	if (sum < a)
+		carries |= 1ull << 60;
+	for (int i = 0; i < 16; i++)
+		if (!((carries >> (4 * i)) & 1))
+			r |= 6ull << (4 * i);
+	return r;
+}
+
+/* Enabling FP exceptions with one already recorded interrupts next */
+static void fp_enable_check(struct cpu *cpu, uint64_t msr)
+{
+	if ((cpu->fpscr & FPS_FEX) && (msr & (MSR_FE0 | MSR_FE1)))
+		cpu->fp_intr_pending = true;
+}
+
+static void mtmsr(struct cpu *cpu, uint64_t val, bool l, bool word)
+{
+	uint64_t msr = cpu->msr;
+
+	if (l) {
+		msr = (msr & ~(MSR_EE | MSR_RI)) | (val & (MSR_EE | MSR_RI));
+	} else {
+		uint64_t mask = 0x00000000fffffffeull & ~MSR_ME;
+
+		if (!word)
+			mask |= 0xefffffff00000000ull;
+		msr = (msr & ~mask) | (val & mask);
+		if (val & MSR_PR)
+			msr |= MSR_EE | MSR_IR | MSR_DR;
+		fp_enable_check(cpu, val);
+	}
+	cpu->msr = msr;
+}
+
+static void rfid(struct cpu *cpu, uint64_t srr0, uint64_t srr1, uint64_t cia)
+{
+	uint64_t mask = 0xe0000000ull << 32 | 0x0fffffff87c0ffffull;
+
+	mask &= ~MSR_HV;
+	cpu->msr = (cpu->msr & ~mask) | (srr1 & mask) | MSR_HV;
+	if (srr1 & MSR_PR)
+		cpu->msr |= MSR_EE | MSR_IR | MSR_DR;
+	cpu->resv_valid = false;
+	cpu->no_trace = true;
+	fp_enable_check(cpu, srr1);
+	branch(cpu, srr0 & ~3ull, cia);
+}
+
+static void larx(struct cpu *cpu, uint32_t insn, uint64_t ea, unsigned int len)
+{
+	unsigned int rt = insn_rt(insn);
+
+	if (ea & (len - 1)) {
+		cpu->spr[SPR_DAR] = ea_mask(cpu, ea);
+		raise(0x600);
+	}
+	if (len == 16) {
+		uint64_t hi = load(cpu, ea, 8, false);
+		uint64_t lo = load(cpu, ea + 8, 8, false);
+
+		if (cpu->msr & MSR_LE) {
+			cpu->gpr[rt] = lo;
+			cpu->gpr[rt + 1] = hi;
+		} else {
+			cpu->gpr[rt] = hi;
+			cpu->gpr[rt + 1] = lo;
+		}
+	} else {
+		cpu->gpr[rt] = load(cpu, ea, len, false);
+	}
+	cpu->resv_valid = true;
+	cpu->resv_addr = ea_mask(cpu, ea);
+	cpu->resv_len = len;
+}
+
+static void stcx(struct cpu *cpu, uint32_t insn, uint64_t ea, unsigned int len)
+{
+	unsigned int rs = insn_rt(insn);
+	bool ok;
+
+	if (ea & (len - 1)) {
+		cpu->spr[SPR_DAR] = ea_mask(cpu, ea);
+		raise(0x600);
+	}
+	ok = cpu->resv_valid &&
+		(cpu->resv_addr & ~63ull) == (ea_mask(cpu, ea) & ~63ull);
+	if (ok) {
+		if (len == 16) {
+			bool le = cpu->msr & MSR_LE;
+
+			store(cpu, ea, 8, le ? cpu->gpr[rs + 1] : cpu->gpr[rs], false);
+			store(cpu, ea + 8, 8, le ? cpu->gpr[rs] : cpu->gpr[rs + 1],
+			      false);
+		} else {
+			store(cpu, ea, len, cpu->gpr[rs], false);
+		}
+	}
+	cpu->resv_valid = false;
+	set_cr_field(cpu, 0, (ok ? 2 : 0) | cpu->so);
+}
+
+/* Quadword loads and stores; the RTL requires an even register pair */
+static void load_quad(struct cpu *cpu, uint32_t insn, uint64_t ea,
+		      bool prefixed)
+{
+	unsigned int rt = insn_rt(insn);
+	uint64_t hi, lo;
+
+	if ((rt & 1) || rt == insn_ra(insn))
+		illegal(cpu, insn);
+	if ((ea & 15) && (cpu->msr & MSR_LE) && !prefixed) {
+		cpu->spr[SPR_DAR] = ea_mask(cpu, ea);
+		raise(0x600);
+	}
+	hi = load(cpu, ea, 8, false);
+	lo = load(cpu, ea + 8, 8, false);
+	/* plq puts the lower-addressed doubleword in RT in either endian */
+	if ((cpu->msr & MSR_LE) && !prefixed) {
+		cpu->gpr[rt] = lo;
+		cpu->gpr[rt + 1] = hi;
+	} else {
+		cpu->gpr[rt] = hi;
+		cpu->gpr[rt + 1] = lo;
+	}
+}
+
+static void store_quad(struct cpu *cpu, uint32_t insn, uint64_t ea,
+		       bool prefixed)
+{
+	unsigned int rs = insn_rt(insn);
+	bool le = (cpu->msr & MSR_LE) && !prefixed;
+
+	if (rs & 1)
+		illegal(cpu, insn);
+	store(cpu, ea, 8, le ? cpu->gpr[rs + 1] : cpu->gpr[rs], false);
+	store(cpu, ea + 8, 8, le ? cpu->gpr[rs] : cpu->gpr[rs + 1], false);
+}
+
+static inline uint16_t rol16(uint16_t x, unsigned int n)
+{
+	return (x << n) | (x >> (16 - n));
+}
+
+/* HashDigest from ISA Book I section 3.3.17, as loadstore1 computes it */
+static uint64_t hash_digest(uint64_t ra, uint64_t rb, uint64_t key)
+{
+	uint16_t k[8], xl[4], xr[4], t, fx;
+	uint32_t z0 = 0x7d12b0e6;
+	int i, lane;
+
+	for (lane = 0; lane < 4; lane++) {
+		xr[lane] = ((rb >> (lane * 16)) & 0xff) << 8 |
+			((ra >> ((3 - lane) * 16 + 8)) & 0xff);
+		xl[lane] = ((rb >> (lane * 16 + 8)) & 0xff) << 8 |
+			((ra >> ((3 - lane) * 16)) & 0xff);
+	}
+	for (i = 0; i < 4; i++)
+		k[i] = key >> ((3 - i) * 16);
+	for (int step = 0; step < 8; step++) {
+		for (i = 4; i < 8; i++) {
+			t = rol16(k[i - 1], 13) ^ k[i - 3];
+			k[i] = 0xfffc ^ ((z0 >> (34 - i)) & 1) ^ k[i - 4] ^ t ^
+				rol16(t, 15);
+		}
+		z0 = (z0 << 4) & 0x7fffffff;
+		for (lane = 0; lane < 4; lane++) {
+			for (i = 0; i < 4; i++) {
+				fx = (rol16(xl[lane], 1) & rol16(xl[lane], 8)) ^
+					rol16(xl[lane], 2);
+				t = xr[lane] ^ fx ^ k[(i + lane) % 4];
+				xr[lane] = xl[lane];
+				xl[lane] = t;
+			}
+		}
+		memcpy(k, k + 4, 4 * sizeof(k[0]));
+	}
+	return ((uint64_t)(xr[0] ^ xr[2]) << 48) | ((uint64_t)(xl[0] ^ xl[2]) << 32) |
+		((uint64_t)(xr[1] ^ xr[3]) << 16) | (xl[1] ^ xl[3]);
+}
+
+/* hashst, hashchk, hashstp, hashchkp: no-ops unless enabled in (H)DEXCR */
+static void hash_insn(struct cpu *cpu, uint32_t insn)
+{
+	unsigned int xo = (insn >> 1) & 0x3ff;
+	bool priv = xo == 658 || xo == 690;
+	uint64_t dex, ea, hash;
+
+	if (priv && (cpu->msr & MSR_PR))
+		privileged();
+	if (cpu->msr & MSR_PR)
+		dex = (uint32_t)(cpu->spr[SPR_DEXCR] | cpu->spr[SPR_HDEXCR]);
+	else
+		dex = cpu->spr[SPR_HDEXCR] >> 32;
+	if (!(dex & (priv ? DEXCR_PHIE : DEXCR_NPHIE)))
+		return;
+
+	ea = cpu->gpr[insn_ra(insn)] + (0xfffffffffffffe00ull |
+		((insn & 1) << 8) | (insn_rt(insn) << 3));
+	ea = ea_mask(cpu, ea);
+	if (ea & 7) {
+		cpu->spr[SPR_DAR] = ea;
+		raise(0x600);
+	}
+	hash = hash_digest(cpu->gpr[insn_ra(insn)], cpu->gpr[insn_rb(insn)],
+			   cpu->spr[priv ? SPR_HASHPKEYR : SPR_HASHKEYR]);
+	if (xo == 722 || xo == 658)
+		store(cpu, ea, 8, hash, false);
+	else if (load(cpu, ea, 8, false) != hash)
+		trap();
+}
+
+static bool fp_insn(uint32_t insn)
+{
+	switch (insn >> 26) {
+	case 48 ... 55:
+	case 59:
+	case 63:
+		return true;
+	case 31:
+		switch ((insn >> 1) & 0x3ff) {
+		case 535: case 567: case 599: case 631:
+		case 663: case 695: case 727: case 759:
+		case 855: case 887: case 983:
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+ * mfocrf and mtocrf use the first field set in FXM, or CR7 if none,
+ * as crhelpers.vhdl does.
+ */
+static uint32_t fxm_field_mask(uint32_t insn)
+{
+	uint32_t fxm = (insn >> 12) & 0xff;
+	int i;
+
+	for (i = 0; i < 7; i++)
+		if (fxm & (0x80 >> i))
+			break;
+	return 0xf0000000u >> (4 * i);
+}
+
+/* Facility unavailable for TAR and DSCR accesses in problem state */
+static void check_spr_facility(struct cpu *cpu, int sprn, bool pr)
+{
+	uint64_t ic;
+
+	if (!pr)
+		return;
+	if (sprn == SPR_TAR && !(cpu->spr[SPR_FSCR] & FSCR_TAR))
+		ic = 8;
+	else if (sprn == SPR_UDSCR && !(cpu->spr[SPR_FSCR] & FSCR_DSCR))
+		ic = 2;
+	else
+		return;
+	cpu->spr[SPR_FSCR] = (cpu->spr[SPR_FSCR] & ~(0xfull << 56)) | (ic << 56);
+	raise(0xf60);
+}
+
+static void do_mfspr(struct cpu *cpu, uint32_t insn)
+{
+	int sprn = ((insn >> 16) & 0x1f) | ((insn >> 6) & 0x3e0);
+	bool pr = cpu->msr & MSR_PR;
+
+	if (!spr_implemented(sprn)) {
+		if (pr || (cpu->spr[SPR_LPCR] & LPCR_EVIRT) ||
+		    sprn == 0 || (sprn >= 4 && sprn <= 6))
+			illegal(cpu, insn);
+		return;
+	}
+	if ((sprn & 0x10) && pr)
+		privileged();
+	check_spr_facility(cpu, sprn, pr);
+	if (sprn >= 808 && sprn <= 811)
+		return;
+	cpu->gpr[insn_rt(insn)] = read_spr(cpu, sprn);
+}
+
+static void do_mtspr(struct cpu *cpu, uint32_t insn)
+{
+	int sprn = ((insn >> 16) & 0x1f) | ((insn >> 6) & 0x3e0);
+	bool pr = cpu->msr & MSR_PR;
+
+	if (!spr_implemented(sprn)) {
+		if (pr || (cpu->spr[SPR_LPCR] & LPCR_EVIRT) ||
+		    sprn == 0 || (sprn >= 4 && sprn <= 6))
+			illegal(cpu, insn);
+		return;
+	}
+	if ((sprn & 0x10) && pr)
+		privileged();
+	check_spr_facility(cpu, sprn, pr);
+	write_spr(cpu, sprn, cpu->gpr[insn_rt(insn)]);
+}
+
+static void execute_31(struct cpu *cpu, uint32_t insn, uint64_t cia)
+{
+	unsigned int rt = insn_rt(insn), ra = insn_ra(insn), rb = insn_rb(insn);
+	uint64_t a = cpu->gpr[ra], b = cpu->gpr[rb], s = cpu->gpr[rt];
+	uint64_t a0 = ra ? a : 0;
+	uint64_t ea = a0 + b;
+	bool oe = insn & 0x400;
+	bool rc = insn & 1;
+	uint64_t r = 0;
+	bool sf = cpu->msr & MSR_SF;
+	unsigned int xo = (insn >> 1) & 0x3ff;
+
+	if ((xo & 0x1f) == 15) {
+		/* isel */
+		cpu->gpr[rt] = ((cpu->cr >> (31 - insn_rc(insn))) & 1) ? a0 : b;
+		return;
+	}
+	switch (xo) {
+	/* XO-form arithmetic; bit 10 of the XO is OE */
+	case 266: case 266 | 512:
+		r = add_carry(cpu, a, b, 0, false, oe);
+		goto write_rt;
+	case 10: case 10 | 512:
+		r = add_carry(cpu, a, b, 0, true, oe);
+		goto write_rt;
+	case 138: case 138 | 512:
+		r = add_carry(cpu, a, b, cpu->ca, true, oe);
+		goto write_rt;
+	case 234: case 234 | 512:
+		r = add_carry(cpu, a, ~0ull, cpu->ca, true, oe);
+		goto write_rt;
+	case 202: case 202 | 512:
+		r = add_carry(cpu, a, 0, cpu->ca, true, oe);
+		goto write_rt;
+	case 40: case 40 | 512:
+		r = add_carry(cpu, ~a, b, 1, false, oe);
+		goto write_rt;
+	case 8: case 8 | 512:
+		r = add_carry(cpu, ~a, b, 1, true, oe);
+		goto write_rt;
+	case 136: case 136 | 512:
+		r = add_carry(cpu, ~a, b, cpu->ca, true, oe);
+		goto write_rt;
+	case 232: case 232 | 512:
+		r = add_carry(cpu, ~a, ~0ull, cpu->ca, true, oe);
+		goto write_rt;
+	case 200: case 200 | 512:
+		r = add_carry(cpu, ~a, 0, cpu->ca, true, oe);
+		goto write_rt;
+	case 104: case 104 | 512:
+		r = add_carry(cpu, ~a, 0, 1, false, oe);
+		goto write_rt;
+	case 170: {
+		/* addex with CY = 0: uses and sets OV as the carry */
+		uint64_t sum;
+		bool c64, c32;
+
+		if ((insn >> 9) & 3)
+			illegal(cpu, insn);
+		sum = a + b + cpu->ov;
+		c64 = sum < a || (cpu->ov && sum == a);
+		c32 = (((a & 0xffffffff) + (b & 0xffffffff) + cpu->ov) >> 32) & 1;
+		cpu->ov32 = c32;
+		cpu->ov = sf ? c64 : c32;
+		cpu->gpr[rt] = sum;
+		return;
+	}
+	case 74:
+		r = addg6s(a, b);
+		goto write_rt_norc;
+
+	case 233: case 233 | 512: {		/* mulld */
+		__int128_t p = (__int128_t)(int64_t)a * (int64_t)b;
+
+		r = (uint64_t)p;
+		if (oe)
+			set_ov(cpu, p != (int64_t)p, p != (int64_t)p);
+		goto write_rt;
+	}
+	case 235: case 235 | 512: {		/* mullw */
+		int64_t p = (int64_t)(int32_t)a * (int32_t)b;
+
+		r = p;
+		if (oe)
+			set_ov(cpu, p != (int32_t)p, p != (int32_t)p);
+		goto write_rt;
+	}
+	case 73: case 73 | 512:		/* mulhd */
+		r = ((__int128_t)(int64_t)a * (int64_t)b) >> 64;
+		goto write_rt;
+	case 9: case 9 | 512:			/* mulhdu */
+		r = ((__uint128_t)a * b) >> 64;
+		goto write_rt;
+	case 75: case 75 | 512: {		/* mulhw */
+		uint64_t p = (uint64_t)((int64_t)(int32_t)a * (int32_t)b);
+
+		r = (p & 0xffffffff00000000ull) | (p >> 32);
+		goto write_rt;
+	}
+	case 11: case 11 | 512: {		/* mulhwu */
+		uint64_t p = (uint64_t)(uint32_t)a * (uint32_t)b;
+
+		r = (p & 0xffffffff00000000ull) | (p >> 32);
+		goto write_rt;
+	}
+
+	case 489: case 489 | 512:
+		r = divide(cpu, a, b, true, false, false, false, oe);
+		goto write_rt;
+	case 457: case 457 | 512:
+		r = divide(cpu, a, b, false, false, false, false, oe);
+		goto write_rt;
+	case 425: case 425 | 512:
+		r = divide(cpu, a, b, true, false, true, false, oe);
+		goto write_rt;
+	case 393: case 393 | 512:
+		r = divide(cpu, a, b, false, false, true, false, oe);
+		goto write_rt;
+	case 491: case 491 | 512:
+		r = divide(cpu, a, b, true, true, false, false, oe);
+		goto write_rt;
+	case 459: case 459 | 512:
+		r = divide(cpu, a, b, false, true, false, false, oe);
+		goto write_rt;
+	case 427: case 427 | 512:
+		r = divide(cpu, a, b, true, true, true, false, oe);
+		goto write_rt;
+	case 395: case 395 | 512:
+		r = divide(cpu, a, b, false, true, true, false, oe);
+		goto write_rt;
+	case 777:
+		r = divide(cpu, a, b, true, false, false, true, false);
+		goto write_rt_norc;
+	case 265:
+		r = divide(cpu, a, b, false, false, false, true, false);
+		goto write_rt_norc;
+	case 779:
+		r = divide(cpu, a, b, true, true, false, true, false);
+		goto write_rt_norc;
+	case 267:
+		r = divide(cpu, a, b, false, true, false, true, false);
+		goto write_rt_norc;
+
+	/* Logical and bit operations; the target is RA */
+	case 28:  r = s & b; goto write_ra;
+	case 60:  r = s & ~b; goto write_ra;
+	case 124: r = ~(s | b); goto write_ra;
+	case 284: r = ~(s ^ b); goto write_ra;
+	case 316: r = s ^ b; goto write_ra;
+	case 412: r = s | ~b; goto write_ra;
+	case 444: r = s | b; goto write_ra;
+	case 476: r = ~(s & b); goto write_ra;
+	case 954: r = (int8_t)s; goto write_ra;
+	case 922: r = (int16_t)s; goto write_ra;
+	case 986: r = (int32_t)s; goto write_ra;
+	case 26:  r = (uint32_t)s ? __builtin_clz((uint32_t)s) : 32; goto write_ra;
+	case 58:  r = s ? __builtin_clzll(s) : 64; goto write_ra;
+	case 538: r = (uint32_t)s ? __builtin_ctz((uint32_t)s) : 32; goto write_ra;
+	case 570: r = s ? __builtin_ctzll(s) : 64; goto write_ra;
+	case 122: r = popcnt_bytes(s); goto write_ra_norc;
+	case 378:
+		r = __builtin_popcount((uint32_t)s) |
+			((uint64_t)__builtin_popcount(s >> 32) << 32);
+		goto write_ra_norc;
+	case 506: r = __builtin_popcountll(s); goto write_ra_norc;
+	case 154: {
+		uint64_t x = s & 0x0101010101010101ull;
+
+		x ^= x >> 8;
+		x ^= x >> 16;
+		r = x & 0x0000000100000001ull;
+		goto write_ra_norc;
+	}
+	case 186: {
+		uint64_t x = s & 0x0101010101010101ull;
+
+		x ^= x >> 8;
+		x ^= x >> 16;
+		x ^= x >> 32;
+		r = x & 1;
+		goto write_ra_norc;
+	}
+	case 508: {
+		r = 0;
+		for (int i = 0; i < 64; i += 8)
+			if (((s ^ b) >> i & 0xff) == 0)
+				r |= 0xffull << i;
+		goto write_ra_norc;
+	}
+	case 252: r = bpermd(s, b); goto write_ra_norc;
+	case 156: r = pdep(s, b); goto write_ra_norc;
+	case 188: r = pext(s, b); goto write_ra_norc;
+	case 220: r = cfuged(s, b); goto write_ra_norc;
+	case 219:
+		r = ((s & 0x00ff00ff00ff00ffull) << 8) |
+			((s >> 8) & 0x00ff00ff00ff00ffull);
+		goto write_ra_norc;
+	case 155:
+		r = ((uint64_t)__builtin_bswap32(s >> 32) << 32) |
+			__builtin_bswap32(s);
+		goto write_ra_norc;
+	case 187: r = __builtin_bswap64(s); goto write_ra_norc;
+	case 282: r = cdtbcd(s); goto write_ra_norc;
+	case 314: r = cbcdtd(s); goto write_ra_norc;
+
+	/* Shifts */
+	case 24:
+		r = (b & 0x20) ? 0 : (uint32_t)((uint32_t)s << (b & 31));
+		goto write_ra;
+	case 536:
+		r = (b & 0x20) ? 0 : (uint32_t)s >> (b & 31);
+		goto write_ra;
+	case 27:
+		r = (b & 0x40) ? 0 : s << (b & 63);
+		goto write_ra;
+	case 539:
+		r = (b & 0x40) ? 0 : s >> (b & 63);
+		goto write_ra;
+	case 792: {		/* sraw */
+		int32_t w = s;
+		unsigned int n = b & 0x3f;
+
+		if (n > 31) {
+			r = w < 0 ? ~0ull : 0;
+			cpu->ca = cpu->ca32 = w < 0;
+		} else {
+			r = (int64_t)(w >> n);
+			cpu->ca = cpu->ca32 = w < 0 && n &&
+				((uint32_t)w & ((1u << n) - 1));
+		}
+		goto write_ra;
+	}
+	case 824: {		/* srawi */
+		int32_t w = s;
+		unsigned int n = rb;
+
+		r = (int64_t)(w >> n);
+		cpu->ca = cpu->ca32 = w < 0 && n && ((uint32_t)w & ((1u << n) - 1));
+		goto write_ra;
+	}
+	case 794: {		/* srad */
+		int64_t d = s;
+		unsigned int n = b & 0x7f;
+
+		if (n > 63) {
+			r = d < 0 ? ~0ull : 0;
+			cpu->ca = cpu->ca32 = d < 0;
+		} else {
+			r = d >> n;
+			cpu->ca = cpu->ca32 = d < 0 && n && (s & ((1ull << n) - 1));
+		}
+		goto write_ra;
+	}
+	case 826: case 827: {	/* sradi */
+		int64_t d = s;
+		unsigned int n = rb | ((insn & 2) << 4);
+
+		r = d >> n;
+		cpu->ca = cpu->ca32 = d < 0 && n && (s & ((1ull << n) - 1));
+		goto write_ra;
+	}
+	case 890: case 891: {	/* extswsli */
+		unsigned int n = rb | ((insn & 2) << 4);
+
+		r = (uint64_t)(int64_t)(int32_t)s << n;
+		goto write_ra;
+	}
+
+	/* Compares */
+	case 0:
+		if (insn & 0x200000)
+			set_cr_field(cpu, rt >> 2, compare(cpu, a, b));
+		else
+			set_cr_field(cpu, rt >> 2, compare(cpu, (int32_t)a, (int32_t)b));
+		return;
+	case 32:
+		if (insn & 0x200000)
+			set_cr_field(cpu, rt >> 2, compare_unsigned(cpu, a, b));
+		else
+			set_cr_field(cpu, rt >> 2,
+				     compare_unsigned(cpu, (uint32_t)a, (uint32_t)b));
+		return;
+	case 192: {		/* cmprb */
+		uint8_t x = a, lo1 = b, hi1 = b >> 8, lo2 = b >> 16, hi2 = b >> 24;
+		bool in = (x >= lo1 && x <= hi1);
+
+		if (insn & 0x200000)
+			in = in || (x >= lo2 && x <= hi2);
+		set_cr_field(cpu, rt >> 2, in ? 4 : 0);
+		return;
+	}
+	case 224: {		/* cmpeqb */
+		bool eq = false;
+
+		for (int i = 0; i < 64; i += 8)
+			if (((b >> i) & 0xff) == (a & 0xff))
+				eq = true;
+		set_cr_field(cpu, rt >> 2, eq ? 4 : 0);
+		return;
+	}
+	case 128: case 384: case 416: case 448: case 480: {
+		/* setb, setbc, setbcr, setnbc, setnbcr */
+		bool bit = (cpu->cr >> (31 - ra)) & 1;
+
+		switch (xo) {
+		case 128: {
+			uint32_t f = get_cr_field(cpu, ra >> 2);
+
+			r = (f & 8) ? ~0ull : (f & 4) ? 1 : 0;
+			break;
+		}
+		case 384: r = bit; break;
+		case 416: r = !bit; break;
+		case 448: r = bit ? ~0ull : 0; break;
+		case 480: r = bit ? 0 : ~0ull; break;
+		}
+		cpu->gpr[rt] = r;
+		return;
+	}
+	case 576:		/* mcrxrx */
+		set_cr_field(cpu, rt >> 2, (cpu->ov << 3) | (cpu->ov32 << 2) |
+			     (cpu->ca << 1) | cpu->ca32);
+		return;
+
+	/* Traps */
+	case 4:
+		if (trap_cond(a, b, rt, true))
+			trap();
+		return;
+	case 68:
+		if (trap_cond(a, b, rt, false))
+			trap();
+		return;
+
+	/* CR and SPR moves */
+	case 19:
+		if (insn & 0x100000)	/* mfocrf */
+			cpu->gpr[rt] = cpu->cr & fxm_field_mask(insn);
+		else
+			cpu->gpr[rt] = cpu->cr;
+		return;
+	case 144: {
+		uint32_t fxm = (insn >> 12) & 0xff, m = 0;
+
+		if (insn & 0x100000) {	/* mtocrf */
+			m = fxm_field_mask(insn);
+		} else {
+			for (int i = 0; i < 8; i++)
+				if (fxm & (0x80 >> i))
+					m |= 0xf0000000u >> (4 * i);
+		}
+		cpu->cr = (cpu->cr & ~m) | ((uint32_t)s & m);
+		return;
+	}
+	case 339:
+		do_mfspr(cpu, insn);
+		return;
+	case 467:
+		do_mtspr(cpu, insn);
+		return;
+	case 83:
+		if (cpu->msr & MSR_PR)
+			privileged();
+		cpu->gpr[rt] = cpu->msr;
+		return;
+	case 146:
+	case 178:
+		if (cpu->msr & MSR_PR)
+			privileged();
+		mtmsr(cpu, s, insn & 0x10000, xo == 146);
+		return;
+
+	/* Loads */
+	case 87:  cpu->gpr[rt] = load(cpu, ea, 1, false); return;
+	case 279: cpu->gpr[rt] = load(cpu, ea, 2, false); return;
+	case 343: cpu->gpr[rt] = (int16_t)load(cpu, ea, 2, false); return;
+	case 23:  cpu->gpr[rt] = load(cpu, ea, 4, false); return;
+	case 341: cpu->gpr[rt] = (int32_t)load(cpu, ea, 4, false); return;
+	case 21:  cpu->gpr[rt] = load(cpu, ea, 8, false); return;
+	case 790: cpu->gpr[rt] = load(cpu, ea, 2, true); return;
+	case 534: cpu->gpr[rt] = load(cpu, ea, 4, true); return;
+	case 532: cpu->gpr[rt] = load(cpu, ea, 8, true); return;
+	case 119: ea = a + b; r = load(cpu, ea, 1, false); goto load_update;
+	case 311: ea = a + b; r = load(cpu, ea, 2, false); goto load_update;
+	case 375: ea = a + b; r = (int16_t)load(cpu, ea, 2, false); goto load_update;
+	case 55:  ea = a + b; r = load(cpu, ea, 4, false); goto load_update;
+	case 373: ea = a + b; r = (int32_t)load(cpu, ea, 4, false); goto load_update;
+	case 53:  ea = a + b; r = load(cpu, ea, 8, false); goto load_update;
+	case 853: case 821: case 789: case 885: {
+		/* cache-inhibited loads, real mode only */
+		static const unsigned int len[4] = { 4, 2, 1, 8 };
+
+		if (cpu->msr & MSR_PR)
+			privileged();
+		cpu->gpr[rt] = load(cpu, ea, len[(xo >> 5) - 24], false);
+		return;
+	}
+	case 52:  larx(cpu, insn, ea, 1); return;
+	case 116: larx(cpu, insn, ea, 2); return;
+	case 20:  larx(cpu, insn, ea, 4); return;
+	case 84:  larx(cpu, insn, ea, 8); return;
+	case 276:
+		if ((rt & 1) || rt == ra || rt == rb)
+			illegal(cpu, insn);
+		larx(cpu, insn, ea, 16);
+		return;
+
+	/* Stores */
+	case 215: store(cpu, ea, 1, s, false); return;
+	case 407: store(cpu, ea, 2, s, false); return;
+	case 151: store(cpu, ea, 4, s, false); return;
+	case 149: store(cpu, ea, 8, s, false); return;
+	case 918: store(cpu, ea, 2, s, true); return;
+	case 662: store(cpu, ea, 4, s, true); return;
+	case 660: store(cpu, ea, 8, s, true); return;
+	case 247: ea = a + b; store(cpu, ea, 1, s, false); goto store_update;
+	case 439: ea = a + b; store(cpu, ea, 2, s, false); goto store_update;
+	case 183: ea = a + b; store(cpu, ea, 4, s, false); goto store_update;
+	case 181: ea = a + b; store(cpu, ea, 8, s, false); goto store_update;
+	case 981: case 949: case 917: case 1013: {
+		static const unsigned int len[4] = { 4, 2, 1, 8 };
+
+		if (cpu->msr & MSR_PR)
+			privileged();
+		store(cpu, ea, len[(xo >> 5) - 28], s, false);
+		return;
+	}
+	case 694: stcx(cpu, insn, ea, 1); return;
+	case 726: stcx(cpu, insn, ea, 2); return;
+	case 150: stcx(cpu, insn, ea, 4); return;
+	case 214: stcx(cpu, insn, ea, 8); return;
+	case 182:
+		if (rt & 1)
+			illegal(cpu, insn);
+		stcx(cpu, insn, ea, 16);
+		return;
+
+	/* FP loads and stores are done in fpu.cpp */
+	case 535: case 567: case 599: case 631:
+	case 663: case 695: case 727: case 759:
+	case 855: case 887: case 983:
+		execute_fp(cpu, insn);
+		return;
+
+	/* Cache management and synchronization */
+	case 1014: {		/* dcbz */
+		uint64_t line = ea_mask(cpu, ea) & ~63ull;
+
+		for (int i = 0; i < 64; i += 8)
+			store(cpu, line + i, 8, 0, false);
+		return;
+	}
+	case 86: case 278: case 982: case 22:	/* dcbf, dcbt, icbi, icbt */
+	case 246:				/* dcbtst */
+		/* these count as a load or store for trace interrupts */
+		cpu->mem_access = xo == 246 ? ACCESS_STORE : ACCESS_LOAD;
+		cpu->mem_ea = ea_mask(cpu, ea);
+		return;
+	case 54: case 854: case 598: case 838: case 822: case 342: case 374:
+	case 886: case 566:
+	case 530: case 562: case 594: case 626:
+		return;
+	case 30:		/* wait */
+		return;
+	case 755:		/* darn: a fixed value is as good as any here */
+		cpu->gpr[rt] = ((insn >> 16) & 3) == 0 ? 0x12345678 :
+			0x123456789abcdef0ull;
+		return;
+
+	/* MMU management */
+	case 306:
+	case 274:
+		if (cpu->msr & MSR_PR)
+			privileged();
+		if (((insn >> 18) & 3) || (b & 0xcc0))
+			tlb_flush(cpu);
+		else
+			tlb_flush_page(cpu, b);
+		return;
+	case 498:		/* slbia */
+		if (cpu->msr & MSR_PR)
+			privileged();
+		tlb_flush(cpu);
+		return;
+
+	case 206: case 238:	/* msgsnd, msgclr */
+		if (cpu->msr & MSR_PR)
+			privileged();
+		return;
+
+	case 722: case 754: case 658: case 690:
+		hash_insn(cpu, insn);
+		return;
+	}
+	illegal(cpu, insn);
+
+ load_update:
+	cpu->gpr[ra] = ea_mask(cpu, ea);
+	cpu->gpr[rt] = r;
+	return;
+ store_update:
+	cpu->gpr[ra] = ea_mask(cpu, ea);
+	return;
+ write_rt:
+	cpu->gpr[rt] = r;
+	if (rc)
+		set_cr0(cpu, r);
+	return;
+ write_rt_norc:
+	cpu->gpr[rt] = r;
+	return;
+ write_ra:
+	cpu->gpr[ra] = r;
+	if (rc)
+		set_cr0(cpu, r);
+	return;
+ write_ra_norc:
+	cpu->gpr[ra] = r;
+	return;
+}
+
+static void execute_19(struct cpu *cpu, uint32_t insn, uint64_t cia)
+{
+	unsigned int bt = insn_rt(insn), ba = insn_ra(insn), bb = insn_rb(insn);
+	unsigned int xo = (insn >> 1) & 0x3ff;
+	bool lk = insn & 1;
+	uint64_t target;
+	bool a, b, r;
+
+	if ((xo & 0x1f) == 2) {
+		/* addpcis */
+		int64_t d = ((insn >> 6) & 0x3ff) << 6 | ((insn >> 16) & 0x1f) << 1 |
+			(insn & 1);
+
+		d = (int16_t)d;
+		cpu->gpr[bt] = ea_mask(cpu, cia + 4 + (d << 16));
+		return;
+	}
+	switch (xo) {
+	case 16:		/* bclr */
+		target = cpu->lr;
+		if (cond_true(cpu, bt, ba)) {
+			if (lk)
+				cpu->lr = cia + 4;
+			branch(cpu, target & ~3ull, cia);
+		} else if (lk) {
+			cpu->lr = cia + 4;
+		}
+		return;
+	case 528:		/* bcctr */
+		if (!(bt & 4))
+			illegal(cpu, insn);
+		target = cpu->ctr;
+		if (cond_true(cpu, bt, ba))
+			branch(cpu, target & ~3ull, cia);
+		if (lk)
+			cpu->lr = cia + 4;
+		return;
+	case 560:		/* bctar */
+		if ((cpu->msr & MSR_PR) && !(cpu->spr[SPR_FSCR] & FSCR_TAR)) {
+			cpu->spr[SPR_FSCR] = (cpu->spr[SPR_FSCR] & ~(0xfull << 56)) |
+				(8ull << 56);
+			raise(0xf60);
+		}
+		target = cpu->spr[SPR_TAR];
+		if (cond_true(cpu, bt, ba))
+			branch(cpu, target & ~3ull, cia);
+		if (lk)
+			cpu->lr = cia + 4;
+		return;
+	case 0:			/* mcrf */
+		set_cr_field(cpu, bt >> 2, get_cr_field(cpu, ba >> 2));
+		return;
+	case 150:		/* isync */
+		return;
+	case 18:		/* rfid */
+	case 274:		/* hrfid */
+		if (cpu->msr & MSR_PR)
+			privileged();
+		if (xo == 18)
+			rfid(cpu, cpu->spr[SPR_SRR0], cpu->spr[SPR_SRR1], cia);
+		else
+			rfid(cpu, cpu->spr[SPR_HSRR0], cpu->spr[SPR_HSRR1], cia);
+		return;
+	case 82:		/* rfscv */
+		if (cpu->msr & MSR_PR)
+			privileged();
+		rfid(cpu, cpu->lr, cpu->ctr, cia);
+		return;
+	}
+
+	a = (cpu->cr >> (31 - ba)) & 1;
+	b = (cpu->cr >> (31 - bb)) & 1;
+	switch (xo) {
+	case 257: r = a & b; break;
+	case 129: r = a & !b; break;
+	case 289: r = a == b; break;
+	case 225: r = !(a & b); break;
+	case 33:  r = !(a | b); break;
+	case 449: r = a | b; break;
+	case 417: r = a | !b; break;
+	case 193: r = a ^ b; break;
+	default:
+		illegal(cpu, insn);
+	}
+	cpu->cr = (cpu->cr & ~(0x80000000u >> bt)) | ((uint32_t)r << (31 - bt));
+}
+
+static void execute_rld(struct cpu *cpu, uint32_t insn)
+{
+	unsigned int rs = insn_rt(insn), ra = insn_ra(insn);
+	uint64_t s = cpu->gpr[rs], r, m;
+	unsigned int sh = insn_rb(insn) | ((insn & 2) << 4);
+	unsigned int mb = ((insn >> 6) & 0x1f) | (insn & 0x20);
+
+	switch ((insn >> 2) & 7) {
+	case 0:			/* rldicl */
+		r = rotl64(s, sh) & mask64(mb, 63);
+		break;
+	case 1:			/* rldicr */
+		r = rotl64(s, sh) & mask64(0, mb);
+		break;
+	case 2:			/* rldic */
+		r = rotl64(s, sh) & mask64(mb, 63 - sh);
+		break;
+	case 3:			/* rldimi */
+		m = mask64(mb, 63 - sh);
+		r = (rotl64(s, sh) & m) | (cpu->gpr[ra] & ~m);
+		break;
+	case 4:
+		sh = cpu->gpr[insn_rb(insn)] & 63;
+		if (insn & 2)	/* rldcr */
+			r = rotl64(s, sh) & mask64(0, mb);
+		else		/* rldcl */
+			r = rotl64(s, sh) & mask64(mb, 63);
+		break;
+	default:
+		illegal(cpu, insn);
+	}
+	cpu->gpr[ra] = r;
+	if (insn & 1)
+		set_cr0(cpu, r);
+}
+
+void execute(struct cpu *cpu, uint32_t insn)
+{
+	unsigned int op = insn >> 26;
+	unsigned int rt = insn_rt(insn), ra = insn_ra(insn);
+	uint64_t cia = cpu->nia;
+	uint64_t a = cpu->gpr[ra], a0 = ra ? a : 0;
+	int64_t d = (int16_t)insn;
+	uint64_t ea = a0 + d, r;
+	uint32_t c;
+
+	if ((cpu->msr & (MSR_FP | MSR_PR)) != MSR_FP && fp_insn(insn)) {
+		if (!(cpu->msr & MSR_FP))
+			raise(0x800);
+	}
+	cpu->nia = ea_mask(cpu, cia + 4);
+
+	switch (op) {
+	case 0:
+		if (insn == 0x00000200) {
+			if (cpu->msr & MSR_PR)
+				privileged();
+			cpu->halted = true;
+			cpu->nia = cia;
+			return;
+		}
+		break;
+	case 2:
+		if (trap_cond(a, d, rt, false))
+			trap();
+		return;
+	case 3:
+		if (trap_cond(a, d, rt, true))
+			trap();
+		return;
+	case 4:
+		switch (insn & 0x3f) {
+		case 48: {	/* maddhd */
+			__int128_t p = (__int128_t)(int64_t)a *
+				(int64_t)cpu->gpr[insn_rb(insn)] +
+				(int64_t)cpu->gpr[insn_rc(insn)];
+
+			cpu->gpr[rt] = p >> 64;
+			return;
+		}
+		case 49: {	/* maddhdu */
+			__uint128_t p = (__uint128_t)a * cpu->gpr[insn_rb(insn)] +
+				cpu->gpr[insn_rc(insn)];
+
+			cpu->gpr[rt] = p >> 64;
+			return;
+		}
+		case 51:	/* maddld */
+			cpu->gpr[rt] = a * cpu->gpr[insn_rb(insn)] +
+				cpu->gpr[insn_rc(insn)];
+			return;
+		}
+		break;
+	case 7:
+		cpu->gpr[rt] = a * d;
+		return;
+	case 8:
+		cpu->gpr[rt] = add_carry(cpu, ~a, d, 1, true, false);
+		return;
+	case 10:
+		if (insn & 0x200000)
+			c = compare_unsigned(cpu, a, (uint16_t)insn);
+		else
+			c = compare_unsigned(cpu, (uint32_t)a, (uint16_t)insn);
+		set_cr_field(cpu, rt >> 2, c);
+		return;
+	case 11:
+		if (insn & 0x200000)
+			c = compare(cpu, a, d);
+		else
+			c = compare(cpu, (int32_t)a, d);
+		set_cr_field(cpu, rt >> 2, c);
+		return;
+	case 12:
+		cpu->gpr[rt] = add_carry(cpu, a, d, 0, true, false);
+		return;
+	case 13:
+		r = add_carry(cpu, a, d, 0, true, false);
+		cpu->gpr[rt] = r;
+		set_cr0(cpu, r);
+		return;
+	case 14:
+		cpu->gpr[rt] = a0 + d;
+		return;
+	case 15:
+		cpu->gpr[rt] = a0 + (d << 16);
+		return;
+	case 16: {		/* bc */
+		uint64_t target = (int16_t)(insn & 0xfffc);
+
+		if (!(insn & 2))
+			target += cia;
+		if (cond_true(cpu, rt, ra))
+			branch(cpu, target, cia);
+		/* not truncated in 32-bit mode, as in the RTL */
+		if (insn & 1)
+			cpu->lr = cia + 4;
+		return;
+	}
+	case 17:
+		if (insn & 2) {
+			/* sc */
+			cpu->no_trace = true;
+			take_interrupt(cpu, { 0xc00, 0, false });
+		} else {
+			/* scv */
+			if ((cpu->msr & MSR_PR) && !(cpu->spr[SPR_FSCR] & FSCR_SCV)) {
+				cpu->nia = cia;
+				cpu->spr[SPR_FSCR] =
+					(cpu->spr[SPR_FSCR] & ~(0xfull << 56)) |
+					(12ull << 56);
+				raise(0xf60);
+			}
+			cpu->no_trace = true;
+			take_interrupt(cpu, { 0x17000 + ((insn >> 5) & 0x7f) * 32,
+					      0, false });
+		}
+		return;
+	case 18: {		/* b */
+		uint64_t target = insn & 0x03fffffc;
+
+		if (target & 0x02000000)
+			target |= ~0x03ffffffull;
+		if (!(insn & 2))
+			target += cia;
+		if (insn & 1)
+			cpu->lr = cia + 4;
+		branch(cpu, target, cia);
+		return;
+	}
+	case 19:
+		execute_19(cpu, insn, cia);
+		return;
+	case 20: {		/* rlwimi */
+		uint64_t m = mask64(32 + insn_rc(insn), 32 + ((insn >> 1) & 31));
+
+		r = (rotl32(cpu->gpr[rt], insn_rb(insn)) & m) | (a & ~m);
+		goto write_ra;
+	}
+	case 21:		/* rlwinm */
+		r = rotl32(cpu->gpr[rt], insn_rb(insn)) &
+			mask64(32 + insn_rc(insn), 32 + ((insn >> 1) & 31));
+		goto write_ra;
+	case 23:		/* rlwnm */
+		r = rotl32(cpu->gpr[rt], cpu->gpr[insn_rb(insn)] & 31) &
+			mask64(32 + insn_rc(insn), 32 + ((insn >> 1) & 31));
+		goto write_ra;
+	case 24:
+		cpu->gpr[ra] = cpu->gpr[rt] | (uint16_t)insn;
+		return;
+	case 25:
+		cpu->gpr[ra] = cpu->gpr[rt] | ((uint64_t)(uint16_t)insn << 16);
+		return;
+	case 26:
+		cpu->gpr[ra] = cpu->gpr[rt] ^ (uint16_t)insn;
+		return;
+	case 27:
+		cpu->gpr[ra] = cpu->gpr[rt] ^ ((uint64_t)(uint16_t)insn << 16);
+		return;
+	case 28:
+		r = cpu->gpr[rt] & (uint16_t)insn;
+		cpu->gpr[ra] = r;
+		set_cr0(cpu, r);
+		return;
+	case 29:
+		r = cpu->gpr[rt] & ((uint64_t)(uint16_t)insn << 16);
+		cpu->gpr[ra] = r;
+		set_cr0(cpu, r);
+		return;
+	case 30:
+		execute_rld(cpu, insn);
+		return;
+	case 31:
+		execute_31(cpu, insn, cia);
+		return;
+	case 32: cpu->gpr[rt] = load(cpu, ea, 4, false); return;
+	case 34: cpu->gpr[rt] = load(cpu, ea, 1, false); return;
+	case 40: cpu->gpr[rt] = load(cpu, ea, 2, false); return;
+	case 42: cpu->gpr[rt] = (int16_t)load(cpu, ea, 2, false); return;
+	case 33: ea = a + d; r = load(cpu, ea, 4, false); goto load_update;
+	case 35: ea = a + d; r = load(cpu, ea, 1, false); goto load_update;
+	case 41: ea = a + d; r = load(cpu, ea, 2, false); goto load_update;
+	case 43: ea = a + d; r = (int16_t)load(cpu, ea, 2, false); goto load_update;
+	case 36: store(cpu, ea, 4, cpu->gpr[rt], false); return;
+	case 38: store(cpu, ea, 1, cpu->gpr[rt], false); return;
+	case 44: store(cpu, ea, 2, cpu->gpr[rt], false); return;
+	case 37: ea = a + d; store(cpu, ea, 4, cpu->gpr[rt], false); goto store_update;
+	case 39: ea = a + d; store(cpu, ea, 1, cpu->gpr[rt], false); goto store_update;
+	case 45: ea = a + d; store(cpu, ea, 2, cpu->gpr[rt], false); goto store_update;
+	case 48 ... 55:
+	case 59:
+	case 63:
+		execute_fp(cpu, insn);
+		return;
+	case 56:		/* lq */
+		if (insn & 0xf)
+			break;
+		load_quad(cpu, insn, a0 + (int16_t)(insn & 0xfff0), false);
+		return;
+	case 58:
+		ea = a0 + (int16_t)(insn & 0xfffc);
+		switch (insn & 3) {
+		case 0:
+			cpu->gpr[rt] = load(cpu, ea, 8, false);
+			return;
+		case 1:
+			ea = a + (int16_t)(insn & 0xfffc);
+			r = load(cpu, ea, 8, false);
+			goto load_update;
+		case 2:
+			cpu->gpr[rt] = (int32_t)load(cpu, ea, 4, false);
+			return;
+		}
+		break;
+	case 62:
+		ea = a0 + (int16_t)(insn & 0xfffc);
+		switch (insn & 3) {
+		case 0:
+			store(cpu, ea, 8, cpu->gpr[rt], false);
+			return;
+		case 1:
+			ea = a + (int16_t)(insn & 0xfffc);
+			store(cpu, ea, 8, cpu->gpr[rt], false);
+			goto store_update;
+		case 2:
+			store_quad(cpu, insn, ea, false);
+			return;
+		}
+		break;
+	}
+	cpu->nia = cia;
+	illegal(cpu, insn);
+
+ load_update:
+	cpu->gpr[ra] = ea_mask(cpu, ea);
+	cpu->gpr[rt] = r;
+	return;
+ store_update:
+	cpu->gpr[ra] = ea_mask(cpu, ea);
+	return;
+ write_ra:
+	cpu->gpr[ra] = r;
+	if (insn & 1)
+		set_cr0(cpu, r);
+}
+
+/*
+ * Prefixed instructions. The prefix has already been checked for the
+ * alignment and facility conditions by the caller.
+ */
+void execute_prefixed(struct cpu *cpu, uint32_t prefix, uint32_t insn)
+{
+	unsigned int type = (prefix >> 23) & 7;
+	unsigned int rt = insn_rt(insn), ra = insn_ra(insn);
+	uint64_t cia = cpu->nia;
+	int64_t d = ((int64_t)((uint64_t)(prefix & 0x3ffff) << 46) >> 30) |
+		(uint16_t)insn;
+	bool r = (prefix >> 20) & 1;
+	uint64_t ea;
+
+	cpu->nia = ea_mask(cpu, cia + 8);
+	if ((prefix >> 24) & 1) {
+		/* pnop: MRR form with a zero suffix-type field */
+		if (type == 6 && ((prefix >> 20) & 7) == 0)
+			return;
+		goto bad;
+	}
+	if (r && ra)
+		goto bad;
+	ea = (r ? cia : (ra ? cpu->gpr[ra] : 0)) + d;
+	if (type == 4) {
+		/* MLS form */
+		switch (insn >> 26) {
+		case 14: cpu->gpr[rt] = ea; return;
+		case 32: cpu->gpr[rt] = load(cpu, ea, 4, false); return;
+		case 34: cpu->gpr[rt] = load(cpu, ea, 1, false); return;
+		case 40: cpu->gpr[rt] = load(cpu, ea, 2, false); return;
+		case 42: cpu->gpr[rt] = (int16_t)load(cpu, ea, 2, false); return;
+		case 36: store(cpu, ea, 4, cpu->gpr[rt], false); return;
+		case 38: store(cpu, ea, 1, cpu->gpr[rt], false); return;
+		case 44: store(cpu, ea, 2, cpu->gpr[rt], false); return;
+		case 48: case 50: case 52: case 54:
+			if (!(cpu->msr & MSR_FP)) {
+				cpu->nia = cia;
+				raise(0x800, SRR1_PREFIXED);
+			}
+			execute_fp_prefixed(cpu, insn, ea);
+			return;
+		}
+	} else if (type == 0) {
+		/* 8LS form */
+		switch (insn >> 26) {
+		case 41: cpu->gpr[rt] = (int32_t)load(cpu, ea, 4, false); return;
+		case 56: load_quad(cpu, insn, ea, true); return;
+		case 57: cpu->gpr[rt] = load(cpu, ea, 8, false); return;
+		case 60: store_quad(cpu, insn, ea, true); return;
+		case 61: store(cpu, ea, 8, cpu->gpr[rt], false); return;
+		}
+	}
+ bad:
+	cpu->nia = cia;
+	cpu->spr[SPR_HEIR] = ((uint64_t)prefix << 32) | insn;
+	raise(0xe40, SRR1_PREFIXED, true);
+}
@@ -0,0 +1,973 @@
+/*
+ * Floating-point instructions.
+ *
+ * Arithmetic is done with host doubles, with the rounding mode and
+ * exception flags taken from and folded back into the FPSCR. NaN
+ * propagation, fcti* saturation values and the conditions under which the
+ * target is left unmodified follow fpu.vhdl. The reciprocal and square-root
+ * estimates (fre, frsqrte) return the correctly rounded value rather than
+ * the RTL's table-based estimate.
+ */
+
+#include <fenv.h>
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+#include "funcsim.h"
+
+#define FPS_FX		(1u << 31)
+#define FPS_VX		(1u << 29)
+#define FPS_OX		(1u << 28)
+#define FPS_UX		(1u << 27)
+#define FPS_ZX		(1u << 26)
+#define FPS_XX		(1u << 25)
+#define FPS_VXSNAN	(1u << 24)
+#define FPS_VXISI	(1u << 23)
+#define FPS_VXIDI	(1u << 22)
+#define FPS_VXZDZ	(1u << 21)
+#define FPS_VXIMZ	(1u << 20)
+#define FPS_VXVC	(1u << 19)
+#define FPS_FR		(1u << 18)
+#define FPS_FI		(1u << 17)
+#define FPS_FPRF	(0x1fu << 12)
+#define FPS_FPCC	(0xfu << 12)
+#define FPS_VXSOFT	(1u << 10)
+#define FPS_VXSQRT	(1u << 9)
+#define FPS_VXCVI	(1u << 8)
+#define FPS_VE		(1u << 7)
+#define FPS_OE		(1u << 6)
+#define FPS_UE		(1u << 5)
+#define FPS_ZE		(1u << 4)
+#define FPS_XE		(1u << 3)
+
+#define FPS_VX_ALL	(FPS_VXSNAN | FPS_VXISI | FPS_VXIDI | FPS_VXZDZ | \
+			 FPS_VXIMZ | FPS_VXVC | FPS_VXSOFT | FPS_VXSQRT | \
+			 FPS_VXCVI)
+#define FPS_EXC_ALL	(FPS_OX | FPS_UX | FPS_ZX | FPS_XX | FPS_VX_ALL)
+
+#define DP_QNAN		0x7ff8000000000000ull
+#define DP_QUIET	(1ull << 51)
+
+static inline double to_double(uint64_t bits)
+{
+	double d;
+
+	memcpy(&d, &bits, 8);
+	return d;
+}
+
+static inline uint64_t to_bits(double d)
+{
+	uint64_t bits;
+
+	memcpy(&bits, &d, 8);
+	return bits;
+}
+
+static inline bool is_nan(uint64_t x)
+{
+	return (x & 0x7fffffffffffffffull) > 0x7ff0000000000000ull;
+}
+
+static inline bool is_snan(uint64_t x)
+{
+	return is_nan(x) && !(x & DP_QUIET);
+}
+
+static inline bool is_inf(uint64_t x)
+{
+	return (x & 0x7fffffffffffffffull) == 0x7ff0000000000000ull;
+}
+
+static inline bool is_zero(uint64_t x)
+{
+	return !(x & 0x7fffffffffffffffull);
+}
+
+/* Convert single-precision bits to double-precision bits, exactly */
+static uint64_t single_to_dp(uint32_t w)
+{
+	uint64_t sign = (uint64_t)(w >> 31) << 63;
+	unsigned int exp = (w >> 23) & 0xff;
+	uint64_t frac = w & 0x7fffff;
+
+	if (exp == 0xff)
+		return sign | 0x7ff0000000000000ull | (frac << 29);
+	if (exp == 0) {
+		int e = 897;
+
+		if (!frac)
+			return sign;
+		while (!(frac & 0x800000)) {
+			frac <<= 1;
+			e--;
+		}
+		return sign | ((uint64_t)e << 52) | ((frac & 0x7fffff) << 29);
+	}
+	return sign | ((uint64_t)(exp + 896) << 52) | (frac << 29);
+}
+
+/* The stfs conversion: no rounding, denormalize if needed */
+static uint32_t dp_to_single(uint64_t x)
+{
+	unsigned int exp = (x >> 52) & 0x7ff;
+
+	if (exp >= 874 && exp <= 896) {
+		uint64_t mant = (x & 0x000fffffffffffffull) | (1ull << 52);
+
+		mant >>= 897 - exp;
+		return ((x >> 32) & 0x80000000u) | (uint32_t)(mant >> 29);
+	}
+	return ((x >> 32) & 0xc0000000u) | ((x >> 29) & 0x3fffffffu);
+}
+
+/* Single-precision results below 2^-126 are denormal as singles */
+static uint32_t fprf(uint64_t x, bool single)
+{
+	bool neg = x >> 63;
+	unsigned int exp = (x >> 52) & 0x7ff;
+
+	if (is_nan(x))
+		return 0x11;
+	if (is_inf(x))
+		return neg ? 0x09 : 0x05;
+	if (is_zero(x))
+		return neg ? 0x12 : 0x02;
+	if (exp == 0 || (single && exp < 0x381))
+		return neg ? 0x18 : 0x14;
+	return neg ? 0x08 : 0x04;
+}
+
+static const int host_rounding[4] = {
+	FE_TONEAREST, FE_TOWARDZERO, FE_UPWARD, FE_DOWNWARD
+};
+
+/* Set the exception bits in new, updating FX, VX and FEX */
+static void fpscr_set(struct cpu *cpu, uint32_t bits)
+{
+	uint32_t old = cpu->fpscr;
+	uint32_t f = old | bits;
+
+	if ((f & ~old) & FPS_EXC_ALL)
+		f |= FPS_FX;
+	cpu->fpscr = f;
+}
+
+static void fpscr_summary(struct cpu *cpu)
+{
+	/* bit 52 is reserved and reads as 0 */
+	uint32_t f = cpu->fpscr & ~(FPS_VX | FPS_FEX | 0x800);
+
+	if (f & FPS_VX_ALL)
+		f |= FPS_VX;
+	if (((f & FPS_VX) && (f & FPS_VE)) || ((f & FPS_OX) && (f & FPS_OE)) ||
+	    ((f & FPS_UX) && (f & FPS_UE)) || ((f & FPS_ZX) && (f & FPS_ZE)) ||
+	    ((f & FPS_XX) && (f & FPS_XE)))
+		f |= FPS_FEX;
+	cpu->fpscr = f;
+}
+
+/* Round a double result to single precision, keeping NaN payloads */
+static uint64_t round_single(uint64_t x)
+{
+	if (is_nan(x))
+		return x & 0xffffffffe0000000ull;
+	return to_bits((double)(float)to_double(x));
+}
+
+enum fp_arith { FADD, FSUB, FMUL, FDIV, FSQRT, FMADD, FMSUB, FNMADD, FNMSUB,
+		FRE, FRSQRTE, FRSP, FCFID, FCFIDU, FRIN, FRIZ, FRIP, FRIM };
+
+/*
+ * The estimate table from fpu.vhdl, so that fre and frsqrte give the same
+ * results as the RTL. Entries are 0.19 fractions in [0.5, 1) without the
+ * top bit. The first 256 are 1/x for x in [1, 2), indexed by the top 8
+ * fraction bits; the other 768 are 1/sqrt(x) for x in [1, 4), indexed by
+ * the two integer bits and the top 8 fraction bits.
+ */
+static const uint32_t inverse_table[1024] = {
+	0x3fc01, 0x3f411, 0x3ec31, 0x3e460, 0x3dc9f, 0x3d4ec, 0x3cd49, 0x3c5b5,
+	0x3be2f, 0x3b6b8, 0x3af4f, 0x3a7f4, 0x3a0a7, 0x39968, 0x39237, 0x38b14,
+	0x383fe, 0x37cf5, 0x375f9, 0x36f0a, 0x36828, 0x36153, 0x35a8a, 0x353ce,
+	0x34d1e, 0x3467a, 0x33fe3, 0x33957, 0x332d7, 0x32c62, 0x325f9, 0x31f9c,
+	0x3194a, 0x31303, 0x30cc7, 0x30696, 0x30070, 0x2fa54, 0x2f443, 0x2ee3d,
+	0x2e841, 0x2e250, 0x2dc68, 0x2d68b, 0x2d0b8, 0x2caee, 0x2c52e, 0x2bf79,
+	0x2b9cc, 0x2b429, 0x2ae90, 0x2a900, 0x2a379, 0x29dfb, 0x29887, 0x2931b,
+	0x28db8, 0x2885e, 0x2830d, 0x27dc4, 0x27884, 0x2734d, 0x26e1d, 0x268f6,
+	0x263d8, 0x25ec1, 0x259b3, 0x254ac, 0x24fad, 0x24ab7, 0x245c8, 0x240e1,
+	0x23c01, 0x23729, 0x23259, 0x22d90, 0x228ce, 0x22413, 0x21f60, 0x21ab4,
+	0x2160f, 0x21172, 0x20cdb, 0x2084b, 0x203c2, 0x1ff40, 0x1fac4, 0x1f64f,
+	0x1f1e1, 0x1ed79, 0x1e918, 0x1e4be, 0x1e069, 0x1dc1b, 0x1d7d4, 0x1d392,
+	0x1cf57, 0x1cb22, 0x1c6f3, 0x1c2ca, 0x1bea7, 0x1ba8a, 0x1b672, 0x1b261,
+	0x1ae55, 0x1aa50, 0x1a64f, 0x1a255, 0x19e60, 0x19a70, 0x19686, 0x192a2,
+	0x18ec3, 0x18ae9, 0x18715, 0x18345, 0x17f7c, 0x17bb7, 0x177f7, 0x1743d,
+	0x17087, 0x16cd7, 0x1692c, 0x16585, 0x161e4, 0x15e47, 0x15ab0, 0x1571d,
+	0x1538e, 0x15005, 0x14c80, 0x14900, 0x14584, 0x1420d, 0x13e9b, 0x13b2d,
+	0x137c3, 0x1345e, 0x130fe, 0x12da2, 0x12a4a, 0x126f6, 0x123a7, 0x1205c,
+	0x11d15, 0x119d2, 0x11694, 0x11359, 0x11023, 0x10cf1, 0x109c2, 0x10698,
+	0x10372, 0x10050, 0x0fd31, 0x0fa17, 0x0f700, 0x0f3ed, 0x0f0de, 0x0edd3,
+	0x0eacb, 0x0e7c7, 0x0e4c7, 0x0e1ca, 0x0ded2, 0x0dbdc, 0x0d8eb, 0x0d5fc,
+	0x0d312, 0x0d02b, 0x0cd47, 0x0ca67, 0x0c78a, 0x0c4b1, 0x0c1db, 0x0bf09,
+	0x0bc3a, 0x0b96e, 0x0b6a5, 0x0b3e0, 0x0b11e, 0x0ae5f, 0x0aba3, 0x0a8eb,
+	0x0a636, 0x0a383, 0x0a0d4, 0x09e28, 0x09b80, 0x098da, 0x09637, 0x09397,
+	0x090fb, 0x08e61, 0x08bca, 0x08936, 0x086a5, 0x08417, 0x0818c, 0x07f04,
+	0x07c7e, 0x079fc, 0x0777c, 0x074ff, 0x07284, 0x0700d, 0x06d98, 0x06b26,
+	0x068b6, 0x0664a, 0x063e0, 0x06178, 0x05f13, 0x05cb1, 0x05a52, 0x057f5,
+	0x0559a, 0x05342, 0x050ed, 0x04e9a, 0x04c4a, 0x049fc, 0x047b0, 0x04567,
+	0x04321, 0x040dd, 0x03e9b, 0x03c5c, 0x03a1f, 0x037e4, 0x035ac, 0x03376,
+	0x03142, 0x02f11, 0x02ce2, 0x02ab5, 0x0288b, 0x02663, 0x0243d, 0x02219,
+	0x01ff7, 0x01dd8, 0x01bbb, 0x019a0, 0x01787, 0x01570, 0x0135b, 0x01149,
+	0x00f39, 0x00d2a, 0x00b1e, 0x00914, 0x0070c, 0x00506, 0x00302, 0x00100,
+	0x3fe00, 0x3fa06, 0x3f612, 0x3f224, 0x3ee3a, 0x3ea58, 0x3e67c, 0x3e2a4,
+	0x3ded2, 0x3db06, 0x3d73e, 0x3d37e, 0x3cfc2, 0x3cc0a, 0x3c85a, 0x3c4ae,
+	0x3c106, 0x3bd64, 0x3b9c8, 0x3b630, 0x3b29e, 0x3af10, 0x3ab86, 0x3a802,
+	0x3a484, 0x3a108, 0x39d94, 0x39a22, 0x396b6, 0x3934e, 0x38fea, 0x38c8c,
+	0x38932, 0x385dc, 0x3828a, 0x37f3e, 0x37bf6, 0x378b2, 0x37572, 0x37236,
+	0x36efe, 0x36bca, 0x3689a, 0x36570, 0x36248, 0x35f26, 0x35c06, 0x358ea,
+	0x355d4, 0x352c0, 0x34fb0, 0x34ca4, 0x3499c, 0x34698, 0x34398, 0x3409c,
+	0x33da2, 0x33aac, 0x337bc, 0x334cc, 0x331e2, 0x32efc, 0x32c18, 0x32938,
+	0x3265a, 0x32382, 0x320ac, 0x31dd8, 0x31b0a, 0x3183e, 0x31576, 0x312b0,
+	0x30fee, 0x30d2e, 0x30a74, 0x307ba, 0x30506, 0x30254, 0x2ffa4, 0x2fcf8,
+	0x2fa4e, 0x2f7a8, 0x2f506, 0x2f266, 0x2efca, 0x2ed2e, 0x2ea98, 0x2e804,
+	0x2e572, 0x2e2e4, 0x2e058, 0x2ddce, 0x2db48, 0x2d8c6, 0x2d646, 0x2d3c8,
+	0x2d14c, 0x2ced4, 0x2cc5e, 0x2c9ea, 0x2c77a, 0x2c50c, 0x2c2a2, 0x2c038,
+	0x2bdd2, 0x2bb70, 0x2b90e, 0x2b6b0, 0x2b454, 0x2b1fa, 0x2afa4, 0x2ad4e,
+	0x2aafc, 0x2a8ac, 0x2a660, 0x2a414, 0x2a1cc, 0x29f86, 0x29d42, 0x29b00,
+	0x298c2, 0x29684, 0x2944a, 0x29210, 0x28fda, 0x28da6, 0x28b74, 0x28946,
+	0x28718, 0x284ec, 0x282c4, 0x2809c, 0x27e78, 0x27c56, 0x27a34, 0x27816,
+	0x275fa, 0x273e0, 0x271c8, 0x26fb0, 0x26d9c, 0x26b8a, 0x2697a, 0x2676c,
+	0x26560, 0x26356, 0x2614c, 0x25f46, 0x25d42, 0x25b40, 0x2593e, 0x25740,
+	0x25542, 0x25348, 0x2514e, 0x24f58, 0x24d62, 0x24b6e, 0x2497c, 0x2478c,
+	0x2459e, 0x243b0, 0x241c6, 0x23fde, 0x23df6, 0x23c10, 0x23a2c, 0x2384a,
+	0x2366a, 0x2348c, 0x232ae, 0x230d2, 0x22efa, 0x22d20, 0x22b4a, 0x22976,
+	0x227a2, 0x225d2, 0x22402, 0x22234, 0x22066, 0x21e9c, 0x21cd2, 0x21b0a,
+	0x21944, 0x2177e, 0x215ba, 0x213fa, 0x21238, 0x2107a, 0x20ebc, 0x20d00,
+	0x20b46, 0x2098e, 0x207d6, 0x20620, 0x2046c, 0x202b8, 0x20108, 0x1ff58,
+	0x1fda8, 0x1fbfc, 0x1fa50, 0x1f8a4, 0x1f6fc, 0x1f554, 0x1f3ae, 0x1f208,
+	0x1f064, 0x1eec2, 0x1ed22, 0x1eb82, 0x1e9e4, 0x1e846, 0x1e6aa, 0x1e510,
+	0x1e378, 0x1e1e0, 0x1e04a, 0x1deb4, 0x1dd20, 0x1db8e, 0x1d9fc, 0x1d86c,
+	0x1d6de, 0x1d550, 0x1d3c4, 0x1d238, 0x1d0ae, 0x1cf26, 0x1cd9e, 0x1cc18,
+	0x1ca94, 0x1c910, 0x1c78c, 0x1c60a, 0x1c48a, 0x1c30c, 0x1c18e, 0x1c010,
+	0x1be94, 0x1bd1a, 0x1bba0, 0x1ba28, 0x1b8b2, 0x1b73c, 0x1b5c6, 0x1b452,
+	0x1b2e0, 0x1b16e, 0x1affe, 0x1ae8e, 0x1ad20, 0x1abb4, 0x1aa46, 0x1a8dc,
+	0x1a772, 0x1a608, 0x1a4a0, 0x1a33a, 0x1a1d4, 0x1a070, 0x19f0c, 0x19da8,
+	0x19c48, 0x19ae6, 0x19986, 0x19828, 0x196ca, 0x1956e, 0x19412, 0x192b8,
+	0x1915e, 0x19004, 0x18eae, 0x18d56, 0x18c00, 0x18aac, 0x18958, 0x18804,
+	0x186b2, 0x18562, 0x18412, 0x182c2, 0x18174, 0x18026, 0x17eda, 0x17d8e,
+	0x17c44, 0x17afa, 0x179b2, 0x1786a, 0x17724, 0x175de, 0x17498, 0x17354,
+	0x17210, 0x170ce, 0x16f8c, 0x16e4c, 0x16d0c, 0x16bcc, 0x16a8e, 0x16950,
+	0x16814, 0x166d8, 0x1659e, 0x16464, 0x1632a, 0x161f2, 0x160ba, 0x15f84,
+	0x15e4e, 0x15d1a, 0x15be6, 0x15ab2, 0x15980, 0x1584e, 0x1571c, 0x155ec,
+	0x154bc, 0x1538e, 0x15260, 0x15134, 0x15006, 0x14edc, 0x14db0, 0x14c86,
+	0x14b5e, 0x14a36, 0x1490e, 0x147e6, 0x146c0, 0x1459a, 0x14476, 0x14352,
+	0x14230, 0x1410c, 0x13fea, 0x13eca, 0x13daa, 0x13c8a, 0x13b6c, 0x13a4e,
+	0x13930, 0x13814, 0x136f8, 0x135dc, 0x134c2, 0x133a8, 0x1328e, 0x13176,
+	0x1305e, 0x12f48, 0x12e30, 0x12d1a, 0x12c06, 0x12af2, 0x129de, 0x128ca,
+	0x127b8, 0x126a6, 0x12596, 0x12486, 0x12376, 0x12266, 0x12158, 0x1204a,
+	0x11f3e, 0x11e32, 0x11d26, 0x11c1a, 0x11b10, 0x11a06, 0x118fc, 0x117f4,
+	0x116ec, 0x115e4, 0x114de, 0x113d8, 0x112d2, 0x111ce, 0x110ca, 0x10fc6,
+	0x10ec2, 0x10dc0, 0x10cbe, 0x10bbc, 0x10abc, 0x109bc, 0x108bc, 0x107be,
+	0x106c0, 0x105c2, 0x104c4, 0x103c8, 0x102cc, 0x101d0, 0x100d6, 0x0ffdc,
+	0x0fee2, 0x0fdea, 0x0fcf0, 0x0fbf8, 0x0fb02, 0x0fa0a, 0x0f914, 0x0f81e,
+	0x0f72a, 0x0f636, 0x0f542, 0x0f44e, 0x0f35a, 0x0f268, 0x0f176, 0x0f086,
+	0x0ef94, 0x0eea4, 0x0edb4, 0x0ecc6, 0x0ebd6, 0x0eae8, 0x0e9fa, 0x0e90e,
+	0x0e822, 0x0e736, 0x0e64a, 0x0e55e, 0x0e474, 0x0e38a, 0x0e2a0, 0x0e1b8,
+	0x0e0d0, 0x0dfe8, 0x0df00, 0x0de1a, 0x0dd32, 0x0dc4c, 0x0db68, 0x0da82,
+	0x0d99e, 0x0d8ba, 0x0d7d6, 0x0d6f4, 0x0d612, 0x0d530, 0x0d44e, 0x0d36c,
+	0x0d28c, 0x0d1ac, 0x0d0cc, 0x0cfee, 0x0cf0e, 0x0ce30, 0x0cd54, 0x0cc76,
+	0x0cb9a, 0x0cabc, 0x0c9e0, 0x0c906, 0x0c82a, 0x0c750, 0x0c676, 0x0c59c,
+	0x0c4c4, 0x0c3ea, 0x0c312, 0x0c23a, 0x0c164, 0x0c08c, 0x0bfb6, 0x0bee0,
+	0x0be0a, 0x0bd36, 0x0bc62, 0x0bb8c, 0x0baba, 0x0b9e6, 0x0b912, 0x0b840,
+	0x0b76e, 0x0b69c, 0x0b5cc, 0x0b4fa, 0x0b42a, 0x0b35a, 0x0b28a, 0x0b1bc,
+	0x0b0ee, 0x0b01e, 0x0af50, 0x0ae84, 0x0adb6, 0x0acea, 0x0ac1e, 0x0ab52,
+	0x0aa86, 0x0a9bc, 0x0a8f0, 0x0a826, 0x0a75c, 0x0a694, 0x0a5ca, 0x0a502,
+	0x0a43a, 0x0a372, 0x0a2aa, 0x0a1e4, 0x0a11c, 0x0a056, 0x09f90, 0x09ecc,
+	0x09e06, 0x09d42, 0x09c7e, 0x09bba, 0x09af6, 0x09a32, 0x09970, 0x098ae,
+	0x097ec, 0x0972a, 0x09668, 0x095a8, 0x094e8, 0x09426, 0x09368, 0x092a8,
+	0x091e8, 0x0912a, 0x0906c, 0x08fae, 0x08ef0, 0x08e32, 0x08d76, 0x08cba,
+	0x08bfe, 0x08b42, 0x08a86, 0x089ca, 0x08910, 0x08856, 0x0879c, 0x086e2,
+	0x08628, 0x08570, 0x084b6, 0x083fe, 0x08346, 0x0828e, 0x081d8, 0x08120,
+	0x0806a, 0x07fb4, 0x07efe, 0x07e48, 0x07d92, 0x07cde, 0x07c2a, 0x07b76,
+	0x07ac2, 0x07a0e, 0x0795a, 0x078a8, 0x077f4, 0x07742, 0x07690, 0x075de,
+	0x0752e, 0x0747c, 0x073cc, 0x0731c, 0x0726c, 0x071bc, 0x0710c, 0x0705e,
+	0x06fae, 0x06f00, 0x06e52, 0x06da4, 0x06cf6, 0x06c4a, 0x06b9c, 0x06af0,
+	0x06a44, 0x06998, 0x068ec, 0x06840, 0x06796, 0x066ea, 0x06640, 0x06596,
+	0x064ec, 0x06442, 0x0639a, 0x062f0, 0x06248, 0x061a0, 0x060f8, 0x06050,
+	0x05fa8, 0x05f00, 0x05e5a, 0x05db4, 0x05d0e, 0x05c68, 0x05bc2, 0x05b1c,
+	0x05a76, 0x059d2, 0x0592e, 0x05888, 0x057e4, 0x05742, 0x0569e, 0x055fa,
+	0x05558, 0x054b6, 0x05412, 0x05370, 0x052ce, 0x0522e, 0x0518c, 0x050ec,
+	0x0504a, 0x04faa, 0x04f0a, 0x04e6a, 0x04dca, 0x04d2c, 0x04c8c, 0x04bee,
+	0x04b50, 0x04ab0, 0x04a12, 0x04976, 0x048d8, 0x0483a, 0x0479e, 0x04700,
+	0x04664, 0x045c8, 0x0452c, 0x04490, 0x043f6, 0x0435a, 0x042c0, 0x04226,
+	0x0418a, 0x040f0, 0x04056, 0x03fbe, 0x03f24, 0x03e8c, 0x03df2, 0x03d5a,
+	0x03cc2, 0x03c2a, 0x03b92, 0x03afa, 0x03a62, 0x039cc, 0x03934, 0x0389e,
+	0x03808, 0x03772, 0x036dc, 0x03646, 0x035b2, 0x0351c, 0x03488, 0x033f2,
+	0x0335e, 0x032ca, 0x03236, 0x031a2, 0x03110, 0x0307c, 0x02fea, 0x02f56,
+	0x02ec4, 0x02e32, 0x02da0, 0x02d0e, 0x02c7c, 0x02bec, 0x02b5a, 0x02aca,
+	0x02a38, 0x029a8, 0x02918, 0x02888, 0x027f8, 0x0276a, 0x026da, 0x0264a,
+	0x025bc, 0x0252e, 0x024a0, 0x02410, 0x02384, 0x022f6, 0x02268, 0x021da,
+	0x0214e, 0x020c0, 0x02034, 0x01fa8, 0x01f1c, 0x01e90, 0x01e04, 0x01d78,
+	0x01cee, 0x01c62, 0x01bd8, 0x01b4c, 0x01ac2, 0x01a38, 0x019ae, 0x01924,
+	0x0189c, 0x01812, 0x01788, 0x01700, 0x01676, 0x015ee, 0x01566, 0x014de,
+	0x01456, 0x013ce, 0x01346, 0x012c0, 0x01238, 0x011b2, 0x0112c, 0x010a4,
+	0x0101e, 0x00f98, 0x00f12, 0x00e8c, 0x00e08, 0x00d82, 0x00cfe, 0x00c78,
+	0x00bf4, 0x00b70, 0x00aec, 0x00a68, 0x009e4, 0x00960, 0x008dc, 0x00858,
+	0x007d6, 0x00752, 0x006d0, 0x0064e, 0x005cc, 0x0054a, 0x004c8, 0x00446,
+	0x003c4, 0x00342, 0x002c2, 0x00240, 0x001c0, 0x00140, 0x000c0, 0x00040,
+};
+
+
+/* fre and frsqrte: a table lookup with no refinement, as the RTL does */
+static double estimate(double b, bool rsqrt)
+{
+	double x;
+	int e, idx;
+
+	if (b == 0 || isinf(b))
+		return rsqrt ? 1.0 / sqrt(b) : 1.0 / b;
+	x = 2 * frexp(b, &e);
+	e--;
+	if (rsqrt) {
+		/* make the exponent even, so x is in [1, 4) */
+		if (e & 1) {
+			x *= 2;
+			e--;
+		}
+		idx = (int)(x * 256);
+		return ldexp((0x40000 | inverse_table[idx]) / 524288.0, -e / 2);
+	}
+	idx = (int)(fabs(x) * 256) - 256;
+	return copysign(ldexp((0x40000 | inverse_table[idx]) / 524288.0, -e), b);
+}
+
+static double compute(enum fp_arith op, double a, double b, double c,
+		      uint64_t bits_b, bool single)
+{
+	volatile double r;
+
+	switch (op) {
+	case FADD:   r = a + b; break;
+	case FSUB:   r = a - b; break;
+	case FMUL:   r = a * c; break;
+	case FDIV:   r = a / b; break;
+	case FSQRT:  r = sqrt(b); break;
+	case FMADD:  r = fma(a, c, b); break;
+	case FMSUB:  r = fma(a, c, -b); break;
+	case FNMADD: r = fma(a, c, b); break;
+	case FNMSUB: r = fma(a, c, -b); break;
+	case FRE:    r = estimate(b, false); break;
+	case FRSQRTE: r = estimate(b, true); break;
+	case FRSP:   r = b; break;
+	case FCFID:  r = (double)(int64_t)bits_b; break;
+	case FCFIDU: r = (double)bits_b; break;
+	case FRIN:   r = round(b); break;
+	case FRIZ:   r = trunc(b); break;
+	case FRIP:   r = ceil(b); break;
+	default:     r = floor(b); break;
+	}
+	if (single) {
+		if (op == FCFID)
+			r = (float)(int64_t)bits_b;
+		else if (op == FCFIDU)
+			r = (float)bits_b;
+		else
+			r = (float)r;
+	}
+	return r;
+}
+
+/* Round to a 24-bit significand in the current mode, ignoring range */
+static double round_24(double x)
+{
+	int e;
+	double m = frexp(x, &e);
+
+	/* (double) so as not to get the float overload */
+	return ldexp((double)(float)m, e);
+}
+
+/*
+ * Compute a double-precision result scaled by 2^scale, for overflow and
+ * underflow with the exception enabled. This goes through long double
+ * for the exponent range, so it can occasionally be off by one ulp from
+ * double rounding.
+ */
+static double scaled_double(enum fp_arith op, uint64_t bits_a, uint64_t bits_b,
+			    uint64_t bits_c, int scale)
+{
+	long double a = to_double(bits_a), b = to_double(bits_b);
+	long double c = to_double(bits_c);
+	volatile long double r;
+
+	switch (op) {
+	case FADD:   r = a + b; break;
+	case FSUB:   r = a - b; break;
+	case FMUL:   r = a * c; break;
+	case FDIV:   r = a / b; break;
+	case FMADD:
+	case FNMADD: r = fmal(a, c, b); break;
+	case FMSUB:
+	case FNMSUB: r = fmal(a, c, -b); break;
+	default:     r = b; break;
+	}
+	return (double)ldexpl(r, scale);
+}
+
+/*
+ * Do an arithmetic operation. Returns false if the target register
+ * should not be written because of an enabled exception.
+ */
+static bool fp_arith(struct cpu *cpu, enum fp_arith op, uint64_t a, uint64_t b,
+		     uint64_t c, bool single, uint64_t *res)
+{
+	uint32_t exc = 0;
+	uint64_t r;
+	bool integer_src = op == FCFID || op == FCFIDU;
+	bool round_int = op >= FRIN;
+	bool uses_a = op <= FDIV || (op >= FMADD && op <= FNMSUB);
+	bool uses_c = op == FMUL || (op >= FMADD && op <= FNMSUB);
+	bool uses_b = op != FMUL;
+	int raised;
+
+	cpu->fpscr &= ~(FPS_FR | FPS_FI);
+	if (!integer_src &&
+	    ((uses_a && is_snan(a)) || (uses_b && is_snan(b)) ||
+	     (uses_c && is_snan(c))))
+		exc |= FPS_VXSNAN;
+
+	if (!integer_src && ((uses_a && is_nan(a)) || (uses_b && is_nan(b)) ||
+			     (uses_c && is_nan(c)))) {
+		/* Propagate the first NaN of A, B, C */
+		if (uses_a && is_nan(a))
+			r = a;
+		else if (uses_b && is_nan(b))
+			r = b;
+		else
+			r = c;
+		r |= DP_QUIET;
+		if (single)
+			r = round_single(r);
+		goto done;
+	}
+
+	switch (op) {
+	case FADD:
+	case FSUB:
+		if (is_inf(a) && is_inf(b) &&
+		    ((a ^ b) >> 63) == (op == FADD))
+			exc |= FPS_VXISI;
+		break;
+	case FMUL:
+		if ((is_inf(a) && is_zero(c)) || (is_zero(a) && is_inf(c)))
+			exc |= FPS_VXIMZ;
+		break;
+	case FDIV:
+		if (is_inf(a) && is_inf(b))
+			exc |= FPS_VXIDI;
+		else if (is_zero(a) && is_zero(b))
+			exc |= FPS_VXZDZ;
+		else if (is_zero(b) && !is_inf(a))
+			exc |= FPS_ZX;
+		break;
+	case FSQRT:
+	case FRSQRTE:
+		if ((b >> 63) && !is_zero(b))
+			exc |= FPS_VXSQRT;
+		else if (op == FRSQRTE && is_zero(b))
+			exc |= FPS_ZX;
+		break;
+	case FRE:
+		if (is_zero(b))
+			exc |= FPS_ZX;
+		break;
+	case FMADD: case FMSUB: case FNMADD: case FNMSUB:
+		if ((is_inf(a) && is_zero(c)) || (is_zero(a) && is_inf(c))) {
+			exc |= FPS_VXIMZ;
+		} else if ((is_inf(a) || is_inf(c)) && is_inf(b)) {
+			bool psign = (a ^ c) >> 63;
+			bool bsign = (b >> 63) ^ (op == FMSUB || op == FNMSUB);
+
+			if (psign != bsign)
+				exc |= FPS_VXISI;
+		}
+		break;
+	default:
+		break;
+	}
+
+	if (exc & (FPS_VXISI | FPS_VXIMZ | FPS_VXIDI | FPS_VXZDZ |
+		   FPS_VXSQRT)) {
+		r = DP_QNAN;
+	} else {
+		int mode = host_rounding[cpu->fpscr & 3];
+		double rr, rz;
+		int scale = 0;
+
+		feclearexcept(FE_ALL_EXCEPT);
+		fesetround(mode);
+		rr = compute(op, to_double(a), to_double(b), to_double(c), b,
+			     single);
+		raised = fetestexcept(FE_ALL_EXCEPT);
+		/* the host only reports underflow when inexact */
+		if (rr != 0 && fabs(rr) < (single ? FLT_MIN : DBL_MIN))
+			raised |= FE_UNDERFLOW;
+		/*
+		 * With overflow or underflow enabled, the result has its
+		 * exponent adjusted by 192 (single) or 1536 (double) and is
+		 * rounded with no range limit; a single-precision result may
+		 * still be outside the single-precision range.
+		 */
+		if ((raised & FE_OVERFLOW) && (cpu->fpscr & FPS_OE))
+			scale = single ? -192 : -1536;
+		else if ((raised & FE_UNDERFLOW) && (cpu->fpscr & FPS_UE))
+			scale = single ? 192 : 1536;
+		if (scale && single) {
+			feclearexcept(FE_ALL_EXCEPT);
+			rr = round_24(ldexp(compute(op, to_double(a), to_double(b),
+						    to_double(c), b, false), scale));
+			raised = fetestexcept(FE_INEXACT) |
+				(scale < 0 ? FE_OVERFLOW : FE_UNDERFLOW);
+		} else if (scale) {
+			feclearexcept(FE_ALL_EXCEPT);
+			rr = scaled_double(op, a, b, c, scale);
+			raised = fetestexcept(FE_INEXACT) |
+				(scale < 0 ? FE_OVERFLOW : FE_UNDERFLOW);
+		}
+		fesetround(FE_TOWARDZERO);
+		if (scale && !single) {
+			rz = scaled_double(op, a, b, c, scale);
+		} else {
+			rz = compute(op, to_double(a), to_double(b),
+				     to_double(c), b, single && !scale);
+			if (scale)
+				rz = round_24(ldexp(rz, scale));
+		}
+		fesetround(FE_TONEAREST);
+		r = to_bits(rr);
+		if (op == FNMADD || op == FNMSUB)
+			r ^= 1ull << 63;
+
+		if (!round_int && (raised & FE_INEXACT)) {
+			exc |= FPS_XX;
+			cpu->fpscr |= FPS_FI;
+			if (fabs(rr) > fabs(rz))
+				cpu->fpscr |= FPS_FR;
+		}
+		if (raised & FE_OVERFLOW)
+			exc |= FPS_OX | FPS_XX;
+		if ((raised & FE_UNDERFLOW) &&
+		    ((raised & FE_INEXACT) || (cpu->fpscr & FPS_UE)))
+			exc |= FPS_UX;
+		if (op == FRE || op == FRSQRTE) {
+			/* estimates don't report inexact */
+			exc &= ~(FPS_XX | FPS_UX);
+			cpu->fpscr &= ~(FPS_FR | FPS_FI);
+		}
+		if (round_int && is_nan(r))
+			r |= DP_QUIET;
+	}
+
+ done:
+	fpscr_set(cpu, exc);
+	fpscr_summary(cpu);
+	if (((exc & FPS_VX_ALL) && (cpu->fpscr & FPS_VE)) ||
+	    ((exc & FPS_ZX) && (cpu->fpscr & FPS_ZE))) {
+		cpu->fpscr &= ~(FPS_FR | FPS_FI);
+		return false;
+	}
+	cpu->fpscr = (cpu->fpscr & ~FPS_FPRF) | (fprf(r, single) << 12);
+	*res = r;
+	return true;
+}
+
+/* fcti[w|d][u][z] */
+static bool fp_to_int(struct cpu *cpu, uint64_t b, bool dword,
+		      bool is_unsigned, bool round_zero, uint64_t *res)
+{
+	double d = to_double(b), rd;
+	bool neg = b >> 63;
+	uint32_t exc = 0;
+	uint64_t r;
+	bool ovf;
+
+	cpu->fpscr &= ~(FPS_FR | FPS_FI);
+	if (is_nan(b)) {
+		if (is_snan(b))
+			exc |= FPS_VXSNAN;
+		ovf = true;
+	} else {
+		fesetround(round_zero ? FE_TOWARDZERO : host_rounding[cpu->fpscr & 3]);
+		rd = nearbyint(d);
+		fesetround(FE_TONEAREST);
+		if (!dword && !is_unsigned)
+			ovf = rd < -2147483648.0 || rd > 2147483647.0;
+		else if (!dword)
+			ovf = rd < 0.0 || rd > 4294967295.0;
+		else if (!is_unsigned)
+			ovf = rd < -9223372036854775808.0 ||
+				rd >= 9223372036854775808.0;
+		else
+			ovf = rd < 0.0 || rd >= 18446744073709551616.0;
+		if (!ovf) {
+			if (is_unsigned)
+				r = (uint64_t)rd;
+			else
+				r = (uint64_t)(int64_t)rd;
+			if (rd != d) {
+				exc |= FPS_XX;
+				cpu->fpscr |= FPS_FI;
+				if (fabs(rd) > fabs(d))
+					cpu->fpscr |= FPS_FR;
+			}
+		}
+		neg = neg && rd != 0.0;
+	}
+	if (ovf) {
+		exc |= FPS_VXCVI;
+		if (!neg && !is_nan(b))
+			r = dword ? (is_unsigned ? ~0ull : 0x7fffffffffffffffull) :
+				(is_unsigned ? 0xffffffffull : 0x7fffffffull);
+		else if (is_unsigned)
+			r = 0;
+		else
+			r = dword ? 0x8000000000000000ull : 0xffffffff80000000ull;
+	}
+	fpscr_set(cpu, exc);
+	fpscr_summary(cpu);
+	if ((exc & FPS_VX_ALL) && (cpu->fpscr & FPS_VE))
+		return false;
+	*res = r;
+	return true;
+}
+
+static void fp_compare(struct cpu *cpu, uint32_t insn, uint64_t a, uint64_t b)
+{
+	unsigned int bf = insn_rt(insn) >> 2;
+	bool ordered = insn & 0x40;
+	uint32_t c, exc = 0;
+
+	if (is_nan(a) || is_nan(b)) {
+		c = 1;
+		if (is_snan(a) || is_snan(b)) {
+			exc |= FPS_VXSNAN;
+			if (ordered && !(cpu->fpscr & FPS_VE))
+				exc |= FPS_VXVC;
+		} else if (ordered) {
+			exc |= FPS_VXVC;
+		}
+	} else {
+		double da = to_double(a), db = to_double(b);
+
+		c = da < db ? 8 : da > db ? 4 : 2;
+	}
+	fpscr_set(cpu, exc);
+	fpscr_summary(cpu);
+	cpu->fpscr = (cpu->fpscr & ~FPS_FPCC) | (c << 12);
+	set_cr_field(cpu, bf, c);
+}
+
+static int fp_exponent(uint64_t x)
+{
+	int e = (x >> 52) & 0x7ff;
+
+	if (e == 0) {
+		if (is_zero(x))
+			return -1075;
+		return -1022 - (__builtin_clzll(x & 0x000fffffffffffffull) - 12);
+	}
+	return e - 1023;
+}
+
+/* ftdiv and ftsqrt */
+static void fp_test(struct cpu *cpu, uint32_t insn, uint64_t a, uint64_t b,
+		    bool sqrt_test)
+{
+	unsigned int bf = insn_rt(insn) >> 2;
+	bool special_b = is_zero(b) || is_inf(b) || is_nan(b);
+	int eb = fp_exponent(b), ea = fp_exponent(a);
+	bool fe, fg;
+
+	fg = is_zero(b) || is_inf(b) || (!is_nan(b) && eb < -1022);
+	if (sqrt_test) {
+		fe = special_b || (b >> 63) || eb <= -970;
+	} else {
+		fg = fg || is_inf(a);
+		fe = is_nan(a) || is_inf(a) || special_b || eb <= -1022 ||
+			eb >= 1021 || (!is_zero(a) && (ea - eb >= 1023 ||
+						       ea - eb <= -1021 ||
+						       ea <= -970));
+	}
+	set_cr_field(cpu, bf, (fg << 2) | (fe << 1));
+}
+
+static void fp_write(struct cpu *cpu, uint32_t insn, uint64_t val)
+{
+	cpu->fpr[insn_rt(insn)] = val;
+}
+
+static void fp_load_store(struct cpu *cpu, uint32_t insn, uint64_t ea,
+			  unsigned int op)
+{
+	unsigned int rt = insn_rt(insn);
+
+	switch (op) {
+	case 0:			/* lfs */
+		cpu->fpr[rt] = single_to_dp(load(cpu, ea, 4, false));
+		break;
+	case 1:			/* lfd */
+		cpu->fpr[rt] = load(cpu, ea, 8, false);
+		break;
+	case 2:			/* stfs */
+		store(cpu, ea, 4, dp_to_single(cpu->fpr[rt]), false);
+		break;
+	case 3:			/* stfd */
+		store(cpu, ea, 8, cpu->fpr[rt], false);
+		break;
+	}
+}
+
+void execute_fp_prefixed(struct cpu *cpu, uint32_t insn, uint64_t ea)
+{
+	/* plfs, plfd, pstfs, pstfd: primary opcodes 48, 50, 52, 54 */
+	fp_load_store(cpu, insn, ea, ((insn >> 26) - 48) >> 1);
+}
+
+/* The FP exception-enabled program interrupt, precise mode */
+static void check_fp_enabled(struct cpu *cpu)
+{
+	if ((cpu->fpscr & FPS_FEX) && (cpu->msr & (MSR_FE0 | MSR_FE1))) {
+		struct interrupt intr = { 0x700, SRR1_FP_ENAB, false };
+
+		throw intr;
+	}
+}
+
+static void execute_31_fp(struct cpu *cpu, uint32_t insn)
+{
+	unsigned int ra = insn_ra(insn), rt = insn_rt(insn);
+	uint64_t ea = (ra ? cpu->gpr[ra] : 0) + cpu->gpr[insn_rb(insn)];
+	unsigned int xo = (insn >> 1) & 0x3ff;
+	bool update = false;
+
+	if (!(cpu->msr & MSR_SF))
+		ea = (uint32_t)ea;
+	switch (xo) {
+	case 567: case 631: case 695: case 759:
+		update = true;
+		/* fall through */
+	case 535: case 599: case 663: case 727:
+		fp_load_store(cpu, insn, ea, ((xo - 535) >> 6));
+		break;
+	case 855:		/* lfiwax */
+		cpu->fpr[rt] = (int32_t)load(cpu, ea, 4, false);
+		break;
+	case 887:		/* lfiwzx */
+		cpu->fpr[rt] = (uint32_t)load(cpu, ea, 4, false);
+		break;
+	case 983:		/* stfiwx */
+		store(cpu, ea, 4, cpu->fpr[rt], false);
+		break;
+	default:
+		illegal(cpu, insn);
+	}
+	if (update)
+		cpu->gpr[ra] = ea;
+}
+
+void execute_fp(struct cpu *cpu, uint32_t insn)
+{
+	unsigned int op = insn >> 26;
+	unsigned int rt = insn_rt(insn), ra = insn_ra(insn), rb = insn_rb(insn);
+	uint64_t a = cpu->fpr[ra], b = cpu->fpr[rb], c = cpu->fpr[insn_rc(insn)];
+	unsigned int xo = (insn >> 1) & 0x3ff;
+	bool single = op == 59;
+	bool rc = insn & 1;
+	uint64_t r, ea;
+	unsigned int i;
+
+	if (op == 31) {
+		execute_31_fp(cpu, insn);
+		return;
+	}
+	if (op < 56) {
+		ea = (ra ? cpu->gpr[ra] : 0) + (int16_t)insn;
+		if (!(cpu->msr & MSR_SF))
+			ea = (uint32_t)ea;
+		fp_load_store(cpu, insn, ea, (op - 48) >> 1);
+		if (op & 1)
+			cpu->gpr[ra] = ea;
+		return;
+	}
+
+	if (xo & 0x10) {
+		static const int aform[16] = {
+			-1, -1, FDIV, -1, FSUB, FADD, FSQRT, -2,
+			FRE, FMUL, FRSQRTE, -1, FMSUB, FMADD, FNMSUB, FNMADD
+		};
+		int f = aform[xo & 0xf];
+
+		if (f == -1)
+			illegal(cpu, insn);
+		if (f == -2) {
+			/* fsel */
+			if (single)
+				illegal(cpu, insn);
+			r = (!is_nan(a) && (is_zero(a) || !(a >> 63))) ? c : b;
+			fp_write(cpu, insn, r);
+			goto out;
+		}
+		if (fp_arith(cpu, (enum fp_arith)f, a, b, c, single, &r))
+			fp_write(cpu, insn, r);
+		goto out;
+	}
+
+	if (single) {
+		if (xo == 846 || xo == 974) {
+			if (fp_arith(cpu, xo == 846 ? FCFID : FCFIDU, 0, b, 0,
+				     true, &r))
+				fp_write(cpu, insn, r);
+			goto out;
+		}
+		illegal(cpu, insn);
+	}
+
+	switch (xo) {
+	case 0:			/* fcmpu */
+	case 32:		/* fcmpo */
+		fp_compare(cpu, insn, a, b);
+		check_fp_enabled(cpu);
+		return;
+	case 128:		/* ftdiv */
+		fp_test(cpu, insn, a, b, false);
+		return;
+	case 160:		/* ftsqrt */
+		fp_test(cpu, insn, a, b, true);
+		return;
+	case 64: {		/* mcrfs */
+		unsigned int sh = 28 - 4 * (ra >> 2);
+		uint32_t f = (cpu->fpscr >> sh) & 0xf;
+
+		set_cr_field(cpu, rt >> 2, f);
+		/* exception bits in the field are cleared */
+		cpu->fpscr &= ~((0xfu << sh) & (FPS_FX | FPS_EXC_ALL));
+		fpscr_summary(cpu);
+		return;
+	}
+	case 38:		/* mtfsb1 */
+	case 70:		/* mtfsb0 */
+		if (rt == 1 || rt == 2)
+			goto out;
+		if (xo == 38)
+			fpscr_set(cpu, 0x80000000u >> rt);
+		else
+			cpu->fpscr &= ~(0x80000000u >> rt);
+		fpscr_summary(cpu);
+		goto out;
+	case 134: {		/* mtfsfi */
+		unsigned int bf = rt >> 2;
+
+		if (!(insn & 0x10000)) {
+			unsigned int sh = 28 - 4 * bf;
+
+			cpu->fpscr = (cpu->fpscr & ~(0xfu << sh)) |
+				(((insn >> 12) & 0xf) << sh);
+			fpscr_summary(cpu);
+		}
+		goto out;
+	}
+	case 711: {		/* mtfsf */
+		uint32_t flm = (insn >> 17) & 0xff, mask = 0;
+
+		if (insn & (1u << 25))
+			flm = 0xff;
+		else if (insn & 0x10000)
+			flm = 0;
+		for (i = 0; i < 8; i++)
+			if (flm & (1u << i))
+				mask |= 0xfu << (4 * i);
+		cpu->fpscr = (cpu->fpscr & ~mask) | ((uint32_t)b & mask);
+		fpscr_summary(cpu);
+		goto out;
+	}
+	case 583: {		/* mffs and friends */
+		uint32_t f = cpu->fpscr;
+
+		switch (ra) {
+		case 0:
+			break;
+		case 1:		/* mffsce */
+			cpu->fpscr &= ~(FPS_VE | FPS_OE | FPS_UE | FPS_ZE |
+					FPS_XE);
+			fpscr_summary(cpu);
+			break;
+		case 20: case 21:	/* mffscdrn[i]: no DRN */
+			f &= 0xff;
+			break;
+		case 22:	/* mffscrn */
+			f &= 0xff;
+			cpu->fpscr = (cpu->fpscr & ~3u) | (b & 3);
+			break;
+		case 23:	/* mffscrni */
+			f &= 0xff;
+			cpu->fpscr = (cpu->fpscr & ~3u) | ((insn >> 11) & 3);
+			break;
+		case 24:	/* mffsl */
+			f &= 0x0007f0ff;
+			break;
+		default:
+			illegal(cpu, insn);
+		}
+		fp_write(cpu, insn, f);
+		goto out;
+	}
+	case 8:			/* fcpsgn */
+		r = (a & (1ull << 63)) | (b & ~(1ull << 63));
+		break;
+	case 40:		/* fneg */
+		r = b ^ (1ull << 63);
+		break;
+	case 72:		/* fmr */
+		r = b;
+		break;
+	case 136:		/* fnabs */
+		r = b | (1ull << 63);
+		break;
+	case 264:		/* fabs */
+		r = b & ~(1ull << 63);
+		break;
+	case 966:		/* fmrgew */
+		r = (a & 0xffffffff00000000ull) | (b >> 32);
+		break;
+	case 838:		/* fmrgow */
+		r = (a << 32) | (uint32_t)b;
+		break;
+	case 12:		/* frsp */
+		if (fp_arith(cpu, FRSP, 0, b, 0, true, &r))
+			fp_write(cpu, insn, r);
+		goto out;
+	case 846:		/* fcfid */
+	case 974:		/* fcfidu */
+		if (fp_arith(cpu, xo == 846 ? FCFID : FCFIDU, 0, b, 0, false, &r))
+			fp_write(cpu, insn, r);
+		goto out;
+	case 392: case 424: case 456: case 488:
+		if (fp_arith(cpu, (enum fp_arith)(FRIN + ((xo - 392) >> 5)),
+			     0, b, 0, false, &r))
+			fp_write(cpu, insn, r);
+		goto out;
+	case 14: case 15: case 142: case 143:
+	case 814: case 815: case 942: case 943:
+		if (fp_to_int(cpu, b, xo & 0x200, xo & 0x80, xo & 1, &r))
+			fp_write(cpu, insn, r);
+		goto out;
+	default:
+		illegal(cpu, insn);
+	}
+	fp_write(cpu, insn, r);
+
+ out:
+	if (rc)
+		set_cr_field(cpu, 1, cpu->fpscr >> 28);
+	check_fp_enabled(cpu);
+}
@@ -0,0 +1,335 @@
+/*
+ * funcsim: a fast functional simulator for Microwatt.
+ *
+ * Runs a main_ram.bin image the way core_tb does, one instruction at a time
+ * with no timing, optionally dumping the registers at the end in core_tb's
+ * format, writing basic block vectors for SimPoint, and writing checkpoints
+ * that core_tb can resume from (see checkpoint.cpp).
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+#include "funcsim.h"
+
+struct options {
+	const char *image;
+	uint64_t max_insns;
+	bool dump;
+	std::vector<uint64_t> checkpoints;
+	uint64_t checkpoint_every;
+	const char *checkpoint_prefix;
+	uint64_t stub_addr;
+	const char *bbv_file;
+	uint64_t bbv_interval;
+};
+
+/* Basic block vectors, in the SimPoint "T:id:count" format */
+struct bbv {
+	FILE *f;
+	uint64_t interval;
+	uint64_t next;
+	uint64_t block_start;
+	uint64_t block_len;
+	std::unordered_map<uint64_t, unsigned int> ids;
+	std::unordered_map<unsigned int, uint64_t> counts;
+};
+
+static void bbv_end_block(struct bbv *b)
+{
+	unsigned int id;
+
+	if (!b->block_len)
+		return;
+	auto it = b->ids.find(b->block_start);
+	if (it == b->ids.end()) {
+		id = b->ids.size() + 1;
+		b->ids[b->block_start] = id;
+	} else {
+		id = it->second;
+	}
+	b->counts[id] += b->block_len;
+	b->block_len = 0;
+}
+
+static void bbv_flush(struct bbv *b)
+{
+	if (b->counts.empty())
+		return;
+	fputc('T', b->f);
+	for (auto &c : b->counts)
+		fprintf(b->f, ":%u:%lu ", c.first, (unsigned long)c.second);
+	fputc('\n', b->f);
+	b->counts.clear();
+}
+
+static void load_image(const char *name, uint8_t *mem, uint64_t size)
+{
+	FILE *f = fopen(name, "rb");
+	size_t n;
+
+	if (!f) {
+		fprintf(stderr, "funcsim: can't open %s: %s\n", name, strerror(errno));
+		exit(1);
+	}
+	n = fread(mem, 1, size, f);
+	if (n == size && fgetc(f) != EOF)
+		fprintf(stderr, "funcsim: %s is larger than RAM, truncated\n", name);
+	fclose(f);
+}
+
+static void dump_registers(struct cpu *cpu)
+{
+	for (int i = 0; i < 32; i++)
+		printf("GPR%d %016lX\n", i, (unsigned long)cpu->gpr[i]);
+	printf("CR %016lX\n", (unsigned long)cpu->cr);
+	printf("LR %016lX\n", (unsigned long)cpu->lr);
+	printf("CTR %016lX\n", (unsigned long)cpu->ctr);
+	printf("XER %016lX\n", (unsigned long)get_xer(cpu));
+}
+
+/*
+ * Run until attn, the instruction limit or the next checkpoint.
+ * Returns false if the program stopped.
+ */
+static bool trace_insns;
+
+/* For --trace, show the registers an instruction changed */
+static void trace_changes(struct cpu *cpu, const uint64_t *gpr, uint32_t cr,
+			  uint64_t xer)
+{
+	for (int i = 0; i < 32; i++)
+		if (cpu->gpr[i] != gpr[i])
+			fprintf(stderr, "    r%d = %016lx\n", i,
+				(unsigned long)cpu->gpr[i]);
+	if (cpu->cr != cr)
+		fprintf(stderr, "    cr = %08x\n", cpu->cr);
+	if (get_xer(cpu) != xer)
+		fprintf(stderr, "    xer = %08lx\n", (unsigned long)get_xer(cpu));
+}
+
+static bool run(struct cpu *cpu, uint64_t until, struct bbv *bbv)
+{
+	while (cpu->icount < until) {
+		uint64_t cia, msr, gpr[32], xer = 0;
+		uint32_t cr = 0;
+
+		check_async(cpu);
+		cia = cpu->nia;
+		msr = cpu->msr;
+		cpu->no_trace = false;
+		cpu->mem_access = 0;
+		try {
+			uint32_t insn = fetch(cpu, cia);
+
+			if (trace_insns) {
+				fprintf(stderr, "%lu %016lx %08x\n",
+					(unsigned long)cpu->icount,
+					(unsigned long)cia, insn);
+				memcpy(gpr, cpu->gpr, sizeof(gpr));
+				cr = cpu->cr;
+				xer = get_xer(cpu);
+			}
+
+			if ((insn >> 26) == 1) {
+				if ((cpu->msr & MSR_PR) &&
+				    !(cpu->spr[SPR_FSCR] & FSCR_PREFIX)) {
+					cpu->spr[SPR_FSCR] =
+						(cpu->spr[SPR_FSCR] & ~(0xfull << 56)) |
+						(13ull << 56);
+					throw interrupt { 0xf60, 0, false };
+				}
+				if ((cia & 63) == 60)
+					throw interrupt { 0x600, SRR1_PREFIXED |
+							  SRR1_ISI_PERM, false };
+				execute_prefixed(cpu, insn, fetch(cpu, cia + 4));
+			} else {
+				execute(cpu, insn);
+			}
+			if (trace_insns)
+				trace_changes(cpu, gpr, cr, xer);
+			if (cpu->halted)
+				return false;
+			check_trace(cpu, cia, insn, msr);
+			pmu_count(cpu, cia, insn);
+		} catch (const struct interrupt &intr) {
+			cpu->nia = cia;
+			take_interrupt(cpu, intr);
+		}
+		cpu->icount++;
+
+		if (bbv) {
+			bbv->block_len++;
+			if (cpu->nia != cia + 4 && cpu->nia != cia + 8) {
+				bbv_end_block(bbv);
+				bbv->block_start = cpu->nia;
+			}
+			if (cpu->icount >= bbv->next) {
+				bbv_end_block(bbv);
+				bbv->block_start = cpu->nia;
+				bbv_flush(bbv);
+				bbv->next += bbv->interval;
+			}
+		}
+	}
+	return true;
+}
+
+static uint64_t parse_size(const char *s)
+{
+	char *end;
+	uint64_t v = strtoull(s, &end, 0);
+
+	switch (*end) {
+	case 'k': case 'K': v <<= 10; break;
+	case 'm': case 'M': v <<= 20; break;
+	case 'g': case 'G': v <<= 30; break;
+	}
+	return v;
+}
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"Usage: funcsim [options] image.bin\n"
+		"  -r, --ram-size SIZE        BRAM size (default 384k, as core_tb)\n"
+		"  -d, --dram-size SIZE       DRAM size at 0x40000000 (default 0)\n"
+		"      --dram-at-0            DRAM at 0 rather than BRAM\n"
+		"      --potato               potato UART rather than 16550\n"
+		"  -n, --max-insns N          stop after N instructions\n"
+		"      --dump                 print registers at the end, like core_tb\n"
+		"  -c, --checkpoint-at N      write a checkpoint after N instructions\n"
+		"                             (may be given more than once)\n"
+		"      --checkpoint-every N   write a checkpoint every N instructions\n"
+		"  -o, --checkpoint-prefix P  checkpoint file prefix (default \"checkpoint\")\n"
+		"      --stub-addr ADDR       where to put the checkpoint restore code\n"
+		"      --bbv FILE             write basic block vectors to FILE\n"
+		"      --bbv-interval N       instructions per BBV interval (default 100M)\n"
+		"  -t, --trace                print each instruction to stderr\n");
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	static const struct option longopts[] = {
+		{ "ram-size", required_argument, NULL, 'r' },
+		{ "dram-size", required_argument, NULL, 'd' },
+		{ "dram-at-0", no_argument, NULL, 'Z' },
+		{ "potato", no_argument, NULL, 'P' },
+		{ "max-insns", required_argument, NULL, 'n' },
+		{ "dump", no_argument, NULL, 'D' },
+		{ "checkpoint-at", required_argument, NULL, 'c' },
+		{ "checkpoint-every", required_argument, NULL, 'E' },
+		{ "checkpoint-prefix", required_argument, NULL, 'o' },
+		{ "stub-addr", required_argument, NULL, 'S' },
+		{ "bbv", required_argument, NULL, 'B' },
+		{ "bbv-interval", required_argument, NULL, 'I' },
+		{ "trace", no_argument, NULL, 't' },
+		{ "help", no_argument, NULL, 'h' },
+		{ NULL, 0, NULL, 0 }
+	};
+	struct options opts = {};
+	struct bbv bbv = {};
+	struct cpu *cpu;
+	uint64_t next_ckpt;
+	size_t ckpt_idx = 0;
+	int c;
+
+	soc.bram_size = 384 * 1024;
+	soc.clk_freq = 100000000;
+	soc.uart_16550 = true;
+	opts.max_insns = ~0ull;
+	opts.checkpoint_prefix = "checkpoint";
+	opts.bbv_interval = 100000000;
+
+	while ((c = getopt_long(argc, argv, "r:d:n:c:o:th", longopts, NULL)) != -1) {
+		switch (c) {
+		case 'r': soc.bram_size = parse_size(optarg); break;
+		case 'd': soc.dram_size = parse_size(optarg); break;
+		case 'Z': soc.dram_at_0 = true; break;
+		case 'P': soc.uart_16550 = false; break;
+		case 'n': opts.max_insns = parse_size(optarg); break;
+		case 'D': opts.dump = true; break;
+		case 'c': opts.checkpoints.push_back(parse_size(optarg)); break;
+		case 'E': opts.checkpoint_every = parse_size(optarg); break;
+		case 'o': opts.checkpoint_prefix = optarg; break;
+		case 'S': opts.stub_addr = strtoull(optarg, NULL, 0); break;
+		case 'B': opts.bbv_file = optarg; break;
+		case 'I': opts.bbv_interval = parse_size(optarg); break;
+		case 't': trace_insns = true; break;
+		default: usage();
+		}
+	}
+	if (optind != argc - 1)
+		usage();
+	opts.image = argv[optind];
+
+	soc.bram = (uint8_t *)calloc(1, soc.bram_size);
+	soc.dram = (uint8_t *)calloc(1, soc.dram_size ? soc.dram_size : 1);
+	cpu = (struct cpu *)calloc(1, sizeof(*cpu));
+	if (!soc.bram || !soc.dram || !cpu) {
+		fprintf(stderr, "funcsim: out of memory\n");
+		return 1;
+	}
+	load_image(opts.image, soc.dram_at_0 ? soc.dram : soc.bram,
+		   soc.dram_at_0 ? soc.dram_size : soc.bram_size);
+	cpu_reset(cpu);
+
+	if (opts.bbv_file) {
+		bbv.f = fopen(opts.bbv_file, "w");
+		if (!bbv.f) {
+			fprintf(stderr, "funcsim: can't create %s: %s\n",
+				opts.bbv_file, strerror(errno));
+			return 1;
+		}
+		bbv.interval = opts.bbv_interval;
+		bbv.next = bbv.interval;
+	}
+
+	std::sort(opts.checkpoints.begin(), opts.checkpoints.end());
+	for (;;) {
+		next_ckpt = opts.max_insns;
+		if (ckpt_idx < opts.checkpoints.size() &&
+		    opts.checkpoints[ckpt_idx] < next_ckpt)
+			next_ckpt = opts.checkpoints[ckpt_idx];
+		if (opts.checkpoint_every) {
+			uint64_t n = (cpu->icount / opts.checkpoint_every + 1) *
+				opts.checkpoint_every;
+
+			if (n < next_ckpt)
+				next_ckpt = n;
+		}
+		if (!run(cpu, next_ckpt, opts.bbv_file ? &bbv : NULL))
+			break;
+		if ((ckpt_idx < opts.checkpoints.size() &&
+		     opts.checkpoints[ckpt_idx] <= cpu->icount) ||
+		    (opts.checkpoint_every &&
+		     cpu->icount % opts.checkpoint_every == 0))
+			write_checkpoint(cpu, opts.checkpoint_prefix,
+					 opts.stub_addr);
+		while (ckpt_idx < opts.checkpoints.size() &&
+		       opts.checkpoints[ckpt_idx] <= cpu->icount)
+			ckpt_idx++;
+		if (cpu->icount >= opts.max_insns)
+			break;
+	}
+
+	fflush(stderr);
+	if (opts.bbv_file) {
+		bbv_end_block(&bbv);
+		bbv_flush(&bbv);
+		fclose(bbv.f);
+	}
+	if (opts.dump)
+		dump_registers(cpu);
+	if (!cpu->halted)
+		fprintf(stderr, "funcsim: stopped after %lu instructions at %016lx\n",
+			(unsigned long)cpu->icount, (unsigned long)cpu->nia);
+	return 0;
+}
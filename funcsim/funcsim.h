@@ -0,0 +1,256 @@
+#ifndef __FUNCSIM_H
+#define __FUNCSIM_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Functional model of the Microwatt core and SoC. Architected state lives
+ * in struct cpu; it is everything we need to hand over to the RTL model
+ * (see checkpoint.cpp).
+ */
+
+#define MSR_SF		(1ull << 63)
+#define MSR_HV		(1ull << 60)
+#define MSR_EE		(1ull << 15)
+#define MSR_PR		(1ull << 14)
+#define MSR_FP		(1ull << 13)
+#define MSR_ME		(1ull << 12)
+#define MSR_FE0		(1ull << 11)
+#define MSR_SE		(1ull << 10)
+#define MSR_BE		(1ull << 9)
+#define MSR_FE1		(1ull << 8)
+#define MSR_IR		(1ull << 5)
+#define MSR_DR		(1ull << 4)
+#define MSR_PMM		(1ull << 2)
+#define MSR_RI		(1ull << 1)
+#define MSR_LE		(1ull << 0)
+
+/* SRR1 interrupt-specific bits, in the positions execute1 uses */
+#define SRR1_ISI_NOPT	(1ull << 30)	/* also trace */
+#define SRR1_PREFIXED	(1ull << 29)
+#define SRR1_ISI_PERM	(1ull << 28)	/* also trace after a load */
+#define SRR1_TRACE_ST	(1ull << 27)
+#define SRR1_FP_ENAB	(1ull << 20)
+#define SRR1_CIABR	(1ull << 20)
+#define SRR1_ISI_BADTREE (1ull << 19)
+#define SRR1_ISI_RC	(1ull << 18)
+#define SRR1_PRIV	(1ull << 18)
+#define SRR1_TRAP	(1ull << 17)
+#define SRR1_FP_NEXT	(1ull << 16)	/* SRR0 is the next instruction */
+
+#define FPS_FEX		(1u << 30)
+
+#define DSISR_NOPT	(1u << 30)
+#define DSISR_PERM	(1u << 27)
+#define DSISR_STORE	(1u << 25)
+#define DSISR_DAWR	(1u << 22)
+#define DSISR_BADTREE	(1u << 19)
+#define DSISR_RC	(1u << 18)
+
+#define LPCR_HAIL	(1ull << 26)
+#define LPCR_EVIRT	(1ull << 21)
+#define LPCR_LD		(1ull << 17)
+#define LPCR_HEIC	(1ull << 4)
+#define LPCR_LPES	(1ull << 3)
+#define LPCR_HVICE	(1ull << 1)
+#define LPCR_FIXED	((1ull << 22) | (1ull << 20))	/* UPRT, HR */
+
+#define FSCR_PREFIX	(1ull << 13)
+#define FSCR_SCV	(1ull << 12)
+#define FSCR_TAR	(1ull << 8)
+#define FSCR_DSCR	(1ull << 2)
+
+#define MMCR0_FC	0x80000000ull
+
+#define SPR_XER		1
+#define SPR_UDSCR	3
+#define SPR_LR		8
+#define SPR_CTR		9
+#define SPR_DSCR	17
+#define SPR_DSISR	18
+#define SPR_DAR		19
+#define SPR_DEC		22
+#define SPR_SRR0	26
+#define SPR_SRR1	27
+#define SPR_CFAR	28
+#define SPR_PID		48
+#define SPR_CTRL	136
+#define SPR_CTRLW	152
+#define SPR_FSCR	153
+#define SPR_DAWR0	180
+#define SPR_DAWR1	181
+#define SPR_CIABR	187
+#define SPR_DAWRX0	188
+#define SPR_DAWRX1	189
+#define SPR_HFSCR	190
+#define SPR_VRSAVE	256
+#define SPR_SPRG3U	259
+#define SPR_TB		268
+#define SPR_TBU		269
+#define SPR_SPRG0	272
+#define SPR_SPRG1	273
+#define SPR_SPRG2	274
+#define SPR_SPRG3	275
+#define SPR_TBLW	284
+#define SPR_TBUW	285
+#define SPR_PVR		287
+#define SPR_HSPRG0	304
+#define SPR_HSPRG1	305
+#define SPR_HRMOR	313
+#define SPR_HSRR0	314
+#define SPR_HSRR1	315
+#define SPR_LPCR	318
+#define SPR_HMER	336
+#define SPR_HMEER	337
+#define SPR_HEIR	339
+#define SPR_HDEXCRU	455
+#define SPR_PTCR	464
+#define SPR_HASHKEYR	468
+#define SPR_HASHPKEYR	469
+#define SPR_HDEXCR	471
+#define SPR_PMC5	791
+#define SPR_PMC6	792
+#define SPR_MMCR0	795
+#define SPR_MMCR1	798
+#define SPR_SIAR	796
+#define SPR_SDAR	797
+#define SPR_DEXCRU	812
+#define SPR_TAR		815
+#define SPR_DEXCR	828
+#define SPR_PIR		1023
+
+#define PVR_MICROWATT	0x00630000
+
+/* Thrown when an instruction takes an interrupt */
+struct interrupt {
+	uint64_t vec;
+	uint64_t srr1;		/* bits 33:36 and 42:47 */
+	bool hv;
+};
+
+struct tlb_entry {
+	uint64_t tag;		/* EA page | 1, or 0 if invalid */
+	uint64_t pa;		/* physical page */
+	uint8_t *host;		/* host address of the page if it is RAM */
+	uint64_t pte;
+};
+
+#define TLB_SIZE	1024
+
+struct cpu {
+	uint64_t gpr[32];
+	uint64_t fpr[32];
+	uint32_t cr;
+	uint8_t so, ov, ca, ov32, ca32;
+	uint32_t xer_low;	/* XER bits 17:0, kept but unused */
+	uint64_t nia;
+	uint64_t msr;
+	uint64_t lr, ctr;
+	uint32_t fpscr;
+	uint64_t spr[1024];	/* everything else */
+
+	/* Decrementer and timebase advance one per instruction */
+	uint64_t icount;
+	uint64_t tb_offset;	/* TB = icount + tb_offset */
+	uint64_t dec_set;	/* DEC value at icount dec_at */
+	uint64_t dec_at;
+
+	/* PMC5/PMC6 count instructions while MMCR0[FC] = 0 */
+	uint64_t pmc_at;
+
+	bool resv_valid;
+	uint64_t resv_addr;
+	unsigned int resv_len;
+
+	/* Translation state */
+	struct tlb_entry itlb[TLB_SIZE];
+	struct tlb_entry dtlb[TLB_SIZE];
+
+	bool halted;
+	bool stop_on_illegal;
+	bool trace_pending;
+	uint64_t trace_srr1;
+	bool fp_intr_pending;	/* MSR[FE0,FE1] enabled with FPSCR[FEX] set */
+
+	/* What the current instruction did, for trace interrupts */
+	bool no_trace;		/* rfid and sc aren't traced */
+	uint8_t mem_access;
+	uint64_t mem_ea;	/* last data address, for SDAR */
+};
+
+#define ACCESS_LOAD	1
+#define ACCESS_STORE	2
+
+/* Main memory and SoC configuration */
+struct soc {
+	uint8_t *bram;
+	uint64_t bram_size;
+	uint8_t *dram;
+	uint64_t dram_size;
+	uint64_t clk_freq;
+	bool dram_at_0;
+	bool uart_16550;
+	uint8_t uart_ier, uart_lcr, uart_mcr, uart_scr, uart_dll, uart_dlm;
+	uint64_t potato_div, potato_irq_en;
+	int console_fd;
+};
+
+extern struct soc soc;
+
+/* mem.cpp */
+uint8_t *phys_ram(uint64_t pa, unsigned int len);
+uint64_t phys_read(uint64_t pa, unsigned int len);
+void phys_write(uint64_t pa, unsigned int len, uint64_t val);
+void tlb_flush(struct cpu *cpu);
+void tlb_flush_page(struct cpu *cpu, uint64_t ea);
+uint64_t translate(struct cpu *cpu, uint64_t ea, bool iside, bool store,
+		   uint8_t **host);
+uint64_t load(struct cpu *cpu, uint64_t ea, unsigned int len, bool byterev);
+void store(struct cpu *cpu, uint64_t ea, unsigned int len, uint64_t val,
+	   bool byterev);
+uint32_t fetch(struct cpu *cpu, uint64_t ea);
+void console_poll(void);
+
+/* exec.cpp */
+void cpu_reset(struct cpu *cpu);
+void take_interrupt(struct cpu *cpu, const struct interrupt &intr);
+void execute(struct cpu *cpu, uint32_t insn);
+void execute_prefixed(struct cpu *cpu, uint32_t prefix, uint32_t insn);
+uint64_t read_spr(struct cpu *cpu, int sprn);
+void write_spr(struct cpu *cpu, int sprn, uint64_t val);
+uint64_t get_xer(struct cpu *cpu);
+void set_xer(struct cpu *cpu, uint64_t val);
+uint64_t get_dec(struct cpu *cpu);
+void check_async(struct cpu *cpu);
+void check_trace(struct cpu *cpu, uint64_t cia, uint32_t insn, uint64_t msr);
+void pmu_count(struct cpu *cpu, uint64_t cia, uint32_t insn);
+[[noreturn]] void illegal(struct cpu *cpu, uint32_t insn);
+
+/* checkpoint.cpp */
+void write_checkpoint(struct cpu *cpu, const char *prefix, uint64_t stub_addr);
+
+/* fpu.cpp */
+void execute_fp(struct cpu *cpu, uint32_t insn);
+void execute_fp_prefixed(struct cpu *cpu, uint32_t insn, uint64_t ea);
+
+/* Instruction field helpers */
+static inline unsigned int insn_rt(uint32_t insn) { return (insn >> 21) & 31; }
+static inline unsigned int insn_ra(uint32_t insn) { return (insn >> 16) & 31; }
+static inline unsigned int insn_rb(uint32_t insn) { return (insn >> 11) & 31; }
+static inline unsigned int insn_rc(uint32_t insn) { return (insn >> 6) & 31; }
+static inline bool insn_rcbit(uint32_t insn) { return insn & 1; }
+
+static inline void set_cr_field(struct cpu *cpu, unsigned int bf, uint32_t val)
+{
+	unsigned int sh = 28 - 4 * bf;
+
+	cpu->cr = (cpu->cr & ~(0xfu << sh)) | (val << sh);
+}
+
+static inline uint32_t get_cr_field(struct cpu *cpu, unsigned int bf)
+{
+	return (cpu->cr >> (28 - 4 * bf)) & 0xf;
+}
+
+#endif
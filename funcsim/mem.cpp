@@ -0,0 +1,604 @@
+/*
+ * Physical memory map, SoC devices and the radix MMU.
+ *
+ * The memory map follows soc.vhdl: BRAM at 0 (and 0x80000000), DRAM at
+ * 0x40000000, and I/O from 0xc0000000. Only the bottom 32 bits of a real
+ * address reach the wishbone, so higher bits alias.
+ */
+
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "funcsim.h"
+#include "microwatt_soc.h"
+
+struct soc soc;
+
+#define PA_MASK		0xffffffffull
+#define PAGE_MASK	0xfffull
+
+static const uint64_t syscon_sig = 0xf00daa5500010001ull;
+
+uint8_t *phys_ram(uint64_t pa, unsigned int len)
+{
+	uint64_t off;
+
+	pa &= PA_MASK;
+	switch (pa >> 29) {
+	case 0:
+		if (!soc.dram_at_0) {
+			off = pa;
+			goto bram;
+		}
+		off = pa;
+		goto dram;
+	case 1:
+	case 2:
+	case 3:
+		off = pa - DRAM_BASE;
+		if (pa < DRAM_BASE)
+			off = pa;
+		goto dram;
+	case 4:
+	case 5:
+		off = pa - BRAM_BASE;
+		goto bram;
+	default:
+		return NULL;
+	}
+bram:
+	if (off + len > soc.bram_size)
+		return NULL;
+	return soc.bram + off;
+dram:
+	if (off + len > soc.dram_size)
+		return NULL;
+	return soc.dram + off;
+}
+
+/*
+ * Console input, read without blocking whenever the program looks at the
+ * UART status.
+ */
+static unsigned char rx_buf[256];
+static unsigned int rx_head, rx_tail;
+static unsigned int rx_polls;
+static bool rx_eof;
+
+void console_poll(void)
+{
+	struct pollfd fd = { .fd = 0, .events = POLLIN, .revents = 0 };
+	ssize_t n;
+
+	if (rx_eof || rx_head != rx_tail)
+		return;
+	fflush(stderr);
+	if (poll(&fd, 1, 0) != 1)
+		return;
+	n = read(0, rx_buf, sizeof(rx_buf));
+	if (n <= 0) {
+		rx_eof = true;
+		return;
+	}
+	rx_head = 0;
+	rx_tail = n;
+}
+
+static bool rx_ready(void)
+{
+	/* A syscall per status read would dominate polling loops */
+	if (rx_head == rx_tail && (rx_polls++ & 63) == 0)
+		console_poll();
+	return rx_head != rx_tail;
+}
+
+static uint8_t rx_byte(void)
+{
+	if (rx_head == rx_tail)
+		return 0;
+	return rx_buf[rx_head++];
+}
+
+/* Console output goes to stderr, as from core_tb */
+static void tx_byte(uint8_t c)
+{
+	putc(c, stderr);
+	if (c == '\n')
+		fflush(stderr);
+}
+
+static uint64_t syscon_read(uint64_t off)
+{
+	switch (off) {
+	case SYS_REG_SIGNATURE:
+		return syscon_sig;
+	case SYS_REG_INFO:
+		return SYS_REG_INFO_HAS_UART | SYS_REG_INFO_HAS_LARGE_SYSCON |
+			(soc.bram_size ? SYS_REG_INFO_HAS_BRAM : 0) |
+			(soc.dram_size ? SYS_REG_INFO_HAS_DRAM : 0);
+	case SYS_REG_BRAMINFO:
+		return soc.bram_size;
+	case SYS_REG_DRAMINFO:
+		return soc.dram_size;
+	case SYS_REG_CLKINFO:
+		return soc.clk_freq;
+	case SYS_REG_CTRL:
+		return soc.dram_at_0 ? SYS_REG_CTRL_DRAM_AT_0 : 0;
+	case SYS_REG_UART0_INFO:
+		return (soc.uart_16550 ? SYS_REG_UART_IS_16550 : 0) |
+			(soc.clk_freq & 0xffffffff);
+	case SYS_REG_CPU_CTRL:
+		return (1ull << 8) | 1;
+	}
+	return 0;
+}
+
+static void syscon_write(uint64_t off, uint64_t val)
+{
+	if (off == SYS_REG_CTRL)
+		soc.dram_at_0 = val & SYS_REG_CTRL_DRAM_AT_0;
+}
+
+static uint8_t uart_16550_read(unsigned int reg)
+{
+	bool dlab = soc.uart_lcr & UART_REG_LCR_DLAB;
+
+	switch (reg) {
+	case UART_REG_RX:
+		return dlab ? soc.uart_dll : rx_byte();
+	case UART_REG_IER:
+		return dlab ? soc.uart_dlm : soc.uart_ier;
+	case UART_REG_IIR:
+		return 0x01;
+	case UART_REG_LCR:
+		return soc.uart_lcr;
+	case UART_REG_MCR:
+		return soc.uart_mcr;
+	case UART_REG_LSR:
+		return UART_REG_LSR_THRE | UART_REG_LSR_TEMT |
+			(rx_ready() ? UART_REG_LSR_DR : 0);
+	case UART_REG_SCR:
+		return soc.uart_scr;
+	}
+	return 0;
+}
+
+static void uart_16550_write(unsigned int reg, uint8_t val)
+{
+	bool dlab = soc.uart_lcr & UART_REG_LCR_DLAB;
+
+	switch (reg) {
+	case UART_REG_TX:
+		if (dlab)
+			soc.uart_dll = val;
+		else
+			tx_byte(val);
+		break;
+	case UART_REG_IER:
+		if (dlab)
+			soc.uart_dlm = val;
+		else
+			soc.uart_ier = val;
+		break;
+	case UART_REG_LCR:
+		soc.uart_lcr = val;
+		break;
+	case UART_REG_MCR:
+		soc.uart_mcr = val;
+		break;
+	case UART_REG_SCR:
+		soc.uart_scr = val;
+		break;
+	}
+}
+
+static uint64_t potato_read(uint64_t off)
+{
+	switch (off) {
+	case POTATO_CONSOLE_RX:
+		return rx_byte();
+	case POTATO_CONSOLE_STATUS:
+		return POTATO_CONSOLE_STATUS_TX_EMPTY |
+			(rx_ready() ? 0 : POTATO_CONSOLE_STATUS_RX_EMPTY);
+	case POTATO_CONSOLE_CLOCK_DIV:
+		return soc.potato_div;
+	case POTATO_CONSOLE_IRQ_EN:
+		return soc.potato_irq_en;
+	}
+	return 0;
+}
+
+static void potato_write(uint64_t off, uint64_t val)
+{
+	switch (off) {
+	case POTATO_CONSOLE_TX:
+		tx_byte(val);
+		break;
+	case POTATO_CONSOLE_CLOCK_DIV:
+		soc.potato_div = val;
+		break;
+	case POTATO_CONSOLE_IRQ_EN:
+		soc.potato_irq_en = val;
+		break;
+	}
+}
+
+/*
+ * I/O accesses. Registers are 64 bits wide except for the 16550, which
+ * has byte registers on a 4-byte stride. Unmapped I/O reads as all ones,
+ * as in soc.vhdl.
+ */
+static uint64_t io_read64(uint64_t pa)
+{
+	if (pa >= SYSCON_BASE && pa < SYSCON_BASE + 0x1000)
+		return syscon_read(pa - SYSCON_BASE);
+	if (pa >= UART_BASE && pa < UART_BASE + 0x1000) {
+		if (!soc.uart_16550)
+			return potato_read(pa - UART_BASE);
+		return uart_16550_read(pa & 0x1c) |
+			((uint64_t)uart_16550_read((pa & 0x1c) + 4) << 32);
+	}
+	if (pa >= XICS_ICP_BASE && pa < GPIO_BASE + 0x1000)
+		return 0;
+	return ~0ull;
+}
+
+uint64_t phys_read(uint64_t pa, unsigned int len)
+{
+	uint8_t *p = phys_ram(pa, len);
+	uint64_t val = 0;
+
+	if (p) {
+		memcpy(&val, p, len);
+		return val;
+	}
+	pa &= PA_MASK;
+	if (pa < SYSCON_BASE)
+		return 0;
+	val = io_read64(pa & ~7ull) >> (8 * (pa & 7));
+	if (len < 8)
+		val &= (1ull << (8 * len)) - 1;
+	return val;
+}
+
+void phys_write(uint64_t pa, unsigned int len, uint64_t val)
+{
+	uint8_t *p = phys_ram(pa, len);
+	uint64_t off;
+
+	if (p) {
+		memcpy(p, &val, len);
+		return;
+	}
+	pa &= PA_MASK;
+	if (pa >= SYSCON_BASE && pa < SYSCON_BASE + 0x1000) {
+		off = pa - SYSCON_BASE;
+		syscon_write(off & ~7ull, val << (8 * (off & 7)));
+	} else if (pa >= UART_BASE && pa < UART_BASE + 0x1000) {
+		off = pa - UART_BASE;
+		if (soc.uart_16550)
+			uart_16550_write(off & 0x1c, val);
+		else
+			potato_write(off & ~7ull, val);
+	}
+}
+
+void tlb_flush(struct cpu *cpu)
+{
+	memset(cpu->itlb, 0, sizeof(cpu->itlb));
+	memset(cpu->dtlb, 0, sizeof(cpu->dtlb));
+}
+
+void tlb_flush_page(struct cpu *cpu, uint64_t ea)
+{
+	unsigned int i = (ea >> 12) % TLB_SIZE;
+
+	cpu->itlb[i].tag = 0;
+	cpu->dtlb[i].tag = 0;
+}
+
+struct walk_result {
+	uint64_t pte;
+	bool invalid, badtree, segerr;
+};
+
+static bool read_table(uint64_t addr, uint64_t *val)
+{
+	uint8_t *p = phys_ram(addr, 8);
+
+	if (!p)
+		return false;
+	/* Radix tree data structures are big-endian */
+	memcpy(val, p, 8);
+	*val = __builtin_bswap64(*val);
+	return true;
+}
+
+/* Walk the radix tree as mmu.vhdl does, returning the leaf PTE */
+static struct walk_result radix_walk(struct cpu *cpu, uint64_t ea)
+{
+	struct walk_result r = { 0, false, false, false };
+	uint64_t ptcr = cpu->spr[SPR_PTCR];
+	uint64_t prtbl, pgtbl, pde, pid, rts, mbits, shift, idx, base;
+	uint64_t prtb_size, nonzero;
+
+	if (!read_table((ptcr & 0x00fffffffffff000ull) | 8, &prtbl)) {
+		r.badtree = true;
+		return r;
+	}
+	pid = (ea >> 63) ? 0 : (cpu->spr[SPR_PID] & 0xffffffff);
+	prtb_size = (prtbl & 0x1f) + 12;
+	base = prtbl & 0x00fffffffffff000ull;
+	if (prtb_size < 64)
+		base &= ~((1ull << prtb_size) - 1);
+	idx = (pid << 4) & ((prtb_size < 64 ? (1ull << prtb_size) : 0) - 1);
+	if (!read_table(base | idx, &pgtbl)) {
+		r.badtree = true;
+		return r;
+	}
+	rts = (((pgtbl >> 61) & 3) << 3) | ((pgtbl >> 5) & 7);
+	mbits = pgtbl & 0x1f;
+	if (mbits == 0) {
+		r.invalid = true;
+		return r;
+	}
+	/* Segment check: bits above the tree size must match bit 63 */
+	shift = rts + 31;
+	nonzero = shift < 62 ? (ea << 2) >> (shift + 2) : 0;
+	if ((ea >> 63) != ((ea >> 62) & 1) || nonzero) {
+		r.segerr = true;
+		return r;
+	}
+	if (mbits < 5 || mbits > 16 || mbits > shift - 12) {
+		r.badtree = true;
+		return r;
+	}
+	base = pgtbl & 0x00ffffffffffff00ull;
+	for (;;) {
+		shift -= mbits;
+		idx = (ea >> shift) & ((1ull << mbits) - 1);
+		if (!read_table((base & ~((8ull << mbits) - 1)) | (idx << 3),
+				&pde)) {
+			r.badtree = true;
+			return r;
+		}
+		if (!(pde >> 63)) {
+			r.invalid = true;
+			return r;
+		}
+		if ((pde >> 62) & 1)
+			break;
+		mbits = pde & 0x1f;
+		if (mbits < 5 || mbits > 16 || mbits > shift - 12) {
+			r.badtree = true;
+			return r;
+		}
+		base = pde & 0x00ffffffffffff00ull;
+	}
+	/* Large pages: the remaining EA bits select the 4k page */
+	shift -= 12;
+	if (shift) {
+		uint64_t m = ((1ull << shift) - 1) << 12;
+		pde = (pde & ~m) | (ea & m);
+	}
+	r.pte = pde & 0x00ffffffffffffffull;
+	return r;
+}
+
+/* Check a leaf PTE against an access, as mmu.vhdl does */
+static int pte_check(struct cpu *cpu, uint64_t pte, bool iside, bool store)
+{
+	bool priv = !(cpu->msr & MSR_PR);
+	bool perm_ok = false;
+
+	if (priv || !(pte & 8)) {
+		if (!iside)
+			perm_ok = (pte & 2) || ((pte & 4) && !store);
+		else
+			perm_ok = (pte & 1) && !(pte & 0x20);
+	}
+	if (!perm_ok)
+		return 1;
+	if (!(pte & 0x100) || (store && !(pte & 0x80)))
+		return 2;
+	return 0;
+}
+
+[[noreturn]] static void mmu_fault(struct cpu *cpu, uint64_t ea, bool iside,
+				   bool store, const struct walk_result &w,
+				   int perm)
+{
+	struct interrupt intr = { 0, 0, false };
+
+	if (!iside) {
+		uint32_t dsisr = store ? DSISR_STORE : 0;
+
+		cpu->spr[SPR_DAR] = ea;
+		intr.vec = w.segerr ? 0x380 : 0x300;
+		if (w.invalid)
+			dsisr |= DSISR_NOPT;
+		if (w.badtree)
+			dsisr |= DSISR_BADTREE;
+		if (perm == 1)
+			dsisr |= DSISR_PERM;
+		if (perm == 2)
+			dsisr |= DSISR_RC;
+		if (!w.segerr)
+			cpu->spr[SPR_DSISR] = dsisr;
+	} else {
+		intr.vec = w.segerr ? 0x480 : 0x400;
+		if (!w.segerr) {
+			if (w.invalid)
+				intr.srr1 |= SRR1_ISI_NOPT;
+			if (w.badtree)
+				intr.srr1 |= SRR1_ISI_BADTREE;
+			if (perm == 1)
+				intr.srr1 |= SRR1_ISI_PERM;
+			if (perm == 2)
+				intr.srr1 |= SRR1_ISI_RC;
+		}
+	}
+	throw intr;
+}
+
+uint64_t translate(struct cpu *cpu, uint64_t ea, bool iside, bool store,
+		   uint8_t **host)
+{
+	struct tlb_entry *e;
+	struct walk_result w;
+	uint64_t tag;
+	int perm;
+
+	if (!(cpu->msr & (iside ? MSR_IR : MSR_DR))) {
+		*host = phys_ram(ea & ~PAGE_MASK, PAGE_MASK + 1);
+		return ea;
+	}
+	tag = (ea & ~PAGE_MASK) | 1;
+	e = &(iside ? cpu->itlb : cpu->dtlb)[(ea >> 12) % TLB_SIZE];
+	if (e->tag == tag && pte_check(cpu, e->pte, iside, store) == 0) {
+		*host = e->host;
+		return e->pa | (ea & PAGE_MASK);
+	}
+	/* Miss, or a permission failure that a fresh walk might fix */
+	e->tag = 0;
+	w = radix_walk(cpu, ea);
+	if (w.invalid || w.badtree || w.segerr)
+		mmu_fault(cpu, ea, iside, store, w, 0);
+	perm = pte_check(cpu, w.pte, iside, store);
+	if (perm)
+		mmu_fault(cpu, ea, iside, store, w, perm);
+	e->tag = tag;
+	e->pte = w.pte;
+	e->pa = w.pte & 0x00fffffffffff000ull;
+	e->host = phys_ram(e->pa, PAGE_MASK + 1);
+	*host = e->host;
+	return e->pa | (ea & PAGE_MASK);
+}
+
+static inline uint64_t byteswap(uint64_t val, unsigned int len)
+{
+	switch (len) {
+	case 2:
+		return __builtin_bswap16(val);
+	case 4:
+		return __builtin_bswap32(val);
+	case 8:
+		return __builtin_bswap64(val);
+	}
+	return val;
+}
+
+/*
+ * Data address watchpoints, matched a doubleword at a time like
+ * loadstore1 does, so DAR is the address of the doubleword that hit
+ * unless it is the first one.
+ */
+static void check_dawr(struct cpu *cpu, uint64_t ea, unsigned int len,
+		       bool store)
+{
+	bool priv = !(cpu->msr & MSR_PR);
+	bool virt = cpu->msr & MSR_DR;
+
+	for (uint64_t dw = ea >> 3; dw <= (ea + len - 1) >> 3; dw++) {
+		for (int i = 0; i < 2; i++) {
+			uint64_t x = cpu->spr[i ? SPR_DAWRX1 : SPR_DAWRX0];
+			uint64_t base = cpu->spr[i ? SPR_DAWR1 : SPR_DAWR0] >> 3;
+			uint64_t a = dw;
+
+			/* PRIVM, then WT/WTI, then DR/DW */
+			if (!(x & (priv ? 4 : 1)))
+				continue;
+			if (!(x & 8) && virt != !!(x & 0x10))
+				continue;
+			if (!(x & (store ? 0x40 : 0x20)))
+				continue;
+			if (priv && (x & 0x80))		/* HRAMMC */
+				a &= ~(1ull << 60);
+			if (a < base || a > base + ((x >> 10) & 0x3f))
+				continue;
+			cpu->spr[SPR_DAR] = dw == ea >> 3 ? ea : dw << 3;
+			cpu->spr[SPR_DSISR] = DSISR_DAWR | (store ? DSISR_STORE : 0);
+			throw interrupt { 0x300, 0, false };
+		}
+	}
+}
+
+static inline bool big_endian(struct cpu *cpu, bool byterev)
+{
+	return !(cpu->msr & MSR_LE) != byterev;
+}
+
+uint64_t load(struct cpu *cpu, uint64_t ea, unsigned int len, bool byterev)
+{
+	uint64_t pa, val = 0;
+	uint8_t *host;
+
+	if (!(cpu->msr & MSR_SF))
+		ea &= 0xffffffff;
+	cpu->mem_access = ACCESS_LOAD;
+	cpu->mem_ea = ea;
+	if (cpu->spr[SPR_DAWRX0] | cpu->spr[SPR_DAWRX1])
+		check_dawr(cpu, ea, len, false);
+	if ((ea & PAGE_MASK) + len > PAGE_MASK + 1) {
+		/* Crosses a page; do it a byte at a time */
+		for (unsigned int i = 0; i < len; i++)
+			val |= load(cpu, ea + i, 1, false) << (8 * i);
+	} else {
+		pa = translate(cpu, ea, false, false, &host);
+		if (host)
+			memcpy(&val, host + (ea & PAGE_MASK), len);
+		else
+			val = phys_read(pa, len);
+	}
+	if (big_endian(cpu, byterev))
+		val = byteswap(val, len);
+	return val;
+}
+
+void store(struct cpu *cpu, uint64_t ea, unsigned int len, uint64_t val,
+	   bool byterev)
+{
+	uint64_t pa;
+	uint8_t *host;
+
+	if (!(cpu->msr & MSR_SF))
+		ea &= 0xffffffff;
+	cpu->mem_access = ACCESS_STORE;
+	cpu->mem_ea = ea;
+	if (cpu->spr[SPR_DAWRX0] | cpu->spr[SPR_DAWRX1])
+		check_dawr(cpu, ea, len, true);
+	if (big_endian(cpu, byterev))
+		val = byteswap(val, len);
+	if ((ea & PAGE_MASK) + len > PAGE_MASK + 1) {
+		/* Check both pages before writing anything */
+		translate(cpu, ea, false, true, &host);
+		translate(cpu, (ea + len - 1) & ~PAGE_MASK, false, true, &host);
+		for (unsigned int i = 0; i < len; i++) {
+			pa = translate(cpu, ea + i, false, true, &host);
+			phys_write(pa, 1, val >> (8 * i));
+		}
+		return;
+	}
+	pa = translate(cpu, ea, false, true, &host);
+	if (host)
+		memcpy(host + (ea & PAGE_MASK), &val, len);
+	else
+		phys_write(pa, len, val);
+}
+
+uint32_t fetch(struct cpu *cpu, uint64_t ea)
+{
+	uint64_t pa;
+	uint32_t insn;
+	uint8_t *host;
+
+	pa = translate(cpu, ea, true, false, &host);
+	if (host)
+		memcpy(&insn, host + (ea & PAGE_MASK), 4);
+	else
+		insn = phys_read(pa, 4);
+	if (!(cpu->msr & MSR_LE))
+		insn = __builtin_bswap32(insn);
+	return insn;
+}
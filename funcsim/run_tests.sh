@@ -0,0 +1,42 @@
+#!/bin/bash
+#
+# Run the random execution tests and the console tests on funcsim and
+# compare with the expected results, as scripts/run_test.sh and
+# scripts/run_test_console.sh do for core_tb.
+
+TESTS=${1:-../tests}
+FAIL=0
+
+# Console tests that can't pass on funcsim: there is no interrupt
+# controller model, so test_xics never sees its interrupts
+XFAIL="test_xics"
+
+TMPDIR=$(mktemp -d)
+trap 'rm -rf "$TMPDIR"' EXIT
+
+for bin in "$TESTS"/[0-9]*.bin; do
+	t=$(basename "$bin" .bin)
+	./funcsim --dump -n 10000000 "$bin" 2>/dev/null |
+		grep -E '^(GPR[0-9]|LR |CTR |XER |CR [0-9])' | sort |
+		grep -v GPR31 > "$TMPDIR/test.out"
+	grep -v "^$" "$TESTS/$t.out" | sort | grep -v GPR31 > "$TMPDIR/exp.out"
+	if ! diff -q "$TMPDIR/test.out" "$TMPDIR/exp.out" > /dev/null; then
+		echo "$t FAIL ********"
+		FAIL=1
+	fi
+done
+
+for bin in "$TESTS"/test_*.bin; do
+	t=$(basename "$bin" .bin)
+	./funcsim -n 100000000 "$bin" < /dev/null 2> "$TMPDIR/test.out" > /dev/null
+	if [[ " $XFAIL " == *" $t "* ]]; then
+		echo "$t XFAIL"
+	elif ! diff -q "$TMPDIR/test.out" "$TESTS/$t.console_out" > /dev/null; then
+		echo "$t FAIL ********"
+		FAIL=1
+	else
+		echo "$t PASS"
+	fi
+done
+
+exit $FAIL
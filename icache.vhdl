@@ -41,6 +41,8 @@ entity icache is
         NUM_LINES : positive := 32;
         -- Number of ways
         NUM_WAYS  : positive := 4;
+        -- Number of lines to prefetch ahead of a miss (0 for none)
+        PREFETCH_LINES : natural := 0;
         -- Non-zero to enable log data collection
         LOG_LENGTH : natural := 0
         );
@@ -150,6 +152,10 @@ architecture rtl of icache is
     type cache_valids_t is array(index_t) of cache_way_valids_t;
     type row_per_line_valid_t is array(0 to ROW_PER_LINE - 1) of std_ulogic;
     signal cache_valids : cache_valids_t;
+    -- Lines that were prefetched and haven't been used yet
+    signal cache_pf     : cache_valids_t;
+    -- Set of cache tags for the line to be prefetched
+    signal pf_tags_set  : cache_tags_set_t;
 
     -- Cache reload state machine
     type state_t is (IDLE, STOP_RELOAD, CLR_TAG, WAIT_ACK);
@@ -178,6 +184,15 @@ architecture rtl of icache is
         end_row_ix       : row_in_line_t;
         rows_valid       : row_per_line_valid_t;
 
+        -- Next-line prefetch state
+        pf_reload        : std_ulogic;  -- line being reloaded is a prefetch
+        pf_way           : way_sig_t;
+        pf_addr          : real_addr_t; -- next line to prefetch
+        pf_be            : std_ulogic;
+        pf_count         : natural range 0 to PREFETCH_LINES;
+        pf_ready         : std_ulogic;  -- pf_tags_set is for pf_addr
+        pf_rr            : way_sig_t;   -- victim if no way is free
+
         stalled_hit      : std_ulogic;  -- remembers hit while stalled
         stalled_way      : way_sig_t;
 
@@ -208,6 +223,7 @@ architecture rtl of icache is
 
     -- PLRU output interface
     signal plru_victim : way_sig_t;
+    signal replace_way : way_sig_t;
 
     -- Memory write snoop signals
     signal snoop_valid  : std_ulogic;
@@ -293,6 +309,23 @@ architecture rtl of icache is
         return endian & addr(addr'left downto SET_SIZE_BITS);
     end;
 
+    -- Returns whether this is the last line in a page
+    function is_last_line(addr: real_addr_t) return boolean is
+    begin
+        return addr(MIN_LG_PGSZ - 1 downto LINE_OFF_BITS) = (MIN_LG_PGSZ - 1 downto LINE_OFF_BITS => '1');
+    end;
+
+    -- Return the address of the start of the next line
+    function next_line(addr: real_addr_t) return real_addr_t is
+        variable result : real_addr_t;
+    begin
+        result := addr;
+        result(MIN_LG_PGSZ - 1 downto LINE_OFF_BITS) :=
+            std_ulogic_vector(unsigned(addr(MIN_LG_PGSZ - 1 downto LINE_OFF_BITS)) + 1);
+        result(LINE_OFF_BITS - 1 downto 0) := (others => '0');
+        return result;
+    end;
+
 begin
 
     -- byte-swap read data if big endian
@@ -399,16 +432,10 @@ begin
         -- They are instantiated like this instead of trying to describe them as
         -- a single array in order to avoid problems with writing a single way.
         process(clk)
-            variable replace_way : way_sig_t;
             variable snoop_addr : real_addr_t;
             variable next_raddr : real_addr_t;
         begin
             if rising_edge(clk) then
-                replace_way := to_unsigned(0, WAY_BITS);
-                if NUM_WAYS > 1 then
-                    -- Get victim way from plru
-                    replace_way := plru_victim;
-                end if;
                 -- Read tags using NIA for next cycle
                 if flush_in = '1' or i_in.req = '0' or (stall_in = '0' and stall_out = '0') then
                     next_raddr := i_in.next_rpn & i_in.next_nia(MIN_LG_PGSZ - 1 downto 0);
@@ -419,6 +446,11 @@ begin
                         to_unsigned(i, WAY_BITS) = replace_way then
                         tag_overwrite(i) <= '1';
                     end if;
+                elsif PREFETCH_LINES > 0 and r.state = CLR_TAG and r.store_index = req_index and
+                    to_unsigned(i, WAY_BITS) = replace_way then
+                    -- The tag read for the stalled request is being
+                    -- replaced (by a prefetch, which doesn't stall fetch)
+                    tag_overwrite(i) <= '1';
                 end if;
 
                 -- Second read port for snooping writes to memory
@@ -427,6 +459,11 @@ begin
                     snoop_tags_set(i) <= ic_tags(to_integer(get_index(snoop_addr)));
                 end if;
 
+                -- Third read port for checking the line to prefetch
+                if PREFETCH_LINES > 0 and not is_X(r.pf_addr) then
+                    pf_tags_set(i) <= ic_tags(to_integer(get_index(r.pf_addr)));
+                end if;
+
                 -- Write one tag when in CLR_TAG state
                 if r.state = CLR_TAG and to_unsigned(i, WAY_BITS) = replace_way then
                     ic_tags(to_integer(r.store_index)) <= r.store_tag;
@@ -485,6 +522,12 @@ begin
         end process;
     end generate;
 
+    -- Victim way for a reload: from the PLRU for a miss (the PLRU is read
+    -- at the index of the missing request), or as chosen for a prefetch
+    replace_way <= r.pf_way when r.pf_reload = '1' else
+                   plru_victim when NUM_WAYS > 1 else
+                   to_unsigned(0, WAY_BITS);
+
     -- Cache hit detection, output to fetch2 and other misc logic
     icache_comb : process(all)
 	variable is_hit  : std_ulogic;
@@ -645,17 +688,25 @@ begin
         variable tag       : cache_tag_t;
         variable snoop_addr : real_addr_t;
         variable snoop_cache_tags : cache_tags_set_t;
-        variable replace_way : way_sig_t;
+        variable pf_start : boolean;
+        variable pf_hit : boolean;
+        variable pf_victim : way_sig_t;
     begin
         if rising_edge(clk) then
             ev.icache_miss <= '0';
             ev.itlb_miss_resolved <= '0';
+            ev.prefetch_useful <= '0';
+            ev.prefetch_discard <= '0';
             r.recv_valid <= '0';
 	    -- On reset, clear all valid bits to force misses
             if rst = '1' then
 		for i in index_t loop
 		    cache_valids(i) <= (others => '0');
+                    cache_pf(i) <= (others => '0');
 		end loop;
+                r.pf_reload <= '0';
+                r.pf_count <= 0;
+                r.pf_rr <= to_unsigned(0, WAY_BITS);
                 r.state <= IDLE;
                 r.wb.cyc <= '0';
                 r.wb.stb <= '0';
@@ -694,12 +745,33 @@ begin
                 end if;
                 snoop_index2 <= snoop_index;
 
+                -- The first fetch from a prefetched line restarts the
+                -- prefetching from the line after it
+                pf_start := false;
+                r.pf_ready <= '1';
+                if req_is_hit = '1' and cache_pf(to_integer(req_index))(to_integer(req_hit_way)) = '1' then
+                    cache_pf(to_integer(req_index))(to_integer(req_hit_way)) <= '0';
+                    ev.prefetch_useful <= '1';
+                    pf_start := true;
+                end if;
+                if pf_start or req_is_miss = '1' then
+                    pf_start := true;
+                    r.pf_count <= 0;
+                    if not is_last_line(real_addr) then
+                        r.pf_count <= PREFETCH_LINES;
+                    end if;
+                    r.pf_addr <= next_line(real_addr);
+                    r.pf_be <= i_in.big_endian;
+                    r.pf_ready <= '0';
+                end if;
+
                 -- Process cache invalidations
                 if inval_in = '1' then
                     for i in index_t loop
                         cache_valids(i) <= (others => '0');
                     end loop;
                     r.store_valid <= '0';
+                    r.pf_count <= 0;
                 else
                     -- Do invalidations from snooped stores to memory,
                     -- two cycles after the address appears on wb_snoop_in.
@@ -746,6 +818,48 @@ begin
 
 			-- Track that we had one request sent
 			r.state <= CLR_TAG;
+                        r.pf_reload <= '0';
+
+                    elsif PREFETCH_LINES > 0 and r.pf_count /= 0 and r.pf_ready = '1' and
+                        not pf_start and inval_in = '0' then
+                        -- Otherwise prefetch the next line, if it isn't
+                        -- already in the cache.  Use a free way if there is
+                        -- one, since the PLRU is for another set.
+                        assert not is_X(r.pf_addr) severity failure;
+                        pf_hit := false;
+                        pf_victim := r.pf_rr;
+                        for i in NUM_WAYS - 1 downto 0 loop
+                            if cache_valids(to_integer(get_index(r.pf_addr)))(i) = '0' then
+                                pf_victim := to_unsigned(i, WAY_BITS);
+                            elsif pf_tags_set(i) = get_tag(r.pf_addr, r.pf_be) then
+                                pf_hit := true;
+                            end if;
+                        end loop;
+                        if not pf_hit then
+                            r.store_index <= get_index(r.pf_addr);
+                            r.recv_row <= get_row(r.pf_addr);
+                            r.store_row <= get_row(r.pf_addr);
+                            r.store_tag <= get_tag(r.pf_addr, r.pf_be);
+                            r.store_valid <= '1';
+                            r.end_row_ix <= to_unsigned(ROW_PER_LINE - 1, ROW_LINEBITS);
+                            r.wb.adr <= addr_to_wb(r.pf_addr);
+                            r.wb.cyc <= '1';
+                            r.wb.stb <= '1';
+                            r.state <= CLR_TAG;
+                            r.pf_reload <= '1';
+                            r.pf_way <= pf_victim;
+                            if r.pf_rr = NUM_WAYS - 1 then
+                                r.pf_rr <= to_unsigned(0, WAY_BITS);
+                            else
+                                r.pf_rr <= r.pf_rr + 1;
+                            end if;
+                        end if;
+                        r.pf_count <= r.pf_count - 1;
+                        if is_last_line(r.pf_addr) then
+                            r.pf_count <= 0;
+                        end if;
+                        r.pf_addr <= next_line(r.pf_addr);
+                        r.pf_ready <= '0';
 		    end if;
 
 		when CLR_TAG | WAIT_ACK =>
@@ -753,16 +867,16 @@ begin
                     assert not is_X(r.store_row) severity failure;
                     assert not is_X(r.recv_row) severity failure;
                     if r.state = CLR_TAG then
-                        replace_way := to_unsigned(0, WAY_BITS);
-                        if NUM_WAYS > 1 then
-                            -- Get victim way from plru
-                            replace_way := plru_victim;
-                        end if;
 			r.store_way <= replace_way;
 
 			-- Force misses on that way while reloading that line
                         assert not is_X(replace_way) severity failure;
                         cache_valids(to_integer(r.store_index))(to_integer(replace_way)) <= '0';
+                        if cache_valids(to_integer(r.store_index))(to_integer(replace_way)) = '1' and
+                            cache_pf(to_integer(r.store_index))(to_integer(replace_way)) = '1' then
+                            ev.prefetch_discard <= '1';
+                        end if;
+                        cache_pf(to_integer(r.store_index))(to_integer(replace_way)) <= r.pf_reload;
 
                         r.state <= WAIT_ACK;
                     end if;
@@ -799,6 +913,17 @@ begin
                         r.state <= STOP_RELOAD;
                     end if;
 
+                    -- Abandon a prefetch if fetch misses on another line,
+                    -- unless the prefetched line is just complete
+                    if r.state = WAIT_ACK and r.pf_reload = '1' and req_is_miss = '1' and
+                        (req_index /= r.store_index or req_tag /= r.store_tag) and
+                        not (r.recv_valid = '1' and is_last_row(r.store_row, r.end_row_ix)) then
+                        r.wb.stb <= '0';
+                        r.store_valid <= '0';
+                        r.state <= STOP_RELOAD;
+                        ev.prefetch_discard <= cache_pf(to_integer(r.store_index))(to_integer(r.store_way));
+                    end if;
+
 		    -- Incoming acks processing
 		    if wishbone_in.ack = '1' then
 			-- Check for completion
@@ -64,6 +64,7 @@ architecture behave of loadstore1 is
         load         : std_ulogic;
         store        : std_ulogic;
         flush        : std_ulogic;
+        clean        : std_ulogic;
         touch        : std_ulogic;
         sync         : std_ulogic;
         tlbie        : std_ulogic;
@@ -704,6 +705,10 @@ begin
             when OP_DCBF =>
                 v.load := '1';
                 v.flush := '1';
+            when OP_DCBST =>
+                v.load := '1';
+                v.flush := '1';
+                v.clean := '1';
             when OP_DCBZ =>
                 v.dcbz := '1';
             when OP_TLBIE =>
@@ -1280,6 +1285,7 @@ begin
             d_out.load <= stage1_req.load;
             d_out.dcbz <= stage1_req.dcbz;
             d_out.flush <= stage1_req.flush;
+            d_out.clean <= stage1_req.clean;
             d_out.touch <= stage1_req.touch;
             d_out.sync <= stage1_req.sync;
             d_out.nc <= stage1_req.nc;
@@ -1297,6 +1303,7 @@ begin
             d_out.load <= r2.req.load;
             d_out.dcbz <= r2.req.dcbz;
             d_out.flush <= r2.req.flush;
+            d_out.clean <= r2.req.clean;
             d_out.touch <= r2.req.touch;
             d_out.sync <= r2.req.sync;
             d_out.nc <= r2.req.nc;
@@ -259,6 +259,8 @@ begin
                 inc(1) := p_in.run;
             when x"fc" =>
                 inc(1) := p_in.occur.ld_complete;
+            when x"e0" =>
+                inc(1) := p_in.occur.ipref_useful;
             when others =>
         end case;
 
@@ -293,6 +295,10 @@ begin
                 inc(3) := p_in.occur.dc_ld_miss_resolved;
             when x"f8" =>
                 inc(3) := tbbit;
+            when x"fa" =>
+                inc(3) := p_in.occur.dc_pref_useful;
+            when x"fc" =>
+                inc(3) := p_in.occur.dc_pref_useless;
             when x"fe" =>
                 inc(3) := p_in.occur.dtlb_miss;
             when others =>
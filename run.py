@@ -24,6 +24,11 @@ PRJ.add_library("unisim").add_source_files(ROOT / "sim-unisim" / "*.vhdl")
 
 PRJ.set_sim_option("disable_ieee_warnings", True)
 
+# Test both the one bit per cycle divider and the fast one
+divider_tb = PRJ.library("lib").test_bench("divider_tb")
+divider_tb.add_config(name="slow", generics=dict(FAST=False))
+divider_tb.add_config(name="fast", generics=dict(FAST=True))
+
 def _gen_vhdl_ls(vu):
     """
     Generate the vhdl_ls.toml file required by VHDL-LS language server.
@@ -0,0 +1,330 @@
+#!/usr/bin/python3
+#
+# Measure MicroPython boot time and REPL latency on the GHDL simulator
+# (core_tb), Verilator (microwatt-verilator) or a board over a serial
+# port. We time reset to the first banner, reset to the first >>> prompt,
+# and then each command of a fixed script of Python workloads, from the
+# core reading the first byte of the command to it printing the next
+# prompt.
+#
+# The simulators log the cycle count of every console byte to the file
+# named by SIM_CONSOLE_CYCLES (see sim_console_c.c), which gives exact
+# simulated cycles. On hardware only wall time is known; --clk-hz turns
+# that into an estimate of cycles.
+#
+# Each measurement is printed as a "MPY name=... cycles=... wall_ms=..."
+# line. Simulated cycle counts can be compared against, and recorded in,
+# the same performance baseline as scripts/run_tests.py uses.
+
+import argparse
+import json
+import os
+import select
+import shutil
+import subprocess
+import sys
+import tempfile
+import termios
+import time
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+from run_tests import compare_baseline, load_baseline, update_baseline
+
+# Defined on the target with exec() so that the REPL's auto-indent
+# doesn't get in the way
+SETUP = '''
+def loop(n):
+ s=0
+ for i in range(n):
+  s+=i
+ return s
+def dicts(n):
+ d={}
+ for i in range(n):
+  d['k%d'%i]=i*i
+ s=0
+ for i in range(n):
+  s+=d['k%d'%i]
+ return s
+def fmt(n):
+ r=[]
+ for i in range(n):
+  r.append('%05d|%-6s|%x'%(i,'ab'*(i%3),i*31))
+  r.append('{}:{:>4}'.format(i,i%7))
+ return len(''.join(r))
+def sort(n):
+ x=1
+ l=[]
+ for i in range(n):
+  x=(x*1103515245+12345)&0x7fffffff
+  l.append(x)
+ l.sort()
+ return l[n//2]
+'''
+
+# (name, expression, work per unit of --scale)
+WORKLOADS = [
+    ('print', 'print("foo")', 0),
+    ('loop', 'loop(%d)', 200),
+    ('dict', 'dicts(%d)', 50),
+    ('format', 'fmt(%d)', 20),
+    ('sort', 'sort(%d)', 50),
+]
+
+BANNER = b'MicroPython'
+PROMPT = b'>>> '
+
+
+class Console:
+    """A console on a simulator or serial port, with optional cycle log"""
+
+    def __init__(self, read_fd, write_fd, cycles_file=None):
+        self.read_fd = read_fd
+        self.write_fd = write_fd
+        self.cycles_file = cycles_file
+        self.output = bytearray()
+        self.pos = 0
+        self.sent = 0
+        self.records = {'R': [], 'W': []}
+        self.cycles_data = b''
+        self.log = None
+
+    def send(self, data):
+        """Send data and return the index of its first byte"""
+        start = self.sent
+        os.write(self.write_fd, data)
+        self.sent += len(data)
+        return start
+
+    def expect(self, pattern, timeout):
+        """Wait for pattern, returning the offset just past it"""
+        deadline = time.time() + timeout
+        while True:
+            i = self.output.find(pattern, self.pos)
+            if i >= 0:
+                self.pos = i + len(pattern)
+                return self.pos
+            left = deadline - time.time()
+            if left <= 0:
+                raise TimeoutError('timed out waiting for %r' % pattern)
+            r, _, _ = select.select([self.read_fd], [], [], left)
+            if r:
+                data = os.read(self.read_fd, 4096)
+                if not data:
+                    raise EOFError('console closed waiting for %r' % pattern)
+                self.output += data
+                if self.log:
+                    self.log.write(data)
+                    self.log.flush()
+
+    def cycle(self, direction, index, timeout=10):
+        """Cycle at which the index'th byte was read (R) or written (W)"""
+        if not self.cycles_file:
+            return None
+        deadline = time.time() + timeout
+        records = self.records[direction]
+        while len(records) <= index:
+            with open(self.cycles_file, 'rb') as f:
+                f.seek(len(self.cycles_data))
+                self.cycles_data += f.read()
+            lines = self.cycles_data.split(b'\n')
+            self.records = {'R': [], 'W': []}
+            for l in lines[:-1]:
+                d, c, _ = l.split()
+                self.records[d.decode()].append(int(c))
+            records = self.records[direction]
+            if len(records) > index:
+                break
+            if time.time() > deadline:
+                raise TimeoutError('no cycle logged for %s byte %d'
+                                   % (direction, index))
+            time.sleep(0.01)
+        return records[index]
+
+
+class Sim:
+    def __init__(self, cmd, image, console_on_stderr):
+        self.tempdir = tempfile.TemporaryDirectory()
+        cycles = os.path.join(self.tempdir.name, 'cycles')
+        open(cycles, 'w').close()
+        if image:
+            shutil.copyfile(image, os.path.join(self.tempdir.name,
+                                                'main_ram.bin'))
+        env = dict(os.environ, SIM_CONSOLE_CYCLES=cycles)
+        out = subprocess.PIPE
+        self.proc = subprocess.Popen(
+            [os.path.abspath(cmd)], cwd=self.tempdir.name, env=env,
+            stdin=subprocess.PIPE,
+            stdout=subprocess.DEVNULL if console_on_stderr else out,
+            stderr=out if console_on_stderr else subprocess.DEVNULL)
+        stream = self.proc.stderr if console_on_stderr else self.proc.stdout
+        self.console = Console(stream.fileno(), self.proc.stdin.fileno(),
+                               cycles)
+
+    def close(self):
+        self.proc.kill()
+        self.proc.wait()
+        self.tempdir.cleanup()
+
+
+class Uart:
+    def __init__(self, device, baud):
+        self.fd = os.open(device, os.O_RDWR | os.O_NOCTTY)
+        attr = termios.tcgetattr(self.fd)
+        speed = getattr(termios, 'B%d' % baud)
+        attr[0] = 0                                     # iflag
+        attr[1] = 0                                     # oflag
+        attr[2] = termios.CS8 | termios.CREAD | termios.CLOCAL
+        attr[3] = 0                                     # lflag
+        attr[4] = attr[5] = speed
+        termios.tcsetattr(self.fd, termios.TCSANOW, attr)
+        termios.tcflush(self.fd, termios.TCIOFLUSH)
+        self.console = Console(self.fd, self.fd)
+
+    def close(self):
+        os.close(self.fd)
+
+
+def expected_results(scale):
+    """What the REPL should print for each workload, from running it here"""
+    env = {}
+    exec(SETUP, env)
+    results = {}
+    for name, expr, n in WORKLOADS:
+        if '%d' in expr:
+            results[name] = repr(eval(expr % (n * scale), env))
+        else:
+            results[name] = 'foo'
+    return results
+
+
+def run(target, args):
+    con = target.console
+    if args.verbose:
+        con.log = sys.stdout.buffer
+    results = []
+    clk = args.clk_hz
+
+    def record(name, cycles, wall):
+        if cycles is None and clk:
+            cycles = int(wall * clk)
+            estimated = True
+        else:
+            estimated = False
+        line = 'MPY name=%s' % name
+        if cycles is not None:
+            line += ' cycles=%d' % cycles
+        line += ' wall_ms=%d' % (wall * 1000)
+        if estimated:
+            line += ' estimated=1'
+        print(line)
+        r = {'name': '%s_%s' % (args.prefix, name), 'status': 'pass',
+             'wall': wall}
+        if cycles is not None and not estimated:
+            r['perf'] = {'cycles': cycles}
+        results.append(r)
+
+    start = time.time()
+    end = con.expect(BANNER, args.timeout)
+    record('boot_banner', con.cycle('W', end - len(BANNER)),
+           time.time() - start)
+    end = con.expect(PROMPT, args.timeout)
+    record('boot_prompt', con.cycle('W', end - 1), time.time() - start)
+
+    expect = expected_results(args.scale)
+    commands = [('define', 'exec(%r)' % SETUP, None)]
+    for name, expr, n in WORKLOADS:
+        cmd = expr % (n * args.scale) if '%d' in expr else expr
+        commands.append((name, cmd, expect[name]))
+
+    for name, cmd, result in commands:
+        begin = time.time()
+        first = con.send(cmd.encode() + b'\r\n')
+        start_pos = con.pos
+        end = con.expect(PROMPT, args.timeout)
+        wall = time.time() - begin
+        output = con.output[start_pos:end].decode(errors='replace')
+        if result is not None and result not in output.split('\r\n')[1:]:
+            print('MPY-ERROR name=%s expected %r got %r'
+                  % (name, result, output))
+            for r in results:
+                r['status'] = 'fail'
+            return results
+        cycles = None
+        if con.cycles_file:
+            cycles = con.cycle('W', end - 1) - con.cycle('R', first)
+        record(name, cycles, wall)
+    return results
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Time MicroPython boot and REPL commands on Microwatt')
+    target = parser.add_mutually_exclusive_group()
+    target.add_argument('--ghdl', default='./core_tb', metavar='SIM',
+                        help='run on this GHDL simulator (default)')
+    target.add_argument('--verilator', nargs='?',
+                        const='./microwatt-verilator', metavar='SIM',
+                        help='run on the Verilator model instead')
+    target.add_argument('--uart', metavar='DEVICE',
+                        help='run on a board attached to this serial port; '
+                        'start the script then reset the board')
+    parser.add_argument('--image', default='micropython/firmware.bin',
+                        help='firmware image for the GHDL simulator')
+    parser.add_argument('--baud', type=int, default=115200)
+    parser.add_argument('--clk-hz', type=int,
+                        help='core clock, to estimate cycles on hardware')
+    parser.add_argument('--scale', type=int, default=1,
+                        help='multiply the work done by each workload')
+    parser.add_argument('--timeout', type=int, default=600,
+                        help='seconds to wait for each step')
+    parser.add_argument('--json', help='write JSON results to this file')
+    parser.add_argument('--baseline', default='tests/perf_baseline.json',
+                        help='performance baseline to compare against')
+    parser.add_argument('--tolerance', type=float, default=2.0,
+                        help='percentage cycle increase to report')
+    parser.add_argument('--update-baseline', action='store_true',
+                        help='record these results in the baseline')
+    parser.add_argument('-v', '--verbose', action='store_true',
+                        help='show the console')
+    args = parser.parse_args()
+
+    if args.uart:
+        target = Uart(args.uart, args.baud)
+        args.prefix = 'micropython_hw'
+    elif args.verilator:
+        target = Sim(args.verilator, None, False)
+        args.prefix = 'micropython_verilator'
+    else:
+        target = Sim(args.ghdl, args.image, True)
+        args.prefix = 'micropython_ghdl'
+    # The workloads' cycle counts depend on how much work they do
+    if args.scale != 1:
+        args.prefix += '_x%d' % args.scale
+
+    try:
+        results = run(target, args)
+    except (TimeoutError, EOFError) as e:
+        print('MPY-ERROR %s' % e)
+        results = []
+    finally:
+        target.close()
+
+    if args.json:
+        with open(args.json, 'w') as f:
+            json.dump(results, f, indent=1)
+            f.write('\n')
+    failed = not results or any(r['status'] != 'pass' for r in results)
+    regressed = 0
+    if not failed and any('perf' in r for r in results):
+        if args.update_baseline:
+            update_baseline(args.baseline, results)
+        else:
+            regressed = compare_baseline(results,
+                                         load_baseline(args.baseline),
+                                         args.tolerance)
+    sys.exit(1 if failed or regressed else 0)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,20 @@
+#!/bin/bash
+# Time fmt_log decoding a synthetic log, 1 GB by default. The entries
+# are random, which exercises every field of the listing.
+set -e
+
+SIZE_MB=${SIZE_MB:-1024}
+LOG=${LOG:-/tmp/fmt_log_bench.bin}
+FMT_LOG=${FMT_LOG:-$(dirname "$0")/fmt_log}
+
+if [ ! -f "$LOG" ] || [ "$(stat -c %s "$LOG")" -ne $((SIZE_MB * 1048576)) ]; then
+	echo "Generating a ${SIZE_MB} MB log in $LOG"
+	head -c $((SIZE_MB * 1048576)) /dev/urandom > "$LOG"
+fi
+
+for j in $(echo 1 "$(nproc)" | tr ' ' '\n' | sort -nu); do
+	echo "fmt_log -j $j:"
+	time "$FMT_LOG" -j "$j" "$LOG" > /dev/null
+done
+echo "fmt_log -c:"
+time "$FMT_LOG" -c "$LOG" > /dev/null
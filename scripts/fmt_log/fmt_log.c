@@ -1,238 +1,1033 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include <stddef.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <elf.h>
+
+#include "log_decode.h"
+
+/* Log input, mapped when it's a regular file */
+struct log_input {
+	FILE *f;
+	const unsigned char *map;
+	size_t count;
+	size_t pos;
+};
+
+static void open_input(struct log_input *in, const char *filename)
+{
+	struct stat st;
+	void *map;
+	int fd;
+
+	memset(in, 0, sizeof(*in));
+	in->f = stdin;
+	if (!filename)
+		return;
+	in->f = fopen(filename, "rb");
+	if (in->f == NULL) {
+		perror(filename);
+		exit(1);
+	}
+	fd = fileno(in->f);
+	if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size < LOG_ENTRY_BYTES)
+		return;
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED)
+		return;
+	in->map = map;
+	in->count = st.st_size / LOG_ENTRY_BYTES;
+}
+
+static int next_entry(struct log_input *in, struct log_entry *log)
+{
+	unsigned char raw[LOG_ENTRY_BYTES];
+	u64 w[4];
+
+	if (in->map) {
+		if (in->pos >= in->count)
+			return 0;
+		log_load(w, in->map + in->pos++ * LOG_ENTRY_BYTES);
+	} else {
+		if (fread(raw, sizeof(raw), 1, in->f) != 1)
+			return 0;
+		log_load(w, raw);
+	}
+	log_unpack(log, w);
+	return 1;
+}
+
+#define MAX_RANGES	32
 
-typedef unsigned long long u64;
-
-struct log_entry {
-	u64	nia_lo: 42;
-	u64	nia_hi: 1;
-	u64	ic_ra_valid: 1;
-	u64	ic_access_ok: 1;
-	u64	ic_is_miss: 1;
-	u64	ic_is_hit: 1;
-	u64	ic_way: 3;
-	u64	ic_state: 1;
-	u64	ic_part_nia: 4;
-	u64	ic_fetch_failed: 1;
-	u64	ic_stall_out: 1;
-	u64	ic_wb_stall: 1;
-	u64	ic_wb_cyc: 1;
-	u64	ic_wb_stb: 1;
-	u64	ic_wb_adr: 3;
-	u64	ic_wb_ack: 1;
-
-	u64	ic_insn: 36;
-	u64	ic_valid: 1;
-	u64	d1_valid: 1;
-	u64	d1_unit: 2;
-	u64	d1_part_nia: 4;
-	u64	d1_insn_type: 6;
-	u64	d2_bypass_a: 1;
-	u64	d2_bypass_b: 1;
-	u64	d2_bypass_c: 1;
-	u64	d2_stall_out: 1;
-	u64	d2_stopped_out: 1;
-	u64	d2_valid: 1;
-	u64	d2_part_nia: 4;
-	u64	e1_flush_out: 1;
-	u64	e1_stall_out: 1;
-	u64	e1_redirect: 1;
-	u64	e1_valid: 1;
-
-	u64	e1_write_enable: 1;
-	u64	e1_irq_state: 1;
-	u64	e1_irq: 1;
-	u64	e1_exception: 1;
-	u64	e1_msr_dr: 1;
-	u64	e1_msr_ir: 1;
-	u64	e1_msr_pr: 1;
-	u64	e1_msr_ee: 1;
-	u64	pad1: 4;
-	u64	ls_state: 3;
-	u64	ls_dw_done: 1;
-	u64	ls_min_done: 1;
-	u64	ls_do_valid: 1;
-	u64	ls_mo_valid: 1;
-	u64	ls_lo_valid: 1;
-	u64	ls_eo_except: 1;
-	u64	ls_stall_out: 1;
-	u64	pad2: 1;
-	u64	dc_state: 3;
-	u64	dc_ra_valid: 1;
-	u64	dc_tlb_way: 3;
-	u64	dc_stall_out: 1;
-	u64	dc_op: 3;
-	u64	dc_do_valid: 1;
-	u64	dc_do_error: 1;
-	u64	dc_wb_cyc: 1;
-	u64	dc_wb_stb: 1;
-	u64	dc_wb_ack: 1;
-	u64	dc_wb_stall: 1;
-	u64	dc_wb_adr: 3;
-	u64	cr_wr_mask: 8;
-	u64	cr_wr_data: 4;
-	u64	cr_wr_enable: 1;
-	u64	reg_wr_reg: 7;
-	u64	reg_wr_enable: 1;
-
-	u64	reg_wr_data;
+/* Cycles by cause for instructions in [start, end] */
+struct cpi_range {
+	u64	start;
+	u64	end;
+	long int cycles[NR_CAUSES];
 };
 
-#define FLAG(i, y)	(log.i? y: ' ')
-#define FLGA(i, y, z)	(log.i? y: z)
-#define PNIA(f)		(full_nia[log.f] & 0xff)
-
-const char *units[4] = { "al", "ls", "fp", "3?" };
-const char *ops[64] =
-{
-	"illegal", "nop    ", "add    ", "attn   ", "b      ", "bc     ", "bcreg  ", "bperm  ",
-	"bsort  ", "cmp    ", "compute", "countb ", "darn   ", "dcbf   ", "dcbst  ", "dcbz   ",
-	"icbi   ", "icbt   ", "fpcmp  ", "fparith", "fpmove ", "fpmisc ", "div    ", "dive   ",
-	"mod    ", "isync  ", "ld     ", "st     ", "mcrxrx ", "mfmsr  ", "mfspr  ", "msg    ",
-	"mtcrf  ", "mtmsr  ", "mtspr  ", "mull64 ", "mulh64 ", "mulh32 ", "rfid   ", "sc     ",
-	"sync   ", "tlbie  ", "trap   ", "wait   ", "ffail  ", "?45    ", "?46    ", "?47    ",
-	"?48    ", "?49    ", "?50    ", "?51    ", "?52    ", "?53    ", "?54    ", "?55    ",
-	"?56    ", "?57    ", "?58    ", "?59    ", "?60    ", "?61    ", "?62    ", "?63    "
+/* The extra range at the end collects everything outside the others */
+static struct cpi_range ranges[MAX_RANGES + 1];
+static int nranges;
+
+/*
+ * Kanata export, for the Konata pipeline viewer. Instructions are
+ * followed from the icache output through decode1, decode2 and on to
+ * execute1 or loadstore by the partial NIA each stage logs, matching
+ * them against the oldest instruction in the previous stage with the
+ * same tag. One that turns up in a stage without having been seen
+ * before (at the start of the log, say) starts there.
+ */
+#define KANATA_MAX	64
+
+enum kstage { KS_IC, KS_DEC1, KS_DEC2, KS_EX, KS_LS };
+
+static const char *kstage_names[] = { "ic", "dec1", "dec2", "ex1", "ls" };
+
+struct kinsn {
+	long int id;
+	enum kstage stage;
+	int tag;
+	int is_ls;
+	int labelled;	/* unit and op label printed */
+	int issued;
 };
 
-const char *spr_names[13] =
+/* In flight instructions, oldest first */
+static struct kinsn kinsns[KANATA_MAX];
+static int nkinsns;
+static long int kcycle, klast_cycle, knext_id, knext_retire;
+
+static void kanata_sync(void)
+{
+	if (kcycle != klast_cycle) {
+		printf("C\t%ld\n", kcycle - klast_cycle);
+		klast_cycle = kcycle;
+	}
+}
+
+static void kanata_remove(int i, int flushed)
 {
-	"lr ", "ctr", "sr0", "sr1", "hr0", "hr1", "sg0", "sg1",
-	"sg2", "sg3", "hg0", "hg1", "xer"
+	kanata_sync();
+	printf("E\t%ld\t0\t%s\n", kinsns[i].id, kstage_names[kinsns[i].stage]);
+	printf("R\t%ld\t%ld\t%d\n", kinsns[i].id, flushed ? 0 : knext_retire++, flushed);
+	memmove(&kinsns[i], &kinsns[i + 1], (nkinsns - i - 1) * sizeof(kinsns[0]));
+	--nkinsns;
+}
+
+static void kanata_move(struct kinsn *k, enum kstage stage)
+{
+	kanata_sync();
+	printf("E\t%ld\t0\t%s\n", k->id, kstage_names[k->stage]);
+	printf("S\t%ld\t0\t%s\n", k->id, kstage_names[stage]);
+	k->stage = stage;
+}
+
+static int kanata_find(enum kstage stage, int tag)
+{
+	int i;
+
+	for (i = 0; i < nkinsns; ++i)
+		if (kinsns[i].stage == stage && (tag < 0 || kinsns[i].tag == tag))
+			return i;
+	return -1;
+}
+
+/* Find or bring the instruction with this tag into a stage */
+static struct kinsn *kanata_stage(const struct log_decoder *d, enum kstage stage, int tag)
+{
+	struct kinsn *k;
+	int i;
+
+	i = kanata_find(stage, tag);
+	if (i < 0 && stage > KS_IC) {
+		i = kanata_find(stage - 1, tag);
+		if (i >= 0)
+			kanata_move(&kinsns[i], stage);
+	}
+	if (i < 0) {
+		if (nkinsns == KANATA_MAX)
+			kanata_remove(0, 1);
+		i = nkinsns++;
+		k = &kinsns[i];
+		k->id = knext_id++;
+		k->stage = stage;
+		k->tag = tag;
+		k->is_ls = 0;
+		k->labelled = 0;
+		k->issued = 0;
+		kanata_sync();
+		printf("I\t%ld\t%ld\t0\n", k->id, k->id);
+		printf("L\t%ld\t0\t%.16" PRIx64 "\n", k->id, d->full_nia[tag]);
+		printf("S\t%ld\t0\t%s\n", k->id, kstage_names[stage]);
+	}
+
+	/* Anything older left in this stage never made it out */
+	while (i > 0 && kanata_find(stage, -1) < i) {
+		kanata_remove(kanata_find(stage, -1), 1);
+		--i;
+	}
+	return &kinsns[i];
+}
+
+static void kanata_cycle(const struct log_decoder *d, const struct log_entry *log)
+{
+	struct kinsn *k;
+	int i;
+
+	/* Instructions issued last cycle are now past decode2 */
+	for (i = 0; i < nkinsns; ++i) {
+		if (kinsns[i].issued) {
+			kinsns[i].issued = 0;
+			kanata_move(&kinsns[i], kinsns[i].is_ls ? KS_LS : KS_EX);
+		}
+	}
+
+	if (log->e1_valid && (i = kanata_find(KS_EX, -1)) >= 0)
+		kanata_remove(i, 0);
+	if (log->ls_lo_valid && (i = kanata_find(KS_LS, -1)) >= 0)
+		kanata_remove(i, 0);
+	if (log->e1_flush_out) {
+		for (i = 0; i < nkinsns; )
+			if (kinsns[i].stage < KS_EX)
+				kanata_remove(i, 1);
+			else
+				++i;
+		return;
+	}
+
+	/* Work back to front so nothing moves more than a stage a cycle */
+	if (log->d2_valid) {
+		k = kanata_stage(d, KS_DEC2, log->d2_part_nia);
+		k->issued = !log->e1_stall_out;
+	}
+	if (log->d1_valid) {
+		k = kanata_stage(d, KS_DEC1, log->d1_part_nia);
+		if (!k->labelled) {
+			k->labelled = 1;
+			k->is_ls = log->d1_unit == 1;
+			kanata_sync();
+			printf("L\t%ld\t0\t %s %s\n", k->id, units[log->d1_unit],
+			       ops[log->d1_insn_type]);
+		}
+	}
+	if (log->ic_valid)
+		kanata_stage(d, KS_IC, log->ic_part_nia);
+}
+
+static void kanata(struct log_input *in)
+{
+	struct log_entry log;
+	struct log_decoder d;
+
+	printf("Kanata\t0004\n");
+	printf("C=\t0\n");
+	log_decode_init(&d);
+	while (next_entry(in, &log)) {
+		log_decode_nia(&d, &log);
+		kanata_cycle(&d, &log);
+		++kcycle;
+	}
+}
+
+/*
+ * The cycle listing. A mapped log is cut into chunks which are decoded
+ * in parallel into memory buffers and written out in order. The only
+ * state carried from one entry to the next is the fetch NIA history
+ * behind the partial NIAs, so a first pass records the last fetch NIA
+ * for each history slot in every chunk, which gives the history at the
+ * start of each chunk.
+ */
+#define CHUNK_ENTRIES	16384
+#define OUT_BUF_SIZE	(1 << 20)
+
+struct chunk_slot {
+	char		*buf;
+	size_t		len;
+	long int	ncompl;
+	long int	idx;		/* chunk held, -1 when free */
+	int		done;
 };
-			     
-int main(int ac, char **av)
+
+struct chunk_nia {
+	u64		nia[16];
+	unsigned int	seen;
+};
+
+static struct {
+	struct log_input *in;
+	struct chunk_nia *chunks;
+	size_t		nchunks;
+	size_t		next;
+	int		nthreads;
+	struct chunk_slot *slots;
+	int		nslots;
+	pthread_mutex_t	lock;
+	pthread_cond_t	cond;
+} par = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+};
+
+static size_t chunk_count(size_t c)
+{
+	size_t n = par.in->count - c * CHUNK_ENTRIES;
+
+	return n < CHUNK_ENTRIES ? n : CHUNK_ENTRIES;
+}
+
+static void *scan_worker(void *arg)
 {
+	long int t = (long int)arg;
+	struct chunk_nia *cn;
 	struct log_entry log;
-	u64 full_nia[16];
-	long int lineno = 1;
-	FILE *f;
-	const char *filename;
-	int i;
-	long int ncompl = 0;
+	size_t c, i, n, idx;
+	u64 w[4];
+
+	for (c = t; c < par.nchunks; c += par.nthreads) {
+		cn = &par.chunks[c];
+		cn->seen = 0;
+		n = chunk_count(c);
+		for (i = n; i-- > 0 && cn->seen != 0xffff; ) {
+			log_load(w, par.in->map + (c * CHUNK_ENTRIES + i) * LOG_ENTRY_BYTES);
+			log_unpack(&log, w);
+			idx = log.nia_lo & 0xf;
+			if (cn->seen & (1u << idx))
+				continue;
+			cn->seen |= 1u << idx;
+			cn->nia[idx] = (log.nia_hi? 0xc000000000000000: 0) | (log.nia_lo << 2);
+		}
+	}
+	return NULL;
+}
+
+static void decode_chunk(size_t c, struct chunk_slot *slot)
+{
+	struct log_decoder d;
+	struct log_entry log;
+	size_t i, n = chunk_count(c);
+	const unsigned char *raw;
+	char *p = slot->buf;
+	u64 w[4];
 
-	if (ac != 1 && ac != 2) {
-		fprintf(stderr, "Usage: %s [filename]\n", av[0]);
+	log_decode_init(&d);
+	memcpy(d.full_nia, par.chunks[c].nia, sizeof(d.full_nia));
+	d.lineno = c * CHUNK_ENTRIES + 1;
+	raw = par.in->map + c * CHUNK_ENTRIES * LOG_ENTRY_BYTES;
+	for (i = 0; i < n; ++i) {
+		log_load(w, raw + i * LOG_ENTRY_BYTES);
+		log_unpack(&log, w);
+		p = log_format_entry(&d, &log, p);
+	}
+	slot->len = p - slot->buf;
+	slot->ncompl = d.ncompl;
+}
+
+static void *decode_worker(void *arg)
+{
+	struct chunk_slot *slot;
+	size_t c;
+
+	(void)arg;
+	pthread_mutex_lock(&par.lock);
+	while (par.next < par.nchunks) {
+		c = par.next++;
+		slot = &par.slots[c % par.nslots];
+		while (slot->idx != -1)
+			pthread_cond_wait(&par.cond, &par.lock);
+		slot->idx = c;
+		slot->done = 0;
+		pthread_mutex_unlock(&par.lock);
+
+		decode_chunk(c, slot);
+
+		pthread_mutex_lock(&par.lock);
+		slot->done = 1;
+		pthread_cond_broadcast(&par.cond);
+	}
+	pthread_mutex_unlock(&par.lock);
+	return NULL;
+}
+
+static void listing_parallel(struct log_input *in, int nthreads)
+{
+	pthread_t *threads;
+	struct log_decoder d;
+	struct chunk_slot *slot;
+	size_t c;
+	int i, j;
+
+	par.in = in;
+	par.nthreads = nthreads;
+	par.nchunks = (in->count + CHUNK_ENTRIES - 1) / CHUNK_ENTRIES;
+	par.nslots = 2 * nthreads;
+	par.chunks = calloc(par.nchunks, sizeof(*par.chunks));
+	par.slots = calloc(par.nslots, sizeof(*par.slots));
+	threads = calloc(nthreads, sizeof(*threads));
+	if (!par.chunks || !par.slots || !threads) {
+		fprintf(stderr, "Out of memory\n");
 		exit(1);
 	}
-	f = stdin;
-	if (ac == 2) {
-		filename = av[1];
-		f = fopen(filename, "rb");
-		if (f == NULL) {
-			perror(filename);
+	for (i = 0; i < par.nslots; ++i) {
+		par.slots[i].idx = -1;
+		par.slots[i].buf = malloc(LOG_FORMAT_MAX(CHUNK_ENTRIES));
+		if (!par.slots[i].buf) {
+			fprintf(stderr, "Out of memory\n");
 			exit(1);
 		}
 	}
 
-	for (i = 0; i < 15; ++i)
-		full_nia[i] = i << 2;
+	for (i = 0; i < nthreads; ++i)
+		pthread_create(&threads[i], NULL, scan_worker, (void *)(long int)i);
+	for (i = 0; i < nthreads; ++i)
+		pthread_join(threads[i], NULL);
+
+	/* Turn the last NIAs of each chunk into the history at its start */
+	log_decode_init(&d);
+	for (c = 0; c < par.nchunks; ++c) {
+		struct chunk_nia last = par.chunks[c];
+
+		memcpy(par.chunks[c].nia, d.full_nia, sizeof(d.full_nia));
+		for (j = 0; j < 16; ++j)
+			if (last.seen & (1u << j))
+				d.full_nia[j] = last.nia[j];
+	}
+
+	for (i = 0; i < nthreads; ++i)
+		pthread_create(&threads[i], NULL, decode_worker, NULL);
+	for (c = 0; c < par.nchunks; ++c) {
+		slot = &par.slots[c % par.nslots];
+		pthread_mutex_lock(&par.lock);
+		while (slot->idx != (long int)c || !slot->done)
+			pthread_cond_wait(&par.cond, &par.lock);
+		pthread_mutex_unlock(&par.lock);
 
-	while (fread(&log, sizeof(log), 1, f) == 1) {
-		full_nia[log.nia_lo & 0xf] = (log.nia_hi? 0xc000000000000000: 0) |
-			(log.nia_lo << 2);
-		if (lineno % 20 == 1) {
-			printf("        fetch1 NIA      icache                             decode1       decode2   execute1         loadstore  dcache       CR   GSPR\n");
-			printf("     ----------------   TAHW S -WB-- pN  ic --insn--    pN un op         pN byp    FR IIE MSR  WC   SD MM CE   SRTO DE -WB-- c ms reg val\n");
-			printf("                        LdMy t csnSa IA                 IA it            IA abc    le srx EPID em   tw rd mx   tAwp vr csnSa 0 k\n");
+		fwrite(slot->buf, 1, slot->len, stdout);
+		d.ncompl += slot->ncompl;
+
+		pthread_mutex_lock(&par.lock);
+		slot->idx = -1;
+		pthread_cond_broadcast(&par.cond);
+		pthread_mutex_unlock(&par.lock);
+	}
+	for (i = 0; i < nthreads; ++i)
+		pthread_join(threads[i], NULL);
+
+	d.lineno = in->count + 1;
+	log_decode_summary(&d, stdout);
+}
+
+static void listing(struct log_input *in, int nthreads)
+{
+	struct log_entry log;
+	struct log_decoder d;
+	char *buf, *p;
+
+	if (in->map && nthreads > 1 && in->count > CHUNK_ENTRIES) {
+		listing_parallel(in, nthreads);
+		return;
+	}
+
+	buf = malloc(OUT_BUF_SIZE);
+	if (!buf) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+	p = buf;
+	log_decode_init(&d);
+	while (next_entry(in, &log)) {
+		p = log_format_entry(&d, &log, p);
+		if (buf + OUT_BUF_SIZE - p < (long int)LOG_FORMAT_MAX(1)) {
+			fwrite(buf, 1, p - buf, stdout);
+			p = buf;
 		}
-		printf("%4ld %c0000%.11llx %c ", lineno,
-		       (log.nia_hi? 'c': '0'),
-		       (unsigned long long)log.nia_lo << 2,
-		       FLAG(ic_stall_out, '|'));
-		printf("%c%c%c%d %c %c%c%d%c%c %.2llx ",
-		       FLGA(ic_ra_valid, ' ', 'T'),
-		       FLGA(ic_access_ok, ' ', 'X'),
-		       FLGA(ic_is_hit, 'H', FLGA(ic_is_miss, 'M', ' ')),
-		       log.ic_way,
-		       FLAG(ic_state, 'W'),
-		       FLAG(ic_wb_cyc, 'c'),
-		       FLAG(ic_wb_stb, 's'),
-		       log.ic_wb_adr,
-		       FLAG(ic_wb_stall, 'S'),
-		       FLAG(ic_wb_ack, 'a'),
-		       PNIA(ic_part_nia));
-		if (log.ic_valid) {
-			if (log.ic_insn & (1ul << 35))
-				printf("ill %.8lx", log.ic_insn & 0xfffffffful);
-			else
-				printf("%3lu x%.7lx", (long)(log.ic_insn >> 26),
-				       (unsigned long)(log.ic_insn & 0x3ffffff));
-		} else if (log.ic_fetch_failed)
-			printf("    !!!!!!!!");
-		else
-			printf("--- --------");
-		printf(" %c%c %.2llx ",
-		       FLAG(ic_valid, '>'),
-		       FLAG(d2_stall_out, '|'),
-		       PNIA(d1_part_nia));
-		if (log.d1_valid)
-			printf("%s %s",
-			       units[log.d1_unit],
-			       ops[log.d1_insn_type]);
-		else
-			printf("-- -------");
-		printf(" %c%c ",
-		       FLAG(d1_valid, '>'),
-		       FLAG(d2_stall_out, '|'));
-		printf("%.2llx %c%c%c %c%c ",
-		       PNIA(d2_part_nia),
-		       FLAG(d2_bypass_a, 'a'),
-		       FLAG(d2_bypass_b, 'b'),
-		       FLAG(d2_bypass_c, 'c'),
-		       FLAG(d2_valid, '>'),
-		       FLAG(e1_stall_out, '|'));
-		printf("%c%c %c%c%c %c%c%c%c %c%c ",
-		       FLAG(e1_flush_out, 'F'),
-		       FLAG(e1_redirect, 'R'),
-		       FLAG(e1_irq_state, 'w'),
-		       FLAG(e1_irq, 'I'),
-		       FLAG(e1_exception, 'X'),
-		       FLAG(e1_msr_ee, 'E'),
-		       FLGA(e1_msr_pr, 'u', 's'),
-		       FLAG(e1_msr_ir, 'I'),
-		       FLAG(e1_msr_dr, 'D'),
-		       FLAG(e1_write_enable, 'W'),
-		       FLAG(e1_valid, 'C'));
-		printf("%c %d%d %c%c %c%c %c ",
-		       FLAG(ls_stall_out, '|'),
-		       log.ls_state,
-		       log.ls_dw_done,
-		       FLAG(ls_mo_valid, 'M'),
-		       FLAG(ls_min_done, 'm'),
-		       FLAG(ls_lo_valid, 'C'),
-		       FLAG(ls_eo_except, 'X'),
-		       FLAG(ls_do_valid, '>'));
-		printf("%d%c%d%d %c%c %c%c%d%c%c ",
-		       log.dc_state,
-		       FLAG(dc_ra_valid, 'R'),
-		       log.dc_tlb_way,
-		       log.dc_op,
-		       FLAG(dc_do_valid, 'V'),
-		       FLAG(dc_do_error, 'E'),
-		       FLAG(dc_wb_cyc, 'c'),
-		       FLAG(dc_wb_stb, 's'),
-		       log.dc_wb_adr,
-		       FLAG(dc_wb_stall, 'S'),
-		       FLAG(dc_wb_ack, 'a'));
-		if (log.cr_wr_enable)
-			printf("%x>%.2x ", log.cr_wr_data, log.cr_wr_mask);
+	}
+	fwrite(buf, 1, p - buf, stdout);
+	log_decode_summary(&d, stdout);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [-c] [-r start-end]... [-k] [-s elf [-l]] [-j threads] [filename]\n", prog);
+	fprintf(stderr, "  -c            print a CPI stack instead of the cycle listing\n");
+	fprintf(stderr, "  -r start-end  break the CPI stack down by hex NIA range (implies -c)\n");
+	fprintf(stderr, "  -k            write a Kanata pipeline trace for the Konata viewer\n");
+	fprintf(stderr, "  -s elf        profile cycles by function using the symbols in elf\n");
+	fprintf(stderr, "  -l            add a profile by source line (needs addr2line)\n");
+	fprintf(stderr, "  -j threads    listing decode threads (default: one per CPU)\n");
+	exit(1);
+}
+
+static void add_range(const char *arg, const char *prog)
+{
+	struct cpi_range *r;
+	char *end;
+
+	if (nranges >= MAX_RANGES) {
+		fprintf(stderr, "Too many ranges (max %d)\n", MAX_RANGES);
+		exit(1);
+	}
+	r = &ranges[nranges];
+	r->start = strtoull(arg, &end, 16);
+	if (end == arg || *end != '-')
+		usage(prog);
+	arg = end + 1;
+	r->end = strtoull(arg, &end, 16);
+	if (end == arg || *end || r->end < r->start)
+		usage(prog);
+	++nranges;
+}
+
+static void print_stack(const long int *cycles, long int total)
+{
+	long int ninsn = cycles[CAUSE_BASE];
+	int i;
+
+	printf("CPI stack: %ld cycles, %ld instructions, %.2f CPI\n\n",
+	       total, ninsn, ninsn ? (double)total / ninsn : 0.0);
+	printf("  %-8s %7s  %6s  %6s\n", "", "cycles", "CPI", "%");
+	for (i = 0; i < NR_CAUSES; ++i)
+		printf("  %-8s %7ld  %6.2f  %5.1f%%\n", log_cause_name(i), cycles[i],
+		       ninsn ? (double)cycles[i] / ninsn : 0.0,
+		       total ? 100.0 * cycles[i] / total : 0.0);
+}
+
+static void print_range(const struct cpi_range *r, const char *name)
+{
+	long int total = 0, ninsn = r->cycles[CAUSE_BASE];
+	int i;
+
+	for (i = 0; i < NR_CAUSES; ++i)
+		total += r->cycles[i];
+	if (name)
+		printf("%-33s", name);
+	else
+		printf("%.16" PRIx64 "-%.16" PRIx64, r->start, r->end);
+	printf(" %8ld %8ld", total, ninsn);
+	if (!ninsn) {
+		printf("       -\n");
+		return;
+	}
+	printf("  %6.2f", (double)total / ninsn);
+	for (i = 0; i < NR_CAUSES; ++i)
+		printf(" %7.2f", (double)r->cycles[i] / ninsn);
+	printf("\n");
+}
+
+static void cpi_stack(struct log_input *in)
+{
+	struct log_entry log;
+	struct log_decoder d;
+	enum log_cause cause;
+	long int cycles[NR_CAUSES] = { 0 }, total = 0;
+	int i;
+
+	log_decode_init(&d);
+	while (next_entry(in, &log)) {
+		log_decode_nia(&d, &log);
+		cause = log_decode_cause(&d, &log);
+		++cycles[cause];
+		++total;
+		/* Ranges may overlap, the first match wins */
+		for (i = 0; i < nranges; ++i)
+			if (d.e1_nia >= ranges[i].start && d.e1_nia <= ranges[i].end)
+				break;
+		++ranges[i].cycles[cause];
+	}
+
+	print_stack(cycles, total);
+	if (!nranges)
+		return;
+
+	printf("\n%-33s %8s %8s  %6s", "range", "cycles", "insns", "CPI");
+	for (i = 0; i < NR_CAUSES; ++i)
+		printf(" %7s", log_cause_name(i));
+	printf("\n");
+	for (i = 0; i < nranges; ++i)
+		print_range(&ranges[i], NULL);
+	print_range(&ranges[nranges], "(other)");
+}
+
+/*
+ * Symbol profile. Each cycle is charged to an instruction address as
+ * for the CPI stack, icache misses to the fetch address that missed
+ * and dcache stall cycles to the last instruction issued. Counts are
+ * kept per address and folded into the functions of an ELF symbol
+ * table, and optionally into source lines using addr2line.
+ */
+struct prof_count {
+	u64	nia;
+	int	valid;
+	long int cycles;
+	long int insns;
+	long int icmiss;
+	long int dcstall;
+};
+
+static struct prof_count *prof_table;
+static size_t prof_size, prof_used;
+
+static size_t prof_hash(u64 nia)
+{
+	return ((nia >> 2) * 0x9e3779b97f4a7c15ull) >> 20;
+}
+
+static struct prof_count *prof_slot(struct prof_count *table, size_t size, u64 nia)
+{
+	size_t i = prof_hash(nia) & (size - 1);
+
+	while (table[i].valid && table[i].nia != nia)
+		i = (i + 1) & (size - 1);
+	return &table[i];
+}
+
+static struct prof_count *prof_entry(u64 nia)
+{
+	struct prof_count *p, *old = prof_table;
+	size_t i, old_size = prof_size;
+
+	if (2 * (prof_used + 1) > prof_size) {
+		prof_size = prof_size ? 2 * prof_size : 4096;
+		prof_table = calloc(prof_size, sizeof(*prof_table));
+		if (!prof_table) {
+			perror("calloc");
+			exit(1);
+		}
+		for (i = 0; i < old_size; ++i)
+			if (old[i].valid)
+				*prof_slot(prof_table, prof_size, old[i].nia) = old[i];
+		free(old);
+	}
+	p = prof_slot(prof_table, prof_size, nia);
+	if (!p->valid) {
+		p->valid = 1;
+		p->nia = nia;
+		++prof_used;
+	}
+	return p;
+}
+
+static void prof_add(struct prof_count *to, const struct prof_count *from)
+{
+	to->cycles += from->cycles;
+	to->insns += from->insns;
+	to->icmiss += from->icmiss;
+	to->dcstall += from->dcstall;
+}
+
+struct symbol {
+	u64	start;
+	u64	end;
+	const char *name;
+	int	func;
+	struct prof_count count;
+};
+
+static struct symbol *syms;
+static size_t nsyms;
+
+static const unsigned char *elf;
+static size_t elf_size;
+static int elf_be;
+static const char *elf_name;
+
+static u64 elf_get(u64 off, int len)
+{
+	u64 v = 0;
+	int i;
+
+	if (off > elf_size || len > elf_size - off) {
+		fprintf(stderr, "%s: truncated ELF file\n", elf_name);
+		exit(1);
+	}
+	for (i = 0; i < len; ++i)
+		v |= (u64)elf[off + i] << 8 * (elf_be ? len - 1 - i : i);
+	return v;
+}
+
+/* Read a field of an ELF structure at offset base, in the file's byte order */
+#define ELF_GET(base, type, field) \
+	elf_get((base) + offsetof(type, field), sizeof(((type *)0)->field))
+
+static int sym_compare(const void *a, const void *b)
+{
+	const struct symbol *x = a, *y = b;
+
+	if (x->start != y->start)
+		return x->start < y->start ? -1 : 1;
+	/* Prefer sized functions over labels at the same address */
+	if (x->func != y->func)
+		return y->func - x->func;
+	return (x->end > y->end) - (x->end < y->end);
+}
+
+/*
+ * Collect the code symbols: functions, and untyped labels in
+ * executable sections, which is what assembly entry points get.
+ * Zero-sized symbols extend to the next one.
+ */
+static void load_symbols(const char *filename)
+{
+	u64 shoff, shentsize, sec, symtab = 0, strtab, strsize;
+	u64 i, n, shnum, off, value, size, shndx, flags, limit;
+	unsigned int type;
+	const char *name;
+	struct stat st;
+	void *map;
+	size_t j, k;
+	int fd;
+
+	elf_name = filename;
+	fd = open(filename, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st) < 0) {
+		perror(filename);
+		exit(1);
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED) {
+		perror(filename);
+		exit(1);
+	}
+	close(fd);
+	elf = map;
+	elf_size = st.st_size;
+	if (elf_size < sizeof(Elf64_Ehdr) || memcmp(elf, ELFMAG, SELFMAG) ||
+	    elf[EI_CLASS] != ELFCLASS64) {
+		fprintf(stderr, "%s: not a 64-bit ELF file\n", filename);
+		exit(1);
+	}
+	elf_be = elf[EI_DATA] == ELFDATA2MSB;
+
+	shoff = ELF_GET(0, Elf64_Ehdr, e_shoff);
+	shnum = ELF_GET(0, Elf64_Ehdr, e_shnum);
+	shentsize = ELF_GET(0, Elf64_Ehdr, e_shentsize);
+	for (i = 0; i < shnum; ++i) {
+		sec = shoff + i * shentsize;
+		type = ELF_GET(sec, Elf64_Shdr, sh_type);
+		if (type == SHT_SYMTAB || (type == SHT_DYNSYM && !symtab))
+			symtab = sec;
+	}
+	if (!symtab) {
+		fprintf(stderr, "%s: no symbol table\n", filename);
+		exit(1);
+	}
+	sec = shoff + ELF_GET(symtab, Elf64_Shdr, sh_link) * shentsize;
+	strtab = ELF_GET(sec, Elf64_Shdr, sh_offset);
+	strsize = ELF_GET(sec, Elf64_Shdr, sh_size);
+	if (strtab > elf_size || strsize > elf_size - strtab || !strsize ||
+	    elf[strtab + strsize - 1]) {
+		fprintf(stderr, "%s: bad string table\n", filename);
+		exit(1);
+	}
+
+	n = ELF_GET(symtab, Elf64_Shdr, sh_size) / sizeof(Elf64_Sym);
+	off = ELF_GET(symtab, Elf64_Shdr, sh_offset);
+	syms = calloc(n + 1, sizeof(*syms));
+	if (!syms) {
+		perror("calloc");
+		exit(1);
+	}
+	for (i = 0; i < n; ++i, off += sizeof(Elf64_Sym)) {
+		type = ELF64_ST_TYPE(ELF_GET(off, Elf64_Sym, st_info));
+		shndx = ELF_GET(off, Elf64_Sym, st_shndx);
+		if ((type != STT_FUNC && type != STT_NOTYPE) ||
+		    shndx == SHN_UNDEF || shndx >= shnum)
+			continue;
+		sec = shoff + shndx * shentsize;
+		flags = ELF_GET(sec, Elf64_Shdr, sh_flags);
+		if (!(flags & SHF_EXECINSTR))
+			continue;
+		if (ELF_GET(off, Elf64_Sym, st_name) >= strsize)
+			continue;
+		name = (const char *)elf + strtab + ELF_GET(off, Elf64_Sym, st_name);
+		if (!*name || name[0] == '$' || !strncmp(name, ".L", 2))
+			continue;
+		value = ELF_GET(off, Elf64_Sym, st_value);
+		size = ELF_GET(off, Elf64_Sym, st_size);
+		limit = ELF_GET(sec, Elf64_Shdr, sh_addr) + ELF_GET(sec, Elf64_Shdr, sh_size);
+		syms[nsyms].start = value;
+		/* Zero-sized symbols are bounded by their section for now */
+		syms[nsyms].end = size ? value + size : limit;
+		syms[nsyms].func = size != 0;
+		syms[nsyms].name = name;
+		++nsyms;
+	}
+	qsort(syms, nsyms, sizeof(*syms), sym_compare);
+
+	/* Drop aliases and labels inside sized functions, clip the rest */
+	for (j = k = 0; j < nsyms; ++j) {
+		if (k && syms[j].start < syms[k - 1].end &&
+		    (syms[j].start == syms[k - 1].start || syms[k - 1].func))
+			continue;
+		syms[k++] = syms[j];
+	}
+	nsyms = k;
+	for (j = 0; j + 1 < nsyms; ++j)
+		if (!syms[j].func && syms[j].end > syms[j + 1].start)
+			syms[j].end = syms[j + 1].start;
+	syms[nsyms].name = "(unknown)";
+}
+
+/* Index of the symbol containing nia, or nsyms for none */
+static size_t find_symbol(u64 nia)
+{
+	size_t lo = 0, hi = nsyms, mid;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (syms[mid].start <= nia)
+			lo = mid + 1;
 		else
-			printf("     ");
-		if (log.reg_wr_enable) {
-			if (log.reg_wr_reg < 32 || log.reg_wr_reg > 44)
-				printf("r%02d", log.reg_wr_reg);
-			else
-				printf("%s", spr_names[log.reg_wr_reg - 32]);
-			printf("=%.16llx", log.reg_wr_data);
+			hi = mid;
+	}
+	if (lo && nia < syms[lo - 1].end)
+		return lo - 1;
+	return nsyms;
+}
+
+static int count_compare(const void *a, const void *b)
+{
+	const struct prof_count *x = *(struct prof_count * const *)a;
+	const struct prof_count *y = *(struct prof_count * const *)b;
+
+	if (x->cycles != y->cycles)
+		return x->cycles < y->cycles ? 1 : -1;
+	return (x->nia > y->nia) - (x->nia < y->nia);
+}
+
+static void print_count_header(const char *what)
+{
+	printf("\n%10s %6s %10s %6s %8s %8s  %s\n",
+	       "cycles", "%", "insns", "CPI", "icmiss", "dcstall", what);
+}
+
+static void print_count(const struct prof_count *c, long int total, const char *name)
+{
+	printf("%10ld %5.1f%% %10ld", c->cycles,
+	       total ? 100.0 * c->cycles / total : 0.0, c->insns);
+	if (c->insns)
+		printf(" %6.2f", (double)c->cycles / c->insns);
+	else
+		printf(" %6s", "-");
+	printf(" %8ld %8ld  %s\n", c->icmiss, c->dcstall, name);
+}
+
+/*
+ * Run addr2line over the addresses in the profile, with the cross
+ * version named by $ADDR2LINE if the host one can't read the ELF.
+ */
+static FILE *run_addr2line(FILE *addrs)
+{
+	const char *prog = getenv("ADDR2LINE");
+	int fds[2];
+	pid_t pid;
+
+	if (!prog)
+		prog = "addr2line";
+	if (pipe(fds) < 0) {
+		perror("pipe");
+		exit(1);
+	}
+	pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		exit(1);
+	}
+	if (pid == 0) {
+		dup2(fileno(addrs), 0);
+		dup2(fds[1], 1);
+		close(fds[0]);
+		close(fds[1]);
+		execlp(prog, prog, "-e", elf_name, (char *)NULL);
+		perror(prog);
+		_exit(1);
+	}
+	close(fds[1]);
+	return fdopen(fds[0], "r");
+}
+
+struct line_count {
+	char	*line;
+	struct prof_count count;
+};
+
+static int line_compare(const void *a, const void *b)
+{
+	return strcmp(((const struct line_count *)a)->line,
+		      ((const struct line_count *)b)->line);
+}
+
+static void print_lines(long int total)
+{
+	struct line_count *lines;
+	struct prof_count **order;
+	char buf[4096], *p;
+	size_t i, j, n = 0;
+	FILE *addrs, *f;
+	int status;
+
+	addrs = tmpfile();
+	lines = calloc(prof_used + 1, sizeof(*lines));
+	order = calloc(prof_used + 1, sizeof(*order));
+	if (!addrs || !lines || !order) {
+		perror("source lines");
+		exit(1);
+	}
+	for (i = 0; i < prof_size; ++i)
+		if (prof_table[i].valid) {
+			fprintf(addrs, "%" PRIx64 "\n", prof_table[i].nia);
+			lines[n++].count = prof_table[i];
 		}
-		printf("\n");
-		++lineno;
-		if (log.ls_lo_valid || log.e1_valid)
-			++ncompl;
+	fflush(addrs);
+	rewind(addrs);
+	f = run_addr2line(addrs);
+	for (i = 0; i < n; ++i) {
+		if (!f || !fgets(buf, sizeof(buf), f))
+			break;
+		buf[strcspn(buf, "\n")] = 0;
+		p = strstr(buf, " (discriminator");
+		if (p)
+			*p = 0;
+		lines[i].line = strdup(buf);
 	}
-	printf("%ld instructions completed, %.2f CPI\n", ncompl,
-	       (double)(lineno - 1) / ncompl);
+	if (f)
+		fclose(f);
+	fclose(addrs);
+	wait(&status);
+	if (i < n || !WIFEXITED(status) || WEXITSTATUS(status)) {
+		fprintf(stderr, "addr2line failed, no source lines\n");
+		return;
+	}
+
+	qsort(lines, n, sizeof(*lines), line_compare);
+	for (i = j = 0; i < n; ++i) {
+		if (j && !strcmp(lines[i].line, lines[j - 1].line)) {
+			prof_add(&lines[j - 1].count, &lines[i].count);
+			continue;
+		}
+		lines[j++] = lines[i];
+	}
+	n = j;
+	for (i = 0; i < n; ++i) {
+		lines[i].count.nia = i;
+		order[i] = &lines[i].count;
+	}
+	qsort(order, n, sizeof(*order), count_compare);
+	print_count_header("source line");
+	for (i = 0; i < n; ++i)
+		print_count(order[i], total, lines[order[i]->nia].line);
+}
+
+static void profile(struct log_input *in, int source_lines)
+{
+	struct log_entry log;
+	struct log_decoder d;
+	struct prof_count *p, **order;
+	enum log_cause cause;
+	long int total = 0, ninsn = 0;
+	size_t i, n = 0;
+
+	log_decode_init(&d);
+	while (next_entry(in, &log)) {
+		log_decode_nia(&d, &log);
+		cause = log_decode_cause(&d, &log);
+		p = prof_entry(d.e1_nia);
+		++p->cycles;
+		++total;
+		if (cause == CAUSE_BASE) {
+			++p->insns;
+			++ninsn;
+		}
+		if (log.ls_stall_out || log.dc_stall_out)
+			++p->dcstall;
+		/* A miss starts when the icache sees it while idle */
+		if (log.ic_is_miss && !log.ic_state)
+			++prof_entry(d.full_nia[log.nia_lo & 0xf])->icmiss;
+	}
+
+	for (i = 0; i < prof_size; ++i)
+		if (prof_table[i].valid)
+			prof_add(&syms[find_symbol(prof_table[i].nia)].count, &prof_table[i]);
+	order = calloc(nsyms + 1, sizeof(*order));
+	if (!order) {
+		perror("calloc");
+		exit(1);
+	}
+	for (i = 0; i <= nsyms; ++i) {
+		p = &syms[i].count;
+		if (p->cycles || p->icmiss) {
+			p->nia = i;
+			order[n++] = p;
+		}
+	}
+	qsort(order, n, sizeof(*order), count_compare);
+
+	printf("Profile: %ld cycles, %ld instructions, %.2f CPI\n",
+	       total, ninsn, ninsn ? (double)total / ninsn : 0.0);
+	print_count_header("function");
+	for (i = 0; i < n; ++i)
+		print_count(order[i], total, syms[order[i]->nia].name);
+	if (source_lines)
+		print_lines(total);
+}
+
+int main(int ac, char **av)
+{
+	struct log_input in;
+	const char *symfile = NULL;
+	int opt, stack = 0, pipe = 0, source_lines = 0, nthreads;
+
+	nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	while ((opt = getopt(ac, av, "cr:ks:lj:")) != -1) {
+		switch (opt) {
+		case 'c':
+			stack = 1;
+			break;
+		case 'k':
+			pipe = 1;
+			break;
+		case 'r':
+			add_range(optarg, av[0]);
+			stack = 1;
+			break;
+		case 's':
+			symfile = optarg;
+			break;
+		case 'l':
+			source_lines = 1;
+			break;
+		case 'j':
+			nthreads = atoi(optarg);
+			if (nthreads < 1)
+				usage(av[0]);
+			break;
+		default:
+			usage(av[0]);
+		}
+	}
+	if (ac - optind > 1 || stack + pipe + !!symfile > 1 ||
+	    (source_lines && !symfile))
+		usage(av[0]);
+	if (symfile)
+		load_symbols(symfile);
+	open_input(&in, optind < ac ? av[optind] : NULL);
+
+	if (symfile)
+		profile(&in, source_lines);
+	else if (stack)
+		cpi_stack(&in);
+	else if (pipe)
+		kanata(&in);
+	else
+		listing(&in, nthreads < 1 ? 1 : nthreads);
 	exit(0);
 }
@@ -0,0 +1,505 @@
+/*
+ * Core log entry decoding, shared by fmt_log and mw_debug.
+ *
+ * Each entry is 256 bits, read out of the core as four 64-bit words.
+ */
+#ifndef LOG_DECODE_H
+#define LOG_DECODE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+typedef uint64_t u64;
+
+/*
+ * A log entry unpacked into one member per field. The raw entry is
+ * four little-endian 64-bit words, fields packed from the LS bit of
+ * each word up in the order below (see core_debug.vhdl and the log
+ * outputs of each unit). Unpacking uses explicit shifts and masks so
+ * it doesn't depend on how a compiler lays out bitfields.
+ */
+struct log_entry {
+	u64		nia_lo;
+	unsigned int	nia_hi;
+	unsigned int	ic_ra_valid;
+	unsigned int	ic_access_ok;
+	unsigned int	ic_is_miss;
+	unsigned int	ic_is_hit;
+	unsigned int	ic_way;
+	unsigned int	ic_state;
+	unsigned int	ic_part_nia;
+	unsigned int	ic_fetch_failed;
+	unsigned int	ic_stall_out;
+	unsigned int	ic_wb_stall;
+	unsigned int	ic_wb_cyc;
+	unsigned int	ic_wb_stb;
+	unsigned int	ic_wb_adr;
+	unsigned int	ic_wb_ack;
+
+	u64		ic_insn;
+	unsigned int	ic_valid;
+	unsigned int	d1_valid;
+	unsigned int	d1_unit;
+	unsigned int	d1_part_nia;
+	unsigned int	d1_insn_type;
+	unsigned int	d2_bypass_a;
+	unsigned int	d2_bypass_b;
+	unsigned int	d2_bypass_c;
+	unsigned int	d2_stall_out;
+	unsigned int	d2_stopped_out;
+	unsigned int	d2_valid;
+	unsigned int	d2_part_nia;
+	unsigned int	e1_flush_out;
+	unsigned int	e1_stall_out;
+	unsigned int	e1_redirect;
+	unsigned int	e1_valid;
+
+	unsigned int	e1_write_enable;
+	unsigned int	e1_irq_state;
+	unsigned int	e1_irq;
+	unsigned int	e1_exception;
+	unsigned int	e1_msr_dr;
+	unsigned int	e1_msr_ir;
+	unsigned int	e1_msr_pr;
+	unsigned int	e1_msr_ee;
+	unsigned int	ls_state;
+	unsigned int	ls_dw_done;
+	unsigned int	ls_min_done;
+	unsigned int	ls_do_valid;
+	unsigned int	ls_mo_valid;
+	unsigned int	ls_lo_valid;
+	unsigned int	ls_eo_except;
+	unsigned int	ls_stall_out;
+	unsigned int	dc_state;
+	unsigned int	dc_ra_valid;
+	unsigned int	dc_tlb_way;
+	unsigned int	dc_stall_out;
+	unsigned int	dc_op;
+	unsigned int	dc_do_valid;
+	unsigned int	dc_do_error;
+	unsigned int	dc_wb_cyc;
+	unsigned int	dc_wb_stb;
+	unsigned int	dc_wb_ack;
+	unsigned int	dc_wb_stall;
+	unsigned int	dc_wb_adr;
+	unsigned int	cr_wr_mask;
+	unsigned int	cr_wr_data;
+	unsigned int	cr_wr_enable;
+	unsigned int	reg_wr_reg;
+	unsigned int	reg_wr_enable;
+
+	u64		reg_wr_data;
+};
+
+#define LOG_ENTRY_BYTES	32
+
+#define LOG_BITS(w, s, n)	(((w) >> (s)) & ((1ull << (n)) - 1))
+
+static inline void log_unpack(struct log_entry *e, const u64 w[4])
+{
+	e->nia_lo = LOG_BITS(w[0], 0, 42);
+	e->nia_hi = LOG_BITS(w[0], 42, 1);
+	e->ic_ra_valid = LOG_BITS(w[0], 43, 1);
+	e->ic_access_ok = LOG_BITS(w[0], 44, 1);
+	e->ic_is_miss = LOG_BITS(w[0], 45, 1);
+	e->ic_is_hit = LOG_BITS(w[0], 46, 1);
+	e->ic_way = LOG_BITS(w[0], 47, 3);
+	e->ic_state = LOG_BITS(w[0], 50, 1);
+	e->ic_part_nia = LOG_BITS(w[0], 51, 4);
+	e->ic_fetch_failed = LOG_BITS(w[0], 55, 1);
+	e->ic_stall_out = LOG_BITS(w[0], 56, 1);
+	e->ic_wb_stall = LOG_BITS(w[0], 57, 1);
+	e->ic_wb_cyc = LOG_BITS(w[0], 58, 1);
+	e->ic_wb_stb = LOG_BITS(w[0], 59, 1);
+	e->ic_wb_adr = LOG_BITS(w[0], 60, 3);
+	e->ic_wb_ack = LOG_BITS(w[0], 63, 1);
+
+	e->ic_insn = LOG_BITS(w[1], 0, 36);
+	e->ic_valid = LOG_BITS(w[1], 36, 1);
+	e->d1_valid = LOG_BITS(w[1], 37, 1);
+	e->d1_unit = LOG_BITS(w[1], 38, 2);
+	e->d1_part_nia = LOG_BITS(w[1], 40, 4);
+	e->d1_insn_type = LOG_BITS(w[1], 44, 6);
+	e->d2_bypass_a = LOG_BITS(w[1], 50, 1);
+	e->d2_bypass_b = LOG_BITS(w[1], 51, 1);
+	e->d2_bypass_c = LOG_BITS(w[1], 52, 1);
+	e->d2_stall_out = LOG_BITS(w[1], 53, 1);
+	e->d2_stopped_out = LOG_BITS(w[1], 54, 1);
+	e->d2_valid = LOG_BITS(w[1], 55, 1);
+	e->d2_part_nia = LOG_BITS(w[1], 56, 4);
+	e->e1_flush_out = LOG_BITS(w[1], 60, 1);
+	e->e1_stall_out = LOG_BITS(w[1], 61, 1);
+	e->e1_redirect = LOG_BITS(w[1], 62, 1);
+	e->e1_valid = LOG_BITS(w[1], 63, 1);
+
+	e->e1_write_enable = LOG_BITS(w[2], 0, 1);
+	e->e1_irq_state = LOG_BITS(w[2], 1, 1);
+	e->e1_irq = LOG_BITS(w[2], 2, 1);
+	e->e1_exception = LOG_BITS(w[2], 3, 1);
+	e->e1_msr_dr = LOG_BITS(w[2], 4, 1);
+	e->e1_msr_ir = LOG_BITS(w[2], 5, 1);
+	e->e1_msr_pr = LOG_BITS(w[2], 6, 1);
+	e->e1_msr_ee = LOG_BITS(w[2], 7, 1);
+	e->ls_state = LOG_BITS(w[2], 12, 3);
+	e->ls_dw_done = LOG_BITS(w[2], 15, 1);
+	e->ls_min_done = LOG_BITS(w[2], 16, 1);
+	e->ls_do_valid = LOG_BITS(w[2], 17, 1);
+	e->ls_mo_valid = LOG_BITS(w[2], 18, 1);
+	e->ls_lo_valid = LOG_BITS(w[2], 19, 1);
+	e->ls_eo_except = LOG_BITS(w[2], 20, 1);
+	e->ls_stall_out = LOG_BITS(w[2], 21, 1);
+	e->dc_state = LOG_BITS(w[2], 23, 3);
+	e->dc_ra_valid = LOG_BITS(w[2], 26, 1);
+	e->dc_tlb_way = LOG_BITS(w[2], 27, 3);
+	e->dc_stall_out = LOG_BITS(w[2], 30, 1);
+	e->dc_op = LOG_BITS(w[2], 31, 3);
+	e->dc_do_valid = LOG_BITS(w[2], 34, 1);
+	e->dc_do_error = LOG_BITS(w[2], 35, 1);
+	e->dc_wb_cyc = LOG_BITS(w[2], 36, 1);
+	e->dc_wb_stb = LOG_BITS(w[2], 37, 1);
+	e->dc_wb_ack = LOG_BITS(w[2], 38, 1);
+	e->dc_wb_stall = LOG_BITS(w[2], 39, 1);
+	e->dc_wb_adr = LOG_BITS(w[2], 40, 3);
+	e->cr_wr_mask = LOG_BITS(w[2], 43, 8);
+	e->cr_wr_data = LOG_BITS(w[2], 51, 4);
+	e->cr_wr_enable = LOG_BITS(w[2], 55, 1);
+	e->reg_wr_reg = LOG_BITS(w[2], 56, 7);
+	e->reg_wr_enable = LOG_BITS(w[2], 63, 1);
+
+	e->reg_wr_data = w[3];
+}
+
+/* Load a raw entry as stored in a log file */
+static inline void log_load(u64 w[4], const unsigned char *p)
+{
+	int i, j;
+
+	for (i = 0; i < 4; ++i) {
+		w[i] = 0;
+		for (j = 7; j >= 0; --j)
+			w[i] = (w[i] << 8) | p[i * 8 + j];
+	}
+}
+
+#define FLAG(i, y)	(log->i? y: ' ')
+#define FLGA(i, y, z)	(log->i? y: z)
+#define PNIA(f)		(d->full_nia[log->f] & 0xff)
+
+static const char *units[4] = { "al", "ls", "fp", "3?" };
+static const char *ops[64] =
+{
+	"illegal", "nop    ", "add    ", "attn   ", "b      ", "bc     ", "bcreg  ", "bperm  ",
+	"bsort  ", "cmp    ", "compute", "countb ", "darn   ", "dcbf   ", "dcbst  ", "dcbz   ",
+	"icbi   ", "icbt   ", "fpcmp  ", "fparith", "fpmove ", "fpmisc ", "div    ", "dive   ",
+	"mod    ", "isync  ", "ld     ", "st     ", "mcrxrx ", "mfmsr  ", "mfspr  ", "msg    ",
+	"mtcrf  ", "mtmsr  ", "mtspr  ", "mull64 ", "mulh64 ", "mulh32 ", "rfid   ", "sc     ",
+	"sync   ", "tlbie  ", "trap   ", "wait   ", "ffail  ", "?45    ", "?46    ", "?47    ",
+	"?48    ", "?49    ", "?50    ", "?51    ", "?52    ", "?53    ", "?54    ", "?55    ",
+	"?56    ", "?57    ", "?58    ", "?59    ", "?60    ", "?61    ", "?62    ", "?63    "
+};
+
+static const char *spr_names[13] =
+{
+	"lr ", "ctr", "sr0", "sr1", "hr0", "hr1", "sg0", "sg1",
+	"sg2", "sg3", "hg0", "hg1", "xer"
+};
+
+struct log_decoder {
+	u64	full_nia[16];
+	long int lineno;
+	long int ncompl;
+	u64	e1_nia;		/* last instruction issued to execute1 */
+	int	refill;		/* pipeline refilling after a redirect */
+};
+
+/*
+ * Root cause of a cycle, for CPI stacks. Cycles completing an
+ * instruction are "base", others are charged to the oldest stage
+ * holding things up, or to the last redirect while the pipeline
+ * refills behind it.
+ */
+enum log_cause {
+	CAUSE_BASE,
+	CAUSE_ICACHE,
+	CAUSE_DECODE,
+	CAUSE_EXECUTE,
+	CAUSE_LOADSTORE,
+	CAUSE_FLUSH,
+	CAUSE_OTHER,
+	NR_CAUSES
+};
+
+static inline const char *log_cause_name(enum log_cause cause)
+{
+	static const char *names[NR_CAUSES] =
+	{
+		"base", "icache", "decode", "execute", "ldst", "flush", "other"
+	};
+
+	return names[cause];
+}
+
+static void log_decode_init(struct log_decoder *d)
+{
+	int i;
+
+	for (i = 0; i < 16; ++i)
+		d->full_nia[i] = i << 2;
+	d->lineno = 1;
+	d->ncompl = 0;
+	d->e1_nia = 0;
+	d->refill = 0;
+}
+
+/* Track the fetch NIAs that the partial NIAs of later stages refer to */
+static void log_decode_nia(struct log_decoder *d, const struct log_entry *log)
+{
+	d->full_nia[log->nia_lo & 0xf] = (log->nia_hi? 0xc000000000000000: 0) |
+		(log->nia_lo << 2);
+}
+
+/*
+ * Classify one cycle, after log_decode_nia(). Also updates d->e1_nia,
+ * the (approximate) address of the instruction the cycle is charged to.
+ */
+static inline enum log_cause log_decode_cause(struct log_decoder *d, const struct log_entry *log)
+{
+	enum log_cause cause;
+
+	if (log->ls_lo_valid || log->e1_valid)
+		cause = CAUSE_BASE;
+	else if (log->ls_stall_out || log->dc_stall_out)
+		cause = CAUSE_LOADSTORE;
+	else if (log->e1_stall_out)
+		cause = CAUSE_EXECUTE;
+	else if (log->d2_stall_out)
+		cause = CAUSE_DECODE;
+	else if (log->e1_redirect || log->e1_flush_out)
+		cause = CAUSE_FLUSH;
+	else if (log->ic_stall_out || log->ic_is_miss || log->ic_state)
+		cause = CAUSE_ICACHE;
+	else if (d->refill)
+		cause = CAUSE_FLUSH;
+	else
+		cause = CAUSE_OTHER;
+
+	if (log->e1_redirect || log->e1_flush_out)
+		d->refill = 1;
+	else if (log->d2_valid || cause == CAUSE_BASE)
+		d->refill = 0;
+	if (log->d2_valid && !log->e1_stall_out)
+		d->e1_nia = d->full_nia[log->d2_part_nia];
+	return cause;
+}
+
+/*
+ * The listing is formatted by hand rather than with printf, which
+ * dominated decode time on long logs. The output is unchanged.
+ */
+#define LOG_LINE_MAX	256
+
+static const char log_header[] =
+	"        fetch1 NIA      icache                             decode1       decode2   execute1         loadstore  dcache       CR   GSPR\n"
+	"     ----------------   TAHW S -WB-- pN  ic --insn--    pN un op         pN byp    FR IIE MSR  WC   SD MM CE   SRTO DE -WB-- c ms reg val\n"
+	"                        LdMy t csnSa IA                 IA it            IA abc    le srx EPID em   tw rd mx   tAwp vr csnSa 0 k\n";
+
+/* Room needed to format count entries */
+#define LOG_FORMAT_MAX(count)	((count) * LOG_LINE_MAX + \
+				 ((count) / 20 + 1) * (sizeof(log_header) - 1))
+
+/* Exactly n hex digits */
+static inline char *put_hex(char *p, u64 v, int n)
+{
+	static const char hex[] = "0123456789abcdef";
+	int i;
+
+	for (i = n - 1; i >= 0; --i) {
+		p[i] = hex[v & 0xf];
+		v >>= 4;
+	}
+	return p + n;
+}
+
+/* At least n decimal digits, zero or space padded */
+static inline char *put_dec(char *p, u64 v, int n, char pad)
+{
+	char tmp[20];
+	int i = 0;
+
+	do {
+		tmp[i++] = '0' + v % 10;
+		v /= 10;
+	} while (v);
+	while (n-- > i)
+		*p++ = pad;
+	while (i)
+		*p++ = tmp[--i];
+	return p;
+}
+
+static inline char *put_str(char *p, const char *str)
+{
+	while (*str)
+		*p++ = *str++;
+	return p;
+}
+
+#define PUTC(c)		(*p++ = (c))
+
+/*
+ * Format one entry as a line of the cycle-by-cycle listing (preceded
+ * by the column headings every 20 lines). Returns the end of the text.
+ */
+static char *log_format_entry(struct log_decoder *d, const struct log_entry *log, char *p)
+{
+	log_decode_nia(d, log);
+	if (d->lineno % 20 == 1)
+		p = put_str(p, log_header);
+	p = put_dec(p, d->lineno, 4, ' ');
+	PUTC(' ');
+	PUTC(log->nia_hi? 'c': '0');
+	p = put_str(p, "0000");
+	p = put_hex(p, log->nia_lo << 2, 11);
+	PUTC(' ');
+	PUTC(FLAG(ic_stall_out, '|'));
+	PUTC(' ');
+
+	PUTC(FLGA(ic_ra_valid, ' ', 'T'));
+	PUTC(FLGA(ic_access_ok, ' ', 'X'));
+	PUTC(FLGA(ic_is_hit, 'H', FLGA(ic_is_miss, 'M', ' ')));
+	PUTC('0' + log->ic_way);
+	PUTC(' ');
+	PUTC(FLAG(ic_state, 'W'));
+	PUTC(' ');
+	PUTC(FLAG(ic_wb_cyc, 'c'));
+	PUTC(FLAG(ic_wb_stb, 's'));
+	PUTC('0' + log->ic_wb_adr);
+	PUTC(FLAG(ic_wb_stall, 'S'));
+	PUTC(FLAG(ic_wb_ack, 'a'));
+	PUTC(' ');
+	p = put_hex(p, PNIA(ic_part_nia), 2);
+	PUTC(' ');
+	if (log->ic_valid) {
+		if (log->ic_insn & (1ull << 35)) {
+			p = put_str(p, "ill ");
+			p = put_hex(p, log->ic_insn & 0xffffffffull, 8);
+		} else {
+			p = put_dec(p, log->ic_insn >> 26, 3, ' ');
+			p = put_str(p, " x");
+			p = put_hex(p, log->ic_insn & 0x3ffffff, 7);
+		}
+	} else if (log->ic_fetch_failed)
+		p = put_str(p, "    !!!!!!!!");
+	else
+		p = put_str(p, "--- --------");
+
+	PUTC(' ');
+	PUTC(FLAG(ic_valid, '>'));
+	PUTC(FLAG(d2_stall_out, '|'));
+	PUTC(' ');
+	p = put_hex(p, PNIA(d1_part_nia), 2);
+	PUTC(' ');
+	if (log->d1_valid) {
+		p = put_str(p, units[log->d1_unit]);
+		PUTC(' ');
+		p = put_str(p, ops[log->d1_insn_type]);
+	} else
+		p = put_str(p, "-- -------");
+
+	PUTC(' ');
+	PUTC(FLAG(d1_valid, '>'));
+	PUTC(FLAG(d2_stall_out, '|'));
+	PUTC(' ');
+	p = put_hex(p, PNIA(d2_part_nia), 2);
+	PUTC(' ');
+	PUTC(FLAG(d2_bypass_a, 'a'));
+	PUTC(FLAG(d2_bypass_b, 'b'));
+	PUTC(FLAG(d2_bypass_c, 'c'));
+	PUTC(' ');
+	PUTC(FLAG(d2_valid, '>'));
+	PUTC(FLAG(e1_stall_out, '|'));
+	PUTC(' ');
+
+	PUTC(FLAG(e1_flush_out, 'F'));
+	PUTC(FLAG(e1_redirect, 'R'));
+	PUTC(' ');
+	PUTC(FLAG(e1_irq_state, 'w'));
+	PUTC(FLAG(e1_irq, 'I'));
+	PUTC(FLAG(e1_exception, 'X'));
+	PUTC(' ');
+	PUTC(FLAG(e1_msr_ee, 'E'));
+	PUTC(FLGA(e1_msr_pr, 'u', 's'));
+	PUTC(FLAG(e1_msr_ir, 'I'));
+	PUTC(FLAG(e1_msr_dr, 'D'));
+	PUTC(' ');
+	PUTC(FLAG(e1_write_enable, 'W'));
+	PUTC(FLAG(e1_valid, 'C'));
+	PUTC(' ');
+
+	PUTC(FLAG(ls_stall_out, '|'));
+	PUTC(' ');
+	PUTC('0' + log->ls_state);
+	PUTC('0' + log->ls_dw_done);
+	PUTC(' ');
+	PUTC(FLAG(ls_mo_valid, 'M'));
+	PUTC(FLAG(ls_min_done, 'm'));
+	PUTC(' ');
+	PUTC(FLAG(ls_lo_valid, 'C'));
+	PUTC(FLAG(ls_eo_except, 'X'));
+	PUTC(' ');
+	PUTC(FLAG(ls_do_valid, '>'));
+	PUTC(' ');
+
+	PUTC('0' + log->dc_state);
+	PUTC(FLAG(dc_ra_valid, 'R'));
+	PUTC('0' + log->dc_tlb_way);
+	PUTC('0' + log->dc_op);
+	PUTC(' ');
+	PUTC(FLAG(dc_do_valid, 'V'));
+	PUTC(FLAG(dc_do_error, 'E'));
+	PUTC(' ');
+	PUTC(FLAG(dc_wb_cyc, 'c'));
+	PUTC(FLAG(dc_wb_stb, 's'));
+	PUTC('0' + log->dc_wb_adr);
+	PUTC(FLAG(dc_wb_stall, 'S'));
+	PUTC(FLAG(dc_wb_ack, 'a'));
+	PUTC(' ');
+
+	if (log->cr_wr_enable) {
+		p = put_hex(p, log->cr_wr_data, 1);
+		PUTC('>');
+		p = put_hex(p, log->cr_wr_mask, 2);
+		PUTC(' ');
+	} else
+		p = put_str(p, "     ");
+	if (log->reg_wr_enable) {
+		if (log->reg_wr_reg < 32 || log->reg_wr_reg > 44) {
+			PUTC('r');
+			p = put_dec(p, log->reg_wr_reg, 2, '0');
+		} else
+			p = put_str(p, spr_names[log->reg_wr_reg - 32]);
+		PUTC('=');
+		p = put_hex(p, log->reg_wr_data, 16);
+	}
+	PUTC('\n');
+	++d->lineno;
+	if (log->ls_lo_valid || log->e1_valid)
+		++d->ncompl;
+	return p;
+}
+
+/* Print one entry as a line of the cycle-by-cycle listing */
+static inline void log_decode_entry(struct log_decoder *d, const struct log_entry *log, FILE *f)
+{
+	char buf[sizeof(log_header) + LOG_LINE_MAX];
+
+	fwrite(buf, 1, log_format_entry(d, log, buf) - buf, f);
+}
+
+static void log_decode_summary(const struct log_decoder *d, FILE *f)
+{
+	fprintf(f, "%ld instructions completed, %.2f CPI\n", d->ncompl,
+		(double)(d->lineno - 1) / d->ncompl);
+}
+
+#endif /* LOG_DECODE_H */
@@ -17,21 +17,40 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/stat.h>
 #include <urjtag/urjtag.h>
 #include <inttypes.h>
+#include <time.h>
+#include <elf.h>
+
+#include "../fmt_log/log_decode.h"
 
 #define DBG_WB_ADDR		0x00
 #define DBG_WB_DATA		0x01
 #define DBG_WB_CTRL		0x02
+#define DBG_WB_BLOCK		0x03
+#define  DBG_WB_BLOCK_CRC		(0ull << 32)
+#define  DBG_WB_BLOCK_FILL		(1ull << 32)
+#define  DBG_WB_BLOCK_CMP		(2ull << 32)
+#define  DBG_WB_BLOCK_MISMATCH		(1ull << 32)
+#define DBG_WB_CRC		0x04
+#define DBG_WB_FILL		0x05
+
+#define DBG_CORE_ALL		0x08
+#define  DBG_CORE_ALL_MASK(m)		((uint64_t)(m) << 32)
 
 unsigned int core;
 
+#define DBG_CORE_REG(c, r)	(0x10 + ((c) << 4) + ((r) & 0xf))
+
 #define DBG_CORE_CTRL		(0x10 + (core << 4))
 #define  DBG_CORE_CTRL_STOP		(1 << 0)
 #define  DBG_CORE_CTRL_RESET		(1 << 1)
 #define  DBG_CORE_CTRL_ICRESET		(1 << 2)
 #define  DBG_CORE_CTRL_STEP		(1 << 3)
 #define  DBG_CORE_CTRL_START		(1 << 4)
+#define  DBG_CORE_CTRL_SNAP		(1 << 5)
 
 #define DBG_CORE_STAT		(0x11 + (core << 4))
 #define  DBG_CORE_STAT_STOPPING		(1 << 0)
@@ -49,6 +68,12 @@ unsigned int core;
 #define DBG_LOG_TRIGGER		(0x18 + (core << 4))
 #define DBG_LOG_MTRIGGER	(0x19 + (core << 4))
 
+#define DBG_CORE_SNAP_STAT	(0x1a + (core << 4))
+#define DBG_CORE_SNAP_NIA	(0x1b + (core << 4))
+#define DBG_CORE_SNAP_MSR	(0x1c + (core << 4))
+
+#define MAX_CORES		15
+
 static bool debug;
 
 struct backend {
@@ -484,17 +509,10 @@ static int dmi_write(uint8_t addr, uint64_t data)
 	}
 }
 
-static void core_status(void)
+static void stat_strings(uint64_t stat, const char **str1, const char **str2)
 {
-	uint64_t stat, nia, msr;
 	const char *statstr, *statstr2;
 
-	check(dmi_read(DBG_CORE_STAT, &stat), "reading core status");
-	check(dmi_read(DBG_CORE_NIA, &nia), "reading core NIA");
-	check(dmi_read(DBG_CORE_MSR, &msr), "reading core MSR");
-
-	if (debug)
-		printf("Core status = 0x%llx\n", (unsigned long long)stat);
 	statstr = "running";
 	statstr2 = "";
 	if (stat & DBG_CORE_STAT_STOPPED) {
@@ -509,6 +527,22 @@ static void core_status(void)
 			statstr2 = " (terminated)";
 	} else if (stat & DBG_CORE_STAT_TERM)
 		statstr = "odd state (TERM but no STOP)";
+	*str1 = statstr;
+	*str2 = statstr2;
+}
+
+static void core_status(void)
+{
+	uint64_t stat, nia, msr;
+	const char *statstr, *statstr2;
+
+	check(dmi_read(DBG_CORE_STAT, &stat), "reading core status");
+	check(dmi_read(DBG_CORE_NIA, &nia), "reading core NIA");
+	check(dmi_read(DBG_CORE_MSR, &msr), "reading core MSR");
+
+	if (debug)
+		printf("Core status = 0x%llx\n", (unsigned long long)stat);
+	stat_strings(stat, &statstr, &statstr2);
 	printf("Core%u: %s%s\n", core, statstr, statstr2);
 	printf(" NIA: %016" PRIx64 "\n", nia);
 	printf(" MSR: %016" PRIx64 "\n", msr);
@@ -559,6 +593,30 @@ static const char *ldst_spr_names[] = {
 	"pidr", "ptcr", "dsisr", "dar"
 };
 
+static uint64_t gspr_get(uint64_t reg)
+{
+	uint64_t data;
+
+	check(dmi_write(DBG_CORE_GSPR_INDEX, reg), "setting GPR index");
+	data = 0xdeadbeef;
+	check(dmi_read(DBG_CORE_GSPR_DATA, &data), "reading GPR data");
+	return data;
+}
+
+static void gspr_print_name(uint64_t reg)
+{
+	if (reg <= 31)
+		printf("r%"PRId64, reg);
+	else if ((reg - 32) < sizeof(fast_spr_names) / sizeof(fast_spr_names[0]))
+		printf("%s", fast_spr_names[reg - 32]);
+	else if (reg < 60)
+		printf("gspr%"PRId64, reg);
+	else if (reg < 64)
+		printf("%s", ldst_spr_names[reg - 60]);
+	else
+		printf("FPR%"PRId64, reg - 64);
+}
+
 static void gpr_read(uint64_t reg, uint64_t count)
 {
 	uint64_t data;
@@ -567,23 +625,210 @@ static void gpr_read(uint64_t reg, uint64_t count)
 	if (reg + count > 96)
 		count = 96 - reg;
 	for (; count != 0; --count, ++reg) {
-		check(dmi_write(DBG_CORE_GSPR_INDEX, reg), "setting GPR index");
-		data = 0xdeadbeef;
-		check(dmi_read(DBG_CORE_GSPR_DATA, &data), "reading GPR data");
-		if (reg <= 31)
-			printf("r%"PRId64, reg);
-		else if ((reg - 32) < sizeof(fast_spr_names) / sizeof(fast_spr_names[0]))
-			printf("%s", fast_spr_names[reg - 32]);
-		else if (reg < 60)
-			printf("gspr%"PRId64, reg);
-		else if (reg < 64)
-			printf("%s", ldst_spr_names[reg - 60]);
-		else
-			printf("FPR%"PRId64, reg - 64);
+		data = gspr_get(reg);
+		gspr_print_name(reg);
 		printf(":\t%016"PRIx64"\n", data);
 	}
 }
 
+/* -------------- Multiple cores -------------- */
+
+/*
+ * Commands given a set of cores with -c act on all of them. Newer SoCs
+ * have an "all cores" DMI register which delivers one CTRL write to a
+ * mask of cores in the same cycle, so stop/start/step are synchronised
+ * and a CTRL snapshot latches STAT, NIA and MSR of every core at once.
+ * Without it we fall back to one write per core and read each register
+ * across all the cores back to back to keep them as close as we can.
+ */
+static uint16_t core_set;
+static bool all_cores;
+static bool have_all_cores;
+
+static unsigned int count_cores(void)
+{
+	static int ncores = -1;
+	uint64_t val;
+	unsigned int n;
+
+	if (ncores >= 0)
+		return ncores;
+
+	/* Older SoCs have no "all cores" register and read all ones */
+	check(dmi_read(DBG_CORE_ALL, &val), "reading core count");
+	if (val != ~0ull && val <= MAX_CORES) {
+		have_all_cores = true;
+		ncores = val;
+		return ncores;
+	}
+
+	/* DMI addresses beyond the last core read back as all ones */
+	for (n = 0; n < MAX_CORES; n++) {
+		check(dmi_read(DBG_CORE_REG(n, DBG_CORE_STAT), &val),
+		      "reading core status");
+		if (val == ~0ull)
+			break;
+	}
+	ncores = n;
+	return ncores;
+}
+
+static bool parse_cores(const char *arg)
+{
+	unsigned long first, last;
+	char *end;
+
+	if (strcmp(arg, "all") == 0) {
+		all_cores = true;
+		return true;
+	}
+	for (;;) {
+		first = last = strtoul(arg, &end, 10);
+		if (end == arg)
+			return false;
+		if (*end == '-') {
+			arg = end + 1;
+			last = strtoul(arg, &end, 10);
+			if (end == arg || last < first)
+				return false;
+		}
+		if (last >= MAX_CORES)
+			return false;
+		for (; first <= last; first++)
+			core_set |= 1u << first;
+		if (*end == '\0')
+			return true;
+		if (*end != ',')
+			return false;
+		arg = end + 1;
+	}
+}
+
+static bool multi_core(void)
+{
+	return (core_set & (core_set - 1)) != 0;
+}
+
+/* Resolve -c against the cores present, and pick the first as "core" */
+static void setup_cores(void)
+{
+	unsigned int ncores;
+
+	if (all_cores || multi_core()) {
+		ncores = count_cores();
+		if (all_cores)
+			core_set = (1u << ncores) - 1;
+		if (core_set >> ncores) {
+			fprintf(stderr, "Core number out of range (%u cores)\n", ncores);
+			exit(1);
+		}
+	}
+	if (!core_set)
+		core_set = 1;
+	for (core = 0; !(core_set & (1u << core)); core++)
+		;
+}
+
+static void cores_ctrl(uint64_t bits, const char *what)
+{
+	unsigned int c;
+
+	if (have_all_cores) {
+		check(dmi_write(DBG_CORE_ALL, DBG_CORE_ALL_MASK(core_set) | bits), what);
+		return;
+	}
+	for (c = 0; c < MAX_CORES; c++)
+		if (core_set & (1u << c))
+			check(dmi_write(DBG_CORE_REG(c, DBG_CORE_CTRL), bits), what);
+}
+
+/* Read one register from every selected core, back to back */
+static void cores_read(uint8_t reg, uint64_t *vals, const char *what)
+{
+	unsigned int c;
+
+	for (c = 0; c < MAX_CORES; c++)
+		if (core_set & (1u << c))
+			check(dmi_read(DBG_CORE_REG(c, reg), &vals[c]), what);
+}
+
+static void cores_step(void)
+{
+	uint64_t stat[MAX_CORES];
+	unsigned int c;
+
+	cores_read(DBG_CORE_STAT, stat, "reading core status");
+	for (c = 0; c < MAX_CORES; c++) {
+		if ((core_set & (1u << c)) && !(stat[c] & DBG_CORE_STAT_STOPPED)) {
+			printf("Core%u not stopped !\n", c);
+			return;
+		}
+	}
+	cores_ctrl(DBG_CORE_CTRL_STEP, "stepping cores");
+}
+
+static void cores_status(void)
+{
+	uint64_t stat[MAX_CORES], nia[MAX_CORES], msr[MAX_CORES];
+	const char *statstr, *statstr2;
+	char buf[64];
+	unsigned int c;
+
+	if (have_all_cores) {
+		cores_ctrl(DBG_CORE_CTRL_SNAP, "snapshotting cores");
+		cores_read(DBG_CORE_SNAP_STAT, stat, "reading core status");
+		cores_read(DBG_CORE_SNAP_NIA, nia, "reading core NIA");
+		cores_read(DBG_CORE_SNAP_MSR, msr, "reading core MSR");
+	} else {
+		cores_read(DBG_CORE_STAT, stat, "reading core status");
+		cores_read(DBG_CORE_NIA, nia, "reading core NIA");
+		cores_read(DBG_CORE_MSR, msr, "reading core MSR");
+	}
+
+	printf("Core  %-24s  %-16s  %s\n", "Status", "NIA", "MSR");
+	for (c = 0; c < MAX_CORES; c++) {
+		if (!(core_set & (1u << c)))
+			continue;
+		stat_strings(stat[c], &statstr, &statstr2);
+		snprintf(buf, sizeof(buf), "%s%s", statstr, statstr2);
+		printf("%4u  %-24s  %016" PRIx64 "  %016" PRIx64 "\n",
+		       c, buf, nia[c], msr[c]);
+	}
+}
+
+static void cores_gpr_read(uint64_t reg, uint64_t count)
+{
+	uint64_t data[MAX_CORES];
+	unsigned int c;
+	int pad;
+
+	reg &= 0x7f;
+	if (reg + count > 96)
+		count = 96 - reg;
+	printf("\t");
+	for (c = 0, pad = 0; c < MAX_CORES; c++) {
+		if (core_set & (1u << c)) {
+			printf("%*s core%u", pad, "", c);
+			pad = c < 10 ? 11 : 10;
+		}
+	}
+	printf("\n");
+	for (; count != 0; --count, ++reg) {
+		/* Set every index first so the data reads are back to back */
+		for (c = 0; c < MAX_CORES; c++)
+			if (core_set & (1u << c))
+				check(dmi_write(DBG_CORE_REG(c, DBG_CORE_GSPR_INDEX), reg),
+				      "setting GPR index");
+		cores_read(DBG_CORE_GSPR_DATA, data, "reading GPR data");
+		gspr_print_name(reg);
+		printf(":\t");
+		for (c = 0; c < MAX_CORES; c++)
+			if (core_set & (1u << c))
+				printf(" %016"PRIx64, data[c]);
+		printf("\n");
+	}
+}
+
 static void mem_read(uint64_t addr, uint64_t count)
 {
 	union {
@@ -619,34 +864,357 @@ static void mem_write(uint64_t addr, uint64_t data)
 	check(dmi_write(DBG_WB_DATA, data), "writing WB_DATA");
 }
 
-static void load(const char *filename, uint64_t addr)
+/* -------------- Wishbone block engine -------------- */
+
+static uint32_t crc32_table[256];
+
+/* CRC-32 as computed by the debug master, no pre/post inversion */
+static uint32_t crc32_update(uint32_t crc, const void *buf, size_t len)
+{
+	const uint8_t *p = buf;
+	int i, j;
+
+	if (!crc32_table[1]) {
+		for (i = 0; i < 256; i++) {
+			uint32_t c = i;
+
+			for (j = 0; j < 8; j++)
+				c = (c & 1) ? (c >> 1) ^ 0xedb88320 : c >> 1;
+			crc32_table[i] = c;
+		}
+	}
+	while (len--)
+		crc = crc32_table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+	return crc;
+}
+
+static bool block_engine(void)
 {
+	static int present = -1;
 	uint64_t data;
-	int fd, rc, count;
+
+	/*
+	 * Older bitstreams don't decode DBG_WB_CRC, and reading it
+	 * returns all ones rather than a 32-bit value.
+	 */
+	if (present < 0) {
+		check(dmi_read(DBG_WB_CRC, &data), "reading WB_CRC");
+		present = (data >> 32) == 0;
+		if (debug)
+			printf("Block engine %spresent\n", present ? "" : "not ");
+	}
+	return present;
+}
+
+/* Returns the number of transfers left undone by a compare mismatch */
+static uint64_t block_run(uint64_t op, uint64_t count)
+{
+	uint64_t n, left;
+
+	while (count) {
+		n = count < 0xffffffffull ? count : 0xffffffffull;
+		check(dmi_write(DBG_WB_BLOCK, op | n), "writing WB_BLOCK");
+		do {
+			check(dmi_read(DBG_WB_BLOCK, &left), "reading WB_BLOCK");
+		} while (left && !(left & DBG_WB_BLOCK_MISMATCH));
+		count -= n;
+		if (left)
+			return count + (left & 0xffffffff);
+	}
+	return 0;
+}
+
+/* CRC-32 of count doublewords at addr, computed by the target */
+static uint32_t target_crc(uint64_t addr, uint64_t count)
+{
+	uint64_t crc;
+
+	check(dmi_write(DBG_WB_CTRL, 0x7ff), "writing WB_CTRL");
+	check(dmi_write(DBG_WB_ADDR, addr), "writing WB_ADDR");
+	check(dmi_write(DBG_WB_CRC, 0xffffffff), "writing WB_CRC");
+	block_run(DBG_WB_BLOCK_CRC, count);
+	check(dmi_read(DBG_WB_CRC, &crc), "reading WB_CRC");
+	return ~(uint32_t)crc;
+}
+
+static void target_fill(uint64_t addr, uint64_t count, uint64_t value)
+{
+	check(dmi_write(DBG_WB_CTRL, 0x7ff), "writing WB_CTRL");
+	check(dmi_write(DBG_WB_ADDR, addr), "writing WB_ADDR");
+	check(dmi_write(DBG_WB_FILL, value), "writing WB_FILL");
+	block_run(DBG_WB_BLOCK_FILL, count);
+}
+
+/*
+ * Compare count doublewords at addr with value on the target. Returns
+ * false and the address of the first one that differs on a mismatch.
+ */
+static bool target_cmp(uint64_t addr, uint64_t count, uint64_t value,
+		       uint64_t *bad)
+{
+	uint64_t left;
+
+	check(dmi_write(DBG_WB_CTRL, 0x7ff), "writing WB_CTRL");
+	check(dmi_write(DBG_WB_ADDR, addr), "writing WB_ADDR");
+	check(dmi_write(DBG_WB_FILL, value), "writing WB_FILL");
+	left = block_run(DBG_WB_BLOCK_CMP, count);
+	if (!left)
+		return true;
+	*bad = addr + (count - left) * 8;
+	return false;
+}
+
+/* -------------- Loader -------------- */
+
+/*
+ * Zero runs at least this many doublewords long are cleared by the
+ * target with a block fill rather than written one at a time.
+ */
+#define ZERO_RUN_MIN	64
+
+static uint64_t load_count;
+
+/* Where the core starts after a reset (its RESET_ADDRESS), see -r */
+static uint64_t reset_vector;
+
+static void load_progress(uint64_t bytes)
+{
+	uint64_t old = load_count;
+
+	load_count += bytes;
+	if ((old >> 10) != (load_count >> 10)) {
+		printf("%" PRIx64 "...\r", load_count);
+		fflush(stdout);
+	}
+}
+
+static uint64_t read_dword(uint64_t addr)
+{
+	uint64_t data;
+
+	check(dmi_write(DBG_WB_CTRL, 0x7ff), "writing WB_CTRL");
+	check(dmi_write(DBG_WB_ADDR, addr), "writing WB_ADDR");
+	check(dmi_read(DBG_WB_DATA, &data), "reading WB_DATA");
+	return data;
+}
+
+static void write_dwords(uint64_t addr, const uint64_t *data, uint64_t count)
+{
+	uint64_t i = 0, run, end;
+	bool addr_ok = false;
+
+	while (i < count) {
+		run = 0;
+		if (data[i] == 0 && block_engine())
+			while (i + run < count && data[i + run] == 0)
+				run++;
+		if (run >= ZERO_RUN_MIN) {
+			target_fill(addr + i * 8, run, 0);
+			addr_ok = false;
+			i += run;
+			load_progress(run * 8);
+			continue;
+		}
+		if (!addr_ok) {
+			check(dmi_write(DBG_WB_CTRL, 0x7ff), "writing WB_CTRL");
+			check(dmi_write(DBG_WB_ADDR, addr + i * 8), "writing WB_ADDR");
+			addr_ok = true;
+		}
+		for (end = i + (run ? run : 1); i < end; i++) {
+			check(dmi_write(DBG_WB_DATA, data[i]), "writing WB_DATA");
+			load_progress(8);
+		}
+	}
+}
+
+static bool verify_dwords(uint64_t addr, const uint64_t *data, uint64_t count)
+{
+	uint64_t i, d;
+
+	if (block_engine())
+		return target_crc(addr, count) ==
+			~crc32_update(0xffffffff, data, count * 8);
+
+	/* No engine on the target, read it all back */
+	check(dmi_write(DBG_WB_CTRL, 0x7ff), "writing WB_CTRL");
+	check(dmi_write(DBG_WB_ADDR, addr), "writing WB_ADDR");
+	for (i = 0; i < count; i++) {
+		check(dmi_read(DBG_WB_DATA, &d), "reading WB_DATA");
+		if (d != data[i])
+			return false;
+	}
+	return true;
+}
+
+/*
+ * Load memsz bytes at addr, the first filesz of which come from data
+ * and the rest are zero. Bytes outside that range which share a
+ * doubleword with it are preserved.
+ */
+static void load_segment(uint64_t addr, const void *data, uint64_t filesz,
+			 uint64_t memsz, bool verify)
+{
+	uint64_t start = addr & ~7ull;
+	uint64_t end = (addr + memsz + 7) & ~7ull;
+	uint64_t count = (end - start) / 8;
+	uint64_t *buf;
+
+	if (memsz == 0)
+		return;
+	buf = calloc(count, 8);
+	if (!buf) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+	if (start != addr)
+		buf[0] = read_dword(start);
+	if (end != addr + memsz && (count > 1 || start == addr))
+		buf[count - 1] = read_dword(end - 8);
+	memcpy((char *)buf + (addr - start), data, filesz);
+	memset((char *)buf + (addr - start) + filesz, 0, memsz - filesz);
+
+	write_dwords(start, buf, count);
+	if (verify) {
+		if (!verify_dwords(start, buf, count)) {
+			fprintf(stderr, "\nVerify failed at %016" PRIx64 "-%016" PRIx64 "\n",
+				start, end - 1);
+			exit(1);
+		}
+	}
+	free(buf);
+}
+
+/* Instructions loading r12 with a 64-bit value, then branching there */
+static void make_trampoline(uint32_t *insn, uint64_t target)
+{
+	insn[0] = 0x3d800000 | ((target >> 48) & 0xffff);	/* lis r12,.. */
+	insn[1] = 0x618c0000 | ((target >> 32) & 0xffff);	/* ori r12,r12,.. */
+	insn[2] = 0x798c07c6;					/* sldi r12,r12,32 */
+	insn[3] = 0x658c0000 | ((target >> 16) & 0xffff);	/* oris r12,r12,.. */
+	insn[4] = 0x618c0000 | (target & 0xffff);		/* ori r12,r12,.. */
+	insn[5] = 0x7d8903a6;					/* mtctr r12 */
+	insn[6] = 0x4e800420;					/* bctr */
+	insn[7] = 0x60000000;					/* nop */
+}
+
+static void load_elf(const char *filename, const uint8_t *img, size_t size,
+		     uint64_t offset, bool entry, bool verify)
+{
+	const Elf64_Ehdr *eh = (const Elf64_Ehdr *)img;
+	const Elf64_Phdr *ph;
+	uint64_t nia, vec_end;
+	uint32_t tramp[8];
+	bool covers_vec = false;
+	int i;
+
+	if (size < sizeof(*eh) || eh->e_ident[EI_CLASS] != ELFCLASS64 ||
+	    eh->e_ident[EI_DATA] != ELFDATA2LSB) {
+		fprintf(stderr, "%s: only little-endian ELF64 is supported\n", filename);
+		exit(1);
+	}
+	if (eh->e_phoff > size ||
+	    (size - eh->e_phoff) / sizeof(*ph) < eh->e_phnum) {
+		fprintf(stderr, "%s: bad program headers\n", filename);
+		exit(1);
+	}
+
+	vec_end = reset_vector + sizeof(tramp);
+	for (i = 0; i < eh->e_phnum; i++) {
+		ph = (const Elf64_Phdr *)(img + eh->e_phoff) + i;
+		if (ph->p_type != PT_LOAD || ph->p_memsz == 0)
+			continue;
+		if (ph->p_offset > size || size - ph->p_offset < ph->p_filesz ||
+		    ph->p_filesz > ph->p_memsz) {
+			fprintf(stderr, "%s: bad segment %d\n", filename, i);
+			exit(1);
+		}
+		printf("Segment %d: %016" PRIx64 " %" PRIx64 " bytes (%" PRIx64 " zeroed)\n",
+		       i, ph->p_paddr + offset, ph->p_memsz, ph->p_memsz - ph->p_filesz);
+		load_segment(ph->p_paddr + offset, img + ph->p_offset,
+			     ph->p_filesz, ph->p_memsz, verify);
+		if (ph->p_paddr + offset < vec_end &&
+		    ph->p_paddr + offset + ph->p_memsz > reset_vector)
+			covers_vec = true;
+	}
+	printf("%" PRIx64 " done%s.\n", load_count, verify ? ", verified" : "");
+
+	if (!entry)
+		return;
+	/*
+	 * The NIA can't be written over DMI, so get there through the
+	 * reset vector, with a trampoline if the entry point isn't it.
+	 */
+	nia = eh->e_entry + offset;
+	if (nia != reset_vector && covers_vec) {
+		fprintf(stderr, "Image occupies the reset vector %" PRIx64 ", "
+			"starting from there rather than %" PRIx64 "\n",
+			reset_vector, nia);
+		nia = reset_vector;
+	} else if (nia != reset_vector) {
+		make_trampoline(tramp, nia);
+		load_segment(reset_vector, tramp, sizeof(tramp), sizeof(tramp), false);
+	}
+	printf("Entry at %" PRIx64 ", resetting core\n", nia);
+	core_reset();
+}
+
+static uint8_t *read_file(const char *filename, size_t *size)
+{
+	struct stat st;
+	uint8_t *img;
+	size_t done;
+	int fd, rc;
 
 	fd = open(filename, O_RDONLY);
 	if (fd < 0) {
 		fprintf(stderr, "Failed to open '%s': %s\n", filename, strerror(errno));
 		exit(1);
 	}
-	check(dmi_write(DBG_WB_CTRL, 0x7ff), "writing WB_CTRL");
-	check(dmi_write(DBG_WB_ADDR, addr), "writing WB_ADDR");
-	count = 0;
-	for (;;) {
-		data = 0;
-		rc = read(fd, &data, 8);
-		if (rc <= 0)
-			break;
-		// if (rc < 8) XXX fixup endian ?
-		check(dmi_write(DBG_WB_DATA, data), "writing WB_DATA");
-		count += 8;
-		if (!(count % 1024)) {
-			printf("%x...\r", count);
-			fflush(stdout);
+	if (fstat(fd, &st) < 0) {
+		fprintf(stderr, "Failed to stat '%s': %s\n", filename, strerror(errno));
+		exit(1);
+	}
+	img = malloc(st.st_size + 1);
+	if (!img) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+	for (done = 0; done < st.st_size; done += rc) {
+		rc = read(fd, img + done, st.st_size - done);
+		if (rc <= 0) {
+			fprintf(stderr, "Failed to read '%s'\n", filename);
+			exit(1);
 		}
 	}
 	close(fd);
-	printf("%x done.\n", count);
+	*size = st.st_size;
+	return img;
+}
+
+static bool is_elf(const uint8_t *img, size_t size)
+{
+	return size >= SELFMAG && memcmp(img, ELFMAG, SELFMAG) == 0;
+}
+
+static void load(const char *filename, uint64_t addr, bool entry, bool verify)
+{
+	uint8_t *img;
+	size_t size;
+
+	img = read_file(filename, &size);
+	load_count = 0;
+	if (size == 0) {
+		fprintf(stderr, "%s is empty, nothing to load\n", filename);
+	} else if (is_elf(img, size)) {
+		load_elf(filename, img, size, addr, entry, verify);
+	} else {
+		// XXX fixup endian ?
+		load_segment(addr, img, size, size, verify);
+		printf("%" PRIx64 " done%s.\n", load_count, verify ? ", verified" : "");
+		if (entry)
+			fprintf(stderr, "No entry point in a raw binary, ignoring\n");
+	}
+	free(img);
 }
 
 static void save(const char *filename, uint64_t addr, uint64_t size)
@@ -681,47 +1249,239 @@ static void save(const char *filename, uint64_t addr, uint64_t size)
 	printf("%x done.\n", count);
 }
 
-#define LOG_STOP	0x80000000ull
+/* -------------- Fill, checksum and compare -------------- */
 
-static void log_start(void)
+/*
+ * With the block engine these run on the target and only exchange
+ * CRCs over DMI. A file compare checks one CRC per chunk, then bisects
+ * the chunks that differ down to a few doublewords which are read back
+ * and shown. Without the engine everything is read back instead.
+ */
+#define CMP_CHUNK	0x10000
+#define CMP_LEAF	8
+#define CMP_MAX_DIFFS	16
+
+static uint64_t cmp_diffs;
+
+/* Optional hex arguments mustn't swallow a following command */
+static bool is_hex(const char *arg)
 {
-	check(dmi_write(DBG_LOG_ADDR, 0), "writing LOG_ADDR");
+	if (arg[0] == '0' && (arg[1] == 'x' || arg[1] == 'X'))
+		arg += 2;
+	if (!*arg)
+		return false;
+	while (isxdigit(*arg))
+		arg++;
+	return !*arg;
 }
 
-static void log_stop(void)
+static void check_aligned(uint64_t addr, uint64_t size)
 {
-	uint64_t lsize, laddr, waddr;
-
-	check(dmi_write(DBG_LOG_ADDR, LOG_STOP), "writing LOG_ADDR");
-	check(dmi_read(DBG_LOG_ADDR, &laddr), "reading LOG_ADDR");
-	waddr = laddr >> 32;
-	for (lsize = 1; lsize; lsize <<= 1)
-		if ((waddr >> 1) < lsize)
-			break;
-	waddr &= ~lsize;
-	printf("Log size = %" PRIu64 " entries, ", lsize);
-	printf("write ptr = %" PRIx64 "\n", waddr);
+	if ((addr | size) & 7) {
+		fprintf(stderr, "Address and size must be doubleword aligned\n");
+		exit(1);
+	}
 }
 
-static void log_dump(const char *filename)
+static void mem_fill(uint64_t addr, uint64_t size, uint64_t value, bool verify)
 {
-	FILE *f;
-	uint64_t lsize, laddr, waddr;
-	uint64_t orig_laddr;
-	uint64_t i, ldata;
-
-	f = fopen(filename, "w");
-	if (f == NULL) {
-		fprintf(stderr, "Failed to create '%s': %s\n", filename,
-			strerror(errno));
+	uint64_t count = size / 8, i, data, bad = 0;
+	bool ok = true;
+
+	check_aligned(addr, size);
+	if (block_engine()) {
+		target_fill(addr, count, value);
+		if (verify)
+			ok = target_cmp(addr, count, value, &bad);
+	} else {
+		check(dmi_write(DBG_WB_CTRL, 0x7ff), "writing WB_CTRL");
+		check(dmi_write(DBG_WB_ADDR, addr), "writing WB_ADDR");
+		for (i = 0; i < count; i++)
+			check(dmi_write(DBG_WB_DATA, value), "writing WB_DATA");
+		if (verify) {
+			check(dmi_write(DBG_WB_ADDR, addr), "writing WB_ADDR");
+			for (i = 0; i < count && ok; i++) {
+				check(dmi_read(DBG_WB_DATA, &data), "reading WB_DATA");
+				ok = data == value;
+				bad = addr + i * 8;
+			}
+		}
+	}
+	if (!ok) {
+		printf("Fill mismatch at %016" PRIx64 ": %016" PRIx64 "\n",
+		       bad, read_dword(bad));
 		exit(1);
 	}
+	printf("%" PRIx64 " bytes filled%s\n", size, verify ? " and verified" : "");
+}
 
-	check(dmi_read(DBG_LOG_ADDR, &orig_laddr), "reading LOG_ADDR");
-	if (!(orig_laddr & LOG_STOP))
-		check(dmi_write(DBG_LOG_ADDR, LOG_STOP), "writing LOG_ADDR");
-
-	waddr = orig_laddr >> 32;
+static void mem_crc(uint64_t addr, uint64_t size)
+{
+	uint64_t count = size / 8, i, data;
+	uint32_t crc = 0xffffffff;
+
+	check_aligned(addr, size);
+	if (block_engine()) {
+		crc = target_crc(addr, count);
+	} else {
+		check(dmi_write(DBG_WB_CTRL, 0x7ff), "writing WB_CTRL");
+		check(dmi_write(DBG_WB_ADDR, addr), "writing WB_ADDR");
+		for (i = 0; i < count; i++) {
+			check(dmi_read(DBG_WB_DATA, &data), "reading WB_DATA");
+			crc = crc32_update(crc, &data, 8);
+		}
+		crc = ~crc;
+	}
+	printf("CRC-32 of %" PRIx64 " bytes at %016" PRIx64 ": %08x\n",
+	       size, addr, crc);
+}
+
+static bool range_matches(uint64_t addr, const uint64_t *data, uint64_t count)
+{
+	return target_crc(addr, count) == ~crc32_update(0xffffffff, data, count * 8);
+}
+
+static void read_range(uint64_t addr, uint64_t *data, uint64_t count)
+{
+	uint64_t i;
+
+	check(dmi_write(DBG_WB_CTRL, 0x7ff), "writing WB_CTRL");
+	check(dmi_write(DBG_WB_ADDR, addr), "writing WB_ADDR");
+	for (i = 0; i < count; i++)
+		check(dmi_read(DBG_WB_DATA, &data[i]), "reading WB_DATA");
+}
+
+static void show_diffs(uint64_t addr, const uint64_t *target,
+		       const uint64_t *data, uint64_t count)
+{
+	uint64_t i;
+
+	for (i = 0; i < count; i++) {
+		if (target[i] != data[i] && cmp_diffs++ < CMP_MAX_DIFFS)
+			printf("  %016" PRIx64 ": %016" PRIx64 " (file %016" PRIx64 ")\n",
+			       addr + i * 8, target[i], data[i]);
+	}
+}
+
+/* Bisect a range whose CRC differs down to the doublewords that do */
+static void compare_range(uint64_t addr, const uint64_t *data, uint64_t count)
+{
+	uint64_t target[CMP_LEAF], half;
+
+	if (cmp_diffs >= CMP_MAX_DIFFS)
+		return;
+	if (count <= CMP_LEAF) {
+		read_range(addr, target, count);
+		show_diffs(addr, target, data, count);
+		return;
+	}
+	/* If the first half matches, the second one can't */
+	half = count / 2;
+	if (!range_matches(addr, data, half)) {
+		compare_range(addr, data, half);
+		if (range_matches(addr + half * 8, data + half, count - half))
+			return;
+	}
+	compare_range(addr + half * 8, data + half, count - half);
+}
+
+static void compare(const char *filename, uint64_t addr, uint64_t chunk)
+{
+	uint64_t count, i, n, a, nchunks = 0, nbad = 0, tail;
+	uint64_t *buf, *target = NULL;
+	uint8_t *img;
+	size_t size;
+
+	check_aligned(addr, chunk);
+	img = read_file(filename, &size);
+	count = (size + 7) / 8;
+	buf = calloc(count ? count : 1, 8);
+	if (!block_engine())
+		target = calloc(chunk / 8, 8);
+	if (!buf || (!block_engine() && !target)) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+	memcpy(buf, img, size);
+	free(img);
+
+	/* Bytes past the end of the file are whatever the target has */
+	if (size & 7) {
+		tail = read_dword(addr + (count - 1) * 8);
+		memcpy((uint8_t *)&buf[count - 1] + (size & 7),
+		       (uint8_t *)&tail + (size & 7), 8 - (size & 7));
+	}
+
+	printf("Comparing %zx bytes at %016" PRIx64 " in %" PRIx64 " byte chunks\n",
+	       size, addr, chunk);
+	for (i = 0; i < count; i += n, nchunks++) {
+		n = count - i < chunk / 8 ? count - i : chunk / 8;
+		a = addr + i * 8;
+		if (block_engine()) {
+			if (range_matches(a, buf + i, n))
+				continue;
+		} else {
+			read_range(a, target, n);
+			if (memcmp(target, buf + i, n * 8) == 0)
+				continue;
+		}
+		printf(" %016" PRIx64 "-%016" PRIx64 " differs\n", a, a + n * 8 - 1);
+		if (block_engine())
+			compare_range(a, buf + i, n);
+		else
+			show_diffs(a, target, buf + i, n);
+		nbad++;
+	}
+	free(target);
+	free(buf);
+	if (nbad) {
+		printf("%" PRIu64 " of %" PRIu64 " chunks differ\n", nbad, nchunks);
+		exit(1);
+	}
+	printf("Match\n");
+}
+
+#define LOG_STOP	0x80000000ull
+
+static void log_start(void)
+{
+	check(dmi_write(DBG_LOG_ADDR, 0), "writing LOG_ADDR");
+}
+
+static void log_stop(void)
+{
+	uint64_t lsize, laddr, waddr;
+
+	check(dmi_write(DBG_LOG_ADDR, LOG_STOP), "writing LOG_ADDR");
+	check(dmi_read(DBG_LOG_ADDR, &laddr), "reading LOG_ADDR");
+	waddr = laddr >> 32;
+	for (lsize = 1; lsize; lsize <<= 1)
+		if ((waddr >> 1) < lsize)
+			break;
+	waddr &= ~lsize;
+	printf("Log size = %" PRIu64 " entries, ", lsize);
+	printf("write ptr = %" PRIx64 "\n", waddr);
+}
+
+static void log_dump(const char *filename)
+{
+	FILE *f;
+	uint64_t lsize, laddr, waddr;
+	uint64_t orig_laddr;
+	uint64_t i, ldata;
+
+	f = fopen(filename, "w");
+	if (f == NULL) {
+		fprintf(stderr, "Failed to create '%s': %s\n", filename,
+			strerror(errno));
+		exit(1);
+	}
+
+	check(dmi_read(DBG_LOG_ADDR, &orig_laddr), "reading LOG_ADDR");
+	if (!(orig_laddr & LOG_STOP))
+		check(dmi_write(DBG_LOG_ADDR, LOG_STOP), "writing LOG_ADDR");
+
+	waddr = orig_laddr >> 32;
 	for (lsize = 1; lsize; lsize <<= 1)
 		if ((waddr >> 1) < lsize)
 			break;
@@ -748,6 +1508,105 @@ static void log_dump(const char *filename)
 	check(dmi_write(DBG_LOG_ADDR, orig_laddr), "writing LOG_ADDR");
 }
 
+static volatile sig_atomic_t interrupted;
+
+static void sigint_handler(int sig)
+{
+	(void)sig;
+	interrupted = 1;
+}
+
+/*
+ * Capture the log buffer over and over and decode it as we go.
+ *
+ * The log is written every cycle, much faster than it can be read
+ * over DMI, so each pass freezes it, reads the whole ring back from
+ * the write pointer, then lets it run again; what happens between
+ * passes is not captured. If a stop trigger (ltrig/mtrig) is armed,
+ * each pass waits for the trigger to stop the log instead and re-arms
+ * it afterwards, giving one window per trigger hit.
+ */
+static void log_stream(const char *filename, unsigned long passes)
+{
+	struct log_decoder d;
+	struct log_entry log;
+	uint64_t lsize, laddr, waddr, orig_laddr, trig, mtrig;
+	uint64_t i, ldata[4];
+	unsigned long pass;
+	bool armed;
+	FILE *f;
+
+	f = stdout;
+	if (strcmp(filename, "-") != 0) {
+		f = fopen(filename, "w");
+		if (f == NULL) {
+			fprintf(stderr, "Failed to create '%s': %s\n", filename,
+				strerror(errno));
+			exit(1);
+		}
+	}
+
+	check(dmi_read(DBG_LOG_ADDR, &orig_laddr), "reading LOG_ADDR");
+	check(dmi_read(DBG_LOG_TRIGGER, &trig), "reading LOG_TRIGGER");
+	check(dmi_read(DBG_LOG_MTRIGGER, &mtrig), "reading LOG_MTRIGGER");
+	armed = (trig & 1) || (mtrig & 1);
+
+	interrupted = 0;
+	signal(SIGINT, sigint_handler);
+	log_decode_init(&d);
+	check(dmi_write(DBG_LOG_ADDR, 0), "writing LOG_ADDR");
+	for (pass = 0; !passes || pass < passes; pass++) {
+		if (armed) {
+			while (!interrupted) {
+				check(dmi_read(DBG_LOG_TRIGGER, &trig), "reading LOG_TRIGGER");
+				check(dmi_read(DBG_LOG_MTRIGGER, &mtrig), "reading LOG_MTRIGGER");
+				if ((trig | mtrig) & 2)
+					break;
+				usleep(10000);
+			}
+		}
+		if (interrupted)
+			break;
+		check(dmi_write(DBG_LOG_ADDR, LOG_STOP), "writing LOG_ADDR");
+		check(dmi_read(DBG_LOG_ADDR, &laddr), "reading LOG_ADDR");
+		waddr = laddr >> 32;
+		for (lsize = 1; lsize; lsize <<= 1)
+			if ((waddr >> 1) < lsize)
+				break;
+		waddr &= ~lsize;
+
+		check(dmi_write(DBG_LOG_ADDR, LOG_STOP | (waddr << 2)), "writing LOG_ADDR");
+		fprintf(f, "---- pass %lu%s, %" PRIu64 " cycles ----\n", pass,
+			armed ? " (triggered)" : "", lsize);
+		for (i = 0; i < lsize; ++i) {
+			check(dmi_read(DBG_LOG_DATA, &ldata[0]), "reading LOG_DATA");
+			check(dmi_read(DBG_LOG_DATA, &ldata[1]), "reading LOG_DATA");
+			check(dmi_read(DBG_LOG_DATA, &ldata[2]), "reading LOG_DATA");
+			check(dmi_read(DBG_LOG_DATA, &ldata[3]), "reading LOG_DATA");
+			log_unpack(&log, ldata);
+			log_decode_entry(&d, &log, f);
+		}
+		fflush(f);
+		if (f != stdout) {
+			printf("%lu...\r", pass + 1);
+			fflush(stdout);
+		}
+
+		if (trig & 2)
+			check(dmi_write(DBG_LOG_TRIGGER, trig & ~2ull), "writing LOG_TRIGGER");
+		if (mtrig & 2)
+			check(dmi_write(DBG_LOG_MTRIGGER, mtrig & ~2ull), "writing LOG_MTRIGGER");
+		check(dmi_write(DBG_LOG_ADDR, 0), "writing LOG_ADDR");
+	}
+	signal(SIGINT, SIG_DFL);
+	log_decode_summary(&d, f);
+	if (f != stdout)
+		fclose(f);
+	printf("%lu passes done\n", pass);
+
+	check(dmi_write(DBG_LOG_ADDR, orig_laddr & LOG_STOP), "writing LOG_ADDR");
+}
+
 static void ltrig_show(void)
 {
 	uint64_t trig;
@@ -792,9 +1651,851 @@ static void mtrig_set(uint64_t addr)
 	check(dmi_write(DBG_LOG_MTRIGGER, (addr & ~(uint64_t)2) | 1), "writing LOG_MTRIGGER");
 }
 
+/* -------------- Symbols -------------- */
+
+struct symbol {
+	uint64_t addr;
+	uint64_t size;
+	const char *name;
+};
+
+static struct symbol *symbols;
+static unsigned int nsymbols;
+
+static int symbol_cmp(const void *a, const void *b)
+{
+	const struct symbol *sa = a, *sb = b;
+
+	return sa->addr < sb->addr ? -1 : sa->addr > sb->addr;
+}
+
+/* Load function symbols from an ELF. The image is kept for the names. */
+static void load_symbols(const char *filename)
+{
+	const Elf64_Ehdr *eh;
+	const Elf64_Shdr *sh, *strsh;
+	const Elf64_Sym *sym;
+	uint8_t *img;
+	size_t size;
+	unsigned int i, j, n, type;
+
+	img = read_file(filename, &size);
+	eh = (const Elf64_Ehdr *)img;
+	if (!is_elf(img, size) || size < sizeof(*eh) ||
+	    eh->e_ident[EI_CLASS] != ELFCLASS64 ||
+	    eh->e_shoff > size || (size - eh->e_shoff) / sizeof(*sh) < eh->e_shnum) {
+		fprintf(stderr, "%s: not a usable ELF64 file\n", filename);
+		exit(1);
+	}
+	sh = (const Elf64_Shdr *)(img + eh->e_shoff);
+	for (i = 0; i < eh->e_shnum; i++) {
+		if (sh[i].sh_type != SHT_SYMTAB || sh[i].sh_link >= eh->e_shnum)
+			continue;
+		strsh = &sh[sh[i].sh_link];
+		if (sh[i].sh_offset > size || size - sh[i].sh_offset < sh[i].sh_size ||
+		    strsh->sh_offset > size || size - strsh->sh_offset < strsh->sh_size)
+			continue;
+		sym = (const Elf64_Sym *)(img + sh[i].sh_offset);
+		n = sh[i].sh_size / sizeof(*sym);
+		symbols = realloc(symbols, (nsymbols + n) * sizeof(*symbols));
+		if (!symbols) {
+			fprintf(stderr, "Out of memory\n");
+			exit(1);
+		}
+		for (j = 0; j < n; j++) {
+			type = ELF64_ST_TYPE(sym[j].st_info);
+			if ((type != STT_FUNC && type != STT_NOTYPE) ||
+			    sym[j].st_shndx == SHN_UNDEF || sym[j].st_shndx >= eh->e_shnum ||
+			    !(sh[sym[j].st_shndx].sh_flags & SHF_EXECINSTR) ||
+			    sym[j].st_name == 0 || sym[j].st_name >= strsh->sh_size)
+				continue;
+			symbols[nsymbols].addr = sym[j].st_value;
+			symbols[nsymbols].size = sym[j].st_size;
+			/* Unsized labels extend at most to the end of their section */
+			if (!symbols[nsymbols].size)
+				symbols[nsymbols].size = sh[sym[j].st_shndx].sh_addr +
+					sh[sym[j].st_shndx].sh_size - sym[j].st_value;
+			symbols[nsymbols].name = (const char *)img + strsh->sh_offset + sym[j].st_name;
+			if (symbols[nsymbols].name[0] == '$')
+				continue;
+			nsymbols++;
+		}
+	}
+	if (!nsymbols)
+		fprintf(stderr, "%s: no symbols\n", filename);
+	qsort(symbols, nsymbols, sizeof(*symbols), symbol_cmp);
+}
+
+/* Find the symbol containing addr, the last one starting before it wins */
+static const struct symbol *lookup_symbol(uint64_t addr)
+{
+	unsigned int lo = 0, hi = nsymbols, mid;
+	const struct symbol *s;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (symbols[mid].addr <= addr)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo == 0)
+		return NULL;
+	s = &symbols[lo - 1];
+	if (addr - s->addr >= s->size)
+		return NULL;
+	return s;
+}
+
+/* -------------- Profiler -------------- */
+
+#define MSR_PR		(1ull << 14)
+
+/*
+ * A sample is in the function name, or if that is NULL (no symbol
+ * covers it) it is counted on its own by nia.
+ */
+struct sample {
+	const char *name;
+	uint64_t nia;
+	uint8_t core;
+	uint8_t user;
+};
+
+struct profile_entry {
+	const char *name;
+	uint64_t nia;
+	uint64_t samples;
+	uint64_t user;
+};
+
+static int location_cmp(const char *na, uint64_t a, const char *nb, uint64_t b)
+{
+	if (na && nb)
+		return strcmp(na, nb);
+	if (na || nb)
+		return na ? -1 : 1;
+	if (a != b)
+		return a < b ? -1 : 1;
+	return 0;
+}
+
+static int sample_cmp(const void *a, const void *b)
+{
+	const struct sample *sa = a, *sb = b;
+	int r = location_cmp(sa->name, sa->nia, sb->name, sb->nia);
+
+	if (r)
+		return r;
+	if (sa->core != sb->core)
+		return sa->core - sb->core;
+	return sa->user - sb->user;
+}
+
+static int profile_entry_cmp(const void *a, const void *b)
+{
+	const struct profile_entry *pa = a, *pb = b;
+
+	if (pa->samples != pb->samples)
+		return pa->samples < pb->samples ? 1 : -1;
+	return location_cmp(pa->name, pa->nia, pb->name, pb->nia);
+}
+
+static const char *location_name(const char *name, uint64_t nia, char *buf, size_t size)
+{
+	if (name)
+		return name;
+	snprintf(buf, size, "0x%" PRIx64, nia);
+	return buf;
+}
+
+static double elapsed(const struct timespec *from)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - from->tv_sec) + (now.tv_nsec - from->tv_nsec) / 1e9;
+}
+
+/*
+ * Sample NIA and MSR of every core at hz samples per second (or as
+ * fast as the debug link allows) for secs seconds, then print a flat
+ * profile by function, split between user (MSR[PR]) and privileged
+ * samples. With a folded file, also write "core;mode;function count"
+ * lines for flamegraph.pl.
+ */
+static void profile(const char *elf, double secs, unsigned int hz, const char *folded)
+{
+	unsigned int ncores, saved = core, c;
+	struct sample *samples = NULL;
+	struct profile_entry *prof;
+	size_t nsamples = 0, alloc = 0, i, j, nprof;
+	struct timespec start, next;
+	const struct symbol *sym;
+	uint64_t nia, msr, nuser = 0;
+	long interval;
+	char buf[24];
+	FILE *f;
+
+	if (elf)
+		load_symbols(elf);
+	ncores = count_cores();
+	if (!ncores) {
+		fprintf(stderr, "No cores found\n");
+		exit(1);
+	}
+	printf("Sampling %u core%s for %.1fs at %u Hz...\n", ncores,
+	       ncores > 1 ? "s" : "", secs, hz);
+	interval = 1000000000L / hz;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	next = start;
+	while (elapsed(&start) < secs) {
+		for (c = 0; c < ncores; c++) {
+			core = c;
+			check(dmi_read(DBG_CORE_NIA, &nia), "reading core NIA");
+			check(dmi_read(DBG_CORE_MSR, &msr), "reading core MSR");
+			if (nsamples == alloc) {
+				alloc = alloc ? alloc * 2 : 4096;
+				samples = realloc(samples, alloc * sizeof(*samples));
+				if (!samples) {
+					fprintf(stderr, "Out of memory\n");
+					exit(1);
+				}
+			}
+			sym = lookup_symbol(nia);
+			samples[nsamples].name = sym ? sym->name : NULL;
+			samples[nsamples].nia = sym ? 0 : nia;
+			samples[nsamples].core = c;
+			samples[nsamples].user = !!(msr & MSR_PR);
+			nuser += samples[nsamples].user;
+			nsamples++;
+		}
+		next.tv_nsec += interval;
+		while (next.tv_nsec >= 1000000000L) {
+			next.tv_nsec -= 1000000000L;
+			next.tv_sec++;
+		}
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+	}
+	core = saved;
+	if (!nsamples)
+		return;
+
+	printf("%zu samples (%.0f Hz per core), %.1f%% user\n", nsamples,
+	       nsamples / ncores / elapsed(&start), 100.0 * nuser / nsamples);
+
+	/* Group identical function/core/mode samples together */
+	qsort(samples, nsamples, sizeof(*samples), sample_cmp);
+
+	if (folded) {
+		f = fopen(folded, "w");
+		if (f == NULL) {
+			fprintf(stderr, "Failed to create '%s': %s\n", folded,
+				strerror(errno));
+			exit(1);
+		}
+		for (i = 0; i < nsamples; i = j) {
+			for (j = i + 1; j < nsamples && !sample_cmp(&samples[i], &samples[j]); j++)
+				;
+			fprintf(f, "core%u;%s;%s %zu\n", samples[i].core,
+				samples[i].user ? "user" : "kernel",
+				location_name(samples[i].name, samples[i].nia, buf, sizeof(buf)),
+				j - i);
+		}
+		fclose(f);
+	}
+
+	prof = calloc(nsamples, sizeof(*prof));
+	if (!prof) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+	nprof = 0;
+	for (i = 0; i < nsamples; i++) {
+		if (!nprof || location_cmp(prof[nprof - 1].name, prof[nprof - 1].nia,
+					   samples[i].name, samples[i].nia)) {
+			prof[nprof].name = samples[i].name;
+			prof[nprof++].nia = samples[i].nia;
+		}
+		prof[nprof - 1].samples++;
+		prof[nprof - 1].user += samples[i].user;
+	}
+	qsort(prof, nprof, sizeof(*prof), profile_entry_cmp);
+	printf("  samples      %%     user  function\n");
+	for (i = 0; i < nprof; i++)
+		printf("%9" PRIu64 " %5.1f%% %8" PRIu64 "  %s\n", prof[i].samples,
+		       100.0 * prof[i].samples / nsamples, prof[i].user,
+		       location_name(prof[i].name, prof[i].nia, buf, sizeof(buf)));
+	free(prof);
+	free(samples);
+}
+
+/* -------------- GDB server -------------- */
+
+/*
+ * GDB remote serial protocol, one client at a time, on the core
+ * selected with -c. Registers are read over the GSPR index/data
+ * interface and cached until the core is resumed; they can't be
+ * written. Memory goes through the wishbone debug master, so it is
+ * physical (the address bits above the wishbone range are ignored).
+ *
+ * Breakpoints can't stop the core before an instruction executes,
+ * so while any are set, continue single-steps the core and compares
+ * the NIA after each step. Without breakpoints, continue just starts
+ * the core and polls for it stopping (attn) or for a ^C from gdb.
+ */
+
+#define GDB_PKT_MAX	4096
+#define GDB_NREGS	71
+#define GDB_REG_PC	64
+#define GDB_REG_MSR	65
+#define GDB_REG_CR	66
+#define GDB_REG_LR	67
+#define GDB_REG_CTR	68
+#define GDB_REG_XER	69
+#define GDB_REG_FPSCR	70
+#define GDB_MAX_BPS	32
+
+static int gdb_fd = -1;
+static bool gdb_noack;
+static uint64_t gdb_regs[GDB_NREGS];
+static bool gdb_regs_valid;
+static uint64_t gdb_bps[GDB_MAX_BPS];
+static int gdb_nbps;
+
+/*
+ * Bytes other than ^C that arrive while the core is running, kept for
+ * gdb_getc so that the packet they belong to isn't lost.
+ */
+#define GDB_PENDING_MAX	4096
+static unsigned char gdb_pending[GDB_PENDING_MAX];
+static unsigned int gdb_pending_head, gdb_pending_len;
+
+static const char hexchars[] = "0123456789abcdef";
+
+static int gdb_getc(void)
+{
+	unsigned char c;
+
+	if (gdb_pending_len) {
+		c = gdb_pending[gdb_pending_head];
+		gdb_pending_head = (gdb_pending_head + 1) % GDB_PENDING_MAX;
+		gdb_pending_len--;
+		return c;
+	}
+	if (read(gdb_fd, &c, 1) != 1)
+		return -1;
+	return c;
+}
+
+/* Put back a byte gdb_getc returned, to be read again first */
+static void gdb_ungetc(int c)
+{
+	if (c < 0 || gdb_pending_len == GDB_PENDING_MAX)
+		return;
+	gdb_pending_head = (gdb_pending_head + GDB_PENDING_MAX - 1) % GDB_PENDING_MAX;
+	gdb_pending[gdb_pending_head] = c;
+	gdb_pending_len++;
+}
+
+static void gdb_write(const char *buf, size_t len)
+{
+	ssize_t rc;
+
+	while (len) {
+		rc = write(gdb_fd, buf, len);
+		if (rc <= 0)
+			return;
+		buf += rc;
+		len -= rc;
+	}
+}
+
+static int hexval(int c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
+/* Returns the packet length, 0 for an interrupt (^C), -1 on disconnect */
+static int gdb_get_packet(char *buf)
+{
+	int c, len, sum, csum;
+
+	for (;;) {
+		do {
+			c = gdb_getc();
+			if (c < 0)
+				return -1;
+			if (c == 0x03)
+				return 0;
+		} while (c != '$');
+		len = 0;
+		sum = 0;
+		while ((c = gdb_getc()) != '#') {
+			if (c < 0)
+				return -1;
+			if (len < GDB_PKT_MAX - 1)
+				buf[len++] = c;
+			sum += c;
+		}
+		buf[len] = 0;
+		csum = hexval(gdb_getc()) << 4;
+		csum |= hexval(gdb_getc());
+		if (gdb_noack)
+			return len;
+		if (csum == (sum & 0xff)) {
+			gdb_write("+", 1);
+			if (debug)
+				printf("gdb> %s\n", buf);
+			return len;
+		}
+		gdb_write("-", 1);
+	}
+}
+
+static void gdb_put_packet(const char *data)
+{
+	static char pkt[GDB_PKT_MAX * 2 + 4];
+	size_t len = strlen(data);
+	unsigned int sum = 0, i;
+	int c;
+
+	pkt[0] = '$';
+	for (i = 0; i < len; i++)
+		sum += (unsigned char)data[i];
+	memcpy(pkt + 1, data, len);
+	pkt[len + 1] = '#';
+	pkt[len + 2] = hexchars[(sum >> 4) & 0xf];
+	pkt[len + 3] = hexchars[sum & 0xf];
+	if (debug)
+		printf("gdb< %s\n", data);
+	do {
+		gdb_write(pkt, len + 4);
+		if (gdb_noack)
+			return;
+		c = gdb_getc();
+		/* The start of the next packet, the ack was lost */
+		if (c == '$' || c == 0x03)
+			gdb_ungetc(c);
+	} while (c == '-');
+}
+
+static int gdb_reg_size(int reg)
+{
+	if (reg == GDB_REG_CR || reg == GDB_REG_XER || reg == GDB_REG_FPSCR)
+		return 4;
+	return 8;
+}
+
+static void gdb_fetch_regs(void)
+{
+	int i;
+
+	if (gdb_regs_valid)
+		return;
+	for (i = 0; i < 32; i++) {
+		gdb_regs[i] = gspr_get(i);
+		gdb_regs[32 + i] = gspr_get(64 + i);
+	}
+	check(dmi_read(DBG_CORE_NIA, &gdb_regs[GDB_REG_PC]), "reading core NIA");
+	check(dmi_read(DBG_CORE_MSR, &gdb_regs[GDB_REG_MSR]), "reading core MSR");
+	gdb_regs[GDB_REG_LR] = gspr_get(32);
+	gdb_regs[GDB_REG_CTR] = gspr_get(33);
+	gdb_regs[GDB_REG_XER] = gspr_get(44);
+	gdb_regs_valid = true;
+}
+
+/* Append a register in target (little-endian) byte order */
+static char *gdb_put_reg(char *p, int reg)
+{
+	int i, n = gdb_reg_size(reg);
+
+	for (i = 0; i < n; i++) {
+		/* CR and FPSCR aren't readable over DMI */
+		if (reg == GDB_REG_CR || reg == GDB_REG_FPSCR) {
+			*p++ = 'x';
+			*p++ = 'x';
+		} else {
+			*p++ = hexchars[(gdb_regs[reg] >> (i * 8 + 4)) & 0xf];
+			*p++ = hexchars[(gdb_regs[reg] >> (i * 8)) & 0xf];
+		}
+	}
+	*p = 0;
+	return p;
+}
+
+static void gdb_target_xml(char *xml, size_t size)
+{
+	size_t n;
+	int i;
+
+	n = snprintf(xml, size, "<?xml version=\"1.0\"?>"
+		     "<!DOCTYPE target SYSTEM \"gdb-target.dtd\">"
+		     "<target version=\"1.0\">"
+		     "<architecture>powerpc:common64</architecture>"
+		     "<feature name=\"org.gnu.gdb.power.core\">");
+	for (i = 0; i < 32; i++)
+		n += snprintf(xml + n, size - n,
+			      "<reg name=\"r%d\" bitsize=\"64\" type=\"uint64\" regnum=\"%d\"/>",
+			      i, i);
+	n += snprintf(xml + n, size - n,
+		      "<reg name=\"pc\" bitsize=\"64\" type=\"code_ptr\" regnum=\"64\"/>"
+		      "<reg name=\"msr\" bitsize=\"64\" type=\"uint64\"/>"
+		      "<reg name=\"cr\" bitsize=\"32\" type=\"uint32\"/>"
+		      "<reg name=\"lr\" bitsize=\"64\" type=\"code_ptr\"/>"
+		      "<reg name=\"ctr\" bitsize=\"64\" type=\"uint64\"/>"
+		      "<reg name=\"xer\" bitsize=\"32\" type=\"uint32\"/>"
+		      "</feature><feature name=\"org.gnu.gdb.power.fpu\">");
+	for (i = 0; i < 32; i++)
+		n += snprintf(xml + n, size - n,
+			      "<reg name=\"f%d\" bitsize=\"64\" type=\"ieee_double\" regnum=\"%d\"/>",
+			      i, 32 + i);
+	snprintf(xml + n, size - n,
+		 "<reg name=\"fpscr\" bitsize=\"32\" group=\"float\" regnum=\"70\"/>"
+		 "</feature></target>");
+}
+
+static void gdb_xfer_features(const char *args, char *out)
+{
+	static char xml[8192];
+	unsigned long off, len, total;
+
+	if (strncmp(args, "target.xml:", 11) != 0) {
+		strcpy(out, "E00");
+		return;
+	}
+	if (sscanf(args + 11, "%lx,%lx", &off, &len) != 2) {
+		strcpy(out, "E01");
+		return;
+	}
+	if (!xml[0])
+		gdb_target_xml(xml, sizeof(xml));
+	total = strlen(xml);
+	if (len > GDB_PKT_MAX - 2)
+		len = GDB_PKT_MAX - 2;
+	if (off >= total) {
+		strcpy(out, "l");
+		return;
+	}
+	if (len > total - off)
+		len = total - off;
+	out[0] = (off + len < total) ? 'm' : 'l';
+	memcpy(out + 1, xml + off, len);
+	out[len + 1] = 0;
+}
+
+static void gdb_mem_read(uint64_t addr, uint64_t len, char *out)
+{
+	uint64_t start = addr & ~7ull, a, data = 0;
+	int byte;
+
+	check(dmi_write(DBG_WB_CTRL, 0x7ff), "writing WB_CTRL");
+	check(dmi_write(DBG_WB_ADDR, start), "writing WB_ADDR");
+	for (a = start; a < addr + len; a++) {
+		if (!(a & 7))
+			check(dmi_read(DBG_WB_DATA, &data), "reading WB_DATA");
+		if (a < addr)
+			continue;
+		byte = (data >> ((a & 7) * 8)) & 0xff;
+		*out++ = hexchars[byte >> 4];
+		*out++ = hexchars[byte & 0xf];
+	}
+	*out = 0;
+}
+
+/* Write bytes using the byte selects for partial doublewords */
+static void gdb_mem_write(uint64_t addr, const uint8_t *buf, uint64_t len)
+{
+	uint64_t data;
+	unsigned int sel;
+	int i;
+
+	while (len) {
+		data = 0;
+		sel = 0;
+		for (i = addr & 7; i < 8 && len; i++, len--) {
+			data |= (uint64_t)*buf++ << (i * 8);
+			sel |= 1 << i;
+		}
+		check(dmi_write(DBG_WB_CTRL, sel), "writing WB_CTRL");
+		check(dmi_write(DBG_WB_ADDR, addr & ~7ull), "writing WB_ADDR");
+		check(dmi_write(DBG_WB_DATA, data), "writing WB_DATA");
+		addr = (addr & ~7ull) + 8;
+	}
+}
+
+static bool core_is_stopped(void)
+{
+	uint64_t stat;
+
+	check(dmi_read(DBG_CORE_STAT, &stat), "reading core status");
+	return (stat & DBG_CORE_STAT_STOPPED) != 0;
+}
+
+static void gdb_halt(void)
+{
+	int i;
+
+	gdb_regs_valid = false;
+	core_stop();
+	for (i = 0; i < 1000; i++)
+		if (core_is_stopped())
+			return;
+	fprintf(stderr, "Core doesn't stop !\n");
+}
+
+static bool gdb_at_bp(void)
+{
+	uint64_t nia;
+	int i;
+
+	check(dmi_read(DBG_CORE_NIA, &nia), "reading core NIA");
+	for (i = 0; i < gdb_nbps; i++)
+		if (gdb_bps[i] == nia)
+			return true;
+	return false;
+}
+
+static bool gdb_interrupted(int timeout)
+{
+	struct pollfd pfd = { .fd = gdb_fd, .events = POLLIN };
+	unsigned char c;
+
+	/* Leave anything that doesn't fit for when the core stops */
+	if (gdb_pending_len == GDB_PENDING_MAX)
+		return false;
+	if (poll(&pfd, 1, timeout) <= 0)
+		return false;
+	if (read(gdb_fd, &c, 1) != 1)
+		return false;
+	if (c == 0x03)
+		return true;
+	gdb_pending[(gdb_pending_head + gdb_pending_len) % GDB_PENDING_MAX] = c;
+	gdb_pending_len++;
+	return false;
+}
+
+/* Resume the core until it stops by itself, hits a breakpoint or gdb interrupts */
+static const char *gdb_continue(void)
+{
+	unsigned int n;
+
+	gdb_regs_valid = false;
+	if (gdb_nbps) {
+		for (n = 1; ; n++) {
+			check(dmi_write(DBG_CORE_CTRL, DBG_CORE_CTRL_STEP), "stepping core");
+			if (gdb_at_bp())
+				return "S05";
+			if (!(n % 256) && gdb_interrupted(0))
+				return "S02";
+		}
+	}
+	core_start();
+	for (;;) {
+		if (gdb_interrupted(100)) {
+			gdb_halt();
+			return "S02";
+		}
+		if (core_is_stopped())
+			return "S05";
+	}
+}
+
+static void gdb_bp(bool insert, const char *args, char *out)
+{
+	unsigned int type;
+	uint64_t addr;
+	int i;
+
+	if (sscanf(args, "%x,%" SCNx64, &type, &addr) != 2 || type > 1) {
+		out[0] = 0;
+		return;
+	}
+	for (i = 0; i < gdb_nbps; i++)
+		if (gdb_bps[i] == addr)
+			break;
+	if (insert && i == gdb_nbps) {
+		if (gdb_nbps == GDB_MAX_BPS) {
+			strcpy(out, "E01");
+			return;
+		}
+		gdb_bps[gdb_nbps++] = addr;
+	} else if (!insert && i < gdb_nbps) {
+		gdb_bps[i] = gdb_bps[--gdb_nbps];
+	}
+	strcpy(out, "OK");
+}
+
+static void gdb_session(void)
+{
+	static char in[GDB_PKT_MAX], out[GDB_PKT_MAX * 2];
+	static uint8_t bin[GDB_PKT_MAX];
+	uint64_t addr, len, i;
+	char *p;
+	int n, reg;
+
+	gdb_noack = false;
+	gdb_nbps = 0;
+	gdb_halt();
+
+	for (;;) {
+		n = gdb_get_packet(in);
+		if (n < 0)
+			return;
+		if (n == 0) {
+			/* ^C while the core is already stopped */
+			gdb_halt();
+			gdb_put_packet("S02");
+			continue;
+		}
+		out[0] = 0;
+		switch (in[0]) {
+		case '?':
+			strcpy(out, "S05");
+			break;
+		case 'g':
+			gdb_fetch_regs();
+			p = out;
+			for (reg = 0; reg < GDB_NREGS; reg++)
+				p = gdb_put_reg(p, reg);
+			break;
+		case 'p':
+			reg = strtoul(in + 1, NULL, 16);
+			if (reg >= GDB_NREGS) {
+				strcpy(out, "E01");
+				break;
+			}
+			gdb_fetch_regs();
+			gdb_put_reg(out, reg);
+			break;
+		case 'G':
+		case 'P':
+			/* The debug interface can't write registers */
+			strcpy(out, "E01");
+			break;
+		case 'm':
+			if (sscanf(in + 1, "%" SCNx64 ",%" SCNx64, &addr, &len) != 2 ||
+			    len > GDB_PKT_MAX / 2 - 1) {
+				strcpy(out, "E01");
+				break;
+			}
+			gdb_mem_read(addr, len, out);
+			break;
+		case 'M':
+			p = strchr(in, ':');
+			if (!p || sscanf(in + 1, "%" SCNx64 ",%" SCNx64, &addr, &len) != 2 ||
+			    strlen(p + 1) < len * 2) {
+				strcpy(out, "E01");
+				break;
+			}
+			for (i = 0; i < len; i++)
+				bin[i] = (hexval(p[1 + i * 2]) << 4) | hexval(p[2 + i * 2]);
+			gdb_mem_write(addr, bin, len);
+			strcpy(out, "OK");
+			break;
+		case 'c':
+			strcpy(out, gdb_continue());
+			break;
+		case 's':
+			gdb_regs_valid = false;
+			check(dmi_write(DBG_CORE_CTRL, DBG_CORE_CTRL_STEP), "stepping core");
+			strcpy(out, "S05");
+			break;
+		case 'Z':
+		case 'z':
+			gdb_bp(in[0] == 'Z', in + 1, out);
+			break;
+		case 'H':
+		case 'T':
+			strcpy(out, "OK");
+			break;
+		case 'D':
+			gdb_put_packet("OK");
+			core_start();
+			return;
+		case 'k':
+			return;
+		case 'q':
+			if (strncmp(in, "qSupported", 10) == 0)
+				snprintf(out, sizeof(out), "PacketSize=%x;qXfer:features:read+;"
+					 "QStartNoAckMode+", GDB_PKT_MAX);
+			else if (strncmp(in, "qXfer:features:read:", 20) == 0)
+				gdb_xfer_features(in + 20, out);
+			else if (strcmp(in, "qAttached") == 0)
+				strcpy(out, "1");
+			else if (strcmp(in, "qC") == 0)
+				strcpy(out, "QC1");
+			else if (strcmp(in, "qfThreadInfo") == 0)
+				strcpy(out, "m1");
+			else if (strcmp(in, "qsThreadInfo") == 0)
+				strcpy(out, "l");
+			else if (strncmp(in, "qSymbol", 7) == 0)
+				strcpy(out, "OK");
+			break;
+		case 'Q':
+			if (strcmp(in, "QStartNoAckMode") == 0) {
+				gdb_put_packet("OK");
+				gdb_noack = true;
+				continue;
+			}
+			break;
+		}
+		gdb_put_packet(out);
+	}
+}
+
+static void gdb_server(int port)
+{
+	struct sockaddr_in addr;
+	int fd, opt = 1;
+
+	signal(SIGPIPE, SIG_IGN);
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0) {
+		fprintf(stderr, "Error opening socket: %s\n", strerror(errno));
+		exit(1);
+	}
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 1) < 0) {
+		fprintf(stderr, "Failed to listen on port %d: %s\n", port, strerror(errno));
+		exit(1);
+	}
+	printf("Core%u: waiting for gdb on port %d\n", core, port);
+	gdb_fd = accept(fd, NULL, NULL);
+	close(fd);
+	if (gdb_fd < 0) {
+		fprintf(stderr, "Failed to accept: %s\n", strerror(errno));
+		exit(1);
+	}
+	setsockopt(gdb_fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+	printf("gdb connected\n");
+	gdb_pending_len = 0;
+	gdb_session();
+	close(gdb_fd);
+	gdb_fd = -1;
+	printf("gdb disconnected\n");
+}
+
 static void usage(const char *cmd)
 {
-	fprintf(stderr, "Usage: %s -b <jtag|ecp5|sim> [-c core#] <command> <args>\n", cmd);
+	fprintf(stderr, "Usage: %s -b <jtag|ecp5|sim> [-c cores] [-r reset] <command> <args>\n", cmd);
+	fprintf(stderr, "\n");
+	fprintf(stderr, " reset is the hex address the core starts at after a reset\n");
+	fprintf(stderr, " (default 0), used by load ... entry.\n");
+	fprintf(stderr, "\n");
+	fprintf(stderr, " cores is a core number, a list like 0,2-3, or all. Core\n");
+	fprintf(stderr, " control, status and gpr act on every core given (at once\n");
+	fprintf(stderr, " where the SoC supports it), other commands on the first.\n");
 
 	fprintf(stderr, "\n");
 	fprintf(stderr, " CPU core:\n");
@@ -808,8 +2509,16 @@ static void usage(const char *cmd)
 	fprintf(stderr, " Memory:\n");
 	fprintf(stderr, "  mr <hex addr> [count]\n");
 	fprintf(stderr, "  mw <hex addr> <hex value>\n");
-	fprintf(stderr, "  load <file> [addr]		If omitted address is 0\n");
+	fprintf(stderr, "  load <file> [addr] [entry] [verify]\n");
+	fprintf(stderr, "				Raw binary or ELF, addr defaults to 0\n");
+	fprintf(stderr, "				(an offset for ELF). entry: reset into\n");
+	fprintf(stderr, "				the ELF entry point, via a trampoline\n");
+	fprintf(stderr, "				at the reset address (-r). verify:\n");
+	fprintf(stderr, "				check a CRC of the loaded image\n");
 	fprintf(stderr, "  save <file> <addr> <size>\n");
+	fprintf(stderr, "  fill <addr> <size> [value] [verify]\n");
+	fprintf(stderr, "  crc <addr> <size>		CRC-32 of target memory\n");
+	fprintf(stderr, "  compare <file> <addr> [chunk]	compare memory with a file\n");
 
 	fprintf(stderr, "\n");
 	fprintf(stderr, " Registers:\n");
@@ -821,6 +2530,8 @@ static void usage(const char *cmd)
 	fprintf(stderr, "  lstart			start logging\n");
 	fprintf(stderr, "  lstop			stop logging\n");
 	fprintf(stderr, "  ldump <file>			dump log to file\n");
+	fprintf(stderr, "  lstream <file|-> [passes]	capture and decode the log repeatedly\n");
+	fprintf(stderr, "				(until ^C), once per trigger if armed\n");
 	fprintf(stderr, "  ltrig 			show logging stop trigger status\n");
 	fprintf(stderr, "  ltrig off 			clear logging stop trigger address\n");
 	fprintf(stderr, "  ltrig <addr>			set logging stop trigger address\n");
@@ -828,6 +2539,12 @@ static void usage(const char *cmd)
 	fprintf(stderr, "  mtrig off 			clear logging stop trigger address\n");
 	fprintf(stderr, "  mtrig <addr>			set logging stop trigger address\n");
 
+	fprintf(stderr, "\n");
+	fprintf(stderr, " Debugging:\n");
+	fprintf(stderr, "  gdbserver [port]		serve gdb on localhost (default 1234)\n");
+	fprintf(stderr, "  profile <elf|-> <secs> [hz] [folded <file>]\n");
+	fprintf(stderr, "				sample NIA of all cores (default 1000 Hz)\n");
+
 	fprintf(stderr, "\n");
 	fprintf(stderr, " JTAG:\n");
 	fprintf(stderr, "  dmiread <hex addr>\n");
@@ -854,16 +2571,16 @@ int main(int argc, char *argv[])
 			{ "debug",	no_argument,       0, 'd' },
 			{ "frequency",	no_argument,       0, 's' },
 			{ "core",	required_argument, 0, 'c' },
+			{ "reset",	required_argument, 0, 'r' },
 			{ 0, 0, 0, 0 }
 		};
-		c = getopt_long(argc, argv, "dhb:t:s:c:", lopts, &oindex);
+		c = getopt_long(argc, argv, "dhb:t:s:c:r:", lopts, &oindex);
 		if (c < 0)
 			break;
 		switch(c) {
 		case 'c':
-			core = atoi(optarg);
-			if (core >= 15) {
-				fprintf(stderr, "Core number out of range (max 14)\n");
+			if (!parse_cores(optarg)) {
+				fprintf(stderr, "Bad core list %s (max core 14)\n", optarg);
 				exit(1);
 			}
 			break;
@@ -885,6 +2602,13 @@ int main(int argc, char *argv[])
 		case 't':
 			target = optarg;
 			break;
+		case 'r':
+			reset_vector = strtoull(optarg, NULL, 16);
+			if (reset_vector & 3) {
+				fprintf(stderr, "Bad reset address %s\n", optarg);
+				exit(1);
+			}
+			break;
 		case 's':
 			freq = atoi(optarg);
 			if (freq == 0) {
@@ -903,6 +2627,7 @@ int main(int argc, char *argv[])
 	rc = b->init(target, freq);
 	if (rc < 0)
 		exit(1);
+	setup_cores();
 	for (i = optind; i < argc; i++) {
 		if (strcmp(argv[i], "dmiread") == 0) {
 			uint8_t  addr;
@@ -923,15 +2648,30 @@ int main(int argc, char *argv[])
 			data = strtoul(argv[++i], NULL, 16);
 			dmi_write(addr, data);
 		} else if (strcmp(argv[i], "creset") == 0) {
-			core_reset();
+			if (multi_core())
+				cores_ctrl(DBG_CORE_CTRL_RESET, "resetting cores");
+			else
+				core_reset();
 		} else if (strcmp(argv[i], "icreset") == 0) {
-			icache_reset();
+			if (multi_core())
+				cores_ctrl(DBG_CORE_CTRL_ICRESET, "resetting icaches");
+			else
+				icache_reset();
 		} else if (strcmp(argv[i], "stop") == 0) {
-			core_stop();
+			if (multi_core())
+				cores_ctrl(DBG_CORE_CTRL_STOP, "stopping cores");
+			else
+				core_stop();
 		} else if (strcmp(argv[i], "start") == 0) {
-			core_start();
+			if (multi_core())
+				cores_ctrl(DBG_CORE_CTRL_START, "starting cores");
+			else
+				core_start();
 		} else if (strcmp(argv[i], "step") == 0) {
-			core_step();
+			if (multi_core())
+				cores_step();
+			else
+				core_step();
 		} else if (strcmp(argv[i], "quit") == 0) {
 			dmi_write(0xff, 0);
 		} else if (strcmp(argv[i], "status") == 0) {
@@ -956,13 +2696,23 @@ int main(int argc, char *argv[])
 		} else if (strcmp(argv[i], "load") == 0) {
 			const char *filename;
 			uint64_t addr = 0;
+			bool entry = false, verify = false, have_addr = false;
 
 			if ((i+1) >= argc)
 				usage(argv[0]);
 			filename = argv[++i];
-			if (((i+1) < argc) && isxdigit(argv[i+1][0]))
-				addr = strtoul(argv[++i], NULL, 16);
-			load(filename, addr);
+			for (; (i+1) < argc; i++) {
+				if (strcmp(argv[i+1], "entry") == 0)
+					entry = true;
+				else if (strcmp(argv[i+1], "verify") == 0)
+					verify = true;
+				else if (!have_addr && isxdigit(argv[i+1][0])) {
+					addr = strtoul(argv[i+1], NULL, 16);
+					have_addr = true;
+				} else
+					break;
+			}
+			load(filename, addr, entry, verify);
 		} else if (strcmp(argv[i], "save") == 0) {
 			const char *filename;
 			uint64_t addr, size;
@@ -973,6 +2723,42 @@ int main(int argc, char *argv[])
 			addr = strtoul(argv[++i], NULL, 16);
 			size = strtoul(argv[++i], NULL, 16);
 			save(filename, addr, size);
+		} else if (strcmp(argv[i], "fill") == 0) {
+			uint64_t addr, size, value = 0;
+			bool verify = false;
+
+			if ((i+2) >= argc)
+				usage(argv[0]);
+			addr = strtoul(argv[++i], NULL, 16);
+			size = strtoul(argv[++i], NULL, 16);
+			if (((i+1) < argc) && is_hex(argv[i+1]))
+				value = strtoull(argv[++i], NULL, 16);
+			if (((i+1) < argc) && strcmp(argv[i+1], "verify") == 0) {
+				verify = true;
+				i++;
+			}
+			mem_fill(addr, size, value, verify);
+		} else if (strcmp(argv[i], "crc") == 0) {
+			uint64_t addr, size;
+
+			if ((i+2) >= argc)
+				usage(argv[0]);
+			addr = strtoul(argv[++i], NULL, 16);
+			size = strtoul(argv[++i], NULL, 16);
+			mem_crc(addr, size);
+		} else if (strcmp(argv[i], "compare") == 0) {
+			const char *filename;
+			uint64_t addr, chunk = CMP_CHUNK;
+
+			if ((i+2) >= argc)
+				usage(argv[0]);
+			filename = argv[++i];
+			addr = strtoul(argv[++i], NULL, 16);
+			if (((i+1) < argc) && is_hex(argv[i+1]))
+				chunk = strtoul(argv[++i], NULL, 16);
+			if (!chunk)
+				usage(argv[0]);
+			compare(filename, addr, chunk);
 		} else if (strcmp(argv[i], "gpr") == 0) {
 			uint64_t reg, count = 1;
 
@@ -981,7 +2767,10 @@ int main(int argc, char *argv[])
 			reg = strtoul(argv[++i], NULL, 10);
 			if (((i+1) < argc) && isdigit(argv[i+1][0]))
 				count = strtoul(argv[++i], NULL, 10);
-			gpr_read(reg, count);
+			if (multi_core())
+				cores_gpr_read(reg, count);
+			else
+				gpr_read(reg, count);
 		} else if (strcmp(argv[i], "lstart") == 0) {
 			log_start();
 		} else if (strcmp(argv[i], "lstop") == 0) {
@@ -993,6 +2782,42 @@ int main(int argc, char *argv[])
 				usage(argv[0]);
 			filename = argv[++i];
 			log_dump(filename);
+		} else if (strcmp(argv[i], "gdbserver") == 0) {
+			int port = 1234;
+
+			if (((i+1) < argc) && isdigit(argv[i+1][0]))
+				port = strtoul(argv[++i], NULL, 10);
+			gdb_server(port);
+		} else if (strcmp(argv[i], "profile") == 0) {
+			const char *elf, *folded = NULL;
+			unsigned int hz = 1000;
+			double secs;
+
+			if ((i+2) >= argc)
+				usage(argv[0]);
+			elf = argv[++i];
+			if (strcmp(elf, "-") == 0)
+				elf = NULL;
+			secs = strtod(argv[++i], NULL);
+			if (((i+1) < argc) && isdigit(argv[i+1][0]))
+				hz = strtoul(argv[++i], NULL, 10);
+			if (((i+2) < argc) && strcmp(argv[i+1], "folded") == 0) {
+				folded = argv[i+2];
+				i += 2;
+			}
+			if (!hz || secs <= 0)
+				usage(argv[0]);
+			profile(elf, secs, hz, folded);
+		} else if (strcmp(argv[i], "lstream") == 0) {
+			const char *filename;
+			unsigned long passes = 0;
+
+			if ((i+1) >= argc)
+				usage(argv[0]);
+			filename = argv[++i];
+			if (((i+1) < argc) && isdigit(argv[i+1][0]))
+				passes = strtoul(argv[++i], NULL, 10);
+			log_stream(filename, passes);
 		} else if (strcmp(argv[i], "ltrig") == 0) {
 			uint64_t addr;
 
@@ -1020,6 +2845,9 @@ int main(int argc, char *argv[])
 			usage(argv[0]);
 		}
 	}
-	core_status();
+	if (multi_core())
+		cores_status();
+	else
+		core_status();
 	return 0;
 }
@@ -23,7 +23,7 @@ cd $TMPDIR
 
 cp ${MICROWATT_DIR}/tests/${TEST}.bin main_ram.bin
 
-${MICROWATT_DIR}/core_tb > console.out 2> test1.out || true
+${MICROWATT_DIR}/core_tb ${CORE_TB_ARGS} > console.out 2> test1.out || true
 
 # check metavalues aren't increasing
 COUNT=$(grep -c 'metavalue' console.out)
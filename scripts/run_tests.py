@@ -0,0 +1,386 @@
+#!/usr/bin/python3
+#
+# Run the tests in tests/ on a pool of core_batch_tb simulators, one per
+# CPU by default. Each simulator stays up and loads one test image after
+# another (see core_batch_tb.vhdl), so we don't pay for simulator start
+# up on every test. There are two kinds of test:
+#
+#  - register dump tests (N.bin and N.out), checked as run_test.sh does
+#  - console tests (test_x.bin, test_x.console_out and test_x.metavalue),
+#    checked as run_test_console.sh does
+#
+# The tests are run back to back on a core that is only reset between
+# them, so they must initialise everything they dump (GPRs, CR, XER,
+# LR and CTR), as the random execution tests do.
+#
+# Along with the registers, the core dumps performance counts (cycles,
+# instructions and a few PMU events) since reset. These are compared
+# against a baseline, and tests whose cycle count went up by more than
+# the tolerance are reported as performance regressions. Results,
+# including the counts and wall times, can be written out as JUnit XML
+# and/or JSON.
+#
+# CORE_TB_ARGS is passed to each simulator, as run_test.sh passes it to
+# core_tb, so optional features of the core can be turned on with
+# generics, e.g. CORE_TB_ARGS=-gHAS_RAS=true.
+
+import argparse
+import json
+import os
+import queue
+import re
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+import xml.etree.ElementTree as ET
+
+DUMP = re.compile(r'(GPR[0-9]|LR |CTR |XER |CR [0-9])')
+
+
+class SimError(Exception):
+    pass
+
+
+def read_lines(filename):
+    with open(filename) as f:
+        return f.read().splitlines()
+
+
+def expected(tests_dir, test):
+    return sorted(l for l in read_lines(os.path.join(tests_dir, test + '.out'))
+                  if l.strip() and 'GPR31' not in l)
+
+
+class Output:
+    """What the simulator said while running one test"""
+    def __init__(self):
+        self.status = None
+        self.cycles = 0
+        self.dump = []
+        self.perf = {}
+        self.metavalues = 0
+        self.console = b''
+
+
+class Worker:
+    def __init__(self, sim, sim_args, max_cycles):
+        self.sim = sim
+        self.sim_args = sim_args
+        self.max_cycles = max_cycles
+        self.proc = None
+        self.start()
+
+    def start(self):
+        self.dir = tempfile.TemporaryDirectory(prefix='microwatt-')
+        # The images are loaded by name, main_ram.bin just has to exist
+        open(os.path.join(self.dir.name, 'main_ram.bin'), 'wb').close()
+        cmd_file = os.path.join(self.dir.name, 'batch.cmd')
+        os.mkfifo(cmd_file)
+        # Open read/write so we don't block waiting for the simulator
+        self.cmds = os.fdopen(os.open(cmd_file, os.O_RDWR), 'w')
+        # The console goes to stderr, read back from here after each test
+        self.stderr = open(os.path.join(self.dir.name, 'stderr'), 'w+b')
+        self.console_pos = 0
+        # The console polls stdin, give it a pipe that never has data
+        self.proc = subprocess.Popen(
+            [self.sim, '-gMAX_CYCLES=%d' % self.max_cycles] + self.sim_args,
+            cwd=self.dir.name, stdin=subprocess.PIPE,
+            stdout=subprocess.PIPE, stderr=self.stderr)
+
+    def stop(self):
+        if self.proc:
+            self.cmds.close()
+            self.proc.kill()
+            self.proc.wait()
+            self.proc.stdout.close()
+            self.proc.stdin.close()
+            self.stderr.close()
+            self.dir.cleanup()
+            self.proc = None
+
+    def console(self):
+        self.stderr.seek(self.console_pos)
+        data = self.stderr.read()
+        self.console_pos += len(data)
+        return data
+
+    def error(self):
+        lines = self.console().decode('utf-8', 'replace').splitlines()
+        return '\n'.join(['simulator exited'] + lines[-5:])
+
+    def run(self, image):
+        """Run one image, returning an Output"""
+        if not self.proc:
+            self.start()
+        self.console()
+        self.cmds.write(image + '\n')
+        self.cmds.flush()
+        out = Output()
+        for line in self.proc.stdout:
+            # Strip the report prefix, as run_test.sh does
+            line = line.decode('utf-8', 'replace').rstrip('\n')
+            if 'metavalue' in line:
+                out.metavalues += 1
+            line = line.rsplit(': ', 1)[-1]
+            if line.startswith('BATCH '):
+                out.status, cycles = line.split()[1:3]
+                out.cycles = out.perf.get('cycles', int(cycles))
+                out.dump.sort()
+                out.console = self.console()
+                return out
+            if line.startswith('PERF '):
+                name, value = line.split()[1:3]
+                out.perf[name] = int(value)
+            elif DUMP.match(line) and 'GPR31' not in line:
+                out.dump.append(line)
+        msg = self.error()
+        self.stop()
+        raise SimError(msg)
+
+
+def check_registers(tests_dir, test, out):
+    exp = expected(tests_dir, test)
+    if out.dump == exp:
+        return None
+    return '\n'.join(['-' + l for l in exp if l not in out.dump] +
+                     ['+' + l for l in out.dump if l not in exp])
+
+
+def lines(data):
+    # Split into lines the way grep sees them, \r and all
+    l = data.split(b'\n')
+    if l[-1] == b'':
+        l.pop()
+    return l
+
+
+def check_console(tests_dir, test, out):
+    base = os.path.join(tests_dir, test)
+    with open(base + '.metavalue') as f:
+        max_metavalues = int(f.read())
+    if out.metavalues > max_metavalues:
+        return 'metavalues increased from %d to %d' % (max_metavalues,
+                                                       out.metavalues)
+    console = [l for l in lines(out.console)
+               if b'Failed to bind debug socket' not in l]
+    with open(base + '.console_out', 'rb') as f:
+        exp = lines(f.read())
+    if console == exp:
+        return None
+    return 'console output differs'
+
+
+class Runner:
+    def __init__(self, args):
+        self.args = args
+        self.todo = queue.Queue()
+        self.results = []
+        self.lock = threading.Lock()
+
+    def report(self, result):
+        with self.lock:
+            self.results.append(result)
+            if result['status'] == 'pass':
+                print('%s PASS' % result['name'])
+            else:
+                print('%s FAIL ******** %s' % (result['name'],
+                                               result['status']))
+            sys.stdout.flush()
+
+    def run_one(self, w, test):
+        tests_dir = self.args.tests_dir
+        result = {'name': test, 'cycles': None}
+        start = time.monotonic()
+        try:
+            out = w.run(os.path.join(tests_dir, test + '.bin'))
+            result['cycles'] = out.cycles
+            if out.perf:
+                result['perf'] = out.perf
+            if out.status == 'TIMEOUT':
+                result['status'] = 'timeout'
+                result['message'] = 'no result after %d cycles' % out.cycles
+            else:
+                if os.path.exists(os.path.join(tests_dir, test + '.console_out')):
+                    msg = check_console(tests_dir, test, out)
+                else:
+                    msg = check_registers(tests_dir, test, out)
+                result['status'] = 'fail' if msg else 'pass'
+                if msg:
+                    result['message'] = msg
+        except SimError as e:
+            result['status'] = 'error'
+            result['message'] = str(e)
+        result['wall'] = round(time.monotonic() - start, 3)
+        return result
+
+    def worker(self):
+        w = Worker(self.args.sim, self.args.sim_args, self.args.max_cycles)
+        try:
+            while True:
+                try:
+                    test = self.todo.get_nowait()
+                except queue.Empty:
+                    return
+                self.report(self.run_one(w, test))
+        finally:
+            w.stop()
+
+    def run(self, tests):
+        for t in tests:
+            self.todo.put(t)
+        start = time.monotonic()
+        threads = [threading.Thread(target=self.worker)
+                   for i in range(min(self.args.jobs, len(tests)))]
+        for t in threads:
+            t.start()
+        for t in threads:
+            t.join()
+        self.wall = time.monotonic() - start
+        order = {t: i for i, t in enumerate(tests)}
+        self.results.sort(key=lambda r: order[r['name']])
+
+
+def compare_baseline(results, baseline, tolerance):
+    """Print tests whose cycle counts went up, returning how many did"""
+    regressed = []
+    improved = 0
+    compared = 0
+    missing = 0
+    old_total = new_total = 0
+    for r in results:
+        if r['status'] != 'pass' or 'perf' not in r:
+            continue
+        base = baseline.get(r['name'])
+        if not base:
+            missing += 1
+            continue
+        old, new = base['cycles'], r['perf']['cycles']
+        compared += 1
+        old_total += old
+        new_total += new
+        change = 100.0 * (new - old) / old if old else 0.0
+        if change > tolerance:
+            regressed.append((change, r, base))
+        elif change < -tolerance:
+            improved += 1
+
+    if not old_total:
+        print('No performance baseline to compare against')
+        return 0
+    print('Cycles %d -> %d (%+.2f%%) over %d tests, %d improved by more than %.1f%%'
+          % (old_total, new_total, 100.0 * (new_total - old_total) / old_total,
+             compared, improved, tolerance))
+    if missing:
+        print('%d tests have no baseline' % missing)
+    if regressed:
+        print('%d tests regressed by more than %.1f%%:' % (len(regressed), tolerance))
+        regressed.sort(key=lambda x: -x[0])
+        for change, r, base in regressed:
+            events = ['%s %d -> %d' % (k, base[k], v)
+                      for k, v in r['perf'].items()
+                      if k != 'cycles' and k in base and base[k] != v]
+            print('  %-16s %10d -> %10d  %+6.1f%%  %s'
+                  % (r['name'], base['cycles'], r['perf']['cycles'],
+                     change, ', '.join(events)))
+    return len(regressed)
+
+
+def load_baseline(filename):
+    if not os.path.exists(filename):
+        return {}
+    with open(filename) as f:
+        return json.load(f)
+
+
+def update_baseline(filename, results):
+    baseline = load_baseline(filename)
+    for r in results:
+        if r['status'] == 'pass' and 'perf' in r:
+            baseline[r['name']] = r['perf']
+    with open(filename, 'w') as f:
+        json.dump(baseline, f, indent=1, sort_keys=True)
+        f.write('\n')
+
+
+def write_junit(filename, results, wall):
+    failed = [r for r in results if r['status'] in ('fail', 'timeout')]
+    errors = [r for r in results if r['status'] == 'error']
+    suite = ET.Element('testsuite', name='microwatt', tests=str(len(results)),
+                       failures=str(len(failed)), errors=str(len(errors)),
+                       time='%.3f' % wall)
+    for r in results:
+        case = ET.SubElement(suite, 'testcase', classname='tests',
+                             name=r['name'], time='%.3f' % r['wall'])
+        if r['status'] in ('fail', 'timeout'):
+            ET.SubElement(case, 'failure', message=r['status']).text = r['message']
+        elif r['status'] == 'error':
+            ET.SubElement(case, 'error', message='simulator error').text = r['message']
+        if 'perf' in r:
+            ET.SubElement(case, 'system-out').text = '\n'.join(
+                '%s: %d' % (k, v) for k, v in r['perf'].items())
+        elif r['cycles'] is not None:
+            ET.SubElement(case, 'system-out').text = 'cycles: %d' % r['cycles']
+    ET.ElementTree(suite).write(filename, encoding='utf-8', xml_declaration=True)
+
+
+def write_json(filename, results, wall):
+    with open(filename, 'w') as f:
+        json.dump({'wall': round(wall, 3), 'tests': results}, f, indent=1)
+        f.write('\n')
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Run tests/*.bin on a pool of persistent simulators')
+    parser.add_argument('tests', nargs='*',
+                        help='tests to run (default: all with a .out or .console_out file)')
+    parser.add_argument('-j', '--jobs', type=int, default=os.cpu_count(),
+                        help='number of simulators (default: one per CPU)')
+    parser.add_argument('--sim', default='./core_batch_tb',
+                        help='batch simulator (default: %(default)s)')
+    parser.add_argument('--tests-dir', default='tests',
+                        help='test directory (default: %(default)s)')
+    parser.add_argument('--max-cycles', type=int, default=10000000,
+                        help='cycles before a test times out (default: %(default)s)')
+    parser.add_argument('--junit', help='write JUnit XML results to this file')
+    parser.add_argument('--json', help='write JSON results to this file')
+    parser.add_argument('--baseline', default='tests/perf_baseline.json',
+                        help='performance baseline (default: %(default)s)')
+    parser.add_argument('--tolerance', type=float, default=2.0,
+                        help='cycle count increase allowed, in percent (default: %(default)s)')
+    parser.add_argument('--update-baseline', action='store_true',
+                        help='record the counts of passing tests as the new baseline')
+    args = parser.parse_args()
+    args.sim = os.path.abspath(args.sim)
+    args.sim_args = os.environ.get('CORE_TB_ARGS', '').split()
+    args.tests_dir = os.path.abspath(args.tests_dir)
+
+    tests = args.tests
+    if not tests:
+        tests = sorted(os.path.splitext(f)[0] for f in os.listdir(args.tests_dir)
+                       if f.endswith('.out') or f.endswith('.console_out'))
+    if args.jobs < 1 or not tests:
+        parser.error('nothing to run')
+
+    runner = Runner(args)
+    runner.run(tests)
+    if args.junit:
+        write_junit(args.junit, runner.results, runner.wall)
+    if args.json:
+        write_json(args.json, runner.results, runner.wall)
+
+    passed = sum(r['status'] == 'pass' for r in runner.results)
+    print('%d/%d tests passed in %.1fs' % (passed, len(runner.results), runner.wall))
+    if args.update_baseline:
+        update_baseline(args.baseline, runner.results)
+        regressed = 0
+    else:
+        regressed = compare_baseline(runner.results, load_baseline(args.baseline),
+                                     args.tolerance)
+    sys.exit(0 if passed == len(runner.results) and not regressed else 1)
+
+
+if __name__ == '__main__':
+    main()
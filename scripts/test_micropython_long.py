@@ -15,7 +15,7 @@ os.chdir(tempdir.name)
 copyfile(os.path.join(cwd, 'micropython/firmware.bin'),
         os.path.join(tempdir.name, 'main_ram.bin'))
 
-cmd = [ os.path.join(cwd, './core_tb') ]
+cmd = [ os.path.join(cwd, './core_tb') ] + os.environ.get('CORE_TB_ARGS', '').split()
 
 devNull = open(os.devnull, 'w')
 p = subprocess.Popen(cmd, stdout=devNull,
@@ -224,15 +224,18 @@ begin
         variable dp       : std_ulogic;
         variable poll_cnt : natural;
         variable sim_tmp  : std_ulogic_vector(63 downto 0);
+        variable cycle    : unsigned(63 downto 0);
     begin
         if rising_edge(clk) then
             if rst = '0' then
+                cycle := cycle + 1;
                 dp := data_in_pending;
                 if dlab = '0' and reg_idx = REG_IDX_RXTX then
                     if reg_write = '1' then
                         -- FIFO write
                         -- XXX Simulate the FIFO and delays for more
                         -- accurate behaviour & interrupts
+                        sim_console_cycle(std_ulogic_vector(cycle));
                         sim_console_write(x"00000000000000" & wb_dat_i);
                     end if;
                     if reg_read = '1' then
@@ -247,12 +250,15 @@ begin
                     poll_cnt := POLL_DELAY;
                     if dp = '0' and sim_tmp(0) = '1' then
                         dp := '1';
+                        sim_console_cycle(std_ulogic_vector(cycle));
                         sim_console_read(sim_tmp);
                         data_out <= sim_tmp(7 downto 0);
                     end if;
                     poll_cnt := poll_cnt - 1;
                 end if;
                 data_in_pending <= dp;
+            else
+                cycle := (others => '0');
             end if;
         end if;
     end process;
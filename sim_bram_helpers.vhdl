@@ -10,6 +10,9 @@ package sim_bram_helpers is
 
     procedure behavioural_write (val: std_ulogic_vector(63 downto 0); addr: std_ulogic_vector(63 downto 0); length: integer; identifier: integer);
     attribute foreign of behavioural_write : procedure is "VHPIDIRECT behavioural_write";
+
+    impure function behavioural_next_image (cmd_file: String; filename: String) return integer;
+    attribute foreign of behavioural_next_image : function is "VHPIDIRECT behavioural_next_image";
 end sim_bram_helpers;
 
 package body sim_bram_helpers is
@@ -27,4 +30,9 @@ package body sim_bram_helpers is
     begin
         assert false report "VHPI" severity failure;
     end behavioural_write;
+
+    impure function behavioural_next_image (cmd_file: String; filename: String) return integer is
+    begin
+        assert false report "VHPI" severity failure;
+    end behavioural_next_image;
 end sim_bram_helpers;
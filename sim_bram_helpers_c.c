@@ -177,3 +177,74 @@ void behavioural_write(unsigned char *__val, unsigned char *__addr,
 		*p = (val >> (i*8)) & 0xff;
 	}
 }
+
+/*
+ * Batch simulation. Each line of the command file names an image to
+ * load into the region initialised from filename, replacing all of
+ * its contents. Returns 0 at the end of the command file.
+ */
+unsigned long behavioural_next_image(void *__cmds, void *__f)
+{
+	static FILE *cmds;
+	struct ram_behavioural *r = NULL;
+	char *filename, line[4096];
+	unsigned long i, off;
+	struct stat buf;
+	ssize_t n;
+	int fd;
+
+	if (!cmds) {
+		char *cmd_file = from_string(__cmds);
+
+		cmds = fopen(cmd_file, "r");
+		if (!cmds) {
+			fprintf(stderr, "%s: could not open %s\n", __func__,
+				cmd_file);
+			exit(1);
+		}
+		free(cmd_file);
+	}
+
+	filename = from_string(__f);
+	for (i = 0; i < region_nr; i++)
+		if (!strcmp(behavioural_regions[i].filename, filename))
+			r = &behavioural_regions[i];
+	if (!r) {
+		fprintf(stderr, "%s: no region for %s\n", __func__, filename);
+		exit(1);
+	}
+	free(filename);
+
+	/* Whoever is feeding us images will be waiting for our output */
+	fflush(NULL);
+	if (!fgets(line, sizeof(line), cmds))
+		return 0;
+	line[strcspn(line, "\n")] = 0;
+
+	fd = open(line, O_RDONLY);
+	if (fd == -1) {
+		fprintf(stderr, "%s: could not open %s\n", __func__, line);
+		exit(1);
+	}
+	if (fstat(fd, &buf)) {
+		perror("fstat");
+		exit(1);
+	}
+	if (buf.st_size > r->size) {
+		fprintf(stderr, "%s: %s is bigger than the RAM\n", __func__,
+			line);
+		exit(1);
+	}
+
+	memset(r->m, 0, r->size);
+	for (off = 0; off < buf.st_size; off += n) {
+		n = read(fd, (unsigned char *)r->m + off, buf.st_size - off);
+		if (n <= 0) {
+			perror("read");
+			exit(1);
+		}
+	}
+	close(fd);
+
+	return 1;
+}
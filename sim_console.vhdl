@@ -10,6 +10,10 @@ package sim_console is
 
     procedure sim_console_write (val: std_ulogic_vector(63 downto 0));
     attribute foreign of sim_console_write : procedure is "VHPIDIRECT sim_console_write";
+
+    -- Cycle count since reset, used to timestamp the following read or write
+    procedure sim_console_cycle (val: std_ulogic_vector(63 downto 0));
+    attribute foreign of sim_console_cycle : procedure is "VHPIDIRECT sim_console_cycle";
 end sim_console;
 
 package body sim_console is
@@ -27,4 +31,9 @@ package body sim_console is
     begin
         assert false report "VHPI" severity failure;
     end sim_console_write;
+
+    procedure sim_console_cycle (val: std_ulogic_vector(63 downto 0)) is
+    begin
+        assert false report "VHPI" severity failure;
+    end sim_console_cycle;
 end sim_console;
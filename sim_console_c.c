@@ -13,6 +13,35 @@
 
 static struct termios oldt;
 
+/*
+ * If SIM_CONSOLE_CYCLES names a file, every byte read or written is
+ * logged there as "R|W <cycle> <byte in hex>", with the cycle count
+ * since reset passed in by the UART model through sim_console_cycle.
+ * scripts/bench_micropython.py uses this to time the console.
+ */
+static uint64_t console_cycle;
+static FILE *cycles_file;
+
+static void log_cycle(char dir, uint8_t val)
+{
+	static bool initialized = false;
+
+	if (!initialized) {
+		const char *name = getenv("SIM_CONSOLE_CYCLES");
+
+		if (name) {
+			cycles_file = fopen(name, "w");
+			if (!cycles_file)
+				perror(name);
+		}
+		initialized = true;
+	}
+	if (cycles_file) {
+		fprintf(cycles_file, "%c %lu %02x\n", dir, (unsigned long)console_cycle, val);
+		fflush(cycles_file);
+	}
+}
+
 static void disable_raw_mode(void)
 {
 	tcsetattr(STDIN_FILENO, TCSANOW, &oldt);
@@ -51,6 +80,7 @@ void sim_console_read(unsigned char *__rt)
 	}
 
 	//fprintf(stderr, "read returns %c\n", val);
+	log_cycle('R', val);
 
 	to_std_logic_vector(val, __rt, 64);
 }
@@ -87,4 +117,10 @@ void sim_console_write(unsigned char *__rs)
 	val = from_std_logic_vector(__rs, 64);
 
 	fprintf(stderr, "%c", val);
+	log_cycle('W', val);
+}
+
+void sim_console_cycle(unsigned char *__rs)
+{
+	console_cycle = from_std_logic_vector(__rs, 64);
 }
@@ -79,6 +79,7 @@ begin
 
     wishbone: process(clk)
 	variable sim_tmp : std_logic_vector(63 downto 0);
+	variable cycle : unsigned(63 downto 0);
     begin
 	if rising_edge(clk) then
 	    if reset = '1' then
@@ -87,12 +88,15 @@ begin
 		sample_clk_divisor <= (others => '0');
 		irq_recv_enable <= '0';
 		irq_tx_ready_enable <= '0';
+		cycle := (others => '0');
 	    else
+		cycle := cycle + 1;
 		case wb_state is
 		when IDLE =>
 		    if wb_cyc_in = '1' and wb_stb_in = '1' then
 			if wb_we_in = '1' then -- Write to register
 			    if wb_adr_in(11 downto 0) = x"000" then
+				sim_console_cycle(std_ulogic_vector(cycle));
 				sim_console_write(x"00000000000000" & wb_dat_in);
 			    elsif wb_adr_in(11 downto 0) = x"018" then
 				sample_clk_divisor <= wb_dat_in;
@@ -104,6 +108,7 @@ begin
 			    wb_state <= WRITE_ACK;
 			else -- Read from register
 			    if wb_adr_in(11 downto 0) = x"008" then
+				sim_console_cycle(std_ulogic_vector(cycle));
 				sim_console_read(sim_tmp);
 				wb_dat_out <= sim_tmp(7 downto 0);
 			    elsif wb_adr_in(11 downto 0) = x"010" then
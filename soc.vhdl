@@ -69,9 +69,19 @@ entity soc is
 	RAM_INIT_FILE      : string;
 	CLK_FREQ           : positive;
 	SIM                : boolean;
+        SIM_END_ON_TERMINATE : boolean := true;
         NCPUS              : positive := 1;
         HAS_FPU            : boolean := true;
+        FAST_DIVIDE        : boolean := false;
         HAS_BTC            : boolean := true;
+        BTC_SIZE           : positive := 1024;
+        BTC_WAYS           : positive := 1;
+        BTC_TAG_BITS       : positive := 52;
+        HAS_RAS            : boolean := false;
+        HAS_ITC            : boolean := false;
+        ITC_SIZE           : positive := 256;
+        HAS_BHT            : boolean := false;
+        BHT_SIZE           : positive := 1024;
 	DISABLE_FLATTEN_CORE : boolean := false;
         ALT_RESET_ADDRESS  : std_logic_vector(63 downto 0) := (23 downto 0 => '0', others => '1');
 	HAS_DRAM           : boolean  := false;
@@ -90,10 +100,15 @@ entity soc is
         ICACHE_NUM_LINES   : natural := 64;
         ICACHE_NUM_WAYS    : natural := 2;
         ICACHE_TLB_SIZE    : natural := 64;
+        ICACHE_PREFETCH_LINES : natural := 0;
         DCACHE_NUM_LINES   : natural := 64;
         DCACHE_NUM_WAYS    : natural := 2;
         DCACHE_TLB_SET_SIZE : natural := 64;
         DCACHE_TLB_NUM_WAYS : natural := 2;
+        DCACHE_WRITE_BACK  : boolean := false;
+        DCACHE_STORE_QUEUE : boolean := false;
+        DCACHE_SECOND_REFILL : boolean := false;
+        DCACHE_PREFETCH    : boolean := false;
         HAS_SD_CARD        : boolean := false;
         HAS_SD_CARD2       : boolean := false;
         HAS_LCD            : boolean := false;
@@ -106,6 +121,7 @@ entity soc is
 
         run_out      : out std_ulogic;
         run_outs     : out std_ulogic_vector(NCPUS-1 downto 0);
+        terminated_out : out std_ulogic;
 
 	-- "Large" (64-bit) DRAM wishbone
 	wb_dram_in       : out wishbone_master_out;
@@ -243,6 +259,7 @@ architecture behaviour of soc is
     signal dmi_core_dout  : dword_percpu_array;
     signal dmi_core_req   : std_ulogic_vector(NCPUS-1 downto 0);
     signal dmi_core_ack   : std_ulogic_vector(NCPUS-1 downto 0);
+    signal dmi_core_addr  : std_ulogic_vector(3 downto 0);
 
     -- Delayed/latched resets and alt_reset
     signal rst_core    : std_ulogic_vector(NCPUS-1 downto 0);
@@ -278,6 +295,7 @@ architecture behaviour of soc is
     signal io_cycle_external  : std_ulogic;
 
     signal core_run_out       : std_ulogic_vector(NCPUS-1 downto 0);
+    signal core_terminated    : std_ulogic_vector(NCPUS-1 downto 0);
 
     type msg_percpu_array is array(cpu_index_t) of std_ulogic_vector(NCPUS-1 downto 0);
     signal msgs               : msg_percpu_array;
@@ -340,6 +358,11 @@ architecture behaviour of soc is
 
 begin
 
+    -- Snooping only invalidates, so dirty lines in one core's dcache
+    -- aren't visible to the others
+    assert NCPUS = 1 or not DCACHE_WRITE_BACK
+        report "DCACHE_WRITE_BACK needs NCPUS = 1" severity failure;
+
     -- either external reset, or from syscon
     soc_reset <= rst or sw_soc_reset;
     tb_ctrl.reset <= soc_reset;
@@ -370,20 +393,35 @@ begin
         core: entity work.core
 	generic map(
 	    SIM => SIM,
+            SIM_END_ON_TERMINATE => SIM_END_ON_TERMINATE,
             CPU_INDEX => i,
             NCPUS => NCPUS,
             HAS_FPU => HAS_FPU,
+            FAST_DIVIDE => FAST_DIVIDE,
             HAS_BTC => HAS_BTC,
+            BTC_SIZE => BTC_SIZE,
+            BTC_WAYS => BTC_WAYS,
+            BTC_TAG_BITS => BTC_TAG_BITS,
+            HAS_RAS => HAS_RAS,
+            HAS_ITC => HAS_ITC,
+            ITC_SIZE => ITC_SIZE,
+            HAS_BHT => HAS_BHT,
+            BHT_SIZE => BHT_SIZE,
 	    DISABLE_FLATTEN => DISABLE_FLATTEN_CORE,
 	    ALT_RESET_ADDRESS => ALT_RESET_ADDRESS,
             LOG_LENGTH => LOG_LENGTH,
             ICACHE_NUM_LINES => ICACHE_NUM_LINES,
             ICACHE_NUM_WAYS => ICACHE_NUM_WAYS,
             ICACHE_TLB_SIZE => ICACHE_TLB_SIZE,
+            ICACHE_PREFETCH_LINES => ICACHE_PREFETCH_LINES,
             DCACHE_NUM_LINES => DCACHE_NUM_LINES,
             DCACHE_NUM_WAYS => DCACHE_NUM_WAYS,
             DCACHE_TLB_SET_SIZE => DCACHE_TLB_SET_SIZE,
-            DCACHE_TLB_NUM_WAYS => DCACHE_TLB_NUM_WAYS
+            DCACHE_TLB_NUM_WAYS => DCACHE_TLB_NUM_WAYS,
+            DCACHE_WRITE_BACK => DCACHE_WRITE_BACK,
+            DCACHE_STORE_QUEUE => DCACHE_STORE_QUEUE,
+            DCACHE_SECOND_REFILL => DCACHE_SECOND_REFILL,
+            DCACHE_PREFETCH => DCACHE_PREFETCH
 	    )
 	port map(
 	    clk => system_clk,
@@ -396,7 +434,7 @@ begin
 	    wishbone_data_in => wb_masters_in(i),
 	    wishbone_data_out => wb_masters_out(i),
             wb_snoop_in => wb_snoop,
-	    dmi_addr => dmi_addr(3 downto 0),
+	    dmi_addr => dmi_core_addr,
 	    dmi_dout => dmi_core_dout(i),
 	    dmi_din => dmi_dout,
 	    dmi_wr => dmi_wr,
@@ -404,7 +442,8 @@ begin
 	    dmi_req => dmi_core_req(i),
 	    ext_irq => core_ext_irq(i),
             msg_out => msgs(i),
-            msg_in => msgin
+            msg_in => msgin,
+            terminated_out => core_terminated(i)
 	    );
 
         process(all)
@@ -421,6 +460,7 @@ begin
 
     run_out <= or (core_run_out);
     run_outs <= core_run_out and not do_core_reset;
+    terminated_out <= or (core_terminated);
 
     -- Wishbone bus master arbiter & mux
     wb_masters_out(2*NCPUS)     <= wishbone_widen_data(wishbone_dma_out);
@@ -1090,20 +1130,30 @@ begin
 	-- DMI address map (each address is a full 64-bit register)
 	--
 	-- Offset:   Size:    Slave:
-	--  0         4       Wishbone
+	--  0         8       Wishbone
+	--  8         1       All cores
 	-- 10        16       Core 0
         -- 20        16       Core 1
         -- ... and so on for NCPUS cores
+	--
+	-- A write to "all cores" is a CTRL write delivered to every core
+	-- selected by bits 47..32 of the data (none set means all of them)
+	-- in the same cycle, and acked once they all have. Reading it
+	-- returns NCPUS.
 
 	type slave_type is (SLAVE_WB,
+			    SLAVE_ALL_CORES,
 			    SLAVE_CORE,
 			    SLAVE_NONE);
 	variable slave : slave_type;
+	variable sel : std_ulogic_vector(NCPUS-1 downto 0);
     begin
 	-- Simple address decoder
 	slave := SLAVE_NONE;
-	if std_match(dmi_addr, "000000--") then
+	if std_match(dmi_addr, "00000---") then
 	    slave := SLAVE_WB;
+	elsif dmi_addr = "00001000" then
+	    slave := SLAVE_ALL_CORES;
         elsif not is_X(dmi_addr) and to_integer(unsigned(dmi_addr(7 downto 4))) <= NCPUS then
 	    slave := SLAVE_CORE;
 	end if;
@@ -1111,6 +1161,7 @@ begin
 	-- DMI muxing
 	dmi_wb_req <= '0';
         dmi_core_req <= (others => '0');
+        dmi_core_addr <= dmi_addr(3 downto 0);
         dmi_din <= (others => '1');
         dmi_ack <= dmi_req;
 	case slave is
@@ -1118,6 +1169,22 @@ begin
 	    dmi_wb_req <= dmi_req;
 	    dmi_ack <= dmi_wb_ack;
 	    dmi_din <= dmi_wb_dout;
+	when SLAVE_ALL_CORES =>
+	    if dmi_wr = '1' then
+		sel := dmi_dout(NCPUS + 31 downto 32);
+		if sel = (sel'range => '0') then
+		    sel := (others => '1');
+		end if;
+		dmi_core_addr <= "0000";
+		for i in 0 to NCPUS-1 loop
+		    if sel(i) = '1' then
+			dmi_core_req(i) <= dmi_req;
+		    end if;
+		end loop;
+		dmi_ack <= and (dmi_core_ack or not sel);
+	    else
+		dmi_din <= std_ulogic_vector(to_unsigned(NCPUS, 64));
+	    end if;
 	when SLAVE_CORE =>
             for i in 0 to NCPUS-1 loop
                 if not is_X(dmi_addr) and to_integer(unsigned(dmi_addr(7 downto 4))) = i + 1 then
@@ -1139,7 +1206,7 @@ begin
     wishbone_debug: entity work.wishbone_debug_master
 	port map(clk => system_clk,
                  rst => rst_wbdb,
-		 dmi_addr => dmi_addr(1 downto 0),
+		 dmi_addr => dmi_addr(2 downto 0),
 		 dmi_dout => dmi_wb_dout,
 		 dmi_din => dmi_dout,
 		 dmi_wr => dmi_wr,
@@ -5,6 +5,8 @@
 #include <stdio.h>
 #include <termios.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
 
 /* Should we exit simulation on ctrl-c or pass it through? */
 #define EXIT_ON_CTRL_C
@@ -25,6 +27,34 @@ enum state {
 	IDLE, START_BIT, BITS, STOP_BIT, ERROR
 };
 
+/*
+ * If SIM_CONSOLE_CYCLES names a file, log every byte sent or received
+ * there as "R|W <cycle> <byte in hex>", as the GHDL console does.
+ */
+extern uint64_t main_time;
+static FILE *cycles_file;
+
+static void log_cycle(char dir, unsigned char val)
+{
+	static bool initialized = false;
+
+	if (!initialized) {
+		const char *name = getenv("SIM_CONSOLE_CYCLES");
+
+		if (name) {
+			cycles_file = fopen(name, "w");
+			if (!cycles_file)
+				perror(name);
+		}
+		initialized = true;
+	}
+	if (cycles_file) {
+		/* main_time counts clock edges */
+		fprintf(cycles_file, "%c %lu %02x\n", dir, (unsigned long)(main_time / 2), val);
+		fflush(cycles_file);
+	}
+}
+
 static enum state tx_state = IDLE;
 static unsigned long tx_countbits;
 static unsigned char tx_bits;
@@ -110,11 +140,13 @@ void uart_tx(unsigned char tx)
 				}
 				/* Go straight to idle */
 				write(STDOUT_FILENO, &tx_byte, 1);
+				log_cycle('W', tx_byte);
 				tx_state = IDLE;
 			}
 
 			if (tx_countbits == 0) {
 				write(STDOUT_FILENO, &tx_byte, 1);
+				log_cycle('W', tx_byte);
 				tx_state = IDLE;
 			}
 			break;
@@ -208,6 +240,7 @@ unsigned char uart_rx(void)
 				rx_sometimes = 0;
 
 				if (nonblocking_read(&c)) {
+					log_cycle('R', c);
 					rx_state = START_BIT;
 					rx_char = c;
 					rx_countbits = BITWIDTH;
@@ -10,7 +10,7 @@ entity wishbone_debug_master is
          rst : in std_ulogic;
 
          -- Debug bus interface
-         dmi_addr : in std_ulogic_vector(1 downto 0);
+         dmi_addr : in std_ulogic_vector(2 downto 0);
          dmi_din  : in std_ulogic_vector(63 downto 0);
          dmi_dout : out std_ulogic_vector(63 downto 0);
          dmi_req  : in std_ulogic;
@@ -26,10 +26,12 @@ end entity wishbone_debug_master;
 architecture behaviour of wishbone_debug_master is
 
     -- ** Register offsets definitions. All registers are 64-bit
-    constant DBG_WB_ADDR : std_ulogic_vector(1 downto 0) := "00";
-    constant DBG_WB_DATA : std_ulogic_vector(1 downto 0) := "01";
-    constant DBG_WB_CTRL : std_ulogic_vector(1 downto 0) := "10";
-    constant DBG_WB_RSVD : std_ulogic_vector(1 downto 0) := "11";
+    constant DBG_WB_ADDR  : std_ulogic_vector(2 downto 0) := "000";
+    constant DBG_WB_DATA  : std_ulogic_vector(2 downto 0) := "001";
+    constant DBG_WB_CTRL  : std_ulogic_vector(2 downto 0) := "010";
+    constant DBG_WB_BLOCK : std_ulogic_vector(2 downto 0) := "011";
+    constant DBG_WB_CRC   : std_ulogic_vector(2 downto 0) := "100";
+    constant DBG_WB_FILL  : std_ulogic_vector(2 downto 0) := "101";
 
     -- CTRL register:
     --
@@ -41,16 +43,76 @@ architecture behaviour of wishbone_debug_master is
     --                10 - +4
     --                11 - +8
 
+    -- BLOCK register:
+    --
+    -- Writing starts a block operation of <count> wishbone transfers
+    -- from the current address, using the SEL and auto-increment
+    -- settings of CTRL. Reading returns the number of transfers left
+    -- to do (0 once the operation is complete). Data accesses issued
+    -- while a block operation is running wait until it has finished.
+    -- ADDR, CTRL, CRC and FILL must not be written while it is running.
+    --
+    -- bit 31..0  : transfer count
+    -- bit 33..32 : operation (write only):
+    --                00 - read and accumulate the data into CRC
+    --                01 - write FILL to every location
+    --                10 - read and compare with FILL, stopping at the
+    --                     first location that differs
+    -- bit 32     : compare mismatch (read only). Set when a compare
+    --              stopped early, with ADDR left pointing at the location
+    --              that differs and the count including it. Cleared by
+    --              the next block operation.
+
+    -- CRC register:
+    --
+    -- bit 31..0  : CRC-32 (IEEE 802.3, bit reversed) accumulator. Each
+    --              64-bit word is consumed least significant byte first.
+    --              There is no pre or post inversion; write 0xffffffff
+    --              before a block read and invert the result to get the
+    --              usual CRC-32 of the memory contents.
+    -- bit 63..32 : always 0
+
+    -- FILL register:
+    --
+    -- bit 63..0  : data written by fill and compared against by compare
+
     -- ** Address and control registers and read data
     signal reg_addr     : std_ulogic_vector(63 downto 0);
     signal reg_ctrl_out : std_ulogic_vector(63 downto 0);
     signal reg_ctrl     : std_ulogic_vector(10 downto 0);
     signal data_latch   : std_ulogic_vector(63 downto 0);
-    
-    type state_t is (IDLE, WB_CYCLE, DMI_WAIT);
+
+    -- ** Block operation registers
+    signal block_count  : unsigned(31 downto 0);
+    signal block_op     : std_ulogic_vector(1 downto 0);
+    signal crc          : std_ulogic_vector(31 downto 0);
+    signal fill_data    : std_ulogic_vector(63 downto 0);
+    signal mismatch     : std_ulogic;
+    signal dmi_req_1    : std_ulogic;
+
+    type state_t is (IDLE, WB_CYCLE, DMI_WAIT, BLOCK_CYCLE, BLOCK_NEXT);
     signal state : state_t;
     signal do_inc : std_ulogic;
 
+    constant CRC32_POLY : std_ulogic_vector(31 downto 0) := x"edb88320";
+
+    -- Fold a doubleword into a CRC-32, LS bit first
+    function crc32_dword(c : std_ulogic_vector(31 downto 0);
+                         d : std_ulogic_vector(63 downto 0))
+        return std_ulogic_vector is
+        variable r : std_ulogic_vector(31 downto 0);
+    begin
+        r := c;
+        for i in 0 to 63 loop
+            if (r(0) xor d(i)) = '1' then
+                r := ('0' & r(31 downto 1)) xor CRC32_POLY;
+            else
+                r := '0' & r(31 downto 1);
+            end if;
+        end loop;
+        return r;
+    end function;
+
 begin
 
     -- Hard wire unused bits to 0
@@ -62,6 +124,9 @@ begin
         reg_addr        when DBG_WB_ADDR,
         data_latch      when DBG_WB_DATA,
         reg_ctrl_out    when DBG_WB_CTRL,
+        31x"0" & mismatch & std_ulogic_vector(block_count) when DBG_WB_BLOCK,
+        x"00000000" & crc when DBG_WB_CRC,
+        fill_data       when DBG_WB_FILL,
         (others => '0') when others;
 
     -- ADDR and CTRL register writes
@@ -119,12 +184,13 @@ begin
 
         -- Some WB signals are direct wires from registers or DMI
     wb_out.adr <= reg_addr(wb_out.adr'left + wishbone_log2_width downto wishbone_log2_width);
-    wb_out.dat <= dmi_din;
+    wb_out.dat <= fill_data when state = BLOCK_CYCLE else dmi_din;
     wb_out.sel <= reg_ctrl(7 downto 0);
-    wb_out.we  <= dmi_wr;
+    wb_out.we  <= dmi_wr when state = WB_CYCLE else
+                  '1' when state = BLOCK_CYCLE and block_op = "01" else '0';
 
     -- We always move WB cyc and stb simultaneously (no pipelining yet...)
-    wb_out.cyc <= '1' when state = WB_CYCLE else '0';
+    wb_out.cyc <= '1' when state = WB_CYCLE or state = BLOCK_CYCLE else '0';
 
     -- Data latch. WB will take the read data away as soon as the cycle
     -- terminates but we must maintain it on DMI until req goes down, so
@@ -147,12 +213,35 @@ begin
                 state <= IDLE;
                 wb_out.stb <= '0';
                 do_inc <= '0';
+                block_count <= (others => '0');
+                block_op <= "00";
+                crc <= (others => '0');
+                fill_data <= (others => '0');
+                mismatch <= '0';
+                dmi_req_1 <= '0';
             else
+                dmi_req_1 <= dmi_req;
+                if dmi_req = '1' and dmi_wr = '1' and dmi_addr = DBG_WB_CRC then
+                    crc <= dmi_din(31 downto 0);
+                end if;
+                if dmi_req = '1' and dmi_wr = '1' and dmi_addr = DBG_WB_FILL then
+                    fill_data <= dmi_din;
+                end if;
+
                 case state is
                 when IDLE =>
                     if dmi_req = '1' and dmi_addr = DBG_WB_DATA then
                         state <= WB_CYCLE;
                         wb_out.stb <= '1';
+                    elsif dmi_req = '1' and dmi_req_1 = '0' and dmi_wr = '1' and
+                        dmi_addr = DBG_WB_BLOCK and dmi_din(31 downto 0) /= x"00000000" then
+                        -- One-shot on the rising edge of req so that a
+                        -- slow DMI doesn't restart the operation
+                        block_count <= unsigned(dmi_din(31 downto 0));
+                        block_op <= dmi_din(33 downto 32);
+                        mismatch <= '0';
+                        state <= BLOCK_CYCLE;
+                        wb_out.stb <= '1';
                     end if;
                 when WB_CYCLE =>
                     if wb_in.stall = '0' then
@@ -171,6 +260,34 @@ begin
                         state <= IDLE;
                     end if;
                     do_inc <= '0';
+                when BLOCK_CYCLE =>
+                    if wb_in.stall = '0' then
+                        wb_out.stb <= '0';
+                    end if;
+                    if wb_in.ack then
+                        wb_out.stb <= '0';
+                        if block_op = "10" and wb_in.dat /= fill_data then
+                            -- Stop without incrementing ADDR past it
+                            mismatch <= '1';
+                            state <= IDLE;
+                        else
+                            if block_op = "00" then
+                                crc <= crc32_dword(crc, wb_in.dat);
+                            end if;
+                            block_count <= block_count - 1;
+                            do_inc <= reg_ctrl(8);
+                            state <= BLOCK_NEXT;
+                        end if;
+                    end if;
+                when BLOCK_NEXT =>
+                    -- Wait a cycle for the address increment to land
+                    do_inc <= '0';
+                    if block_count = 0 then
+                        state <= IDLE;
+                    else
+                        state <= BLOCK_CYCLE;
+                        wb_out.stb <= '1';
+                    end if;
                 end case;
             end if;
         end if;
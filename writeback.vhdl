@@ -191,6 +191,9 @@ begin
         f.br_nia := e_in.last_nia;
         f.br_last := e_in.br_last and not intr;
         f.br_taken := e_in.br_taken;
+        f.ras_push := e_in.ras_push and not intr;
+        f.ras_pop := e_in.ras_pop and not intr;
+        f.br_indirect := e_in.br_indirect and not intr;
         -- send MSR[IR], ~MSR[PR], ~MSR[LE] and ~MSR[SF] up to fetch1
         f.virt_mode := e_in.redir_mode(3);
         f.priv_mode := e_in.redir_mode(2);